@@ -0,0 +1,452 @@
+#include "BlockCompressor.h"
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	float srgb_to_linear(const float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float linear_to_srgb(const float c)
+	{
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	uint16_t pack_565(const glm::vec3& c)
+	{
+		const glm::vec3 v = glm::clamp(c, 0.0f, 255.0f);
+		const auto r = static_cast<uint16_t>(std::lround(v.r * 31.0f / 255.0f));
+		const auto g = static_cast<uint16_t>(std::lround(v.g * 63.0f / 255.0f));
+		const auto b = static_cast<uint16_t>(std::lround(v.b * 31.0f / 255.0f));
+		return static_cast<uint16_t>(r << 11 | g << 5 | b);
+	}
+
+	glm::ivec3 unpack_565(const uint16_t c)
+	{
+		const int r = c >> 11 & 31;
+		const int g = c >> 5 & 63;
+		const int b = c & 31;
+		return glm::ivec3(r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2);
+	}
+
+	/// @brief the 4 colors a BC1 block can reference, in the order of its indices
+	void bc1_palette(const uint16_t c0, const uint16_t c1, glm::ivec3 palette[4])
+	{
+		palette[0] = unpack_565(c0);
+		palette[1] = unpack_565(c1);
+		if (c0 > c1)
+		{
+			palette[2] = (2 * palette[0] + palette[1]) / 3;
+			palette[3] = (palette[0] + 2 * palette[1]) / 3;
+		}
+		else
+		{
+			palette[2] = (palette[0] + palette[1]) / 2;
+			palette[3] = glm::ivec3(0);
+		}
+	}
+
+	/// @brief the 8 values a BC4 block can reference, in the order of its indices
+	void bc4_palette(const int r0, const int r1, int palette[8])
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+		if (r0 > r1)
+		{
+			for (int i = 2; i < 8; i++)
+				palette[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 2; i < 6; i++)
+				palette[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	gli::format compressed_format(const gli::format format)
+	{
+		switch (format)
+		{
+		case gli::FORMAT_RGB8_UNORM_PACK8: return gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+		case gli::FORMAT_RGB8_SRGB_PACK8: return gli::FORMAT_RGB_DXT1_SRGB_BLOCK8;
+		case gli::FORMAT_R8_UNORM_PACK8: return gli::FORMAT_R_ATI1N_UNORM_BLOCK8;
+		case gli::FORMAT_RG8_UNORM_PACK8: return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+		default: return gli::FORMAT_UNDEFINED;
+		}
+	}
+
+	gli::format decompressed_format(const gli::format format)
+	{
+		switch (format)
+		{
+		case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8: return gli::FORMAT_RGB8_UNORM_PACK8;
+		case gli::FORMAT_RGB_DXT1_SRGB_BLOCK8: return gli::FORMAT_RGB8_SRGB_PACK8;
+		case gli::FORMAT_R_ATI1N_UNORM_BLOCK8: return gli::FORMAT_R8_UNORM_PACK8;
+		case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16: return gli::FORMAT_RG8_UNORM_PACK8;
+		default: return gli::FORMAT_UNDEFINED;
+		}
+	}
+}
+
+gli::texture block_compressor::build_mips(const gli::texture& image)
+{
+	const gli::format format = image.format();
+	if (image.empty() || image.target() != gli::TARGET_2D || gli::is_compressed(format) || gli::is_packed(format) || !gli::is_unorm(format))
+		return gli::texture();
+
+	const size_t components = gli::component_count(format);
+	const size_t channel_size = gli::block_size(format) / components;
+	if (channel_size != 1 && channel_size != 2)
+		return gli::texture();
+
+	const glm::ivec3 extent = image.extent(0);
+	gli::texture2d result(format, gli::extent2d(extent.x, extent.y), image.swizzles());
+	memcpy(result.data(0, 0, 0), image.data(0, 0, 0), image.size(0));
+
+	// srgb values are averaged in linear space, alpha is always linear
+	const bool srgb = gli::is_srgb(format);
+	const float max_value = channel_size == 1 ? 255.0f : 65535.0f;
+	const auto read = [channel_size](const uint8_t* p) -> float
+	{
+		if (channel_size == 1)
+			return *p;
+		uint16_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	};
+
+	for (size_t level = 1; level < result.levels(); level++)
+	{
+		const glm::ivec2 src_extent = result.extent(level - 1);
+		const glm::ivec2 dst_extent = result.extent(level);
+		const auto* src = static_cast<const uint8_t*>(result.data(0, 0, level - 1));
+		auto* dst = static_cast<uint8_t*>(result.data(0, 0, level));
+
+		for (int y = 0; y < dst_extent.y; y++)
+		{
+			for (int x = 0; x < dst_extent.x; x++)
+			{
+				for (size_t c = 0; c < components; c++)
+				{
+					const bool linearize = srgb && c < 3;
+					float sum = 0.0f;
+					for (int i = 0; i < 4; i++)
+					{
+						// odd sizes repeat the last row or column
+						const int sx = std::min(2 * x + (i & 1), src_extent.x - 1);
+						const int sy = std::min(2 * y + (i >> 1), src_extent.y - 1);
+						const float v = read(src + ((sy * src_extent.x + sx) * components + c) * channel_size) / max_value;
+						sum += linearize ? srgb_to_linear(v) : v;
+					}
+					float v = sum * 0.25f;
+					if (linearize)
+						v = linear_to_srgb(v);
+
+					const long out = std::lround(glm::clamp(v, 0.0f, 1.0f) * max_value);
+					uint8_t* p = dst + ((y * dst_extent.x + x) * components + c) * channel_size;
+					if (channel_size == 1)
+						*p = static_cast<uint8_t>(out);
+					else
+					{
+						const auto v16 = static_cast<uint16_t>(out);
+						memcpy(p, &v16, sizeof(v16));
+					}
+				}
+			}
+		}
+	}
+	return result;
+}
+
+bool block_compressor::can_compress(const gli::format format)
+{
+	return compressed_format(format) != gli::FORMAT_UNDEFINED;
+}
+
+gli::texture block_compressor::compress(const gli::texture& image)
+{
+	const gli::format format = compressed_format(image.format());
+	if (image.empty() || image.target() != gli::TARGET_2D || format == gli::FORMAT_UNDEFINED)
+		return gli::texture();
+
+	const bool bc1 = gli::component_count(image.format()) == 3;
+	const int components = static_cast<int>(gli::component_count(image.format()));
+	const auto block_size = static_cast<int>(gli::block_size(format));
+	const glm::ivec3 extent = image.extent(0);
+	gli::texture2d result(format, gli::extent2d(extent.x, extent.y), image.levels());
+
+	for (size_t level = 0; level < image.levels(); level++)
+	{
+		const glm::ivec3 size = image.extent(level);
+		const auto* src = static_cast<const uint8_t*>(image.data(0, 0, level));
+		auto* dst = static_cast<uint8_t*>(result.data(0, 0, level));
+		const int blocks_x = (size.x + 3) / 4;
+		const int blocks_y = (size.y + 3) / 4;
+
+		uint8_t texels[16 * 3];
+		for (int by = 0; by < blocks_y; by++)
+		{
+			for (int bx = 0; bx < blocks_x; bx++)
+			{
+				// blocks that reach over the edge repeat the last texels
+				for (int i = 0; i < 16; i++)
+				{
+					const int x = std::min(bx * 4 + (i & 3), size.x - 1);
+					const int y = std::min(by * 4 + (i >> 2), size.y - 1);
+					memcpy(texels + i * components, src + (y * size.x + x) * components, components);
+				}
+				uint8_t* block = dst + (by * blocks_x + bx) * block_size;
+				if (bc1)
+				{
+					encode_bc1(texels, block);
+					continue;
+				}
+				// BC4 and BC5 store every channel as its own BC4 block
+				for (int c = 0; c < components; c++)
+				{
+					uint8_t channel[16];
+					for (int i = 0; i < 16; i++)
+						channel[i] = texels[i * components + c];
+					encode_bc4(channel, block + c * 8);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+gli::texture block_compressor::decompress(const gli::texture& image)
+{
+	const gli::format format = decompressed_format(image.format());
+	if (image.empty() || image.target() != gli::TARGET_2D || format == gli::FORMAT_UNDEFINED)
+		return image;
+
+	const bool bc1 = gli::component_count(format) == 3;
+	const int components = static_cast<int>(gli::component_count(format));
+	const auto block_size = static_cast<int>(gli::block_size(image.format()));
+	const glm::ivec3 extent = image.extent(0);
+	gli::texture2d result(format, gli::extent2d(extent.x, extent.y), image.levels());
+
+	for (size_t level = 0; level < image.levels(); level++)
+	{
+		const glm::ivec3 size = image.extent(level);
+		const auto* src = static_cast<const uint8_t*>(image.data(0, 0, level));
+		auto* dst = static_cast<uint8_t*>(result.data(0, 0, level));
+		const int blocks_x = (size.x + 3) / 4;
+		const int blocks_y = (size.y + 3) / 4;
+
+		uint8_t texels[16 * 3];
+		for (int by = 0; by < blocks_y; by++)
+		{
+			for (int bx = 0; bx < blocks_x; bx++)
+			{
+				const uint8_t* block = src + (by * blocks_x + bx) * block_size;
+				if (bc1)
+					decode_bc1(block, texels);
+				else
+				{
+					for (int c = 0; c < components; c++)
+					{
+						uint8_t channel[16];
+						decode_bc4(block + c * 8, channel);
+						for (int i = 0; i < 16; i++)
+							texels[i * components + c] = channel[i];
+					}
+				}
+
+				for (int i = 0; i < 16; i++)
+				{
+					const int x = bx * 4 + (i & 3);
+					const int y = by * 4 + (i >> 2);
+					if (x < size.x && y < size.y)
+						memcpy(dst + (y * size.x + x) * components, texels + i * components, components);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+gli::texture block_compressor::normal_xy(const gli::texture& image)
+{
+	if (image.empty() || image.target() != gli::TARGET_2D || image.format() != gli::FORMAT_RGB8_UNORM_PACK8)
+		return gli::texture();
+
+	const glm::ivec3 extent = image.extent(0);
+	gli::texture2d result(gli::FORMAT_RG8_UNORM_PACK8, gli::extent2d(extent.x, extent.y), image.levels());
+	for (size_t level = 0; level < image.levels(); level++)
+	{
+		const auto* src = static_cast<const uint8_t*>(image.data(0, 0, level));
+		auto* dst = static_cast<uint8_t*>(result.data(0, 0, level));
+		const size_t texels = result.size(level) / 2;
+		for (size_t i = 0; i < texels; i++)
+		{
+			dst[i * 2] = src[i * 3];
+			dst[i * 2 + 1] = src[i * 3 + 1];
+		}
+	}
+	return result;
+}
+
+double block_compressor::psnr(const gli::texture& reference, const gli::texture& image)
+{
+	if (reference.empty() || image.empty() || reference.format() != image.format() || reference.extent(0) != image.extent(0)
+		|| gli::block_size(reference.format()) != gli::component_count(reference.format()))
+		return 0.0;
+
+	const auto* a = static_cast<const uint8_t*>(reference.data(0, 0, 0));
+	const auto* b = static_cast<const uint8_t*>(image.data(0, 0, 0));
+	const size_t size = reference.size(0);
+	double error = 0.0;
+	for (size_t i = 0; i < size; i++)
+	{
+		const double diff = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+		error += diff * diff;
+	}
+	if (error == 0.0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(255.0 * 255.0 / (error / static_cast<double>(size)));
+}
+
+void block_compressor::encode_bc1(const uint8_t* texels, uint8_t* block)
+{
+	glm::vec3 colors[16];
+	glm::vec3 mean(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		colors[i] = glm::vec3(texels[i * 3], texels[i * 3 + 1], texels[i * 3 + 2]);
+		mean += colors[i];
+	}
+	mean /= 16.0f;
+
+	// the endpoints lie on the principal axis of the colors, found by power iteration of the covariance
+	glm::mat3 covariance(0.0f);
+	for (const auto& c : colors)
+		covariance += glm::outerProduct(c - mean, c - mean);
+	glm::vec3 axis(1.0f);
+	for (int i = 0; i < 8; i++)
+	{
+		axis = covariance * axis;
+		const float length = glm::length(axis);
+		if (length < 1e-6f)
+		{
+			axis = glm::vec3(0.57735f);
+			break;
+		}
+		axis /= length;
+	}
+
+	float min_t = std::numeric_limits<float>::max();
+	float max_t = -std::numeric_limits<float>::max();
+	for (const auto& c : colors)
+	{
+		const float t = glm::dot(c - mean, axis);
+		min_t = std::min(min_t, t);
+		max_t = std::max(max_t, t);
+	}
+	// moving the endpoints inwards a bit lowers the error of the interpolated colors
+	const float inset = (max_t - min_t) / 16.0f;
+	uint16_t c0 = pack_565(mean + axis * (max_t - inset));
+	uint16_t c1 = pack_565(mean + axis * (min_t + inset));
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		glm::ivec3 palette[4];
+		bc1_palette(c0, c1, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			const glm::ivec3 c(texels[i * 3], texels[i * 3 + 1], texels[i * 3 + 2]);
+			uint32_t best = 0;
+			int best_error = std::numeric_limits<int>::max();
+			for (uint32_t p = 0; p < 4; p++)
+			{
+				const glm::ivec3 d = c - palette[p];
+				const int error = d.x * d.x + d.y * d.y + d.z * d.z;
+				if (error < best_error)
+				{
+					best_error = error;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	block[0] = static_cast<uint8_t>(c0);
+	block[1] = static_cast<uint8_t>(c0 >> 8);
+	block[2] = static_cast<uint8_t>(c1);
+	block[3] = static_cast<uint8_t>(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		block[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+void block_compressor::encode_bc4(const uint8_t* texels, uint8_t* block)
+{
+	const uint8_t r0 = *std::max_element(texels, texels + 16);
+	const uint8_t r1 = *std::min_element(texels, texels + 16);
+
+	uint64_t indices = 0;
+	if (r0 != r1)
+	{
+		int palette[8];
+		bc4_palette(r0, r1, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			uint64_t best = 0;
+			int best_error = std::numeric_limits<int>::max();
+			for (uint64_t p = 0; p < 8; p++)
+			{
+				const int error = std::abs(texels[i] - palette[p]);
+				if (error < best_error)
+				{
+					best_error = error;
+					best = p;
+				}
+			}
+			indices |= best << (i * 3);
+		}
+	}
+
+	block[0] = r0;
+	block[1] = r1;
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+void block_compressor::decode_bc1(const uint8_t* block, uint8_t* texels)
+{
+	const auto c0 = static_cast<uint16_t>(block[0] | block[1] << 8);
+	const auto c1 = static_cast<uint16_t>(block[2] | block[3] << 8);
+	const uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24;
+
+	glm::ivec3 palette[4];
+	bc1_palette(c0, c1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		const glm::ivec3& c = palette[indices >> (i * 2) & 3];
+		texels[i * 3] = static_cast<uint8_t>(c.x);
+		texels[i * 3 + 1] = static_cast<uint8_t>(c.y);
+		texels[i * 3 + 2] = static_cast<uint8_t>(c.z);
+	}
+}
+
+void block_compressor::decode_bc4(const uint8_t* block, uint8_t* texels)
+{
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+
+	int palette[8];
+	bc4_palette(block[0], block[1], palette);
+	for (int i = 0; i < 16; i++)
+		texels[i] = static_cast<uint8_t>(palette[indices >> (i * 3) & 7]);
+}
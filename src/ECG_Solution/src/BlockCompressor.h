@@ -0,0 +1,55 @@
+#pragma once
+#include <gli/gli.hpp>
+
+/// @brief prepares material textures for the ktx2 bakes on the cpu
+/// builds complete mip chains and encodes 8 bit rgb images to BC1, single channel images to BC4 and the x and y of normals to BC5,
+/// the decoders are used to verify bakes and as fallback if the driver can't sample the block formats
+class block_compressor
+{
+private:
+	static void encode_bc1(const uint8_t* texels, uint8_t* block);
+	static void encode_bc4(const uint8_t* texels, uint8_t* block);
+	static void decode_bc1(const uint8_t* block, uint8_t* texels);
+	static void decode_bc4(const uint8_t* block, uint8_t* texels);
+
+public:
+	/**
+	 * \brief creates a texture with all mip levels down to 1x1, filtered with a box filter
+	 * srgb images are filtered in linear space
+	 * \param image uncompressed 2d image with 8 or 16 bit unorm channels, only its first level is used
+	 * \return texture with a full mip chain, or an empty texture if the format isn't supported
+	 */
+	static gli::texture build_mips(const gli::texture& image);
+
+	/**
+	 * \brief checks if compress supports a format
+	 */
+	static bool can_compress(gli::format format);
+
+	/**
+	 * \brief encodes every level of a texture, rgb8 to BC1, r8 to BC4 and rg8 to BC5, srgb stays srgb
+	 * \param image uncompressed texture in a format accepted by can_compress
+	 * \return block compressed texture with the same levels
+	 */
+	static gli::texture compress(const gli::texture& image);
+
+	/**
+	 * \brief decodes every level of a BC1, BC4 or BC5 texture back to rgb8, r8 or rg8
+	 * \param image block compressed texture
+	 * \return uncompressed texture, or the given texture if it isn't BC1, BC4 or BC5
+	 */
+	static gli::texture decompress(const gli::texture& image);
+
+	/**
+	 * \brief keeps the x and y of every level of a normal map, the shader rebuilds z from them
+	 * \param image rgb8 tangent space normal map
+	 * \return rg8 texture with the same levels, or an empty texture if the format isn't rgb8
+	 */
+	static gli::texture normal_xy(const gli::texture& image);
+
+	/**
+	 * \brief peak signal to noise ratio of the first level of two 8 bit images with the same format and size
+	 * \return ratio in dB, infinity if the images are identical, 0 if they can't be compared
+	 */
+	static double psnr(const gli::texture& reference, const gli::texture& image);
+};
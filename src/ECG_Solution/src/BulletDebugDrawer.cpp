@@ -8,7 +8,6 @@ bullet_debug_drawer::bullet_debug_drawer(){
 	Shader fragmentShader("../assets/shaders/Testing/bulletDebug.frag");
 	program_;
 	program_.build_from(vertexShader, fragmentShader);
-	glGenBuffers(1, &vbo_id_);
 	glGenVertexArrays(1, &vao_id_);
 }
 
@@ -20,10 +19,14 @@ void bullet_debug_drawer::draw() {
 	// setup
 	glBindVertexArray(vao_id_);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_id_);
-	glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(glm::vec3), &vertices_[0], GL_DYNAMIC_DRAW);
+	// the ring only grows, with room for twice the lines of the largest frame
+	const auto size = static_cast<GLsizeiptr>(vertices_.size() * sizeof(glm::vec3));
+	if (size > vbo_.get_region_size())
+		vbo_.reserve_ring(size * 2);
+	const GLintptr offset = vbo_.push(size, vertices_.data());
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_.get_id());
 
-	glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<GLvoid*>(offset));
 	glEnableVertexAttribArray(10);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -3,6 +3,7 @@
 #include <vector>
 #include "Utils.h"
 #include "Program.h"
+#include "buffer.h"
 
 class bullet_debug_drawer final : public btIDebugDraw
 {
@@ -10,7 +11,7 @@ private:
 	int m_debug_mode_ = 0;
 	std::vector <glm::vec3> vertices_;
 	program program_;
-	GLuint vbo_id_ = 0;
+	buffer vbo_{ GL_ARRAY_BUFFER };	// ring of the lines of the last frames
 	GLuint vao_id_ = 0;
 public:
 	bullet_debug_drawer();
@@ -0,0 +1,324 @@
+#include "ColorLut.h"
+#include "LevelCache.h"
+#include "JobSystem.h"
+#include <glm/gtc/packing.hpp>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+namespace
+{
+	const char lut_magic[4] = { 'L', 'U', 'T', '3' };
+
+	// below this the text is parsed on the calling thread, a 32^3 lut has about 700 kB
+	constexpr size_t parallel_length = 256 * 1024;
+	constexpr size_t min_chunk_length = 64 * 1024;
+
+	// every float with up to 7 digits and a power of ten up to 10 is exact, so one division rounds like strtof
+	const float powers_of_ten[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+	bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+	bool is_space(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	const char* skip_space(const char* p, const char* end)
+	{
+		while (p < end && is_space(*p))
+			p++;
+		return p;
+	}
+
+	const char* next_line(const char* p, const char* end)
+	{
+		p = static_cast<const char*>(memchr(p, '\n', end - p));
+		return p ? p + 1 : end;
+	}
+
+	/// @brief true if nothing but spaces or a comment is left in the line
+	bool at_line_end(const char* p, const char* end)
+	{
+		p = skip_space(p, end);
+		return p == end || *p == '\n' || *p == '#';
+	}
+
+	/**
+	 * \brief parses a number like 0.123456, -1 or 1.5e-3, gives the same result as strtof
+	 * \return the character after the number, nullptr if there is no number
+	 */
+	const char* parse_float(const char* p, const char* end, float& value)
+	{
+		const char* start = p;
+		const bool negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+'))
+			p++;
+
+		uint32_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		for (; p < end && is_digit(*p); p++, any = true)
+		{
+			mantissa = digits < 9 ? mantissa * 10 + (*p - '0') : mantissa;
+			exponent += digits >= 9;
+			digits += mantissa != 0;
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && is_digit(*p); p++, any = true)
+			{
+				if (digits < 9)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					exponent--;
+				}
+				digits += mantissa != 0;
+			}
+		}
+		if (!any)
+			return nullptr;
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* e = p + 1;
+			const bool negative_exponent = e < end && *e == '-';
+			if (e < end && (*e == '-' || *e == '+'))
+				e++;
+			int power = 0;
+			for (; e < end && is_digit(*e) && power < 1000; e++)
+				power = power * 10 + (*e - '0');
+			if (e > p + 1 && is_digit(e[-1]))
+			{
+				exponent += negative_exponent ? -power : power;
+				p = e;
+			}
+		}
+
+		if (digits <= 7 && exponent >= -10 && exponent <= 10)
+		{
+			const float magnitude = exponent < 0 ? static_cast<float>(mantissa) / powers_of_ten[-exponent] : static_cast<float>(mantissa) * powers_of_ten[exponent];
+			value = negative ? -magnitude : magnitude;
+			return p;
+		}
+
+		// long or unusual numbers are rare enough for the slow path
+		char token[64];
+		const size_t length = static_cast<size_t>(p - start);
+		if (length >= sizeof(token))
+			return nullptr;
+		memcpy(token, start, length);
+		token[length] = '\0';
+		value = strtof(token, nullptr);
+		return p;
+	}
+
+	/**
+	 * \brief parses all data lines in [p, end), every line holds one rgb triple
+	 * \return false if a line is malformed
+	 */
+	bool parse_rows(const char* p, const char* end, std::vector<float>& rgb)
+	{
+		rgb.reserve(rgb.size() + (end - p) / 8);
+		while (p < end)
+		{
+			p = skip_space(p, end);
+			if (p < end && *p != '\n' && *p != '#')
+			{
+				float r, g, b;
+				if (!(p = parse_float(p, end, r)) || !(p = parse_float(skip_space(p, end), end, g)) || !(p = parse_float(skip_space(p, end), end, b)) || !at_line_end(p, end))
+					return false;
+				rgb.push_back(r);
+				rgb.push_back(g);
+				rgb.push_back(b);
+			}
+			p = next_line(p, end);
+		}
+		return true;
+	}
+
+	bool starts_with(const char* p, const char* end, const char* keyword)
+	{
+		const size_t length = strlen(keyword);
+		return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && is_space(p[length]);
+	}
+}
+
+bool color_lut::parse_cube(const char* text, const size_t length, uint32_t& size, std::vector<float>& rgb)
+{
+	const char* p = text;
+	const char* end = text + length;
+	size = 0;
+	rgb.clear();
+
+	// keywords come before the first data line
+	for (; p < end; p = next_line(p, end))
+	{
+		const char* line = skip_space(p, end);
+		if (line == end || *line == '\n' || *line == '#')
+			continue;
+		if (is_digit(*line) || *line == '-' || *line == '+' || *line == '.')
+			break;
+
+		if (starts_with(line, end, "LUT_3D_SIZE"))
+		{
+			size = static_cast<uint32_t>(strtoul(line + 11, nullptr, 10));
+		}
+		else if (starts_with(line, end, "LUT_1D_SIZE"))
+		{
+			std::cout << "1d luts are not supported" << std::endl;
+			return false;
+		}
+		else if (starts_with(line, end, "DOMAIN_MIN") || starts_with(line, end, "DOMAIN_MAX"))
+		{
+			const float expected = line[8] == 'I' ? 0.0f : 1.0f;
+			const char* q = line + 10;
+			for (int c = 0; c < 3; c++)
+			{
+				float bound = expected;
+				q = q ? parse_float(skip_space(q, end), end, bound) : nullptr;
+				if (!q || bound != expected)
+				{
+					std::cout << "only luts with a domain from 0 to 1 are supported" << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	if (size < 2 || size > max_size)
+	{
+		std::cout << "lut size " << size << " is not between 2 and " << max_size << std::endl;
+		return false;
+	}
+
+	bool valid = true;
+	const size_t data_length = static_cast<size_t>(end - p);
+	if (data_length < parallel_length)
+	{
+		valid = parse_rows(p, end, rgb);
+	}
+	else
+	{
+		// chunks are split at line starts and parsed independently, then appended in order
+		job_system& jobs = job_system::instance();
+		const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(jobs.get_thread_count() + 1, data_length / min_chunk_length));
+		std::vector<const char*> bounds(chunk_count + 1, end);
+		bounds[0] = p;
+		for (size_t c = 1; c < chunk_count; c++)
+			bounds[c] = next_line(std::max(bounds[c - 1], p + data_length * c / chunk_count), end);
+
+		std::vector<std::vector<float>> chunks(chunk_count);
+		std::vector<char> chunk_valid(chunk_count, 1);
+		jobs.parallel_for(chunk_count, [&bounds, &chunks, &chunk_valid](const size_t c)
+		{
+			chunk_valid[c] = parse_rows(bounds[c], bounds[c + 1], chunks[c]);
+		});
+
+		size_t total = 0;
+		for (size_t c = 0; c < chunk_count; c++)
+		{
+			valid = valid && chunk_valid[c];
+			total += chunks[c].size();
+		}
+		rgb.reserve(total);
+		for (const auto& chunk : chunks)
+			rgb.insert(rgb.end(), chunk.begin(), chunk.end());
+	}
+
+	if (!valid)
+	{
+		std::cout << "lut has a malformed data line" << std::endl;
+		return false;
+	}
+	const size_t expected = static_cast<size_t>(size) * size * size * 3;
+	if (rgb.size() != expected)
+	{
+		std::cout << "lut has " << rgb.size() / 3 << " data points instead of " << expected / 3 << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void color_lut::to_half(const uint32_t size, const std::vector<float>& rgb, lut_data& lut)
+{
+	lut.size = size;
+	lut.texels.resize(rgb.size());
+	for (size_t i = 0; i < rgb.size(); i++)
+		lut.texels[i] = glm::packHalf1x16(rgb[i]);
+}
+
+bool color_lut::write_cache(const std::string& cache_path, const char* cube_path, const lut_data& lut)
+{
+	std::ofstream out(cache_path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	header h{};
+	memcpy(h.magic, lut_magic, 4);
+	h.version = version;
+	h.size = lut.size;
+	level_cache::file_stamp(cube_path, h.source_size, h.source_time);
+
+	out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	out.write(reinterpret_cast<const char*>(lut.texels.data()), lut.texels.size() * sizeof(uint16_t));
+	return static_cast<bool>(out);
+}
+
+bool color_lut::read_cache(const std::string& cache_path, const char* cube_path, lut_data& lut)
+{
+	mapped_file file;
+	if (!file.open(cache_path.c_str()) || file.size() < sizeof(header))
+		return false;
+
+	header h;
+	memcpy(&h, file.data(), sizeof(h));
+	if (memcmp(h.magic, lut_magic, 4) != 0 || h.version != version || h.size < 2 || h.size > max_size)
+		return false;
+
+	// like level bakes, a cache without its source is up to date
+	uint64_t source_size; int64_t source_time;
+	if (level_cache::file_stamp(cube_path, source_size, source_time) && (source_size != h.source_size || source_time != h.source_time))
+		return false;
+
+	const size_t count = static_cast<size_t>(h.size) * h.size * h.size * 3;
+	if (file.size() != sizeof(header) + count * sizeof(uint16_t))
+		return false;
+
+	lut.size = h.size;
+	lut.texels.resize(count);
+	memcpy(lut.texels.data(), file.data() + sizeof(header), count * sizeof(uint16_t));
+	return true;
+}
+
+bool color_lut::load(const char* cube_path, lut_data& lut)
+{
+	const std::string cache_path = cache_path_of(cube_path);
+	if (read_cache(cache_path, cube_path, lut))
+		return true;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	std::ifstream in(cube_path, std::ios::binary);
+	if (!in)
+	{
+		std::cout << "could not open lut " << cube_path << std::endl;
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+	const std::string content = text.str();
+
+	uint32_t size;
+	std::vector<float> rgb;
+	if (!parse_cube(content.data(), content.size(), size, rgb))
+	{
+		std::cout << "could not parse lut " << cube_path << std::endl;
+		return false;
+	}
+	to_half(size, rgb, lut);
+
+	if (!write_cache(cache_path, cube_path, lut))
+		std::cout << "could not write lut cache " << cache_path << std::endl;
+	printf("converted lut %s (%u^3) in %.1f ms\n", cube_path, size,
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief 3d color lookup tables for the color grading of the Renderer
+/// a .cube file is parsed once and converted into a binary cache next to it, eg. "look32.CUBE" -> "look32.CUBE.lut",
+/// afterwards the half float texels of the cache are uploaded directly without touching the text
+class color_lut
+{
+public:
+	static constexpr uint32_t version = 1;
+	static constexpr uint32_t max_size = 65;
+
+	/// @brief texel data of a lut, rgb half floats with red changing fastest
+	struct lut_data
+	{
+		uint32_t size = 0;				// edge length of the cube
+		std::vector<uint16_t> texels;	// size^3 * 3 half floats
+	};
+
+	/**
+	 * \brief loads a lut from its binary cache, the cache is rebuilt first if it is missing or older than the .cube file
+	 * \param cube_path location of the .cube file
+	 * \param lut filled with the texels
+	 * \return false if neither the cache nor the .cube file can be read
+	 */
+	static bool load(const char* cube_path, lut_data& lut);
+
+	/**
+	 * \brief parses the text of a .cube file, large luts are parsed on the job system
+	 * only 3d luts with the default domain of 0 to 1 are supported
+	 * \param text content of the file
+	 * \param length number of characters
+	 * \param size edge length of the cube
+	 * \param rgb size^3 * 3 floats in file order
+	 * \return false if the file is malformed, the reason gets printed
+	 */
+	static bool parse_cube(const char* text, size_t length, uint32_t& size, std::vector<float>& rgb);
+
+	/**
+	 * \brief converts parsed floats into the texels of a lut
+	 */
+	static void to_half(uint32_t size, const std::vector<float>& rgb, lut_data& lut);
+
+	/**
+	 * \brief writes the texels and the stamp of the .cube file into a binary cache
+	 * \return false if the file can't be written
+	 */
+	static bool write_cache(const std::string& cache_path, const char* cube_path, const lut_data& lut);
+
+	/**
+	 * \brief reads the texels of a binary cache
+	 * \param cache_path location of the cache
+	 * \param cube_path location of the .cube file, the cache is rejected if the file changed since it was written
+	 * \param lut filled with the texels
+	 * \return false if the cache is missing, stale or corrupted
+	 */
+	static bool read_cache(const std::string& cache_path, const char* cube_path, lut_data& lut);
+
+	static std::string cache_path_of(const char* cube_path) { return std::string(cube_path) + ".lut"; }
+
+private:
+	/// @brief fixed size start of every cache, followed by the texels
+	struct header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t source_size;	// size of the .cube file when the cache was written
+		int64_t source_time;	// last modification of the .cube file when the cache was written
+		uint32_t size;
+		uint32_t padding;
+	};
+};
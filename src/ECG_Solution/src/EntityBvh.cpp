@@ -0,0 +1,294 @@
+#include "EntityBvh.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+namespace
+{
+	constexpr int bin_count = 16;
+
+	// deeper nodes become leaves regardless of their size, so the traversal stack can't overflow
+	constexpr uint32_t max_depth = 60;
+
+	float half_area(const glm::vec3& min, const glm::vec3& max)
+	{
+		const glm::vec3 d = max - min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	bounding_box merge(const bounding_box& a, const bounding_box& b)
+	{
+		return bounding_box(glm::min(a.min_, b.min_), glm::max(a.max_, b.max_));
+	}
+
+	// bit of the test against the box around the frustum corners, next to the 6 plane bits
+	constexpr uint32_t corner_bit = 1u << 6;
+	constexpr uint32_t all_tests = corner_bit | 0x3F;
+
+	/// @brief frustum in the form the traversal tests it, the corners are reduced to the box around them
+	struct frustum
+	{
+		glm::vec4 planes[6];
+		glm::vec3 corner_min, corner_max;
+	};
+
+	/**
+	 * \brief the tests of frustum_culler::is_box_in_frustum with the same result, but with the nearest and farthest corner only
+	 * the sums round like the dot products of the corners (see cull_boxes), so the smallest and largest sum are the smallest and largest dot product
+	 * \param tests bits of the planes and the corner box that may still reject the box
+	 * \param crossing receives the bits of the tests that neither reject nor fully contain the box
+	 * \return false if the box is culled
+	 */
+	bool test_box(const frustum& f, const bounding_box& b, const uint32_t tests, uint32_t& crossing)
+	{
+		crossing = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			if ((tests >> i & 1) == 0)
+				continue;
+			const glm::vec4& p = f.planes[i];
+			const glm::vec3 lo = glm::vec3(p) * b.min_;
+			const glm::vec3 hi = glm::vec3(p) * b.max_;
+			if ((std::max(lo.x, hi.x) + std::max(lo.y, hi.y)) + (std::max(lo.z, hi.z) + p.w) < 0.0f)
+				return false;
+			if ((std::min(lo.x, hi.x) + std::min(lo.y, hi.y)) + (std::min(lo.z, hi.z) + p.w) < 0.0f)
+				crossing |= 1u << i;
+		}
+		if (tests & corner_bit)
+		{
+			if (glm::any(glm::greaterThan(f.corner_min, b.max_)) || glm::any(glm::lessThan(f.corner_max, b.min_)))
+				return false;
+			// the boxes inside can't reach past the corners if this one doesn't
+			if (glm::any(glm::greaterThan(f.corner_min, b.min_)) || glm::any(glm::lessThan(f.corner_max, b.max_)))
+				crossing |= corner_bit;
+		}
+		return true;
+	}
+}
+
+void entity_bvh::build(const std::vector<bounding_box>& boxes)
+{
+	const auto count = static_cast<uint32_t>(boxes.size());
+	items_.resize(count);
+	std::iota(items_.begin(), items_.end(), 0u);
+
+	std::vector<glm::vec3> centers(count);
+	bounding_box root_bounds(glm::vec3(0.0f), glm::vec3(0.0f));
+	for (uint32_t i = 0; i < count; i++)
+	{
+		centers[i] = (boxes[i].min_ + boxes[i].max_) * 0.5f;
+		root_bounds = i == 0 ? boxes[i] : merge(root_bounds, boxes[i]);
+	}
+
+	nodes_.clear();
+	parents_.clear();
+	nodes_.reserve(count * 2);
+	parents_.reserve(count * 2);
+	nodes_.push_back({ root_bounds, 0, 0, count });
+	parents_.push_back(0);
+	split(0, boxes, centers, 0);
+
+	item_bounds_.resize(count);
+	slot_of_.resize(count);
+	leaf_of_.resize(count);
+	for (uint32_t slot = 0; slot < count; slot++)
+	{
+		item_bounds_[slot] = boxes[items_[slot]];
+		slot_of_[items_[slot]] = slot;
+	}
+	for (uint32_t n = 0; n < nodes_.size(); n++)
+		if (nodes_[n].left == 0)
+			for (uint32_t slot = nodes_[n].first_item; slot < nodes_[n].first_item + nodes_[n].item_count; slot++)
+				leaf_of_[items_[slot]] = n;
+}
+
+void entity_bvh::split(const uint32_t index, const std::vector<bounding_box>& boxes, const std::vector<glm::vec3>& centers, const uint32_t depth)
+{
+	const uint32_t first = nodes_[index].first_item;
+	const uint32_t count = nodes_[index].item_count;
+	if (count <= max_leaf_size || depth >= max_depth)
+		return;
+
+	glm::vec3 center_min = centers[items_[first]], center_max = center_min;
+	for (uint32_t i = first + 1; i < first + count; i++)
+	{
+		center_min = glm::min(center_min, centers[items_[i]]);
+		center_max = glm::max(center_max, centers[items_[i]]);
+	}
+	const glm::vec3 extent = center_max - center_min;
+	const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+	const auto begin = items_.begin() + first;
+	const auto end = begin + count;
+	auto middle = begin + count / 2;
+	if (extent[axis] > 0.0f)
+	{
+		// binned surface area heuristic along the longest axis of the centers
+		const float scale = bin_count / extent[axis];
+		const auto bin_of = [&centers, axis, scale, &center_min](const uint32_t item)
+		{
+			return std::min(bin_count - 1, static_cast<int>((centers[item][axis] - center_min[axis]) * scale));
+		};
+
+		uint32_t bin_items[bin_count] = {};
+		glm::vec3 bin_min[bin_count], bin_max[bin_count];
+		for (auto it = begin; it != end; ++it)
+		{
+			const int bin = bin_of(*it);
+			bin_min[bin] = bin_items[bin] ? glm::min(bin_min[bin], boxes[*it].min_) : boxes[*it].min_;
+			bin_max[bin] = bin_items[bin] ? glm::max(bin_max[bin], boxes[*it].max_) : boxes[*it].max_;
+			bin_items[bin]++;
+		}
+
+		// cost of putting the bins below split into the left child, swept from both sides
+		float left_cost[bin_count] = {};
+		glm::vec3 lo(std::numeric_limits<float>::max()), hi(std::numeric_limits<float>::lowest());
+		uint32_t left_items = 0;
+		for (int split = 1; split < bin_count; split++)
+		{
+			if (bin_items[split - 1])
+			{
+				lo = glm::min(lo, bin_min[split - 1]);
+				hi = glm::max(hi, bin_max[split - 1]);
+				left_items += bin_items[split - 1];
+			}
+			left_cost[split] = left_items ? half_area(lo, hi) * left_items : 0.0f;
+		}
+
+		int best = 0;
+		float best_cost = std::numeric_limits<float>::max();
+		lo = glm::vec3(std::numeric_limits<float>::max());
+		hi = glm::vec3(std::numeric_limits<float>::lowest());
+		uint32_t right_items = 0;
+		for (int split = bin_count - 1; split > 0; split--)
+		{
+			if (bin_items[split])
+			{
+				lo = glm::min(lo, bin_min[split]);
+				hi = glm::max(hi, bin_max[split]);
+				right_items += bin_items[split];
+			}
+			const float cost = left_cost[split] + (right_items ? half_area(lo, hi) * right_items : 0.0f);
+			if (right_items > 0 && right_items < count && cost < best_cost)
+			{
+				best_cost = cost;
+				best = split;
+			}
+		}
+
+		if (best > 0)
+			middle = std::partition(begin, end, [&bin_of, best](const uint32_t item) { return bin_of(item) < best; });
+	}
+
+	// all centers in one bin, split by count instead
+	if (middle == begin || middle == end)
+	{
+		middle = begin + count / 2;
+		std::nth_element(begin, middle, end, [&centers, axis](const uint32_t a, const uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+	}
+
+	const auto left_count = static_cast<uint32_t>(middle - begin);
+	const auto left = static_cast<uint32_t>(nodes_.size());
+	for (const uint32_t child_first : { first, first + left_count })
+	{
+		const uint32_t child_count = child_first == first ? left_count : count - left_count;
+		bounding_box bounds = boxes[items_[child_first]];
+		for (uint32_t i = child_first + 1; i < child_first + child_count; i++)
+			bounds = merge(bounds, boxes[items_[i]]);
+		nodes_.push_back({ bounds, 0, child_first, child_count });
+		parents_.push_back(index);
+	}
+	nodes_[index].left = left;
+
+	split(left, boxes, centers, depth + 1);
+	split(left + 1, boxes, centers, depth + 1);
+}
+
+bounding_box entity_bvh::bounds_of(const uint32_t first, const uint32_t count) const
+{
+	bounding_box bounds = item_bounds_[first];
+	for (uint32_t slot = first + 1; slot < first + count; slot++)
+		bounds = merge(bounds, item_bounds_[slot]);
+	return bounds;
+}
+
+void entity_bvh::refit(const uint32_t item, const bounding_box& b)
+{
+	item_bounds_[slot_of_[item]] = b;
+	uint32_t index = leaf_of_[item];
+	nodes_[index].bounds = bounds_of(nodes_[index].first_item, nodes_[index].item_count);
+	while (index != 0)
+	{
+		index = parents_[index];
+		const uint32_t left = nodes_[index].left;
+		const bounding_box bounds = merge(nodes_[left].bounds, nodes_[left + 1].bounds);
+		// the nodes above an unchanged one don't change either
+		if (bounds.min_ == nodes_[index].bounds.min_ && bounds.max_ == nodes_[index].bounds.max_)
+			break;
+		nodes_[index].bounds = bounds;
+	}
+}
+
+void entity_bvh::accept(const node& n, uint32_t* visible) const
+{
+	for (uint32_t slot = n.first_item; slot < n.first_item + n.item_count; slot++)
+		visible[items_[slot] / 32] |= 1u << (items_[slot] % 32);
+}
+
+uint32_t entity_bvh::cull(const glm::vec4* planes, const glm::vec4* corners, uint32_t* visible) const
+{
+	std::fill(visible, visible + (items_.size() + 31) / 32, 0u);
+	if (items_.empty())
+		return 0;
+
+	frustum f;
+	std::copy(planes, planes + 6, f.planes);
+	f.corner_min = f.corner_max = glm::vec3(corners[0]);
+	for (int i = 1; i < 8; i++)
+	{
+		f.corner_min = glm::min(f.corner_min, glm::vec3(corners[i]));
+		f.corner_max = glm::max(f.corner_max, glm::vec3(corners[i]));
+	}
+
+	// every entry keeps the tests its node still crosses, a test that contains a node contains its whole subtree
+	struct entry
+	{
+		uint32_t node;
+		uint32_t tests;
+	};
+	entry stack[max_depth * 2 + 2];
+	int top = 0;
+	stack[top++] = { 0, all_tests };
+
+	uint32_t visited = 0;
+	while (top > 0)
+	{
+		const entry e = stack[--top];
+		const node& n = nodes_[e.node];
+		visited++;
+
+		uint32_t crossing;
+		if (!test_box(f, n.bounds, e.tests, crossing))
+			continue;
+		if (crossing == 0)
+		{
+			accept(n, visible);
+			continue;
+		}
+
+		if (n.left == 0)
+		{
+			for (uint32_t slot = n.first_item; slot < n.first_item + n.item_count; slot++)
+			{
+				uint32_t item_crossing;
+				if (test_box(f, item_bounds_[slot], crossing, item_crossing))
+					visible[items_[slot] / 32] |= 1u << (items_[slot] % 32);
+			}
+			continue;
+		}
+
+		stack[top++] = { n.left + 1, crossing };
+		stack[top++] = { n.left, crossing };
+	}
+	return visited;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "LevelStructs.h"
+#include <vector>
+
+/// @brief bounding volume hierarchy over the bounds of the render queue, built with binned SAH
+/// frustum culling walks it from the root and accepts or rejects whole subtrees, only leaves that cross the frustum
+/// test their boxes one by one. moving boxes are refit in place, the tree is never rebuilt while a level runs
+class entity_bvh
+{
+public:
+	static constexpr uint32_t max_leaf_size = 4;
+
+	/**
+	 * \brief builds the tree
+	 * \param boxes bounds of every item, the index of a box is the item index used by refit and cull
+	 */
+	void build(const std::vector<bounding_box>& boxes);
+
+	/**
+	 * \brief moves one item and grows or shrinks every node above it
+	 * \param item index of the box in build
+	 * \param b new bounds of the item
+	 */
+	void refit(uint32_t item, const bounding_box& b);
+
+	/**
+	 * \brief frustum culling with the same result as frustum_culler::is_box_in_frustum for every item
+	 * \param planes are the 6 planes of the view frustum
+	 * \param corners are the 8 corners of the view frustum
+	 * \param visible receives (items + 31) / 32 words, bit i % 32 of word i / 32 is set if item i is visible
+	 * \return number of nodes that were visited, for benchmarks
+	 */
+	uint32_t cull(const glm::vec4* planes, const glm::vec4* corners, uint32_t* visible) const;
+
+	size_t get_node_count() const { return nodes_.size(); }
+	size_t get_item_count() const { return items_.size(); }
+
+private:
+	struct node
+	{
+		bounding_box bounds;
+		uint32_t left;			// index of the left child, the right one follows it, 0 for leaves
+		uint32_t first_item;	// the items of every subtree are contiguous in items_
+		uint32_t item_count;
+	};
+
+	std::vector<node> nodes_;
+	std::vector<uint32_t> parents_;
+	std::vector<uint32_t> items_;				// item index in tree order
+	std::vector<bounding_box> item_bounds_;		// bounds in tree order, so leaves read them sequentially
+	std::vector<uint32_t> leaf_of_;				// leaf node of every item
+	std::vector<uint32_t> slot_of_;				// position of every item in items_
+
+	/// @brief splits a node recursively until it has at most max_leaf_size items
+	void split(uint32_t index, const std::vector<bounding_box>& boxes, const std::vector<glm::vec3>& centers, uint32_t depth);
+
+	/// @brief union of the bounds of a range of items in tree order
+	bounding_box bounds_of(uint32_t first, uint32_t count) const;
+
+	/// @brief marks all items of a subtree as visible
+	void accept(const node& n, uint32_t* visible) const;
+};
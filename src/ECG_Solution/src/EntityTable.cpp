@@ -0,0 +1,73 @@
+#include "EntityTable.h"
+
+uint32_t entity_table::add(const std::string& name, const entity_type type, const int32_t mesh_index, const transformation& trs, const bounding_box& model)
+{
+	const auto index = static_cast<uint32_t>(size());
+	world_bounds.push_back(model);
+	entity_render r;
+	r.mesh_index = mesh_index;
+	r.type = type;
+	render.push_back(r);
+	transforms.push_back(trs);
+	model_bounds.push_back(model);
+	bounds_dirty.push_back(1);
+	properties.emplace_back();
+	names.push_back(intern(name));
+	return index;
+}
+
+uint32_t entity_table::add_copy(const entity_table& other, const uint32_t index)
+{
+	const auto copy = static_cast<uint32_t>(size());
+	world_bounds.push_back(other.world_bounds[index]);
+	render.push_back(other.render[index]);
+	transforms.push_back(other.transforms[index]);
+	model_bounds.push_back(other.model_bounds[index]);
+	bounds_dirty.push_back(other.bounds_dirty[index]);
+	properties.push_back(other.properties[index]);
+	names.push_back(intern(other.get_name(index)));
+	return copy;
+}
+
+void entity_table::reserve(const size_t count)
+{
+	world_bounds.reserve(count);
+	render.reserve(count);
+	transforms.reserve(count);
+	model_bounds.reserve(count);
+	bounds_dirty.reserve(count);
+	properties.reserve(count);
+	names.reserve(count);
+}
+
+void entity_table::clear()
+{
+	*this = entity_table();
+}
+
+void entity_table::set_node_trs(const uint32_t index, const glm::vec3 T, const glm::quat R, const glm::vec3 S)
+{
+	transformation& trs = transforms[index];
+	trs.translate = T; trs.rotation = R; trs.scale = S;
+	trs.local = glm::translate(T) * glm::toMat4(R);
+	bounds_dirty[index] = 1;
+}
+
+void entity_table::set_active(const uint32_t index, const bool active)
+{
+	if (render[index].is_active == active)
+		return;
+	render[index].is_active = active;
+	activated.push_back(index);
+}
+
+uint32_t entity_table::intern(const std::string& name)
+{
+	const auto it = name_ids_.find(name);
+	if (it != name_ids_.end())
+		return it->second;
+	const auto id = static_cast<uint32_t>(name_table_.size());
+	name_table_.push_back(name);
+	name_ids_.emplace(name, id);
+	return id;
+}
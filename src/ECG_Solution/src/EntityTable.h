@@ -0,0 +1,115 @@
+#pragma once
+#include "LevelStructs.h"
+#include <unordered_map>
+
+class entity_table;
+
+/// @brief refers to one entity of an entity_table by its index, stays valid while the table lives, also when it grows
+/// physics and gameplay keep these instead of pointers, the data itself lives in the component arrays of the table
+class entity_handle
+{
+public:
+	entity_handle() = default;
+	entity_handle(entity_table* table, const uint32_t index) : table_(table), index_(index) {}
+
+	/// @brief false for physics objects without a model
+	explicit operator bool() const { return table_ != nullptr; }
+
+	uint32_t get_index() const { return index_; }
+	const std::string& get_name() const;
+	game_properties& get_properties() const;
+	bool is_active() const;
+
+	/// @brief inactive entities are neither rendered nor simulated
+	void set_active(bool active) const;
+
+	/// return TRS "model matrix" of the node
+	glm::mat4 get_node_matrix() const;
+
+	/// @return memory efficient TRS data
+	const transformation& get_node_trs() const;
+
+	/// @brief set TRS "model matrix" of the node, the level recomputes the world bounds of all dirty entities once per frame
+	void set_node_trs(glm::vec3 T, glm::quat R, glm::vec3 S) const;
+
+private:
+	entity_table* table_ = nullptr;
+	uint32_t index_ = 0;
+};
+
+/// @brief mesh, kind and state of an entity, the part of it that culling and LOD read besides the bounds
+struct entity_render
+{
+	int32_t mesh_index = -1;
+	entity_type type = rigid;
+	bool is_active = true;		// only active items are rendered. only active items are allowed to interact with the physics world
+};
+
+/**
+ * \brief the entities of a level as parallel component arrays, element i of every array belongs to entity i
+ * culling and LOD stream world_bounds and render only, 36 bytes per entity, transforms are read when an entity moves
+ * and names and gameplay properties never during a frame
+ */
+class entity_table
+{
+public:
+	// hot, read by every culling and LOD pass
+	std::vector<bounding_box> world_bounds;
+	std::vector<entity_render> render;
+
+	// warm, read when an entity moves
+	std::vector<transformation> transforms;
+	std::vector<bounding_box> model_bounds;		// bounds in model space
+	std::vector<uint8_t> bounds_dirty;			// TRS changed since world_bounds were computed
+	std::vector<uint32_t> activated;			// entities whose is_active changed, the level takes them once per frame
+
+	// cold, gameplay and tools only
+	std::vector<game_properties> properties;
+	std::vector<uint32_t> names;				// id of the node name in the name table
+
+	/**
+	 * \brief appends an entity with default game properties, its world bounds are computed by the level
+	 * \return index of the new entity
+	 */
+	uint32_t add(const std::string& name, entity_type type, int32_t mesh_index, const transformation& trs, const bounding_box& model);
+
+	/**
+	 * \brief appends a copy of an entity of another table, with its bounds and game properties
+	 * \return index of the new entity
+	 */
+	uint32_t add_copy(const entity_table& other, uint32_t index);
+
+	void reserve(size_t count);
+	void clear();
+
+	size_t size() const { return render.size(); }
+	bool empty() const { return render.empty(); }
+
+	entity_handle get(const uint32_t index) { return { this, index }; }
+	const std::string& get_name(const uint32_t index) const { return name_table_[names[index]]; }
+	glm::mat4 get_node_matrix(const uint32_t index) const { return transforms[index].get_matrix(); }
+
+	/// @brief number of different names, entities of the same node name share one
+	size_t get_name_count() const { return name_table_.size(); }
+
+	/// @brief sets the TRS of an entity and marks its bounds dirty
+	void set_node_trs(uint32_t index, glm::vec3 T, glm::quat R, glm::vec3 S);
+
+	/// @brief activates or deactivates an entity and lists it in activated if that changed anything
+	void set_active(uint32_t index, bool active);
+
+private:
+	std::vector<std::string> name_table_;
+	std::unordered_map<std::string, uint32_t> name_ids_;
+
+	/// @brief id of a name, adds it to the name table on first use
+	uint32_t intern(const std::string& name);
+};
+
+inline const std::string& entity_handle::get_name() const { return table_->get_name(index_); }
+inline game_properties& entity_handle::get_properties() const { return table_->properties[index_]; }
+inline bool entity_handle::is_active() const { return table_->render[index_].is_active; }
+inline void entity_handle::set_active(const bool active) const { table_->set_active(index_, active); }
+inline glm::mat4 entity_handle::get_node_matrix() const { return table_->get_node_matrix(index_); }
+inline const transformation& entity_handle::get_node_trs() const { return table_->transforms[index_]; }
+inline void entity_handle::set_node_trs(const glm::vec3 T, const glm::quat R, const glm::vec3 S) const { table_->set_node_trs(index_, T, R, S); }
@@ -11,6 +11,8 @@ public:
 	framebuffer(const framebuffer&) = delete;
 	framebuffer(framebuffer&&) = default;
 	GLuint get_handle() const { return handle_; }
+	int get_width() const { return width_; }
+	int get_height() const { return height_; }
 	const Texture& get_texture_color() const { return *tex_color_; }
 	const Texture& get_texture_depth() const { return *tex_depth_; }
 	void bind() const;
@@ -1,4 +1,240 @@
 #include "FrustumCuller.h"
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CULL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// msvc allows every intrinsic in every function
+#define CULL_TARGET(isa)
+#else
+#include <cpuid.h>
+#define CULL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	/// @brief frustum in the form the batched test needs it, the same for every box
+	struct cull_constants
+	{
+		float px[6], py[6], pz[6], pw[6];
+		float corner_min[3];	// the box is outside if its max is below, NaN if a corner is NaN
+		float corner_max[3];	// the box is outside if its min is above
+	};
+
+	cull_constants make_constants(const glm::vec4* planes, const glm::vec4* corners)
+	{
+		cull_constants c;
+		for (int i = 0; i < 6; i++)
+		{
+			c.px[i] = planes[i].x;
+			c.py[i] = planes[i].y;
+			c.pz[i] = planes[i].z;
+			c.pw[i] = planes[i].w;
+		}
+
+		// "all corners are above max" is the same as "the smallest corner is above max", a NaN corner must never reject
+		for (int a = 0; a < 3; a++)
+		{
+			float lo = corners[0][a], hi = corners[0][a];
+			for (int i = 1; i < 8; i++)
+			{
+				const float v = corners[i][a];
+				lo = v < lo || v != v ? v : lo;
+				hi = v > hi || v != v ? v : hi;
+			}
+			c.corner_min[a] = lo;
+			c.corner_max[a] = hi;
+		}
+		return c;
+	}
+
+	// a plane rejects a box if all 8 dot((p.xyz, p.w), (corner, 1)) = (px * x + py * y) + (pz * z + pw) are negative.
+	// float addition and multiplication are monotonic, so the largest of the 8 rounded dots is the rounded dot made of
+	// the largest products, and it is negative exactly if all 8 are
+
+	void cull_scalar(const cull_constants& c, const box_soa& boxes, const size_t first, uint32_t* visible)
+	{
+		for (size_t i = first; i < boxes.count; i++)
+		{
+			bool outside = c.corner_min[0] > boxes.max_x[i] || c.corner_max[0] < boxes.min_x[i]
+				|| c.corner_min[1] > boxes.max_y[i] || c.corner_max[1] < boxes.min_y[i]
+				|| c.corner_min[2] > boxes.max_z[i] || c.corner_max[2] < boxes.min_z[i];
+			for (int p = 0; p < 6 && !outside; p++)
+			{
+				const float x = std::max(c.px[p] * boxes.min_x[i], c.px[p] * boxes.max_x[i]);
+				const float y = std::max(c.py[p] * boxes.min_y[i], c.py[p] * boxes.max_y[i]);
+				const float z = std::max(c.pz[p] * boxes.min_z[i], c.pz[p] * boxes.max_z[i]);
+				outside = (x + y) + (z + c.pw[p]) < 0.0f;
+			}
+			if (!outside)
+				visible[i / 32] |= 1u << (i % 32);
+		}
+	}
+
+#ifdef CULL_X86
+	CULL_TARGET("sse2")
+	size_t cull_sse(const cull_constants& c, const box_soa& boxes, uint32_t* visible)
+	{
+		const size_t end = boxes.count / 4 * 4;
+		for (size_t i = 0; i < end; i += 4)
+		{
+			const __m128 min_x = _mm_loadu_ps(&boxes.min_x[i]), max_x = _mm_loadu_ps(&boxes.max_x[i]);
+			const __m128 min_y = _mm_loadu_ps(&boxes.min_y[i]), max_y = _mm_loadu_ps(&boxes.max_y[i]);
+			const __m128 min_z = _mm_loadu_ps(&boxes.min_z[i]), max_z = _mm_loadu_ps(&boxes.max_z[i]);
+
+			__m128 outside = _mm_or_ps(_mm_cmpgt_ps(_mm_set1_ps(c.corner_min[0]), max_x), _mm_cmplt_ps(_mm_set1_ps(c.corner_max[0]), min_x));
+			outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmpgt_ps(_mm_set1_ps(c.corner_min[1]), max_y), _mm_cmplt_ps(_mm_set1_ps(c.corner_max[1]), min_y)));
+			outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmpgt_ps(_mm_set1_ps(c.corner_min[2]), max_z), _mm_cmplt_ps(_mm_set1_ps(c.corner_max[2]), min_z)));
+			for (int p = 0; p < 6; p++)
+			{
+				const __m128 px = _mm_set1_ps(c.px[p]), py = _mm_set1_ps(c.py[p]), pz = _mm_set1_ps(c.pz[p]);
+				const __m128 x = _mm_max_ps(_mm_mul_ps(px, min_x), _mm_mul_ps(px, max_x));
+				const __m128 y = _mm_max_ps(_mm_mul_ps(py, min_y), _mm_mul_ps(py, max_y));
+				const __m128 z = _mm_max_ps(_mm_mul_ps(pz, min_z), _mm_mul_ps(pz, max_z));
+				const __m128 d = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, _mm_set1_ps(c.pw[p])));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+			}
+			visible[i / 32] |= static_cast<uint32_t>(~_mm_movemask_ps(outside) & 0xF) << (i % 32);
+		}
+		return end;
+	}
+
+	CULL_TARGET("avx")
+	size_t cull_avx(const cull_constants& c, const box_soa& boxes, uint32_t* visible)
+	{
+		const size_t end = boxes.count / 8 * 8;
+		for (size_t i = 0; i < end; i += 8)
+		{
+			const __m256 min_x = _mm256_loadu_ps(&boxes.min_x[i]), max_x = _mm256_loadu_ps(&boxes.max_x[i]);
+			const __m256 min_y = _mm256_loadu_ps(&boxes.min_y[i]), max_y = _mm256_loadu_ps(&boxes.max_y[i]);
+			const __m256 min_z = _mm256_loadu_ps(&boxes.min_z[i]), max_z = _mm256_loadu_ps(&boxes.max_z[i]);
+
+			__m256 outside = _mm256_or_ps(_mm256_cmp_ps(_mm256_set1_ps(c.corner_min[0]), max_x, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_set1_ps(c.corner_max[0]), min_x, _CMP_LT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_or_ps(_mm256_cmp_ps(_mm256_set1_ps(c.corner_min[1]), max_y, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_set1_ps(c.corner_max[1]), min_y, _CMP_LT_OQ)));
+			outside = _mm256_or_ps(outside, _mm256_or_ps(_mm256_cmp_ps(_mm256_set1_ps(c.corner_min[2]), max_z, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_set1_ps(c.corner_max[2]), min_z, _CMP_LT_OQ)));
+			for (int p = 0; p < 6; p++)
+			{
+				const __m256 px = _mm256_set1_ps(c.px[p]), py = _mm256_set1_ps(c.py[p]), pz = _mm256_set1_ps(c.pz[p]);
+				const __m256 x = _mm256_max_ps(_mm256_mul_ps(px, min_x), _mm256_mul_ps(px, max_x));
+				const __m256 y = _mm256_max_ps(_mm256_mul_ps(py, min_y), _mm256_mul_ps(py, max_y));
+				const __m256 z = _mm256_max_ps(_mm256_mul_ps(pz, min_z), _mm256_mul_ps(pz, max_z));
+				const __m256 d = _mm256_add_ps(_mm256_add_ps(x, y), _mm256_add_ps(z, _mm256_set1_ps(c.pw[p])));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+			visible[i / 32] |= static_cast<uint32_t>(~_mm256_movemask_ps(outside) & 0xFF) << (i % 32);
+		}
+		return end;
+	}
+
+	CULL_TARGET("avx512f")
+	size_t cull_avx512(const cull_constants& c, const box_soa& boxes, uint32_t* visible)
+	{
+		const size_t end = boxes.count / 16 * 16;
+		for (size_t i = 0; i < end; i += 16)
+		{
+			const __m512 min_x = _mm512_loadu_ps(&boxes.min_x[i]), max_x = _mm512_loadu_ps(&boxes.max_x[i]);
+			const __m512 min_y = _mm512_loadu_ps(&boxes.min_y[i]), max_y = _mm512_loadu_ps(&boxes.max_y[i]);
+			const __m512 min_z = _mm512_loadu_ps(&boxes.min_z[i]), max_z = _mm512_loadu_ps(&boxes.max_z[i]);
+
+			__mmask16 outside = _mm512_cmp_ps_mask(_mm512_set1_ps(c.corner_min[0]), max_x, _CMP_GT_OQ) | _mm512_cmp_ps_mask(_mm512_set1_ps(c.corner_max[0]), min_x, _CMP_LT_OQ)
+				| _mm512_cmp_ps_mask(_mm512_set1_ps(c.corner_min[1]), max_y, _CMP_GT_OQ) | _mm512_cmp_ps_mask(_mm512_set1_ps(c.corner_max[1]), min_y, _CMP_LT_OQ)
+				| _mm512_cmp_ps_mask(_mm512_set1_ps(c.corner_min[2]), max_z, _CMP_GT_OQ) | _mm512_cmp_ps_mask(_mm512_set1_ps(c.corner_max[2]), min_z, _CMP_LT_OQ);
+			for (int p = 0; p < 6; p++)
+			{
+				const __m512 px = _mm512_set1_ps(c.px[p]), py = _mm512_set1_ps(c.py[p]), pz = _mm512_set1_ps(c.pz[p]);
+				const __m512 x = _mm512_max_ps(_mm512_mul_ps(px, min_x), _mm512_mul_ps(px, max_x));
+				const __m512 y = _mm512_max_ps(_mm512_mul_ps(py, min_y), _mm512_mul_ps(py, max_y));
+				const __m512 z = _mm512_max_ps(_mm512_mul_ps(pz, min_z), _mm512_mul_ps(pz, max_z));
+				const __m512 d = _mm512_add_ps(_mm512_add_ps(x, y), _mm512_add_ps(z, _mm512_set1_ps(c.pw[p])));
+				outside |= _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_LT_OQ);
+			}
+			visible[i / 32] |= static_cast<uint32_t>(static_cast<uint16_t>(~outside)) << (i % 32);
+		}
+		return end;
+	}
+
+	/// @brief transform_box with the columns of the matrix in registers, one box per iteration
+	CULL_TARGET("sse2")
+	void transform_sse(const glm::mat4* matrices, const bounding_box* model, bounding_box* world, const size_t count)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* m = &matrices[i][0][0];
+			const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+			const bounding_box& b = model[i];
+			const __m128 lo = _mm_setr_ps(b.min_.x, b.min_.y, b.min_.z, 0.0f);
+			const __m128 hi = _mm_setr_ps(b.max_.x, b.max_.y, b.max_.z, 0.0f);
+			const __m128 center = _mm_mul_ps(_mm_add_ps(lo, hi), half);
+			const __m128 extent = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+
+			__m128 wc = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))), c3);
+			wc = _mm_add_ps(wc, _mm_mul_ps(c1, _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1))));
+			wc = _mm_add_ps(wc, _mm_mul_ps(c2, _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))));
+			__m128 we = _mm_mul_ps(_mm_andnot_ps(sign, c0), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0)));
+			we = _mm_add_ps(we, _mm_mul_ps(_mm_andnot_ps(sign, c1), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1))));
+			we = _mm_add_ps(we, _mm_mul_ps(_mm_andnot_ps(sign, c2), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			float out_min[4], out_max[4];
+			_mm_storeu_ps(out_min, _mm_sub_ps(wc, we));
+			_mm_storeu_ps(out_max, _mm_add_ps(wc, we));
+			world[i].min_ = glm::vec3(out_min[0], out_min[1], out_min[2]);
+			world[i].max_ = glm::vec3(out_max[0], out_max[1], out_max[2]);
+		}
+	}
+
+	void cpuid(int info[4], const int leaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(info, leaf, 0);
+#else
+		__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	/// @brief register state the operating system saves on context switches
+	uint64_t enabled_state()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return static_cast<uint64_t>(edx) << 32 | eax;
+#endif
+	}
+
+	frustum_culler::simd_level detect_simd_level()
+	{
+		int info[4];
+		cpuid(info, 0);
+		const int leaves = info[0];
+		cpuid(info, 1);
+		const bool sse2 = (info[3] & 1 << 26) != 0;
+		const bool osxsave = (info[2] & 1 << 27) != 0;
+		const bool avx = (info[2] & 1 << 28) != 0;
+		if (!sse2)
+			return frustum_culler::simd_scalar;
+
+		// the os has to save the ymm and zmm registers, otherwise the instructions fault
+		const uint64_t state = osxsave ? enabled_state() : 0;
+		if (!avx || (state & 0x6) != 0x6)
+			return frustum_culler::simd_sse;
+
+		bool avx512 = false;
+		if (leaves >= 7)
+		{
+			cpuid(info, 7);
+			avx512 = (info[1] & 1 << 16) != 0 && (state & 0xE6) == 0xE6;
+		}
+		return avx512 ? frustum_culler::simd_avx512 : frustum_culler::simd_avx;
+	}
+#endif
+}
 
 glm::mat4 frustum_culler::cull_view_proj = glm::mat4(1);
 glm::vec4 frustum_culler::frustum_planes[6];
@@ -61,4 +297,68 @@ bool frustum_culler::is_box_in_frustum(glm::vec4* planes, glm::vec4* corners, co
 	out = 0; for (int i = 0; i < 8; i++) out += ((corners[i].z < b.min_.z) ? 1 : 0); if (out == 8) return false;
 
 	return true;
-}
\ No newline at end of file
+}
+void frustum_culler::cull_boxes(const glm::vec4* planes, const glm::vec4* corners, const box_soa& boxes, uint32_t* visible, const simd_level level)
+{
+	std::fill(visible, visible + boxes.mask_words(), 0u);
+	const cull_constants c = make_constants(planes, corners);
+
+	// the wide loops stop at the last full group of boxes, the rest is done one by one
+	size_t done = 0;
+#ifdef CULL_X86
+	if (level == simd_avx512)
+		done = cull_avx512(c, boxes, visible);
+	else if (level == simd_avx)
+		done = cull_avx(c, boxes, visible);
+	else if (level == simd_sse)
+		done = cull_sse(c, boxes, visible);
+#endif
+	cull_scalar(c, boxes, done, visible);
+}
+
+bounding_box frustum_culler::transform_box(const glm::mat4& m, const bounding_box& b)
+{
+	// the center moves with the matrix, the half extent grows by the absolute rotation and scale (Arvo)
+	const glm::vec3 center = (b.min_ + b.max_) * 0.5f;
+	const glm::vec3 extent = (b.max_ - b.min_) * 0.5f;
+	const glm::vec3 c = glm::vec3(m * glm::vec4(center, 1.0f));
+	const glm::vec3 e = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y + glm::abs(glm::vec3(m[2])) * extent.z;
+	bounding_box world;
+	world.min_ = c - e;
+	world.max_ = c + e;
+	return world;
+}
+
+void frustum_culler::transform_boxes(const glm::mat4* matrices, const bounding_box* model, bounding_box* world, const size_t count)
+{
+#ifdef CULL_X86
+	if (get_simd_level() != simd_scalar)
+	{
+		transform_sse(matrices, model, world, count);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < count; i++)
+		world[i] = transform_box(matrices[i], model[i]);
+}
+
+frustum_culler::simd_level frustum_culler::get_simd_level()
+{
+#ifdef CULL_X86
+	static const simd_level level = detect_simd_level();
+	return level;
+#else
+	return simd_scalar;
+#endif
+}
+
+const char* frustum_culler::get_simd_name(const simd_level level)
+{
+	switch (level)
+	{
+	case simd_avx512: return "AVX-512";
+	case simd_avx: return "AVX";
+	case simd_sse: return "SSE";
+	default: return "scalar";
+	}
+}
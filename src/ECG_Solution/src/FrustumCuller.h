@@ -6,6 +6,8 @@
 class frustum_culler
 {
 public:
+	/// @brief instruction sets of the batched culling, the value is the number of boxes per instruction
+	enum simd_level { simd_scalar = 1, simd_sse = 4, simd_avx = 8, simd_avx512 = 16 };
 
 	static glm::mat4 cull_view_proj;
 	static glm::vec4 frustum_planes[6];
@@ -35,4 +37,35 @@ public:
 	/// @param b is the AABB of some mesh
 	/// @return true if the box is in bounds, meaning its visible from the camera
 	static bool is_box_in_frustum(glm::vec4* planes, glm::vec4* corners, const bounding_box& b);
+
+	/// @brief tests many boxes at once with the same result as is_box_in_frustum for every box
+	/// the 8 corner dot products per plane are replaced by the largest one, which rounds exactly like the largest of the 8
+	/// @param planes are the 6 planes of the view frustum
+	/// @param corners are the 8 corners of the view frustum
+	/// @param boxes are the AABBs to test
+	/// @param visible receives boxes.mask_words() words, bit i % 32 of word i / 32 is set if box i is visible
+	/// @param level instruction set to use, has to be supported by the CPU
+	static void cull_boxes(const glm::vec4* planes, const glm::vec4* corners, const box_soa& boxes, uint32_t* visible, simd_level level);
+	static void cull_boxes(const glm::vec4* planes, const glm::vec4* corners, const box_soa& boxes, uint32_t* visible)
+	{
+		cull_boxes(planes, corners, boxes, visible, get_simd_level());
+	}
+
+	/// @brief bounds of a box after an affine transformation, as tight as the bounds of its 8 transformed corners
+	/// the center is transformed and the half extent is multiplied by the absolute of the upper 3x3 matrix (Arvo)
+	/// @param m is the model matrix
+	/// @param b is the AABB in model space
+	static bounding_box transform_box(const glm::mat4& m, const bounding_box& b);
+
+	/// @brief transform_box for many boxes, with SSE if the CPU supports it
+	/// @param matrices model matrix of every box
+	/// @param model boxes in model space
+	/// @param world receives count boxes in world space
+	static void transform_boxes(const glm::mat4* matrices, const bounding_box* model, bounding_box* world, size_t count);
+
+	/// @brief the widest instruction set that the CPU and the operating system support, detected on first call
+	static simd_level get_simd_level();
+
+	/// @brief name of an instruction set for logs
+	static const char* get_simd_name(simd_level level);
 };
@@ -0,0 +1,252 @@
+#include "GpuCuller.h"
+#include "Program.h"
+#include "LodSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+static_assert(sizeof(draw_elements_indirect_command) == 20, "slots are read as tightly packed indirect commands");
+
+namespace
+{
+	constexpr GLsizeiptr command_size = sizeof(draw_elements_indirect_command);
+
+	/// @brief bounds of the frustum corners like frustum_culler::cull_boxes, a NaN corner never rejects
+	void corner_bounds(const glm::vec4* corners, glm::vec3& corner_min, glm::vec3& corner_max)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			float lo = corners[0][a], hi = corners[0][a];
+			for (int i = 1; i < 8; i++)
+			{
+				const float v = corners[i][a];
+				lo = v < lo || v != v ? v : lo;
+				hi = v > hi || v != v ? v : hi;
+			}
+			corner_min[a] = lo;
+			corner_max[a] = hi;
+		}
+	}
+}
+
+gpu_culler::gpu_culler() = default;
+gpu_culler::~gpu_culler() = default;
+
+void gpu_culler::build(const std::vector<sub_mesh>& meshes, const uint32_t wide_index_base, const std::vector<uint32_t>& model_meshes,
+	const std::vector<bounding_box>& bounds, const std::vector<glm::mat4>& matrices, const std::vector<uint32_t>& flags, const bool count_from_buffer)
+{
+	if (model_meshes.empty())
+		return;
+
+	std::vector<uint32_t> mesh_models(meshes.size(), 0);
+	for (const uint32_t mesh : model_meshes)
+		mesh_models[mesh]++;
+
+	// the LODs of a mesh are consecutive slots, every slot has room for all models of its mesh
+	std::vector<cull_mesh> mesh_table(meshes.size(), cull_mesh{ 0, 1, 0, 0 });
+	std::vector<draw_elements_indirect_command> templates;
+	std::vector<float> errors;
+	first_slots_.assign(meshes.size(), 0);
+	slot_meshes_.clear();
+	instance_count_ = 0;
+	for (const bool short_indices : { true, false })
+	{
+		for (uint32_t m = 0; m < meshes.size(); m++)
+		{
+			const sub_mesh& mesh = meshes[m];
+			if (mesh.short_indices != short_indices || mesh_models[m] == 0)
+				continue;
+			const auto lods = static_cast<uint32_t>(mesh.index_count.size());
+			mesh_table[m].first_slot = static_cast<uint32_t>(templates.size());
+			mesh_table[m].lod_count = std::max<uint32_t>(1, std::min(lods, static_cast<uint32_t>(mesh.lod_error.size())));
+			mesh_table[m].material = mesh.material_index;
+			first_slots_[m] = mesh_table[m].first_slot;
+			for (uint32_t lod = 0; lod < lods; lod++)
+			{
+				templates.push_back(draw_elements_indirect_command{ mesh.index_count[lod], 0,
+					mesh.index_offset[lod] + (mesh.short_indices ? 0 : wide_index_base), mesh.vertex_offset, instance_count_ });
+				errors.push_back(lod < mesh.lod_error.size() ? mesh.lod_error[lod] : 0.0f);
+				slot_meshes_.push_back(m);
+				instance_count_ += mesh_models[m];
+			}
+		}
+		if (short_indices)
+			short_slots_ = static_cast<uint32_t>(templates.size());
+	}
+	slot_count_ = static_cast<uint32_t>(templates.size());
+	model_count_ = static_cast<uint32_t>(model_meshes.size());
+	model_meshes_ = model_meshes;
+	count_from_buffer_ = count_from_buffer;
+
+	std::vector<cull_model> models(model_count_);
+	for (uint32_t i = 0; i < model_count_; i++)
+		models[i] = cull_model{ glm::vec4(bounds[i].min_, 0.0f), glm::vec4(bounds[i].max_, 0.0f), model_meshes[i], flags[i], { 0, 0 } };
+	models_.reserve_memory(static_cast<GLsizeiptr>(models.size() * sizeof(cull_model)), models.data());
+	meshes_.reserve_memory(static_cast<GLsizeiptr>(mesh_table.size() * sizeof(cull_mesh)), mesh_table.data());
+	lod_errors_.reserve_memory(static_cast<GLsizeiptr>(errors.size() * sizeof(float)), errors.data());
+	const std::vector<uint32_t> lods(model_count_ * pass_count, 0);
+	lods_.reserve_memory(static_cast<GLsizeiptr>(lods.size() * sizeof(uint32_t)), lods.data());
+	matrices_.reserve_memory(static_cast<GLsizeiptr>(matrices.size() * sizeof(glm::mat4)), matrices.data());
+	slot_templates_.reserve_memory(static_cast<GLsizeiptr>(templates.size() * command_size), templates.data());
+
+	const uint32_t counts[4] = {};
+	const std::vector<draw_instance> instances(instance_count_, draw_instance{ 0, 0 });
+	for (pass_buffers& p : passes_)
+	{
+		p.slots.reserve_memory(static_cast<GLsizeiptr>(templates.size() * command_size), templates.data());
+		p.commands.reserve_memory(static_cast<GLsizeiptr>(templates.size() * command_size), templates.data());
+		p.counts.reserve_memory(sizeof(counts), counts);
+		p.instances.reserve_memory(static_cast<GLsizeiptr>(instances.size() * sizeof(draw_instance)), instances.data());
+	}
+
+	cull_program_ = std::make_unique<program>();
+	Shader cull_shader("../assets/shaders/Culling/cullCommands.comp");
+	cull_program_->build_from(cull_shader);
+	compact_program_ = std::make_unique<program>();
+	Shader compact_shader("../assets/shaders/Culling/compactCommands.comp");
+	compact_program_->build_from(compact_shader);
+}
+
+void gpu_culler::update_model(const uint32_t model, const bounding_box& bounds, const glm::mat4& matrix) const
+{
+	const glm::vec4 box[2] = { glm::vec4(bounds.min_, 0.0f), glm::vec4(bounds.max_, 0.0f) };
+	models_.update(static_cast<GLintptr>(model * sizeof(cull_model)), sizeof(box), box);
+	matrices_.update(static_cast<GLintptr>(model * sizeof(glm::mat4)), sizeof(glm::mat4), &matrix);
+}
+
+void gpu_culler::set_flags(const uint32_t model, const uint32_t flags) const
+{
+	models_.update(static_cast<GLintptr>(model * sizeof(cull_model) + offsetof(cull_model, flags)), sizeof(uint32_t), &flags);
+}
+
+void gpu_culler::bind_matrices() const
+{
+	matrices_.bind_range(4, 0, static_cast<GLsizeiptr>(model_count_ * sizeof(glm::mat4)));
+}
+
+void gpu_culler::cull(const pass p, const view& v)
+{
+	const pass_buffers& out = passes_[p];
+	const auto slot_bytes = static_cast<GLsizeiptr>(slot_count_ * command_size);
+
+	// every slot starts without instances and both draw counts at 0, copies and clears need no barrier before the shaders
+	glCopyNamedBufferSubData(slot_templates_.get_id(), out.slots.get_id(), 0, 0, slot_bytes);
+	glClearNamedBufferData(out.counts.get_id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	models_.bind_range(8, 0, static_cast<GLsizeiptr>(model_count_ * sizeof(cull_model)));
+	meshes_.bind_range(9, 0, static_cast<GLsizeiptr>(first_slots_.size() * sizeof(cull_mesh)));
+	lod_errors_.bind_range(10, 0, static_cast<GLsizeiptr>(slot_count_ * sizeof(float)));
+	lods_.bind_range(11, 0, static_cast<GLsizeiptr>(model_count_ * pass_count * sizeof(uint32_t)));
+	out.slots.bind_range(12, 0, slot_bytes);
+	out.commands.bind_range(13, 0, slot_bytes);
+	out.counts.bind_range(14, 0, 4 * sizeof(uint32_t));
+	out.instances.bind_range(7, 0, static_cast<GLsizeiptr>(instance_count_ * sizeof(draw_instance)));
+
+	// the limits are computed like lod_system::select_lod does, so they round the same
+	const float limit = lod_system::max_error_pixels * std::exp2(lod_system::bias);
+	glm::vec3 corner_min, corner_max;
+	corner_bounds(v.corners, corner_min, corner_max);
+	cull_program_->use();
+	for (int i = 0; i < 6; i++)
+		cull_program_->set_vec4("planes[" + std::to_string(i) + "]", v.planes[i]);
+	cull_program_->set_vec3("cornerMin", corner_min);
+	cull_program_->set_vec3("cornerMax", corner_max);
+	cull_program_->set_vec3("viewPos", v.position);
+	cull_program_->set_float("nearPlane", v.near_plane);
+	cull_program_->set_float("pixelsPerUnit", v.pixels_per_unit);
+	cull_program_->set_float("limitFiner", limit * (1.0f + lod_system::hysteresis));
+	cull_program_->set_float("limitCoarser", limit * (1.0f - lod_system::hysteresis));
+	cull_program_->setu_int("modelCount", static_cast<int>(model_count_));
+	cull_program_->setu_int("lodOffset", static_cast<int>(p * model_count_));
+	cull_program_->set_int("cullModels", v.cull);
+	cull_program_->set_int("useLod", v.use_lod);
+	cull_program_->set_int("byDistance", v.by_distance);
+	glDispatchCompute((model_count_ + group_size - 1) / group_size, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (count_from_buffer_)
+	{
+		compact_program_->use();
+		compact_program_->setu_int("slotCount", static_cast<int>(slot_count_));
+		compact_program_->setu_int("shortSlots", static_cast<int>(short_slots_));
+		glDispatchCompute((slot_count_ + group_size - 1) / group_size, 1, 1);
+	}
+	// the commands and counts are read by the draws, the instances by the vertex shaders
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void gpu_culler::draw(const pass p) const
+{
+	const pass_buffers& in = passes_[p];
+	in.instances.bind_range(7, 0, static_cast<GLsizeiptr>(instance_count_ * sizeof(draw_instance)));
+	const auto wide_slots = static_cast<GLsizei>(slot_count_ - short_slots_);
+	const auto wide_offset = reinterpret_cast<GLvoid*>(static_cast<GLintptr>(short_slots_ * command_size));
+
+	if (count_from_buffer_)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, in.commands.get_id());
+		glBindBuffer(GL_PARAMETER_BUFFER, in.counts.get_id());
+		const auto draw = glMultiDrawElementsIndirectCount ? glMultiDrawElementsIndirectCount : glMultiDrawElementsIndirectCountARB;
+		if (short_slots_ > 0)
+			draw(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, 0, static_cast<GLsizei>(short_slots_), 0);
+		if (wide_slots > 0)
+			draw(GL_TRIANGLES, GL_UNSIGNED_INT, wide_offset, sizeof(uint32_t), wide_slots, 0);
+		return;
+	}
+
+	// without a draw count from a buffer every slot is drawn, the ones without instances draw nothing
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, in.slots.get_id());
+	if (short_slots_ > 0)
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, static_cast<GLsizei>(short_slots_), 0);
+	if (wide_slots > 0)
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, wide_offset, wide_slots, 0);
+}
+
+uint32_t gpu_culler::read_visible(const pass p) const
+{
+	uint32_t visible = 0;
+	glGetNamedBufferSubData(passes_[p].counts.get_id(), 2 * sizeof(uint32_t), sizeof(uint32_t), &visible);
+	return visible;
+}
+
+int64_t gpu_culler::read_results(const pass p, std::vector<uint32_t>& visible, std::vector<uint8_t>& lods) const
+{
+	const pass_buffers& in = passes_[p];
+	std::vector<draw_elements_indirect_command> slots(slot_count_);
+	std::vector<draw_instance> instances(instance_count_);
+	std::vector<uint32_t> model_lods(model_count_);
+	uint32_t counts[2] = {};
+	glGetNamedBufferSubData(in.slots.get_id(), 0, static_cast<GLsizeiptr>(slots.size() * command_size), slots.data());
+	glGetNamedBufferSubData(in.instances.get_id(), 0, static_cast<GLsizeiptr>(instances.size() * sizeof(draw_instance)), instances.data());
+	glGetNamedBufferSubData(lods_.get_id(), static_cast<GLintptr>(p * model_count_ * sizeof(uint32_t)),
+		static_cast<GLsizeiptr>(model_lods.size() * sizeof(uint32_t)), model_lods.data());
+	glGetNamedBufferSubData(in.counts.get_id(), 0, sizeof(counts), counts);
+
+	visible.assign((model_count_ + 31) / 32, 0u);
+	lods.resize(model_count_);
+	for (uint32_t i = 0; i < model_count_; i++)
+		lods[i] = static_cast<uint8_t>(model_lods[i]);
+
+	bool valid = true;
+	int64_t used = 0;
+	for (uint32_t s = 0; s < slot_count_; s++)
+	{
+		used += slots[s].instanceCount_ > 0;
+		for (uint32_t n = 0; n < slots[s].instanceCount_; n++)
+		{
+			const uint32_t model = instances[slots[s].baseInstance_ + n].model;
+			if (model >= model_count_ || (visible[model / 32] >> (model % 32) & 1) != 0 || slot_meshes_[s] != model_meshes_[model]
+				|| s - first_slots_[model_meshes_[model]] != model_lods[model])
+			{
+				valid = false;
+				continue;
+			}
+			visible[model / 32] |= 1u << (model % 32);
+		}
+	}
+	// the compact pass has to count every used slot once
+	if (count_from_buffer_ && counts[0] + counts[1] != used)
+		valid = false;
+	return valid ? used : -1;
+}
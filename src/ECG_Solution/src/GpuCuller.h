@@ -0,0 +1,141 @@
+#pragma once
+#include "LevelStructs.h"
+#include "buffer.h"
+#include <memory>
+#include <vector>
+
+class program;
+
+/// @brief frustum culling and LOD selection of the render queue in compute shaders, the CPU writes nothing per model and frame
+/// every mesh LOD has a slot, an instanced command with room for an instance of every model of the mesh. the cull pass
+/// picks the LOD of every model with the hysteresis of lod_system and appends the visible models to the slot of their LOD,
+/// the compact pass moves the slots that got an instance to the front of the 16 bit and of the 32 bit commands and counts
+/// them for glMultiDrawElementsIndirectCount. bounds, flags and matrices stay on the GPU, only models that moved are written
+class gpu_culler
+{
+public:
+	static constexpr uint32_t group_size = 64;	// local size of both compute shaders
+
+	/// @brief the shadow pass keeps its own LODs and output buffers, both passes are drawn in the same frame
+	enum pass { main_pass = 0, shadow_pass = 1, pass_count = 2 };
+
+	/// @brief the model is drawn if it is visible, the models the CPU path gives an instance count of 1
+	static constexpr uint32_t model_drawn = 1;
+
+	/// @brief the frustum and the LOD parameters of one pass, the LOD limit and hysteresis come from lod_system
+	struct view
+	{
+		glm::vec4 planes[6];
+		glm::vec4 corners[8];
+		glm::vec3 position{ 0.0f };		// camera position, only used by_distance
+		float near_plane = 0.1f;
+		float pixels_per_unit = 1.0f;	// at distance 1 from the camera if by_distance, else per unit in the shadow map
+		bool by_distance = true;
+		bool cull = true;
+		bool use_lod = true;
+	};
+
+	gpu_culler();
+	~gpu_culler();
+
+	gpu_culler(const gpu_culler&) = delete;
+	gpu_culler& operator=(const gpu_culler&) = delete;
+
+	/**
+	 * \brief creates the slots and uploads the models, loads the compute shaders, needs a GL context
+	 * \param meshes all meshes of the level
+	 * \param wide_index_base start of the 32 bit index pool in the element buffer, like level::get_first_index
+	 * \param model_meshes mesh of every model, in command order of the render queue
+	 * \param bounds world bounds of every model
+	 * \param matrices model matrix of every model
+	 * \param flags of every model, model_drawn or 0
+	 * \param count_from_buffer draw with glMultiDrawElementsIndirectCount, else every slot is drawn and empty ones draw nothing
+	 */
+	void build(const std::vector<sub_mesh>& meshes, uint32_t wide_index_base, const std::vector<uint32_t>& model_meshes,
+		const std::vector<bounding_box>& bounds, const std::vector<glm::mat4>& matrices, const std::vector<uint32_t>& flags, bool count_from_buffer);
+
+	bool is_built() const { return model_count_ > 0; }
+
+	/// @brief writes the bounds and the matrix of a model that moved
+	void update_model(uint32_t model, const bounding_box& bounds, const glm::mat4& matrix) const;
+
+	/// @brief writes the flags of a model that got activated or deactivated
+	void set_flags(uint32_t model, uint32_t flags) const;
+
+	/// @brief binds the model matrices to binding 4, instead of the matrices of the render queue
+	void bind_matrices() const;
+
+	/**
+	 * \brief culls all models, picks their LODs and fills the commands and instances of a pass
+	 * \param p pass, its LODs of the last cull are the start of the hysteresis
+	 * \param v frustum and LOD parameters
+	 */
+	void cull(pass p, const view& v);
+
+	/// @brief draws the commands of the last cull of a pass, the vao and the program have to be bound
+	void draw(pass p) const;
+
+	/// @brief number of models with an instance after the last cull of a pass, stalls until the GPU is done
+	uint32_t read_visible(pass p) const;
+
+	/**
+	 * \brief reads the result of the last cull of a pass back, stalls until the GPU is done, for the tools
+	 * \param visible receives one bit per model, set if the model has an instance
+	 * \param lods receives the LOD of every model
+	 * \return number of commands the pass draws, or -1 if a model has two instances or one in a slot of another mesh or LOD
+	 */
+	int64_t read_results(pass p, std::vector<uint32_t>& visible, std::vector<uint8_t>& lods) const;
+
+	uint32_t get_slot_count() const { return slot_count_; }
+
+private:
+	/// @brief a model as the cull pass reads it, std430 layout
+	struct cull_model
+	{
+		glm::vec4 min;				// world bounds, w unused
+		glm::vec4 max;
+		uint32_t mesh;
+		uint32_t flags;
+		uint32_t padding[2];
+	};
+
+	/// @brief LODs and material of a mesh, std430 layout
+	struct cull_mesh
+	{
+		uint32_t first_slot;		// slot and LOD error of LOD 0, the other LODs follow
+		uint32_t lod_count;
+		uint32_t material;
+		uint32_t padding;
+	};
+
+	/// @brief written by the GPU every cull of a pass
+	struct pass_buffers
+	{
+		buffer slots{ GL_SHADER_STORAGE_BUFFER };		// copy of the slot templates, the cull pass counts the instances
+		buffer commands{ GL_SHADER_STORAGE_BUFFER };	// compacted slots, 16 bit from the start and 32 bit from short_slots_ on
+		buffer counts{ GL_SHADER_STORAGE_BUFFER };		// 16 bit and 32 bit draw counts and the visible models
+		buffer instances{ GL_SHADER_STORAGE_BUFFER };
+	};
+
+	std::unique_ptr<program> cull_program_;
+	std::unique_ptr<program> compact_program_;
+
+	buffer models_{ GL_SHADER_STORAGE_BUFFER };
+	buffer meshes_{ GL_SHADER_STORAGE_BUFFER };
+	buffer lod_errors_{ GL_SHADER_STORAGE_BUFFER };	// one per slot
+	buffer lods_{ GL_SHADER_STORAGE_BUFFER };		// LOD of every model, of the main and then of the shadow pass
+	buffer matrices_{ GL_SHADER_STORAGE_BUFFER };
+	buffer slot_templates_{ GL_COPY_READ_BUFFER };	// the command of every slot without instances
+	pass_buffers passes_[pass_count];
+
+	uint32_t model_count_ = 0;
+	uint32_t slot_count_ = 0;
+	uint32_t short_slots_ = 0;						// slots of the meshes with 16 bit indices, they come first
+	uint32_t instance_count_ = 0;					// instances of all slots
+	bool count_from_buffer_ = false;
+
+	// to check the results read back
+	std::vector<uint32_t> model_meshes_;
+	std::vector<uint32_t> slot_meshes_;
+	std::vector<uint32_t> first_slots_;
+};
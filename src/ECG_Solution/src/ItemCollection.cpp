@@ -3,8 +3,8 @@
 void item_collection::collect(Physics::PhysicsObject* object)
 {
 	collectedItems.push_back(object);
-	game_properties* item_properties = &object->modelGraphics->game_properties;
-	item_properties->is_active = false;
+	object->modelGraphics.set_active(false);
+	const game_properties* item_properties = &object->modelGraphics.get_properties();
 	total_monetary_value_ += item_properties->collectableItemProperties.worth;
 	total_weight_ += item_properties->collectableItemProperties.weight;
 }
@@ -25,8 +25,9 @@ std::vector<item_collection::item_info> item_collection::get_list_of_items() con
 	for (const auto collected_item : collectedItems)
 	{
 		item_info item;
-		item.name = collected_item->modelGraphics->game_properties.display_name;
-		item.price = std::to_string(collected_item->modelGraphics->game_properties.collectableItemProperties.worth);
+		const game_properties& properties = collected_item->modelGraphics.get_properties();
+		item.name = properties.display_name;
+		item.price = std::to_string(properties.collectableItemProperties.worth);
 		itemList.push_back(item);
 	}
 	return itemList;
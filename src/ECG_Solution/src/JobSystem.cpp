@@ -0,0 +1,94 @@
+#include "JobSystem.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+job_system::job_system(const unsigned threads)
+{
+	workers_.reserve(threads);
+	for (unsigned i = 0; i < threads; i++)
+		workers_.emplace_back(&job_system::work, this);
+}
+
+job_system::~job_system()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	wake_.notify_all();
+	for (auto& worker : workers_)
+		worker.join();
+}
+
+job_system& job_system::instance()
+{
+	static job_system pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+void job_system::work()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [this] { return quit_ || !jobs_.empty(); });
+			if (jobs_.empty())
+				return;
+			job = std::move(jobs_.front());
+			jobs_.pop();
+		}
+		job();
+	}
+}
+
+void job_system::submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push(std::move(job));
+	}
+	wake_.notify_one();
+}
+
+void job_system::parallel_for(const size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0)
+		return;
+
+	// every participating thread takes the next free index until all are taken
+	struct batch
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> finished{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	const auto b = std::make_shared<batch>();
+	const size_t total = count;
+
+	const auto run = [b, total, &job]
+	{
+		size_t i;
+		while ((i = b->next.fetch_add(1)) < total)
+		{
+			job(i);
+			if (b->finished.fetch_add(1) + 1 == total)
+			{
+				std::lock_guard<std::mutex> lock(b->mutex);
+				b->done.notify_all();
+			}
+		}
+	};
+
+	const size_t helpers = std::min(static_cast<size_t>(workers_.size()), count - 1);
+	for (size_t i = 0; i < helpers; i++)
+		submit(run);
+	run();
+
+	// helpers that start after all indices are taken return immediately and never touch job
+	std::unique_lock<std::mutex> lock(b->mutex);
+	b->done.wait(lock, [&b, total] { return b->finished.load() == total; });
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/// @brief a pool of persistent worker threads that execute independent jobs
+/// the threads are created once and sleep while there is nothing to do
+class job_system
+{
+private:
+	std::vector<std::thread> workers_;
+	std::queue<std::function<void()>> jobs_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool quit_ = false;
+
+	void work();
+
+public:
+	/**
+	 * \brief starts the worker threads
+	 * \param threads number of workers, the thread that submits jobs is not counted
+	 */
+	explicit job_system(unsigned threads);
+	~job_system();
+
+	/**
+	 * \brief the pool shared by the whole game, uses one worker per core besides the calling thread, but at least one
+	 */
+	static job_system& instance();
+
+	/**
+	 * \brief queues a job, it runs on the next free worker
+	 * \param job the function to execute
+	 */
+	void submit(std::function<void()> job);
+
+	/**
+	 * \brief runs job(i) for every i in [0, count) and returns once all calls are finished
+	 * the calling thread works on the jobs too, so nested calls from inside a job can't deadlock
+	 * \param count number of jobs
+	 * \param job function to call with the index of the job
+	 */
+	void parallel_for(size_t count, const std::function<void(size_t)>& job);
+
+	unsigned get_thread_count() const { return static_cast<unsigned>(workers_.size()); }
+
+	// ensure RAII compliance
+	job_system(const job_system&) = delete;
+	job_system& operator=(const job_system&) = delete;
+};
@@ -0,0 +1,276 @@
+#include "Ktx2.h"
+#include <zstd/zstd.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <cstring>
+
+namespace
+{
+	const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// supercompression schemes, BasisLZ and zlib are not supported
+	constexpr uint32_t no_supercompression = 0;
+	constexpr uint32_t zstd_supercompression = 2;
+
+	struct file_header
+	{
+		uint8_t identifier[12];
+		uint32_t vk_format;
+		uint32_t type_size;
+		uint32_t pixel_width;
+		uint32_t pixel_height;
+		uint32_t pixel_depth;
+		uint32_t layer_count;
+		uint32_t face_count;
+		uint32_t level_count;
+		uint32_t supercompression_scheme;
+		uint32_t dfd_offset;
+		uint32_t dfd_length;
+		uint32_t kvd_offset;
+		uint32_t kvd_length;
+		uint64_t sgd_offset;
+		uint64_t sgd_length;
+	};
+	static_assert(sizeof(file_header) == 80, "ktx2 header must match the file layout");
+
+	struct level_index
+	{
+		uint64_t offset;
+		uint64_t length;
+		uint64_t uncompressed_length;
+	};
+	static_assert(sizeof(level_index) == 24, "ktx2 level index must match the file layout");
+
+	/// @brief VkFormat values of the formats the material textures use
+	struct format_pair
+	{
+		uint32_t vk_format;
+		gli::format format;
+	};
+
+	const format_pair formats[] = {
+		{ 9, gli::FORMAT_R8_UNORM_PACK8 },
+		{ 16, gli::FORMAT_RG8_UNORM_PACK8 },
+		{ 23, gli::FORMAT_RGB8_UNORM_PACK8 },
+		{ 29, gli::FORMAT_RGB8_SRGB_PACK8 },
+		{ 37, gli::FORMAT_RGBA8_UNORM_PACK8 },
+		{ 43, gli::FORMAT_RGBA8_SRGB_PACK8 },
+		{ 84, gli::FORMAT_RGB16_UNORM_PACK16 },
+		{ 91, gli::FORMAT_RGBA16_UNORM_PACK16 },
+		{ 131, gli::FORMAT_RGB_DXT1_UNORM_BLOCK8 },
+		{ 132, gli::FORMAT_RGB_DXT1_SRGB_BLOCK8 },
+		{ 139, gli::FORMAT_R_ATI1N_UNORM_BLOCK8 },
+		{ 141, gli::FORMAT_RG_ATI2N_UNORM_BLOCK16 },
+	};
+
+	uint32_t vk_format_of(const gli::format format)
+	{
+		for (const auto& f : formats)
+			if (f.format == format)
+				return f.vk_format;
+		return 0;
+	}
+
+	gli::format format_of(const uint32_t vk_format)
+	{
+		for (const auto& f : formats)
+			if (f.vk_format == vk_format)
+				return f.format;
+		return gli::FORMAT_UNDEFINED;
+	}
+
+	/// @brief basic data format descriptor of a format, required by the spec even though the vk format says the same
+	/// the bytes of a plane are unknown if the levels are supercompressed
+	std::vector<uint32_t> data_format_descriptor(const gli::format format, const bool supercompressed)
+	{
+		const bool compressed = gli::is_compressed(format);
+		const bool bc5 = format == gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+		const uint32_t samples = compressed && !bc5 ? 1 : static_cast<uint32_t>(gli::component_count(format));
+		const auto block_size = static_cast<uint32_t>(gli::block_size(format));
+		const bool srgb = gli::is_srgb(format);
+		const uint32_t block_length = 24 + 16 * samples;
+
+		// color models rgbsda, bc1a, bc4 and bc5, primaries bt709, transfer linear or srgb
+		const uint32_t model = !compressed ? 1 : bc5 ? 132 : format == gli::FORMAT_R_ATI1N_UNORM_BLOCK8 ? 131 : 128;
+		std::vector<uint32_t> dfd = {
+			4 + block_length,
+			0,
+			2 | block_length << 16,
+			model | 1 << 8 | (srgb ? 2u : 1u) << 16,
+			compressed ? 3u | 3u << 8 : 0u,
+			supercompressed ? 0u : block_size,
+			0 };
+
+		if (compressed)
+		{
+			// a single sample covers the whole 64 bit block, BC5 has a 64 bit sample of red and one of green
+			for (uint32_t c = 0; c < samples; c++)
+				dfd.insert(dfd.end(), { c * 64 | 63 << 16 | c << 24, 0, 0, 0xFFFFFFFF });
+			return dfd;
+		}
+
+		const uint32_t bits = block_size * 8 / samples;
+		for (uint32_t c = 0; c < samples; c++)
+		{
+			// channels r, g, b and alpha, alpha is linear even in srgb formats
+			const uint32_t channel = c < 3 ? c : 15 | (srgb ? 0x10 : 0);
+			dfd.insert(dfd.end(), { c * bits | (bits - 1) << 16 | channel << 24, 0, 0, (1u << bits) - 1 });
+		}
+		return dfd;
+	}
+
+	/// @brief level data has to start at a multiple of the texel block size and of 4, supercompressed levels anywhere
+	uint64_t level_alignment(const gli::format format, const bool supercompressed)
+	{
+		if (supercompressed)
+			return 1;
+		uint64_t alignment = gli::block_size(format);
+		while (alignment % 4 != 0)
+			alignment += gli::block_size(format);
+		return alignment;
+	}
+}
+
+bool ktx2::is_supported(const gli::format format)
+{
+	return vk_format_of(format) != 0;
+}
+
+gli::texture ktx2::load(const std::string& path)
+{
+	// a missing file is not an error, the caller falls back to ktx
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return gli::texture();
+	const auto size = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	file_header header;
+	if (size < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.identifier, identifier, sizeof(identifier)) != 0)
+	{
+		std::cout << path << " is not a ktx2 file" << std::endl;
+		return gli::texture();
+	}
+
+	if (header.supercompression_scheme != no_supercompression && header.supercompression_scheme != zstd_supercompression)
+	{
+		std::cout << path << " uses supercompression scheme " << header.supercompression_scheme << ", only Zstd is supported" << std::endl;
+		return gli::texture();
+	}
+
+	const gli::format format = format_of(header.vk_format);
+	if (format == gli::FORMAT_UNDEFINED || header.face_count != 1 || header.layer_count > 1 || header.pixel_depth > 1 || header.pixel_height == 0)
+	{
+		std::cout << path << " is not a 2d texture in a supported format" << std::endl;
+		return gli::texture();
+	}
+
+	// a level count of 0 asks the loader to generate the mip chain
+	const uint32_t levels = std::max(header.level_count, 1u);
+	std::vector<level_index> index(levels);
+	if (!file.read(reinterpret_cast<char*>(index.data()), levels * sizeof(level_index)))
+	{
+		std::cout << path << " is truncated" << std::endl;
+		return gli::texture();
+	}
+
+	// levels are read straight into the texture storage, supercompressed ones into a buffer and inflated from there
+	const bool supercompressed = header.supercompression_scheme == zstd_supercompression;
+	const std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> context(supercompressed ? ZSTD_createDCtx() : nullptr, ZSTD_freeDCtx);
+	std::vector<char> packed;
+	gli::texture2d image(format, gli::extent2d(header.pixel_width, header.pixel_height), levels);
+	for (uint32_t level = 0; level < levels; level++)
+	{
+		const level_index& l = index[level];
+		char* data = static_cast<char*>(image.data(0, 0, level));
+		if (supercompressed)
+			packed.resize(l.length);
+		if (l.uncompressed_length != image.size(level) || (!supercompressed && l.length != image.size(level)) || l.offset + l.length > size
+			|| !file.seekg(static_cast<std::streamoff>(l.offset))
+			|| !file.read(supercompressed ? packed.data() : data, static_cast<std::streamsize>(l.length))
+			|| (supercompressed && ZSTD_decompressDCtx(context.get(), data, image.size(level), packed.data(), packed.size()) != image.size(level)))
+		{
+			std::cout << path << " has a broken level " << level << std::endl;
+			return gli::texture();
+		}
+	}
+	return image;
+}
+
+bool ktx2::save(const std::string& path, const gli::texture& image, const int zstd)
+{
+	const uint32_t vk_format = vk_format_of(image.format());
+	if (image.empty() || image.target() != gli::TARGET_2D || vk_format == 0)
+		return false;
+
+	const auto levels = static_cast<uint32_t>(image.levels());
+	const bool supercompressed = zstd > 0;
+	const std::vector<uint32_t> dfd = data_format_descriptor(image.format(), supercompressed);
+	const glm::ivec3 extent = image.extent(0);
+
+	file_header header = {};
+	memcpy(header.identifier, identifier, sizeof(identifier));
+	header.vk_format = vk_format;
+	header.type_size = gli::is_compressed(image.format()) ? 1 : static_cast<uint32_t>(gli::block_size(image.format()) / gli::component_count(image.format()));
+	header.pixel_width = extent.x;
+	header.pixel_height = extent.y;
+	header.face_count = 1;
+	header.level_count = levels;
+	header.supercompression_scheme = supercompressed ? zstd_supercompression : no_supercompression;
+	header.dfd_offset = static_cast<uint32_t>(sizeof(header) + levels * sizeof(level_index));
+	header.dfd_length = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	// every level gets supercompressed on its own, a reader can inflate the ones it needs. the frames carry a checksum,
+	// so a damaged file fails to load instead of showing garbage
+	std::vector<std::vector<char>> packed(supercompressed ? levels : 0);
+	const std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> context(supercompressed ? ZSTD_createCCtx() : nullptr, ZSTD_freeCCtx);
+	if (supercompressed)
+	{
+		ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, zstd);
+		ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, 1);
+	}
+	for (uint32_t level = 0; level < packed.size(); level++)
+	{
+		packed[level].resize(ZSTD_compressBound(image.size(level)));
+		const size_t length = ZSTD_compress2(context.get(), packed[level].data(), packed[level].size(), image.data(0, 0, level), image.size(level));
+		if (ZSTD_isError(length))
+		{
+			std::cout << "could not supercompress " << path << ": " << ZSTD_getErrorName(length) << std::endl;
+			return false;
+		}
+		packed[level].resize(length);
+	}
+
+	// the spec recommends the smallest level first, so a streaming reader gets a complete low resolution image early
+	std::vector<level_index> index(levels);
+	const uint64_t alignment = level_alignment(image.format(), supercompressed);
+	uint64_t offset = header.dfd_offset + header.dfd_length;
+	for (uint32_t level = levels; level-- > 0;)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		const uint64_t length = supercompressed ? packed[level].size() : image.size(level);
+		index[level] = { offset, length, image.size(level) };
+		offset += length;
+	}
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "could not write " << path << std::endl;
+		return false;
+	}
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(level_index));
+	out.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+
+	const char padding[16] = {};
+	uint64_t written = header.dfd_offset + header.dfd_length;
+	for (uint32_t level = levels; level-- > 0;)
+	{
+		out.write(padding, static_cast<std::streamsize>(index[level].offset - written));
+		out.write(supercompressed ? packed[level].data() : static_cast<const char*>(image.data(0, 0, level)), static_cast<std::streamsize>(index[level].length));
+		written = index[level].offset + index[level].length;
+	}
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <gli/gli.hpp>
+#include <string>
+
+/// @brief reads and writes 2d textures in the KTX2 container
+/// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+/// the file stores its complete mip chain, so nothing gets generated at load time.
+/// levels can be supercompressed with Zstd, which load inflates on the calling thread. BasisLZ files are not supported
+class ktx2
+{
+public:
+	static constexpr int zstd_level = 19;	// of the bakes, inflating costs the same for every level
+	/**
+	 * \brief loads a ktx2 file
+	 * \param path location of the file
+	 * \return the texture with all levels of the file, an empty texture if it doesn't exist or isn't supported
+	 */
+	static gli::texture load(const std::string& path);
+
+	/**
+	 * \brief writes all levels of a texture into a ktx2 file
+	 * \param path location of the file
+	 * \param image 2d texture in a format that load supports
+	 * \param zstd Zstd level every mip level gets supercompressed with, 0 stores them as they are
+	 * \return false if the format isn't supported or the file can't be written
+	 */
+	static bool save(const std::string& path, const gli::texture& image, int zstd);
+
+	/**
+	 * \brief checks if a texture format can be stored in a ktx2 file
+	 */
+	static bool is_supported(gli::format format);
+};
@@ -1,46 +1,75 @@
 #include "Level.h"
 #include "Program.h"
+#include "JobSystem.h"
+#include "VertexQuantizer.h"
+#include "MeshletCuller.h"
+#include "MeshAnalyzer.h"
+#include "TextureLoader.h"
+#include "TextureRegistry.h"
 #include <meshoptimizer/meshoptimizer.h>
 #include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <random>
 #include <thread>
 #include <optick/optick.h>
 
+bool level::indirect_count_supported = false;
+
 level::level(const char* scene_path, const std::shared_ptr<global_state> state, PerFrameData& perframe_data)
-: state_(state), perframe_data_(&perframe_data)
+: scene_path_(scene_path), state_(state), perframe_data_(&perframe_data)
 {
-	std::cout << "import scene from fbx file..." << std::endl;
-	OPTICK_PUSH("parse fbx file")
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(scene_path,
-	                                         aiProcess_RemoveRedundantMaterials |
-	                                         aiProcess_FindInvalidData |
-	                                         aiProcess_FlipUVs |
-	                                         aiProcess_ValidateDataStructure | 
-	                                         0);
+	const aiScene* scene = nullptr;
+	std::thread mesh, light;
 
-	if (!&scene){
-		std::cerr << "ERROR: Couldn't load scene" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	OPTICK_POP()
+	const bool baked = load_bake();
+	if (!baked)
+	{
+		std::cout << "import scene from fbx file..." << std::endl;
+		OPTICK_PUSH("parse fbx file")
+		scene = importer.ReadFile(scene_path,
+		                          aiProcess_RemoveRedundantMaterials |
+		                          aiProcess_FindInvalidData |
+		                          aiProcess_FlipUVs |
+		                          aiProcess_ValidateDataStructure | 
+		                          0);
+
+		if (!scene){
+			std::cerr << "ERROR: Couldn't load scene" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		OPTICK_POP()
 
-	OPTICK_PUSH("load meshes")
-	std::thread mesh(&level::load_meshes, this, std::ref(scene));
-	std::thread light(&level::load_lights, this, std::ref(scene));
+		load_material_paths(scene);
+		mesh = std::thread(&level::load_meshes, this, scene);
+		light = std::thread(&level::load_lights, this, scene);
+	}
 
 	OPTICK_PUSH("load materials")
-	load_materials(scene);
+	load_materials();
 	OPTICK_POP()
 
-	// build scene graph and calculate AABBs
-	std::cout << "build scene hierarchy..." << std::endl;
-	mesh.join();
-	OPTICK_POP()
+	if (!baked)
+	{
+		// build scene graph and calculate AABBs
+		std::cout << "build scene hierarchy..." << std::endl;
+		OPTICK_PUSH("load meshes")
+		mesh.join();
+		light.join();
+		OPTICK_POP()
+		traverse_tree(scene->mRootNode, glm::mat4(1), lava);
+		collect_cells(scene);
+		save_bake();
+	}
+
 	OPTICK_PUSH("build scene graph")
-	traverse_tree(scene->mRootNode, glm::mat4(1), lava);
 	transform_bounding_boxes();
 	get_scene_bounds();
 	collect_physic_meshes();
+	collect_occluders();
+	link_cells();
 	build_render_queue();
 	assert(queue_scene_.commands.size() == scene_.size());
 	OPTICK_POP()
@@ -50,35 +79,254 @@ level::level(const char* scene_path, const std::shared_ptr<global_state> state,
 	OPTICK_POP()
 
 	// finalize
-	light.join();
 	load_shaders();
 
 	std::cout << std::endl; // debug breakpoint
 }
 
+level::level(const char* scene_path, const bool use_bake)
+: scene_path_(scene_path), state_(std::make_shared<global_state>())
+{
+	if (!use_bake || !load_bake())
+	{
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(scene_path,
+		                                         aiProcess_RemoveRedundantMaterials |
+		                                         aiProcess_FindInvalidData |
+		                                         aiProcess_FlipUVs |
+		                                         aiProcess_ValidateDataStructure |
+		                                         0);
+		if (!scene)
+		{
+			std::cerr << "ERROR: Couldn't load scene " << scene_path << std::endl;
+			return;
+		}
+
+		load_material_paths(scene);
+		load_meshes(scene);
+		load_lights(scene);
+		traverse_tree(scene->mRootNode, glm::mat4(1), lava);
+		collect_cells(scene);
+	}
+
+	transform_bounding_boxes();
+	get_scene_bounds();
+	collect_occluders();
+	link_cells();
+}
+
+level_data level::get_level_data()
+{
+	return level_data{ &meshes_, &vertices, &indices_, &short_indices_, &meshlets_, &material_paths_, &material_names_, &lights_, &scene_, &lava_, &lava_material_, &cells_, &portals_ };
+}
+
+bool level::load_bake()
+{
+	const std::string bake_path = level_cache::bake_path_of(scene_path_.c_str());
+	if (level_cache::is_stale(bake_path.c_str(), scene_path_.c_str()))
+		return false;
+
+	std::cout << "load baked level..." << std::endl;
+	OPTICK_PUSH("load bake")
+	const level_data data = get_level_data();
+	const bool loaded = level_cache::read(bake_path.c_str(), data);
+	OPTICK_POP()
+
+	if (!loaded)
+	{
+		std::cerr << "ERROR: Couldn't read level bake " << bake_path << ", falling back to fbx" << std::endl;
+		return false;
+	}
+
+	global_vertex_offset_ = static_cast<uint32_t>(vertices.size() / 8);
+	global_index_offset_ = static_cast<uint32_t>(indices_.size());
+	global_short_index_offset_ = static_cast<uint32_t>(short_indices_.size());
+	frustum_culler::models_loaded = meshes_.size();
+	return true;
+}
+
+void level::print_index_memory() const
+{
+	const size_t short_meshes = std::count_if(meshes_.begin(), meshes_.end(), [](const sub_mesh& m) { return m.short_indices; });
+	const size_t bytes = short_indices_.size() * sizeof(uint16_t) + indices_.size() * sizeof(uint32_t);
+	const size_t wide_bytes = (short_indices_.size() + indices_.size()) * sizeof(uint32_t);
+	printf("indices: %u meshes 16 bit (%u indices), %u meshes 32 bit (%u indices), %.2f MB instead of %.2f MB, saved %.2f MB\n",
+		static_cast<unsigned>(short_meshes), static_cast<unsigned>(short_indices_.size()),
+		static_cast<unsigned>(meshes_.size() - short_meshes), static_cast<unsigned>(indices_.size()),
+		static_cast<double>(bytes) / (1024.0 * 1024.0), static_cast<double>(wide_bytes) / (1024.0 * 1024.0),
+		static_cast<double>(wide_bytes - bytes) / (1024.0 * 1024.0));
+}
+
+void level::build_benchmark_queue(const size_t count)
+{
+	const entity_table originals = scene_;
+	if (originals.empty())
+		return;
+
+	// copies of the level on a square grid, with a small gap between them
+	const glm::vec3 step = (scene_bounds_.max_ - scene_bounds_.min_) * 1.1f;
+	const size_t copies = (count + originals.size() - 1) / originals.size();
+	const auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(copies))));
+
+	// the frame settings that cost the most
+	state_->cull = true;
+	state_->use_lod = true;
+
+	scene_.clear();
+	scene_.reserve(count);
+	queue_scene_ = render_queue();
+	wide_index_base_ = static_cast<uint32_t>((short_indices_.size() + 1) / 2);
+	for (size_t i = 0; i < count; i++)
+	{
+		const size_t copy = i / originals.size();
+		const glm::vec3 offset(step.x * static_cast<float>(copy % side), 0.0f, step.z * static_cast<float>(copy / side));
+		const uint32_t e = scene_.add_copy(originals, static_cast<uint32_t>(i % originals.size()));
+		scene_.world_bounds[e] = bounding_box(scene_.world_bounds[e].min_ + offset, scene_.world_bounds[e].max_ + offset);
+
+		const sub_mesh& mesh = meshes_[scene_.render[e].mesh_index];
+		queue_scene_.commands.push_back(draw_elements_indirect_command{
+			mesh.index_count[0],
+			scene_.render[e].is_active ? 1u : 0u,
+			get_first_index(mesh, 0),
+			mesh.vertex_offset,
+			0 });
+		queue_scene_.model_matrices.push_back(scene_.get_node_matrix(e));
+		queue_scene_.entities.push_back(e);
+	}
+	build_queue_bounds();
+}
+
+uint32_t level::update_benchmark_queue(const size_t chunks)
+{
+	// a frame gives the commands their instance back in the shadow pass, the main pass only culls them, grouping clears them
+	for (size_t i = 0; i < queue_scene_.commands.size(); i++)
+		queue_scene_.commands[i].instanceCount_ = scene_.render[queue_scene_.entities[i]].is_active ? 1 : 0;
+	return update_render_queue(false, chunks);
+}
+
+void level::build_synthetic_scene(const size_t count)
+{
+	// 64 meshes with 8 LODs whose error doubles from one to the next, every third one with 32 bit indices
+	constexpr uint32_t mesh_count = 64;
+	constexpr uint32_t lods = 8;
+	meshes_.assign(mesh_count, sub_mesh());
+	uint32_t offsets[2] = {};
+	for (uint32_t m = 0; m < mesh_count; m++)
+	{
+		sub_mesh& mesh = meshes_[m];
+		mesh.name = "Synthetic." + std::to_string(m);
+		mesh.short_indices = m % 3 != 0;
+		for (uint32_t lod = 0; lod < lods; lod++)
+		{
+			mesh.index_count.push_back(3072u >> lod);
+			mesh.index_offset.push_back(offsets[mesh.short_indices]);
+			offsets[mesh.short_indices] += 3072u >> lod;
+			mesh.lod_error.push_back(lod == 0 ? 0.0f : 0.005f * static_cast<float>(1 << lod));
+		}
+	}
+
+	// boxes of 1 to 9 units in a square world that grows with the count, every 10th entity moves, every 50th is inactive
+	std::mt19937 rng(14);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const float size = std::sqrt(static_cast<float>(count)) * 10.0f;
+	scene_.clear();
+	scene_.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec3 center((unit(rng) - 0.5f) * size, unit(rng) * 20.0f, (unit(rng) - 0.5f) * size);
+		const glm::vec3 extent = glm::vec3(0.5f) + glm::vec3(unit(rng), unit(rng), unit(rng)) * 4.0f;
+		const bounding_box box(center - extent, center + extent);
+		transformation trs{};
+		trs.local = glm::mat4(1.0f);
+		const uint32_t e = scene_.add("Synthetic." + std::to_string(i), i % 10 == 0 ? dynamic : rigid, static_cast<int32_t>(rng() % mesh_count), trs, box);
+		scene_.world_bounds[e] = box;
+		scene_.render[e].is_active = i % 50 != 0;
+	}
+	get_scene_bounds();
+}
+
+bool level::save_bake()
+{
+	const std::string bake_path = level_cache::bake_path_of(scene_path_.c_str());
+	std::cout << "bake level to " << bake_path << "..." << std::endl;
+	return level_cache::write(bake_path.c_str(), scene_path_.c_str(), get_level_data());
+}
+
 void level::load_meshes(const aiScene* scene)
 {
+	std::cout << "loading meshes..." << std::endl;
+	std::vector<extracted_mesh> results(scene->mNumMeshes);
+	job_system::instance().parallel_for(scene->mNumMeshes, [this, scene, &results](const size_t i)
+	{
+		extract_mesh(scene->mMeshes[i], results[i]);
+	});
+
+	// prefix sum over the mesh sizes gives every mesh its place in the global buffers
+	size_t vertex_floats = 0, index_count = 0, short_index_count = 0, meshlet_count = 0;
+	for (const auto& result : results)
+	{
+		vertex_floats += result.vertices.size();
+		meshlet_count += result.meshlets.size();
+		for (const auto& lod : result.lods)
+			(result.mesh.vertex_count <= short_index_limit ? short_index_count : index_count) += lod.size();
+	}
+
+	meshes_.clear();
+	meshes_.reserve(results.size());
+	vertices.clear();
+	vertices.reserve(vertex_floats);
+	indices_.clear();
+	indices_.reserve(index_count);
+	short_indices_.clear();
+	short_indices_.reserve(short_index_count);
+	meshlets_.clear();
+	meshlets_.reserve(meshlet_count);
+
 	global_vertex_offset_ = 0;
 	global_index_offset_ = 0;
+	global_short_index_offset_ = 0;
+	for (auto& result : results)
+	{
+		sub_mesh& m = result.mesh;
+		m.vertex_offset = global_vertex_offset_;
+		// indices are relative to the mesh, so every mesh that fits gets half sized indices
+		m.short_indices = m.vertex_count <= short_index_limit;
+		uint32_t& index_offset = m.short_indices ? global_short_index_offset_ : global_index_offset_;
+		vertices.insert(vertices.end(), result.vertices.begin(), result.vertices.end());
+
+		uint32_t first_meshlet = 0;
+		for (size_t j = 0; j < result.lods.size(); j++)
+		{
+			const auto& lod = result.lods[j];
+			m.meshlet_offset.push_back(static_cast<uint32_t>(meshlets_.size()));
+			for (uint32_t k = 0; k < m.meshlet_count[j]; k++)
+			{
+				meshlet ml = result.meshlets[first_meshlet + k];
+				ml.first_index += index_offset;
+				meshlets_.push_back(ml);
+			}
+			first_meshlet += m.meshlet_count[j];
 
-	meshes_.reserve(scene->mNumMeshes);
+			m.index_count.push_back(lod.size());
+			m.index_offset.push_back(index_offset);
+			index_offset += lod.size();
+			if (m.short_indices)
+				std::transform(lod.begin(), lod.end(), std::back_inserter(short_indices_), [](const unsigned int i) { return static_cast<uint16_t>(i); });
+			else
+				indices_.insert(indices_.end(), lod.begin(), lod.end());
+		}
 
-	std::cout << "loading meshes..." << std::endl;
-	for (size_t i = 0; i < scene->mNumMeshes; i++)
-	{
-		const aiMesh* mesh = scene->mMeshes[i];
-		meshes_.push_back(extract_mesh(mesh));
+		global_vertex_offset_ += m.vertex_count;
+		meshes_.push_back(std::move(m));
 	}
 	frustum_culler::models_loaded = meshes_.size();
 }
 
-sub_mesh level::extract_mesh(const aiMesh* mesh)
+void level::extract_mesh(const aiMesh* mesh, extracted_mesh& result) const
 {
-
-	printf("Mesh [%s] %u\n", mesh->mName.C_Str(), meshes_.size() + 1);
-	sub_mesh m;
+	printf("Mesh [%s]\n", mesh->mName.C_Str());
+	sub_mesh& m = result.mesh;
 	m.name = mesh->mName.C_Str();
-	m.vertex_offset = global_vertex_offset_;
 	m.material_index = mesh->mMaterialIndex;
 			
 	std::vector<vertex> raw_vertices;
@@ -128,7 +376,8 @@ sub_mesh level::extract_mesh(const aiMesh* mesh)
 
 	m.vertex_count = opt_vertices.size();
 
-	std::vector<float> result_vertices;
+	std::vector<float>& result_vertices = result.vertices;
+	result_vertices.reserve(opt_vertices.size() * 8);
 	for (const auto& vertex : opt_vertices)
 	{
 		result_vertices.push_back(vertex.px); result_vertices.push_back(vertex.py); result_vertices.push_back(vertex.pz);
@@ -136,26 +385,37 @@ sub_mesh level::extract_mesh(const aiMesh* mesh)
 		result_vertices.push_back(vertex.tx); result_vertices.push_back(vertex.ty);
 	}
 
-	std::vector<std::vector<unsigned int>> LODs;
-	generate_lods(opt_indices, result_vertices, LODs);
-
-	vertices.insert(vertices.end(), result_vertices.begin(), result_vertices.end());
+	// pbr.vert displaces every vertex of the lava, its flat mesh would simplify to a few triangles without any error
+	if (static_cast<int32_t>(m.material_index) == lava_material_)
+		result.lods.push_back(opt_indices);
+	else
+		generate_lods(opt_indices, result_vertices, result.lods);
 
-	auto index_sum = 0;
-	for (auto& LOD : LODs)
+	// geometric error of every LOD in model units, the LOD choice projects it onto the screen
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const auto& vertex : opt_vertices)
+	{
+		vmin = glm::min(vmin, glm::vec3(vertex.px, vertex.py, vertex.pz));
+		vmax = glm::max(vmax, glm::vec3(vertex.px, vertex.py, vertex.pz));
+	}
+	const float diagonal = opt_vertices.empty() ? 0.0f : glm::length(vmax - vmin);
+	m.lod_error.push_back(0.0f);
+	for (size_t l = 1; l < result.lods.size(); l++)
 	{
-		m.index_count.push_back(LOD.size());
-		m.index_offset.push_back(global_index_offset_ + index_sum);
-		index_sum += LOD.size();
-		indices_.insert(indices_.end(), LOD.begin(), LOD.end());
+		const float error = mesh_analyzer::simplification_error(result_vertices.data(), m.vertex_count, result.lods[0], result.lods[l]) * diagonal;
+		m.lod_error.push_back(std::max(m.lod_error.back(), error));
 	}
 
-	global_vertex_offset_ += m.vertex_count;
-	global_index_offset_ += index_sum;
-	return m;
+	// split every LOD into meshlets, this only changes the order of the triangles
+	for (auto& lod : result.lods)
+	{
+		const size_t first = result.meshlets.size();
+		meshlet_culler::build_meshlets(lod, result_vertices, result.meshlets);
+		m.meshlet_count.push_back(static_cast<uint32_t>(result.meshlets.size() - first));
+	}
 }
 
-void level::generate_lods(std::vector<unsigned int>& indices,const std::vector<float>& vertices, std::vector<std::vector<unsigned int>>& LODs)
+void level::generate_lods(std::vector<unsigned int>& indices,const std::vector<float>& vertices, std::vector<std::vector<unsigned int>>& LODs) const
 {
 	const size_t vertices_count_in = vertices.size() / 8;
 	size_t target_indices_count = indices.size();
@@ -233,75 +493,86 @@ bounding_box level::compute_bounds_of_mesh(const sub_mesh& mesh) const
 	return {vmin, vmax };
 }
 
-void level::transform_bounding_boxes() const
+void level::transform_bounding_boxes()
 {
-	for (const entity& entity : scene_)
-	{
-		glm::mat4 M = entity.get_node_matrix();
-		bounding_box bounds = entity.model_bounds;
-		bounds = corrected_bounds_transform(M, bounds);
-		entity.world_bounds = bounding_box(bounds.min_, bounds.max_); 
-	}
+	std::vector<glm::mat4> matrices(scene_.size());
+	for (size_t i = 0; i < scene_.size(); i++)
+		matrices[i] = scene_.transforms[i].get_matrix();
+	frustum_culler::transform_boxes(matrices.data(), scene_.model_bounds.data(), scene_.world_bounds.data(), scene_.size());
+	std::fill(scene_.bounds_dirty.begin(), scene_.bounds_dirty.end(), 0);
 }
 
 void level::get_scene_bounds()
 {
 	glm::vec3 vmin(std::numeric_limits<float>::max());
 	glm::vec3 vmax(std::numeric_limits<float>::lowest());
+	glm::vec3 static_min = vmin;
+	glm::vec3 static_max = vmax;
 
-	for (entity entity : scene_)
+	for (size_t i = 0; i < scene_.size(); i++)
 	{
-		glm::vec3 cmin = entity.world_bounds.min_;
-		glm::vec3 cmax = entity.world_bounds.max_;
-
-		vmin = glm::min(vmin, cmin);
-		vmax = glm::max(vmax, cmax);
+		const bounding_box& b = scene_.world_bounds[i];
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+		if (scene_.render[i].type != dynamic && scene_.render[i].type != lava)
+		{
+			static_min = glm::min(static_min, b.min_);
+			static_max = glm::max(static_max, b.max_);
+		}
 	}
 
 	scene_bounds_ = bounding_box(vmin, vmax);
+	// empty if nothing is static, a union with it changes nothing then
+	static_bounds_.min_ = static_min;
+	static_bounds_.max_ = static_max;
 }
 
-void level::load_materials(const aiScene* scene)
+void level::load_material_paths(const aiScene* scene)
 {
-	std::cout << "loading materials..." << std::endl;
-
 	for (size_t m = 0; m < scene->mNumMaterials; m++)
 	{
 		const aiMaterial* mm = scene->mMaterials[m];
-
-#ifdef _DEBUG
-		printf("Material [%s] %u\n", mm->GetName().C_Str(), m + 1);
-#endif
-
 		aiString path;
 
-		if (aiGetMaterialTexture(mm, aiTextureType_BASE_COLOR, 0, &path) == AI_SUCCESS)
-		{
-			const auto albedo_map = std::string(path.C_Str());
-		}
-
 		//	all other materials can be found with: aiTextureType_NORMAL_CAMERA/_METALNESS/_DIFFUSE_ROUGHNESS/_AMBIENT_OCCLUSION
+		aiGetMaterialTexture(mm, aiTextureType_BASE_COLOR, 0, &path);
 
-		if(path.length != 0)
-		{
-			material mat;
-			material::create(path.C_Str(), mm->GetName().C_Str(), mat);
-			materials_.push_back(mat);
-		} else //default
-		{
-			material mat;
-			mat.type = invisible;
-			//create("textures/default/albedo.jpg", "default", mat);
-			materials_.push_back(mat);
-		}
+		material_paths_.emplace_back(path.C_Str()); // empty path means default/invisible
+		material_names_.emplace_back(mm->GetName().C_Str());
 
 		if (strcmp(mm->GetName().C_Str(),"Lava_1") == 0)
-		{
-			perframe_data_->normal_map.y = static_cast<float>(materials_.size()-1);
-		}
+			lava_material_ = static_cast<int32_t>(m);
 	}
 }
 
+void level::load_materials()
+{
+	std::cout << "loading materials..." << std::endl;
+
+	// workers decode the ktx files while this thread uploads, materials must not move until finish
+	texture_loader loader;
+	materials_.resize(material_paths_.size());
+	for (size_t m = 0; m < material_paths_.size(); m++)
+	{
+#ifdef _DEBUG
+		printf("Material [%s] %u\n", material_names_[m].c_str(), m + 1);
+#endif
+
+		if(!material_paths_[m].empty())
+			loader.load_material(material::get_folder(material_paths_[m].c_str()), &materials_[m]);
+		else //default
+			materials_[m].type = invisible;
+	}
+	texture_loader::print_report(loader.finish());
+
+	// textures of a previous level that this one doesn't use anymore
+	const size_t purged = texture_registry::purge_unused();
+	printf("  %u textures resident, %u unused purged\n", static_cast<unsigned>(texture_registry::get_count()), static_cast<unsigned>(purged));
+
+	if (lava_material_ >= 0)
+		perframe_data_->normal_map.y = static_cast<float>(lava_material_);
+}
+
 void level::traverse_tree(const aiNode* n, const glm::mat4 mat, entity_type type)
 {
 	if (strcmp(n->mName.C_Str(),"Rigid") == 0) type = rigid;
@@ -313,26 +584,20 @@ void level::traverse_tree(const aiNode* n, const glm::mat4 mat, entity_type type
 
 	if (n->mNumMeshes > 0)
 	{
-		entity entity;
-
-		// set trivial node variables
-		entity.name = n->mName.C_Str();
-		entity.type = type;
-		entity.mesh_index = n->mMeshes[0];
-		entity.model_bounds = compute_bounds_of_mesh(meshes_[n->mMeshes[0]]);
-
 		// set translation, rotation and scale of this node
-		glm::decompose(M, entity.TRS.scale, entity.TRS.rotation, entity.TRS.translate, glm::vec3(), glm::vec4());
-		entity.TRS.rotation = glm::normalize(glm::conjugate(entity.TRS.rotation));
-		entity.TRS.local = M;
+		transformation trs;
+		glm::decompose(M, trs.scale, trs.rotation, trs.translate, glm::vec3(), glm::vec4());
+		trs.rotation = glm::normalize(glm::conjugate(trs.rotation));
+		trs.local = M;
 
-		scene_.push_back(entity);
+		scene_.add(n->mName.C_Str(), type, n->mMeshes[0], trs, compute_bounds_of_mesh(meshes_[n->mMeshes[0]]));
 	}
 
 	// travers child nodes
 	for (size_t i = 0; i < n->mNumChildren; i++)
 	{
 		if (strcmp(n->mChildren[i]->mName.C_Str(),"Lights") != 0 && // skip lights
+			strcmp(n->mChildren[i]->mName.C_Str(), "Cells") != 0 && strcmp(n->mChildren[i]->mName.C_Str(), "Portals") != 0 && // and portal culling volumes
 			(n->mChildren[i]->mNumChildren > 0 || n->mChildren[i]->mNumMeshes > 0)) // skip empty nodes
 		{
 		traverse_tree(n->mChildren[i], M, type);
@@ -340,6 +605,58 @@ void level::traverse_tree(const aiNode* n, const glm::mat4 mat, entity_type type
 	}
 }
 
+void level::collect_cells(const aiScene* scene)
+{
+	cells_.clear();
+	portals_.clear();
+	for (const bool cells : { true, false })
+	{
+		const aiNode* group = scene->mRootNode->FindNode(cells ? "Cells" : "Portals");
+		if (!group)
+			continue;
+
+		// the transformation of the group is accumulated like traverse_tree does from the root
+		glm::mat4 M(1);
+		for (const aiNode* p = group->mParent; p; p = p->mParent)
+			M = to_glm_mat4(p->mTransformation) * M;
+		collect_node_bounds(scene, group, M, cells ? cells_ : portals_);
+	}
+}
+
+void level::collect_node_bounds(const aiScene* scene, const aiNode* n, const glm::mat4& mat, std::vector<bounding_box>& bounds) const
+{
+	const glm::mat4 M = mat * to_glm_mat4(n->mTransformation);
+	if (n->mNumMeshes > 0)
+	{
+		glm::vec3 lo(std::numeric_limits<float>::max()), hi(std::numeric_limits<float>::lowest());
+		for (uint32_t m = 0; m < n->mNumMeshes; m++)
+		{
+			const aiMesh* mesh = scene->mMeshes[n->mMeshes[m]];
+			for (uint32_t v = 0; v < mesh->mNumVertices; v++)
+			{
+				const glm::vec3 p = glm::vec3(M * glm::vec4(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z, 1.0f));
+				lo = glm::min(lo, p);
+				hi = glm::max(hi, p);
+			}
+		}
+		if (glm::all(glm::lessThanEqual(lo, hi)))
+			bounds.emplace_back(lo, hi);
+	}
+
+	for (size_t i = 0; i < n->mNumChildren; i++)
+		collect_node_bounds(scene, n->mChildren[i], M, bounds);
+}
+
+void level::link_cells()
+{
+	if (cells_.empty())
+		return;
+	const uint32_t unlinked = portal_culler_.build(cells_, portals_);
+	printf("  %u cells, %u portals for the portal culling\n", static_cast<unsigned>(cells_.size()), static_cast<unsigned>(portals_.size() - unlinked));
+	if (unlinked > 0)
+		std::cerr << "WARNING: " << unlinked << " portals open into fewer than 2 cells and are left out" << std::endl;
+}
+
 glm::mat4 level::to_glm_mat4(const aiMatrix4x4& mat)
 {
 	glm::mat4 result;
@@ -354,30 +671,99 @@ void level::setup_buffers()
 {
 	std::cout << "setup buffers..." << std::endl;
 
+	// every model gets the parameters of its mesh, identity parameters restore float vertices unchanged
+	std::vector<vertex_dequant> mesh_dequant(meshes_.size());
+	std::vector<packed_vertex> packed;
+	if (state_->packed_vertices)
+	{
+		packed.resize(vertices.size() / 8);
+		job_system::instance().parallel_for(meshes_.size(), [this, &packed, &mesh_dequant](const size_t i)
+		{
+			const sub_mesh& mesh = meshes_[i];
+			mesh_dequant[i] = vertex_quantizer::pack(vertices.data() + mesh.vertex_offset * 8, mesh.vertex_count, packed.data() + mesh.vertex_offset);
+		});
+	}
+
+	// in the order of the render queue, the shaders find them by model index
+	std::vector<vertex_dequant> model_dequant;
+	model_dequant.reserve(queue_scene_.entities.size());
+	for (const uint32_t entity : queue_scene_.entities)
+		model_dequant.push_back(mesh_dequant[scene_.render[entity].mesh_index]);
+
 	const buffer vbo(0);
-	vbo.reserve_memory(static_cast<GLsizeiptr>(vertices.size() * sizeof(float)), vertices.data());
+	if (state_->packed_vertices)
+		vbo.reserve_memory(static_cast<GLsizeiptr>(packed.size() * sizeof(packed_vertex)), packed.data());
+	else
+		vbo.reserve_memory(static_cast<GLsizeiptr>(vertices.size() * sizeof(float)), vertices.data());
+	// one element buffer holds both pools, the 32 bit pool starts at wide_index_base_
+	std::vector<GLuint> elements(wide_index_base_ + indices_.size());
+	if (!short_indices_.empty())
+		memcpy(elements.data(), short_indices_.data(), short_indices_.size() * sizeof(uint16_t));
+	if (!indices_.empty())
+		memcpy(elements.data() + wide_index_base_, indices_.data(), indices_.size() * sizeof(GLuint));
 	const buffer ebo(0);
-	ebo.reserve_memory(static_cast<GLsizeiptr>(indices_.size() * sizeof(GLuint)), indices_.data());
+	ebo.reserve_memory(static_cast<GLsizeiptr>(elements.size() * sizeof(GLuint)), elements.data());
+	print_index_memory();
 
 	glCreateVertexArrays(1, &vao_);
 	glVertexArrayElementBuffer(vao_, ebo.get_id());
-	glVertexArrayVertexBuffer(vao_, 0, vbo.get_id(), 0, sizeof(glm::vec3) + sizeof(glm::vec3) + sizeof(glm::vec2));
-	// position
-	glEnableVertexArrayAttrib(vao_, 0);
-	glVertexArrayAttribFormat(vao_, 0, 3, GL_FLOAT, GL_FALSE, 0);
-	glVertexArrayAttribBinding(vao_, 0, 0);
-	// normal
-	glEnableVertexArrayAttrib(vao_, 1);
-	glVertexArrayAttribFormat(vao_, 1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3));
-	glVertexArrayAttribBinding(vao_, 1, 0);
-	// uv
-	glEnableVertexArrayAttrib(vao_, 2);
-	glVertexArrayAttribFormat(vao_, 2, 2, GL_FLOAT, GL_TRUE, sizeof(glm::vec3) + sizeof(glm::vec3));
-	glVertexArrayAttribBinding(vao_, 2, 0);
-
-	ibo_.reserve_memory(static_cast<GLsizeiptr>(meshes_.size() * sizeof(draw_elements_indirect_command)), nullptr);
-	matrix_ssbo_.reserve_memory(4, static_cast<GLsizeiptr>(meshes_.size() * sizeof(glm::mat4)), nullptr);
+	if (state_->packed_vertices)
+	{
+		glVertexArrayVertexBuffer(vao_, 0, vbo.get_id(), 0, sizeof(packed_vertex));
+		// position, unorm16 inside the mesh AABB
+		glEnableVertexArrayAttrib(vao_, 0);
+		glVertexArrayAttribFormat(vao_, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(packed_vertex, px));
+		glVertexArrayAttribBinding(vao_, 0, 0);
+		// normal, octahedral snorm16
+		glEnableVertexArrayAttrib(vao_, 1);
+		glVertexArrayAttribFormat(vao_, 1, 2, GL_SHORT, GL_TRUE, offsetof(packed_vertex, nx));
+		glVertexArrayAttribBinding(vao_, 1, 0);
+		// uv, unorm16 inside the uv range of the mesh
+		glEnableVertexArrayAttrib(vao_, 2);
+		glVertexArrayAttribFormat(vao_, 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(packed_vertex, tx));
+		glVertexArrayAttribBinding(vao_, 2, 0);
+	}
+	else
+	{
+		glVertexArrayVertexBuffer(vao_, 0, vbo.get_id(), 0, sizeof(glm::vec3) + sizeof(glm::vec3) + sizeof(glm::vec2));
+		// position
+		glEnableVertexArrayAttrib(vao_, 0);
+		glVertexArrayAttribFormat(vao_, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(vao_, 0, 0);
+		// normal
+		glEnableVertexArrayAttrib(vao_, 1);
+		glVertexArrayAttribFormat(vao_, 1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3));
+		glVertexArrayAttribBinding(vao_, 1, 0);
+		// uv
+		glEnableVertexArrayAttrib(vao_, 2);
+		glVertexArrayAttribFormat(vao_, 2, 2, GL_FLOAT, GL_TRUE, sizeof(glm::vec3) + sizeof(glm::vec3));
+		glVertexArrayAttribBinding(vao_, 2, 0);
+	}
+
+	// worst case every meshlet of the largest LOD of every model is visible
+	size_t meshlet_commands = 1;
+	for (const entity_render& render : scene_.render)
+	{
+		const sub_mesh& mesh = meshes_[render.mesh_index];
+		meshlet_commands += mesh.meshlet_count.empty() ? 0 : *std::max_element(mesh.meshlet_count.begin(), mesh.meshlet_count.end());
+	}
+	queue_scene_.meshlet_commands.reserve(meshlet_commands);
+
+	// per frame the shadow and the main pass push at most one command and one instance per model, the meshlets only in the main pass
+	meshlet_ibo_.reserve_ring(static_cast<GLsizeiptr>(meshlet_commands * sizeof(draw_elements_indirect_command)));
+	if (indirect_count_supported)
+		draw_count_.reserve_ring(static_cast<GLsizeiptr>(2 * 2 * sizeof(uint32_t)), 2);
+	ibo_.reserve_ring(static_cast<GLsizeiptr>(2 * queue_scene_.commands.size() * sizeof(draw_elements_indirect_command)), 2);
+	matrix_ssbo_.reserve_ring(static_cast<GLsizeiptr>(queue_scene_.model_matrices.size() * sizeof(glm::mat4)));
+	instance_ssbo_.reserve_ring(static_cast<GLsizeiptr>(2 * queue_scene_.commands.size() * sizeof(draw_instance)), 2);
 	tex_ssbo_.reserve_memory(5, static_cast<GLsizeiptr>(materials_.size() * sizeof(material)), materials_.data());
+	dequant_ssbo_.reserve_memory(6, static_cast<GLsizeiptr>(model_dequant.size() * sizeof(vertex_dequant)), model_dequant.data());
+	if (state_->gpu_cull)
+		setup_gpu_culling();
+
+	// bounds and physics meshes are already collected, the float copy is not needed anymore
+	if (state_->packed_vertices)
+		std::vector<float>().swap(vertices);
 }
 
 void level::load_lights(const aiScene* scene) {
@@ -474,19 +860,63 @@ std::vector<physics_mesh> level::get_dynamic()
 	return dynamic_;
 }
 
+void level::collect_occluders()
+{
+	occlusion_.clear_occluders();
+	const float min_size = glm::length(scene_bounds_.max_ - scene_bounds_.min_) * min_occluder_size;
+
+	// walls and floors have two large extents, the area spanned by them ranks the candidates
+	std::vector<std::pair<float, uint32_t>> candidates;
+	for (uint32_t i = 0; i < scene_.size(); i++)
+	{
+		if (scene_.render[i].type != rigid || scene_.render[i].mesh_index < 0)
+			continue;
+		glm::vec3 extent = scene_.world_bounds[i].max_ - scene_.world_bounds[i].min_;
+		std::sort(&extent.x, &extent.x + 3);
+		if (extent.y >= min_size)
+			candidates.emplace_back(extent.y * extent.z, i);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	for (const auto& candidate : candidates)
+	{
+		if (occlusion_.get_occluder_count() >= max_occluders)
+			break;
+		const sub_mesh& mesh = meshes_[scene_.render[candidate.second].mesh_index];
+		size_t lod = 0;
+		while (lod < mesh.index_count.size() && mesh.index_count[lod] / 3 > max_occluder_triangles)
+			lod++;
+		if (lod == mesh.index_count.size())
+			continue;
+
+		const glm::mat4 model = scene_.get_node_matrix(candidate.second);
+		positions.resize(mesh.vertex_count);
+		for (uint32_t v = 0; v < mesh.vertex_count; v++)
+		{
+			const float* vf = &vertices[(mesh.vertex_offset + v) * 8];
+			positions[v] = glm::vec3(model * glm::vec4(vf[0], vf[1], vf[2], 1.0f));
+		}
+		indices.resize(mesh.index_count[lod]);
+		for (uint32_t k = 0; k < mesh.index_count[lod]; k++)
+			indices[k] = mesh.short_indices ? short_indices_[mesh.index_offset[lod] + k] : indices_[mesh.index_offset[lod] + k];
+		occlusion_.add_occluder(positions, indices);
+	}
+}
+
 void level::collect_physic_meshes()
 {
 	rigid_.reserve(meshes_.size());
 	dynamic_.reserve(meshes_.size());
 	
-	for (size_t i = 0; i < scene_.size(); i++)
+	for (uint32_t i = 0; i < scene_.size(); i++)
 	{
-		entity& entity = scene_[i];
-
-		if (entity.type == rigid || entity.type == dynamic)
+		const entity_type type = scene_.render[i].type;
+		if (type == rigid || type == dynamic)
 		{
-			glm::mat4 node_matrix = entity.get_node_matrix();
-			uint32_t model_index = entity.mesh_index;
+			glm::mat4 node_matrix = scene_.get_node_matrix(i);
+			uint32_t model_index = scene_.render[i].mesh_index;
 			uint32_t vtx_offset = meshes_[model_index].vertex_offset;
 			uint32_t vtx_count = meshes_[model_index].vertex_count;
 			physics_mesh phy_mesh;
@@ -506,8 +936,8 @@ void level::collect_physic_meshes()
 			}
 
 			phy_mesh.model_trs = trs;
-			phy_mesh.entity = &scene_[i];
-			if (entity.type == rigid)
+			phy_mesh.entity = i;
+			if (type == rigid)
 				rigid_.emplace_back(phy_mesh);
 			else
 				dynamic_.emplace_back(phy_mesh);
@@ -525,25 +955,44 @@ void level::draw_scene() {
 		frustum_culler::cull_view_proj = perframe_data_->view_proj;
 		frustum_culler::get_frustum_planes(frustum_culler::cull_view_proj, frustum_culler::frustum_planes);
 		frustum_culler::get_frustum_corners(frustum_culler::cull_view_proj, frustum_culler::frustum_corners);
+		meshlet_culler::cull_view_pos = glm::vec3(perframe_data_->view_pos);
 		OPTICK_POP()
 	}
 	OPTICK_POP()
 
+	const bool meshlets = state_->cull && state_->meshlet_cull;
+	const bool gpu = use_gpu_culling();
 	OPTICK_PUSH("build render queue")
-	update_render_queue(false);
+	if (gpu)
+	{
+		gpu_.cull(gpu_culler::main_pass, get_gpu_view(false));
+	}
+	else
+	{
+		update_render_queue(false);
+		if (meshlets)
+			build_meshlet_queue();
+	}
 	OPTICK_POP()
 
 	// draw mesh
 	OPTICK_PUSH("draw scene")
-	ibo_.update(static_cast<GLsizeiptr>(queue_scene_.commands.size() * sizeof(draw_elements_indirect_command)), queue_scene_.commands.data());
-	
-	/// mode - draw triangles from every 3 indices
-	/// type - data type of the indices vector
-	/// indirect - offset into commands buffer, which is zero
-	/// drawcount - is the number of draw calls that should be generated
-	/// stride - because the commands are packed tightly aka just as descriped in the GL specs
-	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, static_cast<GLvoid*>(nullptr), static_cast<GLsizei>(queue_scene_.commands.size()), 0);
-	
+	if (gpu)
+	{
+		gpu_.bind_matrices();
+		gpu_.draw(gpu_culler::main_pass);
+	}
+	else if (meshlets)
+	{
+		push_matrices();
+		draw_pass(meshlet_ibo_, queue_scene_.meshlet_commands, queue_scene_.short_meshlet_commands);
+	}
+	else
+	{
+		push_matrices();
+		compact_commands(queue_scene_.commands);
+		draw_pass(ibo_, queue_scene_.draw_commands, queue_scene_.short_draw_commands);
+	}
 	OPTICK_POP()
 		
 	if (state_->cull_debug) // bounding box & frustum culling debug view
@@ -576,8 +1025,42 @@ void level::draw_scene() {
 			frustum_culler::seconds_since_flush += perframe_data_->delta_time.x;
 			if (frustum_culler::seconds_since_flush >= 2)
 			{
+				// the GPU culling counts its visible models itself, reading them back waits for the last frame
+				if (gpu)
+				{
+					frustum_culler::models_visible = gpu_.read_visible(gpu_culler::main_pass);
+					shadow_casters_ = gpu_.read_visible(gpu_culler::shadow_pass);
+				}
 				std::cout << "Models in memory: " << frustum_culler::models_loaded << ", visible: " << frustum_culler::models_visible
 					<< ", culled: " << frustum_culler::models_loaded - frustum_culler::models_visible << "\n";
+				std::cout << "Shadow casters: " << shadow_casters_ << "\n";
+				if (gpu)
+					std::cout << "GPU culling: " << gpu_.get_slot_count() << " command slots, commands and instances written by compute shaders\n";
+				else if (!meshlets)
+					std::cout << "Commands uploaded: " << queue_scene_.draw_commands.size() << " of " << queue_scene_.commands.size()
+						<< ", instances: " << queue_scene_.instances.size() << (indirect_count_supported ? ", draw count from buffer" : "") << "\n";
+				if (occlusion_.get_triangle_count() > 0 && state_->occlusion_cull && !gpu)
+					std::cout << "Occluders: " << occlusion_.get_occluder_count() << " (" << occlusion_.get_triangle_count() << " triangles), models occluded: "
+						<< occlusion_culler::models_occluded << "\n";
+				if (use_portals())
+				{
+					// the GPU culling uses the cells only for the shadow receivers
+					std::cout << "Portal culling: " << portal_culler_.get_visible_cell_count() << " of " << portal_culler_.get_cell_count() << " cells visible"
+						<< (portal_culler_.has_camera_cell() ? "" : ", camera outside of the cells");
+					if (!gpu)
+						std::cout << ", models hidden: " << portal_culler::models_hidden;
+					std::cout << "\n";
+				}
+				if (meshlets)
+					std::cout << "Meshlets tested: " << meshlet_culler::meshlets_tested << ", visible: " << meshlet_culler::meshlets_visible << "\n";
+				if (state_->coherent_cull && coherent_culls_ > 0)
+					std::cout << "Coherent culling: " << coherent_tests_ / coherent_culls_ << " tests per frustum of " << visibility_cache::test_count * queue_scene_.commands.size()
+						<< ", commands retested: " << coherent_retested_ / coherent_culls_ << "\n";
+				std::cout << "Buffer uploads: " << buffer::bytes_uploaded_last_frame / 1024 << " kB last frame, GPU waits: " << buffer::fence_waits << ", dropped pushes: " << buffer::dropped_pushes << "\n";
+				buffer::fence_waits = 0;
+				buffer::dropped_pushes = 0;
+				coherent_tests_ = coherent_retested_ = 0;
+				coherent_culls_ = 0;
 				frustum_culler::seconds_since_flush = 0;
 			}
 		}
@@ -585,14 +1068,15 @@ void level::draw_scene() {
 	}
 }
 
-void level::draw_scene_shadow_map()
+void level::draw_scene_shadow_map(const int shadow_size)
 {
 	OPTICK_PUSH("update scene")
 
 	// recalculate bounds & set lod uniforms
 	if (state_->lava_triggered)
 	{
-		glm::vec3 t = scene_[lava_].TRS.translate;
+		const transformation& trs = scene_.transforms[lava_];
+		glm::vec3 t = trs.translate;
 		if (!state_->won)
 		{
 			t.y += perframe_data_->delta_time.x * .4f;
@@ -601,22 +1085,67 @@ void level::draw_scene_shadow_map()
 		{
 			t.y = -1.0f;
 		}
-		scene_[lava_].set_node_trs(t, scene_[lava_].TRS.rotation, scene_[lava_].TRS.scale);
-		state_->lava_height = scene_[lava_].TRS.translate.y;
+		scene_.set_node_trs(lava_, t, trs.rotation, trs.scale);
+		state_->lava_height = trs.translate.y;
 	}
 
 	OPTICK_PUSH("transform bounding boxes")
+	update_moving_bounds();
+	if (gpu_.is_built())
+		for (const uint32_t e : scene_.activated)
+			gpu_.set_flags(entity_commands_[e], get_gpu_flags(entity_commands_[e]));
+	scene_.activated.clear();
 	OPTICK_POP()
 	OPTICK_PUSH("update frustum culler uniform")
 	lod_system::near_plane = perframe_data_->ssao1.z;
 	lod_system::view_pos = perframe_data_->view_pos;
-	glm::mat4 vp = glm::transpose(perframe_data_->view_proj);
-	lod_system::view_dir = vp[3];
+	// half the screen height covers tan(fov / 2) units at distance 1, which is [1][1] of the inverse projection
+	lod_system::pixels_per_unit = 0.5f * perframe_data_->delta_time.w / perframe_data_->proj_inv[1][1];
+	lod_system::bias = state_->lod_bias;
 	frustum_culler::models_visible = 0;
 	OPTICK_POP()
-		
+
+	// the cells the camera can see through the portals, first in the frame so the shadow receivers and the main pass use them
+	const bool portals = use_portals();
+	if (portals && !state_->freeze_cull)
+	{
+		OPTICK_PUSH("traverse portals")
+		glm::vec4 planes[6];
+		frustum_culler::get_frustum_planes(perframe_data_->view_proj, planes);
+		portal_culler_.update(glm::vec3(perframe_data_->view_pos), planes);
+		OPTICK_POP()
+	}
+
+	OPTICK_PUSH("update shadow caster culler")
+	// moving models are in no cell, they receive shadows wherever they are
+	bounding_box receivers = scene_bounds_;
+	if (portals && portal_culler_.has_camera_cell())
+	{
+		receivers = portal_culler_.get_visible_bounds();
+		for (const uint32_t i : queue_scene_.moving)
+		{
+			const bounding_box& b = scene_.world_bounds[queue_scene_.entities[i]];
+			receivers = bounding_box(glm::min(receivers.min_, b.min_), glm::max(receivers.max_, b.max_));
+		}
+	}
+	const glm::mat4 light_proj = get_tight_scene_frustum(perframe_data_->light_view);
+	// the orthographic projection maps 2 / light_proj[0][0] world units onto the width of the shadow map, LODs use the finer axis
+	const float texel_x = 2.0f / (std::abs(light_proj[0][0]) * static_cast<float>(shadow_size));
+	const float texel_y = 2.0f / (std::abs(light_proj[1][1]) * static_cast<float>(shadow_size));
+	shadow_texel_size_ = std::min(texel_x, texel_y);
+	glm::mat4 caster_frustum;
+	shadow_receivers_ = get_shadow_caster_frustum(perframe_data_->light_view, light_proj, perframe_data_->view_proj, std::max(texel_x, texel_y) * shadow_caster_margin,
+		receivers, caster_frustum);
+	frustum_culler::get_frustum_planes(caster_frustum, shadow_planes_);
+	frustum_culler::get_frustum_corners(caster_frustum, shadow_corners_);
+	OPTICK_POP()
+
+	const bool gpu = use_gpu_culling();
 	OPTICK_PUSH("build render queue")
-	update_render_queue(true);
+	if (gpu)
+		gpu_.cull(gpu_culler::shadow_pass, get_gpu_view(true));
+	else
+		update_render_queue(true);
 	OPTICK_POP()
 	OPTICK_POP()
 
@@ -624,99 +1153,514 @@ void level::draw_scene_shadow_map()
 	OPTICK_PUSH("draw scene")
 	glBindVertexArray(vao_);
 	
-	matrix_ssbo_.update(static_cast<GLsizeiptr>(sizeof(glm::mat4) * queue_scene_.model_matrices.size()), queue_scene_.model_matrices.data());
-	ibo_.update(static_cast<GLsizeiptr>(queue_scene_.commands.size() * sizeof(draw_elements_indirect_command)), queue_scene_.commands.data());
-	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, static_cast<GLvoid*>(nullptr), static_cast<GLsizei>(queue_scene_.commands.size()), 0);
+	if (gpu)
+	{
+		// the LODs are updated without receivers as well, like the CPU path does, but no caster is drawn
+		gpu_.bind_matrices();
+		if (shadow_receivers_ || !state_->cull)
+			gpu_.draw(gpu_culler::shadow_pass);
+	}
+	else
+	{
+		push_matrices();
+		compact_commands(queue_scene_.shadow_commands);
+		draw_pass(ibo_, queue_scene_.draw_commands, queue_scene_.short_draw_commands);
+	}
 	
 	OPTICK_POP()
 }
 
 void level::build_render_queue() {
-	for (const entity& entity : scene_)
+	// the 32 bit pool starts at the next 4 byte boundary behind the 16 bit pool in the element buffer
+	wide_index_base_ = static_cast<uint32_t>((short_indices_.size() + 1) / 2);
+
+	// commands of the same material and mesh are next to each other, compacting the visible ones keeps them together
+	std::vector<uint32_t> order(scene_.size());
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b)
 	{
+		const uint32_t material_a = meshes_[scene_.render[a].mesh_index].material_index;
+		const uint32_t material_b = meshes_[scene_.render[b].mesh_index].material_index;
+		return material_a != material_b ? material_a < material_b : scene_.render[a].mesh_index < scene_.render[b].mesh_index;
+	});
 
-		uint32_t instanceCount = 1;
-		if (!entity.game_properties.is_active)
-			instanceCount = 0;
+	// models with 16 bit indices first, then the rest
+	for (const bool short_indices : { true, false })
+	{
+		for (const uint32_t i : order)
+		{
+			const uint32_t mesh_index = scene_.render[i].mesh_index;
+			if (meshes_[mesh_index].short_indices != short_indices)
+				continue;
+
+			uint32_t instanceCount = 1;
+			if (!scene_.render[i].is_active)
+				instanceCount = 0;
+
+			const glm::mat4 node_matrix = scene_.get_node_matrix(i);
+			const uint32_t material_index = meshes_[mesh_index].material_index;
+			if (materials_[material_index].type == invisible)
+				instanceCount = 0;
+			uint32_t LOD = 0;
 
-		const glm::mat4 node_matrix = entity.get_node_matrix();
-		const uint32_t mesh_index = entity.mesh_index;
-		const uint32_t material_index = meshes_[mesh_index].material_index;
-		const uint32_t model_index = queue_scene_.model_matrices.size();
-		if (materials_[material_index].type == invisible)
-			instanceCount = 0;
-		uint32_t LOD = 0;
-		
-		const uint32_t count = meshes_[mesh_index].index_count[LOD];
-		const uint32_t firstIndex = meshes_[mesh_index].index_offset[LOD];
-		const uint32_t baseVertex = meshes_[mesh_index].vertex_offset;
-		const uint32_t baseInstance = material_index + (static_cast<uint32_t>(model_index) << 16);
-
-		draw_elements_indirect_command cmd = draw_elements_indirect_command{
-			count,
-			instanceCount,
-			firstIndex,
-			baseVertex,
-			baseInstance };
-
-		queue_scene_.commands.push_back(cmd);
-		queue_scene_.model_matrices.push_back(node_matrix);
-		
-		frustum_culler::models_visible += cmd.instanceCount_;
+			const uint32_t count = meshes_[mesh_index].index_count[LOD];
+			const uint32_t firstIndex = get_first_index(meshes_[mesh_index], LOD);
+			const uint32_t baseVertex = meshes_[mesh_index].vertex_offset;
+			// set when the visible commands are grouped into instanced ones
+			const uint32_t baseInstance = 0;
+
+			draw_elements_indirect_command cmd = draw_elements_indirect_command{
+				count,
+				instanceCount,
+				firstIndex,
+				baseVertex,
+				baseInstance };
+
+			queue_scene_.commands.push_back(cmd);
+			queue_scene_.model_matrices.push_back(node_matrix);
+			queue_scene_.entities.push_back(i);
+
+			frustum_culler::models_visible += cmd.instanceCount_;
+		}
+		if (short_indices)
+			queue_scene_.short_commands = static_cast<uint32_t>(queue_scene_.commands.size());
 	}
+
+	build_queue_bounds();
 }
 
-void level::update_render_queue(const bool for_shadow) {
-	for (size_t i = 0; i < queue_scene_.commands.size(); i++)
+void level::build_queue_bounds()
+{
+	queue_scene_.bounds.resize(queue_scene_.commands.size());
+	queue_scene_.visible.resize(queue_scene_.bounds.mask_words());
+	queue_scene_.lods.assign(queue_scene_.commands.size(), 0);
+	queue_scene_.shadow_lods.assign(queue_scene_.commands.size(), 0);
+	queue_scene_.shadow_commands = queue_scene_.commands;
+	queue_scene_.shadow_visible.resize(queue_scene_.bounds.mask_words());
+	queue_scene_.draw_commands.reserve(queue_scene_.commands.size());
+	queue_scene_.instances.reserve(queue_scene_.commands.size());
+	mesh_groups_.assign(meshes_.size(), no_group);
+	entity_commands_.assign(scene_.size(), 0);
+	for (uint32_t i = 0; i < queue_scene_.commands.size(); i++)
 	{
-		entity& entity = scene_[i];
+		const uint32_t e = queue_scene_.entities[i];
+		entity_commands_[e] = i;
+		queue_scene_.bounds.set(i, scene_.world_bounds[e]);
+		if (scene_.render[e].type == dynamic || scene_.render[e].type == lava)
+			queue_scene_.moving.push_back(i);
+	}
+
+	std::vector<bounding_box> boxes(queue_scene_.commands.size());
+	for (uint32_t i = 0; i < boxes.size(); i++)
+		boxes[i] = scene_.world_bounds[queue_scene_.entities[i]];
+	bvh_.build(boxes);
+	view_cache_.reset(boxes.size());
+	shadow_cache_.reset(boxes.size());
+	portal_culler_.assign(queue_scene_.bounds, queue_scene_.moving);
+}
+
+uint32_t level::get_first_index(const sub_mesh& mesh, const size_t lod) const
+{
+	return mesh.index_offset[lod] + (mesh.short_indices ? 0 : wide_index_base_);
+}
+
+void level::push_matrices()
+{
+	if (matrix_frame_ == buffer::get_frame())
+		return;
+	const auto size = static_cast<GLsizeiptr>(sizeof(glm::mat4) * queue_scene_.model_matrices.size());
+	matrix_ssbo_.bind_range(4, matrix_ssbo_.push(size, queue_scene_.model_matrices.data()), size);
+	matrix_frame_ = buffer::get_frame();
+}
+
+void level::draw_pass(buffer& ring, const std::vector<draw_elements_indirect_command>& commands, const uint32_t short_count)
+{
+	const auto instances = static_cast<GLsizeiptr>(queue_scene_.instances.size() * sizeof(draw_instance));
+	instance_ssbo_.bind_range(7, instance_ssbo_.push(instances, queue_scene_.instances.data()), instances);
+	const GLintptr first = ring.push(static_cast<GLsizeiptr>(commands.size() * sizeof(draw_elements_indirect_command)), commands.data());
+	if (first == buffer::no_offset)
+		return;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.get_id());
+	draw_indirect(short_count, commands.size(), first);
+}
+
+void level::draw_indirect(const uint32_t short_count, const size_t count, const GLintptr first)
+{
+	/// mode - draw triangles from every 3 indices
+	/// type - data type of the indices, the 16 bit commands come first
+	/// indirect - offset into commands buffer
+	/// drawcount - is the number of draw calls that should be generated, or its offset in the parameter buffer
+	/// stride - because the commands are packed tightly aka just as descriped in the GL specs
+	if (indirect_count_supported)
+	{
+		const uint32_t counts[2] = { short_count, static_cast<uint32_t>(count - short_count) };
+		const GLintptr counts_offset = draw_count_.push(sizeof(counts), counts);
+		if (counts_offset == buffer::no_offset)
+			return;
+		glBindBuffer(GL_PARAMETER_BUFFER, draw_count_.get_id());
+		const auto draw = glMultiDrawElementsIndirectCount ? glMultiDrawElementsIndirectCount : glMultiDrawElementsIndirectCountARB;
+		if (counts[0] > 0)
+			draw(GL_TRIANGLES, GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid*>(first), counts_offset, static_cast<GLsizei>(counts[0]), 0);
+		if (counts[1] > 0)
+			draw(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<GLvoid*>(first + short_count * sizeof(draw_elements_indirect_command)),
+				counts_offset + sizeof(uint32_t), static_cast<GLsizei>(counts[1]), 0);
+		return;
+	}
+
+	if (short_count > 0)
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid*>(first), static_cast<GLsizei>(short_count), 0);
+	if (count > short_count)
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<GLvoid*>(first + short_count * sizeof(draw_elements_indirect_command)),
+			static_cast<GLsizei>(count - short_count), 0);
+}
+
+void level::compact_commands(const std::vector<draw_elements_indirect_command>& commands)
+{
+	std::vector<draw_elements_indirect_command>& draw = queue_scene_.draw_commands;
+	draw.clear();
+	groups_.clear();
+	command_groups_.clear();
+
+	// the first visible command of a mesh LOD starts a group, later ones only add an instance to it
+	// a mesh has either 16 or 32 bit indices, so the groups of the 16 bit commands still come first
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		if (i == queue_scene_.short_commands)
+			queue_scene_.short_draw_commands = static_cast<uint32_t>(draw.size());
+		const draw_elements_indirect_command& cmd = commands[i];
+		if (cmd.instanceCount_ == 0)
+			continue;
+
+		const uint32_t mesh_index = scene_.render[queue_scene_.entities[i]].mesh_index;
+		uint32_t group = mesh_groups_[mesh_index];
+		while (group != no_group && draw[group].firstIndex_ != cmd.firstIndex_)
+			group = groups_[group].next;
+		if (group == no_group)
+		{
+			group = static_cast<uint32_t>(draw.size());
+			draw.push_back(cmd);
+			draw.back().instanceCount_ = 0;
+			groups_.push_back({ mesh_index, mesh_groups_[mesh_index] });
+			mesh_groups_[mesh_index] = group;
+		}
+		draw[group].instanceCount_++;
+		command_groups_.push_back(group);
+	}
+	if (queue_scene_.short_commands == commands.size())
+		queue_scene_.short_draw_commands = static_cast<uint32_t>(draw.size());
+
+	// the instances of a group follow each other, counted again while they are written
+	uint32_t first_instance = 0;
+	for (draw_elements_indirect_command& cmd : draw)
+	{
+		cmd.baseInstance_ = first_instance;
+		first_instance += cmd.instanceCount_;
+		cmd.instanceCount_ = 0;
+	}
+	queue_scene_.instances.resize(first_instance);
+	size_t visible = 0;
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		if (commands[i].instanceCount_ == 0)
+			continue;
+		const uint32_t group = command_groups_[visible++];
+		draw_elements_indirect_command& cmd = draw[group];
+		queue_scene_.instances[cmd.baseInstance_ + cmd.instanceCount_++] = { static_cast<uint32_t>(i), meshes_[groups_[group].mesh_index].material_index };
+	}
+
+	for (const instance_group& group : groups_)
+		mesh_groups_[group.mesh_index] = no_group;
+}
+
+void level::update_moving_bounds()
+{
+	dirty_commands_.clear();
+	dirty_matrices_.clear();
+	dirty_model_bounds_.clear();
+	for (const uint32_t i : queue_scene_.moving)
+	{
+		const uint32_t e = queue_scene_.entities[i];
+		if (!scene_.bounds_dirty[e])
+			continue;
+		dirty_commands_.push_back(i);
+		dirty_matrices_.push_back(scene_.get_node_matrix(e));
+		dirty_model_bounds_.push_back(scene_.model_bounds[e]);
+	}
+	if (dirty_commands_.empty())
+		return;
+
+	dirty_world_bounds_.resize(dirty_commands_.size());
+	frustum_culler::transform_boxes(dirty_matrices_.data(), dirty_model_bounds_.data(), dirty_world_bounds_.data(), dirty_commands_.size());
+
+	// the scene only shrinks if a model left one of its faces, otherwise growing it by the new bounds is enough
+	const bool use_bvh = queue_scene_.commands.size() >= bvh_min_commands;
+	bool shrink = false;
+	glm::vec3 vmin = scene_bounds_.min_;
+	glm::vec3 vmax = scene_bounds_.max_;
+	for (size_t d = 0; d < dirty_commands_.size(); d++)
+	{
+		const uint32_t i = dirty_commands_[d];
+		const uint32_t e = queue_scene_.entities[i];
+		const bounding_box& b = dirty_world_bounds_[d];
+		const bounding_box& old = scene_.world_bounds[e];
+		shrink = shrink || glm::any(glm::lessThanEqual(old.min_, scene_bounds_.min_)) || glm::any(glm::greaterThanEqual(old.max_, scene_bounds_.max_));
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+
+		scene_.world_bounds[e] = b;
+		scene_.bounds_dirty[e] = 0;
+		queue_scene_.model_matrices[i] = dirty_matrices_[d];
+		queue_scene_.bounds.set(i, b);
+		view_cache_.invalidate(i);
+		shadow_cache_.invalidate(i);
+		if (use_bvh)
+			bvh_.refit(i, b);
+		if (gpu_.is_built())
+			gpu_.update_model(i, b, dirty_matrices_[d]);
+	}
+
+	if (shrink)
+	{
+		vmin = static_bounds_.min_;
+		vmax = static_bounds_.max_;
+		for (const uint32_t i : queue_scene_.moving)
+		{
+			const bounding_box& b = scene_.world_bounds[queue_scene_.entities[i]];
+			vmin = glm::min(vmin, b.min_);
+			vmax = glm::max(vmax, b.max_);
+		}
+	}
+	scene_bounds_.min_ = vmin;
+	scene_bounds_.max_ = vmax;
+}
+
+void level::cull_queue(const glm::vec4* planes, const glm::vec4* corners, visibility_cache& cache, uint32_t* visible)
+{
+	if (state_->coherent_cull)
+	{
+		coherent_tests_ += cache.cull(planes, corners, queue_scene_.bounds, scene_bounds_, visible);
+		coherent_retested_ += cache.get_retested();
+		coherent_culls_++;
+	}
+	else if (queue_scene_.commands.size() >= bvh_min_commands)
+		bvh_.cull(planes, corners, visible);
+	else
+		frustum_culler::cull_boxes(planes, corners, queue_scene_.bounds, visible);
+}
+
+void level::setup_gpu_culling()
+{
+	const size_t count = queue_scene_.commands.size();
+	std::vector<uint32_t> model_meshes(count), flags(count);
+	std::vector<bounding_box> bounds(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t e = queue_scene_.entities[i];
+		model_meshes[i] = scene_.render[e].mesh_index;
+		bounds[i] = scene_.world_bounds[e];
+		flags[i] = get_gpu_flags(i);
+	}
+	gpu_.build(meshes_, wide_index_base_, model_meshes, bounds, queue_scene_.model_matrices, flags, indirect_count_supported);
+	scene_.activated.clear();
+}
+
+uint32_t level::get_gpu_flags(const uint32_t command) const
+{
+	// the shadow pass of the CPU path gives these an instance count of 1, the main pass culls only them
+	const entity_render& render = scene_.render[queue_scene_.entities[command]];
+	const bool moving = render.type == dynamic || render.type == lava;
+	const bool hidden = moving && !materials_.empty() && materials_[meshes_[render.mesh_index].material_index].type == invisible;
+	return render.is_active && !hidden ? gpu_culler::model_drawn : 0;
+}
+
+gpu_culler::view level::get_gpu_view(const bool for_shadow) const
+{
+	const glm::vec4* planes = for_shadow ? shadow_planes_ : frustum_culler::frustum_planes;
+	const glm::vec4* corners = for_shadow ? shadow_corners_ : frustum_culler::frustum_corners;
+	gpu_culler::view v;
+	std::copy(planes, planes + 6, v.planes);
+	std::copy(corners, corners + 8, v.corners);
+	v.position = glm::vec3(lod_system::view_pos);
+	v.near_plane = lod_system::near_plane;
+	// the shadow LODs are picked by their error in shadow map texels, like lod_system::decide_shadow_lod
+	v.pixels_per_unit = for_shadow ? 1.0f / shadow_texel_size_ : lod_system::pixels_per_unit;
+	v.by_distance = !for_shadow;
+	v.cull = state_->cull;
+	v.use_lod = state_->use_lod;
+	return v;
+}
+
+uint32_t level::update_render_queue(const bool for_shadow, size_t chunks) {
+	const bool cull = state_->cull;
+	if (cull && for_shadow)
+	{
+		if (shadow_receivers_)
+			cull_queue(shadow_planes_, shadow_corners_, shadow_cache_, queue_scene_.shadow_visible.data());
+		else
+			std::fill(queue_scene_.shadow_visible.begin(), queue_scene_.shadow_visible.end(), 0u);
+	}
+	else if (cull)
+	{
+		cull_queue(frustum_culler::frustum_planes, frustum_culler::frustum_corners, view_cache_, queue_scene_.visible.data());
+		portal_culler::models_hidden = use_portals() ? portal_culler_.cull(queue_scene_.visible.data()) : 0;
+	}
+
+	const bool occlude = cull && !for_shadow && state_->occlusion_cull && occlusion_.get_triangle_count() > 0;
+	if (occlude)
+		occlusion_.render(frustum_culler::cull_view_proj);
+
+	// every job updates its own range of commands and counts its visible ones, the counts are added up afterwards
+	const size_t count = queue_scene_.commands.size();
+	if (chunks == 0)
+		chunks = (count + queue_chunk_size - 1) / queue_chunk_size;
+	chunks = std::max<size_t>(1, std::min(chunks, count));
+
+	uint32_t visible = 0, occluded = 0;
+	if (chunks == 1)
+	{
+		visible = update_commands(0, count, for_shadow, cull, occlude, occluded);
+	}
+	else
+	{
+		std::vector<uint32_t> chunk_visible(chunks), chunk_occluded(chunks);
+		job_system::instance().parallel_for(chunks, [this, count, chunks, for_shadow, cull, occlude, &chunk_visible, &chunk_occluded](const size_t c)
+		{
+			chunk_visible[c] = update_commands(count * c / chunks, count * (c + 1) / chunks, for_shadow, cull, occlude, chunk_occluded[c]);
+		});
+		for (size_t c = 0; c < chunks; c++)
+		{
+			visible += chunk_visible[c];
+			occluded += chunk_occluded[c];
+		}
+	}
+
+	if (!for_shadow)
+	{
+		frustum_culler::models_visible += visible;
+		occlusion_culler::models_occluded = occluded;
+	}
+	else
+	{
+		shadow_casters_ = visible;
+	}
+	return visible;
+}
+
+uint32_t level::update_commands(const size_t first, const size_t last, const bool for_shadow, const bool cull, const bool occlude, uint32_t& occluded)
+{
+	uint32_t visible = 0;
+	occluded = 0;
+	const bool use_lod = state_->use_lod;
+	for (size_t i = first; i < last; i++)
+	{
+		const uint32_t e = queue_scene_.entities[i];
+		const entity_render& render = scene_.render[e];
+		const bounding_box& bounds = scene_.world_bounds[e];
 		draw_elements_indirect_command& cmd = queue_scene_.commands[i];
 
 		if (for_shadow)
 		{
 			cmd.instanceCount_ = 1;
-			if (!entity.game_properties.is_active)
+			if (!render.is_active)
 				cmd.instanceCount_ = 0;
 
-			if (entity.type == dynamic || entity.type == lava)
+			if (render.type == dynamic || render.type == lava)
 			{
-				const glm::mat4 node_matrix = entity.get_node_matrix();
-				const uint32_t mesh_index = entity.mesh_index;
+				const uint32_t mesh_index = render.mesh_index;
 				const uint32_t material_index = meshes_[mesh_index].material_index;
 				if (materials_[material_index].type == invisible)
 					cmd.instanceCount_ = 0;
-				cmd.baseInstance_ = material_index + (i << 16);
-				queue_scene_.model_matrices[i] = node_matrix;
 			}
+
+			// the shadow pass draws its own copy, culled by the caster frustum and with a LOD by its size in the shadow map
+			draw_elements_indirect_command& caster = queue_scene_.shadow_commands[i];
+			caster = cmd;
+			if (cull && (queue_scene_.shadow_visible[i / 32] >> (i % 32) & 1) == 0)
+				caster.instanceCount_ = 0;
+
+			const uint32_t mesh_index = render.mesh_index;
+			uint32_t LOD = 0;
+			if (use_lod)
+				LOD = lod_system::decide_shadow_lod(meshes_[mesh_index], shadow_texel_size_, queue_scene_.shadow_lods[i]);
+			queue_scene_.shadow_lods[i] = static_cast<uint8_t>(LOD);
+			caster.count_ = meshes_[mesh_index].index_count[LOD];
+			caster.firstIndex_ = get_first_index(meshes_[mesh_index], LOD);
+			visible += caster.instanceCount_;
 		}else
 		{
-			if (state_->cull && cmd.instanceCount_ == 1)
+			if (cull && cmd.instanceCount_ == 1)
 			{
-				if (!frustum_culler::is_box_in_frustum(frustum_culler::frustum_planes, frustum_culler::frustum_corners, entity.world_bounds))
+				if ((queue_scene_.visible[i / 32] >> (i % 32) & 1) == 0)
+				{
+					cmd.instanceCount_ = 0;
+				}
+				else if (occlude && !occlusion_.is_box_visible(bounds))
+				{
 					cmd.instanceCount_ = 0;
+					occluded++;
+				}
 			}
 
-			const uint32_t mesh_index = entity.mesh_index;
+			const uint32_t mesh_index = render.mesh_index;
 
 			uint32_t LOD = 0;
-			if (state_->use_lod)
-				LOD = lod_system::decide_lod(meshes_[mesh_index].index_count.size(), entity.world_bounds);
+			if (use_lod)
+				LOD = lod_system::decide_lod(meshes_[mesh_index], bounds, queue_scene_.lods[i]);
+			queue_scene_.lods[i] = static_cast<uint8_t>(LOD);
 
 			cmd.count_ = meshes_[mesh_index].index_count[LOD];
-			cmd.firstIndex_ = meshes_[mesh_index].index_offset[LOD];
+			cmd.firstIndex_ = get_first_index(meshes_[mesh_index], LOD);
 
-			frustum_culler::models_visible += cmd.instanceCount_;
+			visible += cmd.instanceCount_;
 		}
 	}
+	return visible;
+}
+
+void level::build_meshlet_queue()
+{
+	glm::vec4 planes[6];
+	meshlet_culler::normalize_planes(frustum_culler::frustum_planes, planes);
+	meshlet_culler::meshlets_tested = 0;
+	meshlet_culler::meshlets_visible = 0;
+
+	queue_scene_.meshlet_commands.clear();
+	queue_scene_.short_meshlet_commands = 0;
+	queue_scene_.instances.clear();
+	for (size_t i = 0; i < queue_scene_.commands.size(); i++)
+	{
+		// the meshlets of the 16 bit models end where the first 32 bit model starts
+		if (i == queue_scene_.short_commands)
+			queue_scene_.short_meshlet_commands = static_cast<uint32_t>(queue_scene_.meshlet_commands.size());
+
+		draw_elements_indirect_command cmd = queue_scene_.commands[i];
+		if (cmd.instanceCount_ == 0)
+			continue;
+
+		const sub_mesh& mesh = meshes_[scene_.render[queue_scene_.entities[i]].mesh_index];
+		const size_t lod = queue_scene_.lods[i];
+		cmd.baseInstance_ = static_cast<uint32_t>(queue_scene_.instances.size());
+		queue_scene_.instances.push_back({ static_cast<uint32_t>(i), mesh.material_index });
+
+		const size_t first_command = queue_scene_.meshlet_commands.size();
+		meshlet_culler::cull(meshlets_.data() + mesh.meshlet_offset[lod], mesh.meshlet_count[lod], queue_scene_.model_matrices[i],
+			planes, meshlet_culler::cull_view_pos, cmd, queue_scene_.meshlet_commands);
+
+		// meshlets count their first index inside the pool of their mesh
+		if (!mesh.short_indices)
+			for (size_t c = first_command; c < queue_scene_.meshlet_commands.size(); c++)
+				queue_scene_.meshlet_commands[c].firstIndex_ += wide_index_base_;
+	}
+	if (queue_scene_.short_commands == queue_scene_.commands.size())
+		queue_scene_.short_meshlet_commands = static_cast<uint32_t>(queue_scene_.meshlet_commands.size());
 }
 
 void level::draw_aabbs() const
 {
-	for (const entity& entity : scene_)
+	for (const bounding_box& bounds : scene_.world_bounds)
 	{
-		bounding_box bounds = entity.world_bounds;
-		aabb_viewer_->set_vec3("min", entity.world_bounds.min_);
-		aabb_viewer_->set_vec3("max", entity.world_bounds.max_);
+		aabb_viewer_->set_vec3("min", bounds.min_);
+		aabb_viewer_->set_vec3("max", bounds.max_);
 
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
@@ -763,9 +1707,37 @@ glm::mat4 level::get_tight_scene_frustum(glm::mat4 light_view) const
 	return glm::ortho(min.x, max.x, min.y, max.y, -max.z, -min.z);
 }
 
+bool level::get_shadow_caster_frustum(const glm::mat4& light_view, const glm::mat4& light_proj, const glm::mat4& view_proj, const float margin,
+	const bounding_box& receivers, glm::mat4& caster_frustum) const
+{
+	caster_frustum = light_proj * light_view;
+	const bounding_box scene = corrected_bounds_transform(light_view, scene_bounds_);
+	const bounding_box seen = corrected_bounds_transform(light_view, receivers);
+
+	// the part of the level the camera can see, in light space
+	glm::vec4 corners[8];
+	frustum_culler::get_frustum_corners(view_proj, corners);
+	glm::vec3 lo(std::numeric_limits<float>::max()), hi(std::numeric_limits<float>::lowest());
+	for (const glm::vec4& corner : corners)
+	{
+		const glm::vec3 p = glm::vec3(light_view * glm::vec4(glm::vec3(corner), 1.0f));
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+	lo = glm::max(glm::max(lo, seen.min_) - glm::vec3(margin, margin, 0.0f), scene.min_);
+	hi = glm::min(glm::min(hi, seen.max_) + glm::vec3(margin, margin, 0.0f), scene.max_);
+	if (glm::any(glm::greaterThanEqual(lo, hi)))
+		return false;
+
+	// the light looks down -z, casters lie between the farthest receiver and the light
+	caster_frustum = glm::ortho(lo.x, hi.x, lo.y, hi.y, -scene.max_.z, -lo.z) * light_view;
+	return true;
+}
+
 void level::release() const
 {
-	glDeleteVertexArrays(1, &vao_);
+	if (vao_)
+		glDeleteVertexArrays(1, &vao_);
 
 	for (auto material : materials_)
 	{
@@ -5,9 +5,16 @@
 #include "LightSource.h"
 #include "Camera.h"
 #include "LevelStructs.h"
+#include "EntityTable.h"
 #include "FrustumCuller.h"
+#include "EntityBvh.h"
+#include "VisibilityCache.h"
+#include "OcclusionCuller.h"
+#include "GpuCuller.h"
+#include "PortalCuller.h"
 #include "LodSystem.h"
 #include "buffer.h"
+#include "LevelCache.h"
 #include <glm/gtx/matrix_decompose.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -24,26 +31,93 @@ class level
 {
 private:
 	static constexpr auto vtx_stride = sizeof(vertex);
+	// meshes with up to this many vertices get 16 bit indices
+	static constexpr uint32_t short_index_limit = 65536;
+	// from this many commands on the bvh culls faster than testing every box
+	static constexpr size_t bvh_min_commands = 1024;
+	// commands per job of update_render_queue, smaller queues are updated on the calling thread
+	static constexpr size_t queue_chunk_size = 2048;
+	// occluders are the rigid models with the largest bounds, in the most detailed LOD that has at most max_occluder_triangles
+	static constexpr size_t max_occluders = 32;
+	static constexpr uint32_t max_occluder_triangles = 1024;
+	// and both of their largest bound extents are at least this fraction of the scene size
+	static constexpr float min_occluder_size = 0.05f;
 
 	uint32_t global_vertex_offset_ = 0;
 	uint32_t global_index_offset_ = 0;
+	uint32_t global_short_index_offset_ = 0;
+	// start of the 32 bit pool in the element buffer, in 32 bit indices, the 16 bit pool is in front of it
+	uint32_t wide_index_base_ = 0;
 
 	// buffers
 	GLuint vao_ = 0;
+	// rings written every frame, the shadow and the main pass push into disjoint ranges of them
 	buffer ibo_{ GL_DRAW_INDIRECT_BUFFER };
 	buffer matrix_ssbo_{ GL_SHADER_STORAGE_BUFFER };
+	buffer instance_ssbo_{ GL_SHADER_STORAGE_BUFFER };
+	buffer meshlet_ibo_{ GL_DRAW_INDIRECT_BUFFER };
+	buffer draw_count_{ GL_PARAMETER_BUFFER };	// number of 16 bit and 32 bit commands of every multi draw
+	uint64_t matrix_frame_ = ~0ull;				// ring frame the model matrices were pushed in
+	// written once
 	buffer tex_ssbo_{ GL_SHADER_STORAGE_BUFFER };
+	buffer dequant_ssbo_{ GL_SHADER_STORAGE_BUFFER };
 
 	// mesh data - a loaded scene is entirely contained in these data structures
+	std::string scene_path_;
 	std::vector<sub_mesh> meshes_; 
 	std::vector<float> vertices; 
-	std::vector<unsigned int> indices_; 
+	std::vector<unsigned int> indices_;		// 32 bit pool for meshes with more than short_index_limit vertices
+	std::vector<uint16_t> short_indices_;	// 16 bit pool for all other meshes
+	std::vector<meshlet> meshlets_;
+	std::vector<std::string> material_paths_;
+	std::vector<std::string> material_names_;
 	std::vector<material> materials_;
 	light_sources lights_;
 	render_queue queue_scene_;
-	std::vector<entity> scene_;
-	uint32_t lava_;
+	entity_bvh bvh_;						// over the bounds of queue_scene_, in command order
+	visibility_cache view_cache_;			// culling results of the camera and the shadow frustum of the last frames
+	visibility_cache shadow_cache_;
+	occlusion_culler occlusion_;
+	gpu_culler gpu_;						// culls and picks the LODs of queue_scene_ in compute shaders if gpuCulling is on
+	std::vector<uint32_t> entity_commands_;	// command of every entity, inverse of queue_scene_.entities
+	std::vector<bounding_box> cells_;		// children of the "Cells" node, rooms of the level, and of the "Portals" node,
+	std::vector<bounding_box> portals_;		// the openings between them, both in world space
+	portal_culler portal_culler_;
+
+	// shadow caster culling and LOD of the current shadow pass
+	glm::vec4 shadow_planes_[6];
+	glm::vec4 shadow_corners_[8];
+	bool shadow_receivers_ = true;			// false if the camera sees nothing of the level, then no caster is drawn
+	float shadow_texel_size_ = 1.0f;
+	static constexpr float shadow_caster_margin = 8.0f;	// in shadow map texels
+	uint32_t shadow_casters_ = 0;
+
+	// tests and retested commands of the coherent culling since the last debug output
+	uint64_t coherent_tests_ = 0;
+	uint64_t coherent_retested_ = 0;
+	uint32_t coherent_culls_ = 0;
+	entity_table scene_;
+	uint32_t lava_ = 0;
+	int32_t lava_material_ = -1;
 	bounding_box scene_bounds_;
+	bounding_box static_bounds_;			// bounds of all models that never move, scene_bounds_ is these plus the moving ones
+
+	// commands of the entities that moved since the last frame, with their matrices and bounds for the batched transform
+	std::vector<uint32_t> dirty_commands_;
+	std::vector<glm::mat4> dirty_matrices_;
+	std::vector<bounding_box> dirty_model_bounds_;
+	std::vector<bounding_box> dirty_world_bounds_;
+
+	/// @brief a drawn command of compact_commands, the groups of one mesh are linked, one per visible LOD
+	struct instance_group
+	{
+		uint32_t mesh_index;
+		uint32_t next;				// next group of the same mesh, no_group at the end
+	};
+	static constexpr uint32_t no_group = 0xffffffff;
+	std::vector<instance_group> groups_;		// one per draw command
+	std::vector<uint32_t> mesh_groups_;			// first group of every mesh, no_group between passes
+	std::vector<uint32_t> command_groups_;		// group of every visible command, in command order
 	std::vector<physics_mesh> rigid_;
 	std::vector<physics_mesh> dynamic_;
 
@@ -54,18 +128,28 @@ private:
 	std::shared_ptr<global_state> state_;
 	PerFrameData* perframe_data_{};
 
+	/// @brief output of one mesh extraction, kept apart until all meshes are done so they can run in parallel
+	struct extracted_mesh
+	{
+		sub_mesh mesh;									// offsets are relative to the mesh itself
+		std::vector<float> vertices;
+		std::vector<std::vector<unsigned int>> lods;
+		std::vector<meshlet> meshlets;				// meshlets of all LODs, first_index is relative to its LOD
+	};
+
 	/**
-	 * \brief iterates through a list of assimp meshes, parses adds them to the meshes array
+	 * \brief extracts all assimp meshes on every core, then appends them to the meshes/vertices/indices arrays
+	 * the merge happens in mesh order, so the result is the same as extracting one mesh after another
 	 * \param scene the loaded scene containing the meshes to load
 	 */
 	void load_meshes(const aiScene* scene);
 
 	/**
-	 * \brief extracts vertex and index data, optmizes them and adds them to the indices/vertices arrays
+	 * \brief extracts vertex and index data and optmizes them, touches no level data so it can run on any thread
 	 * \param mesh a mesh containing geometry data
-	 * \return a optimized mesh with all data needed for rendering
+	 * \param result a optimized mesh with all data needed for rendering
 	 */
-	sub_mesh extract_mesh(const aiMesh* mesh);
+	void extract_mesh(const aiMesh* mesh, extracted_mesh& result) const;
 
 	/**
 	 * \brief generates up to 8 LODs for a mesh, code from the 3D Rendering cookbook
@@ -74,7 +158,7 @@ private:
 	 * \param LODs the target index array where the LODs get copied to
 	 */
 	void generate_lods(std::vector<unsigned int>& indices, const std::vector<float>& vertices,
-	                   std::vector<std::vector<unsigned int>>& LODs);
+	                   std::vector<std::vector<unsigned int>>& LODs) const;
 
 	/**
 	 * \brief finds the maximum and minimum vertex positions of a mesh, which should define the bounds (AABB)
@@ -84,10 +168,27 @@ private:
 	bounding_box compute_bounds_of_mesh(const sub_mesh& mesh) const;
 
 	/**
-	 * \brief loads all materials (textures) from the material list assimp provides
+	 * \brief collects the texture folder of every material from the material list assimp provides
 	 * \param scene scene contains the pointer to the material list
 	 */
-	void load_materials(const aiScene* scene);
+	void load_material_paths(const aiScene* scene);
+
+	/**
+	 * \brief loads all materials (textures) from the collected material paths
+	 */
+	void load_materials();
+
+	/**
+	 * \brief fills all level data from the bake of the scene, if it is up to date
+	 * \return false if the bake is missing or stale and the fbx file has to be imported
+	 */
+	bool load_bake();
+
+	/**
+	 * \brief points the level cache to all containers of this level
+	 * \return pointers to the level data
+	 */
+	level_data get_level_data();
 
 	/**
 	 * \brief recursive function that builds a scenegraph with hierarchical transformation, similiar to assimps scene
@@ -96,6 +197,24 @@ private:
 	 */
 	void traverse_tree(const aiNode* n, const glm::mat4 mat, entity_type type);
 
+	/**
+	 * \brief collects the cells and portals of the portal culling, the world bounds of the meshes below the "Cells" and "Portals" nodes
+	 * these nodes are no entities, traverse_tree skips them
+	 * \param scene the loaded scene containing the nodes
+	 */
+	void collect_cells(const aiScene* scene);
+
+	/**
+	 * \brief adds the world bounds of every node with meshes below a node
+	 * \param mat accumulated transformation of the parents of n
+	 */
+	void collect_node_bounds(const aiScene* scene, const aiNode* n, const glm::mat4& mat, std::vector<bounding_box>& bounds) const;
+
+	/**
+	 * \brief links the portals to the cells they connect, the commands are put into their cells by build_queue_bounds
+	 */
+	void link_cells();
+
 	/**
 	 * \brief loads and compiles shaders for debugging the AABBs and the frustum culler
 	 */
@@ -103,6 +222,7 @@ private:
 
 	/**
 	 * \brief Creates and fills vertex and index buffers and sets up the "big" vao which contains all meshes
+	 * with packed vertices the vbo holds 16 byte vertices and the float vertices are released afterwards
 	 */
 	void setup_buffers();
 
@@ -121,14 +241,117 @@ private:
 
 	/**
 	 * \brief recursively builds for every material a render command list by adding all unculled objects
+	 * models with 16 bit indices come first, so both index types can be drawn with one multi draw each
 	 */
 	void build_render_queue();
 
 	/**
-	 * \brief recursively builds for every material a render command list by adding all unculled objects
+	 * \brief fills the culling bounds, the list of moving commands and the bvh from the commands of the render queue
 	 */
-	void update_render_queue(bool for_shadow);
+	void build_queue_bounds();
 
+	/**
+	 * \brief first index of a LOD in the element buffer, in units of the index type of the mesh
+	 */
+	uint32_t get_first_index(const sub_mesh& mesh, size_t lod) const;
+
+	/**
+	 * \brief draws the 16 bit and the 32 bit commands in the bound indirect buffer
+	 * the counts are pushed into draw_count_ if indirect_count_supported
+	 * \param short_count number of commands with 16 bit indices at the start of the buffer
+	 * \param count number of all commands
+	 * \param first offset of the first command in the indirect buffer
+	 */
+	void draw_indirect(uint32_t short_count, size_t count, GLintptr first);
+
+	/**
+	 * \brief pushes the model matrices into their ring and binds them, once per frame for both passes
+	 */
+	void push_matrices();
+
+	/**
+	 * \brief pushes the commands of a pass and the instances of the render queue into their rings and draws them
+	 * \param ring indirect buffer of the commands
+	 * \param commands of the pass, the 16 bit ones first
+	 * \param short_count number of commands with 16 bit indices
+	 */
+	void draw_pass(buffer& ring, const std::vector<draw_elements_indirect_command>& commands, uint32_t short_count);
+
+	/**
+	 * \brief merges the commands with an instance into draw_commands of the render queue, one instanced command per mesh and LOD
+	 * the models of every command are listed in instances, the commands are in the order of the first model they draw
+	 * \param commands commands of the pass, culled ones have no instance
+	 */
+	void compact_commands(const std::vector<draw_elements_indirect_command>& commands);
+
+	/**
+	 * \brief recomputes world bounds and matrices of the moving commands whose entity is dirty
+	 * updates the culling bounds, the bvh and scene_bounds_ from these commands only
+	 */
+	void update_moving_bounds();
+
+	/**
+	 * \brief culls all commands against a frustum, with the results of the last frames if coherent culling is on
+	 * \param cache remembers the results of this frustum
+	 * \param visible receives one bit per command
+	 */
+	void cull_queue(const glm::vec4* planes, const glm::vec4* corners, visibility_cache& cache, uint32_t* visible);
+
+	/// @brief true if the cells the camera sees limit the shadow receivers and the commands of the CPU culling
+	bool use_portals() const { return state_->cull && state_->portal_cull && portal_culler_.get_cell_count() > 0; }
+
+	/// @brief true if the compute shaders cull and draw this frame, meshlet culling stays on the CPU
+	bool use_gpu_culling() const { return gpu_.is_built() && !(state_->cull && state_->meshlet_cull); }
+
+	/// @brief the flags of the model of a command for gpu_, drawn if it is active and not an invisible moving model like the CPU path
+	uint32_t get_gpu_flags(uint32_t command) const;
+
+	/**
+	 * \brief the view of a pass for gpu_ from the state of frustum_culler, lod_system and the shadow caster frustum
+	 */
+	gpu_culler::view get_gpu_view(bool for_shadow) const;
+
+	/**
+	 * \brief the part of the light frustum that can cast shadows into the view of the camera
+	 * the light space bounds of the camera frustum and the level overlap in x and y, and reach from the farthest receiver up to the light
+	 * \param light_view view matrix of the light
+	 * \param light_proj result of get_tight_scene_frustum
+	 * \param view_proj view projection matrix of the camera
+	 * \param margin added around the camera frustum in x and y, in world units, so filtered shadow lookups at the border still find their casters
+	 * \param receivers the part of the level the camera can see, the whole level or the visible cells of the portal culling
+	 * \param caster_frustum view projection matrix of the caster frustum
+	 * \return false if the camera doesn't see any part of the level
+	 */
+	bool get_shadow_caster_frustum(const glm::mat4& light_view, const glm::mat4& light_proj, const glm::mat4& view_proj, float margin,
+		const bounding_box& receivers, glm::mat4& caster_frustum) const;
+
+	/**
+	 * \brief culls the render queue and updates the LOD of every command, ranges of commands are updated on the job system
+	 * \param for_shadow fills shadow_commands instead, culled against the shadow caster frustum and with LODs by shadow map texels
+	 * \param chunks number of ranges to split the commands into, 0 for one per queue_chunk_size commands
+	 * \return number of visible commands, also added to frustum_culler::models_visible
+	 */
+	uint32_t update_render_queue(bool for_shadow, size_t chunks = 0);
+
+	/**
+	 * \brief updates the commands in [first, last), touches nothing but these commands
+	 * \param occlude test the visible commands against the depth of occlusion_
+	 * \param occluded receives the number of commands hidden by occluders
+	 * \return number of visible commands in the range
+	 */
+	uint32_t update_commands(size_t first, size_t last, bool for_shadow, bool cull, bool occlude, uint32_t& occluded);
+
+	/**
+	 * \brief picks the largest rigid models as occluders and hands their triangles in world space to occlusion_
+	 */
+	void collect_occluders();
+
+
+	/**
+	 * \brief replaces the command of every visible model with one command per visible meshlet of its LOD
+	 * every visible model gets one entry in instances, shared by its meshlets
+	 */
+	void build_meshlet_queue();
 
 	/**
 	 * \brief recursively renders every AABB as a wireframe box
@@ -137,11 +360,9 @@ private:
 	void draw_aabbs() const;
 
 	/**
-	 * \brief recursively transforms AABBs in the scene graph from model space to world space
-	 * \param node that gets transformed
-	 * \param global_transform is the accumulation of parent transforms
+	 * \brief transforms the AABBs of all entities from model space to world space
 	 */
-	void transform_bounding_boxes() const;
+	void transform_bounding_boxes();
 
 	/**
 	 * \brief calculates bounds in world space from model space
@@ -152,7 +373,7 @@ private:
 	bounding_box corrected_bounds_transform(glm::mat4 mat, bounding_box bounds) const;
 
 	/**
-	 * \brief computes the tightest possible bounds of the whole scene
+	 * \brief computes the tightest possible bounds of the whole scene and of its models that never move
 	 */
 	void get_scene_bounds();
 
@@ -169,13 +390,70 @@ private:
 	void release() const;
 
 public:
+	// set after glewInit, multi draws take their draw count from a buffer then
+	static bool indirect_count_supported;
+
 	/// @brief loads an fbx file from the given path and converts it to GL data structures
 	/// @param scene_path location of the fbx file, expected to be in folder "assets"
 	/// @param state global state of the program, needed for screen resolution, etc
 	/// @param perframe_data camera uniforms, needed for frustum culling
 	level(const char* scene_path, std::shared_ptr<global_state> state, PerFrameData& perframe_data);
+
+	/// @brief loads only the CPU side of a level (geometry, lights, entities), no GL context is needed
+	/// used by the command line tools
+	/// @param scene_path location of the fbx file
+	/// @param use_bake loads the bake instead of the fbx file if it is up to date
+	level(const char* scene_path, bool use_bake);
 	~level() { release(); }
 
+	/**
+	 * \brief writes all loaded level data into a bake next to the fbx file
+	 * \return false if the bake couldn't be written
+	 */
+	bool save_bake();
+
+	/**
+	 * \brief prints the size of both index pools and how much they save compared to 32 bit indices only
+	 */
+	void print_index_memory() const;
+
+	occlusion_culler& get_occlusion_culler() { return occlusion_; }
+	portal_culler& get_portal_culler() { return portal_culler_; }
+
+	/**
+	 * \brief uploads the render queue to the GPU culling, called by setup_buffers if gpuCulling is on and by the tools
+	 * needs a GL context, the queue of a headless level can be culled on the GPU but not drawn
+	 */
+	void setup_gpu_culling();
+
+	gpu_culler& get_gpu_culler() { return gpu_; }
+	const render_queue& get_render_queue() const { return queue_scene_; }
+
+	/**
+	 * \brief replaces the render queue of a headless level with copies of its entities side by side, until it has count commands
+	 * only for benchmarks, the queue can be updated but not drawn
+	 */
+	void build_benchmark_queue(size_t count);
+
+	/**
+	 * \brief replaces the meshes and entities of a headless level with random boxes of synthetic meshes that have LODs
+	 * but no geometry, for benchmarks on machines without the level, build_benchmark_queue turns them into a queue
+	 */
+	void build_synthetic_scene(size_t count);
+
+	/**
+	 * \brief culls and updates the render queue like a frame does, from the view in frustum_culler and lod_system
+	 * \param chunks number of ranges that are updated in parallel, 0 like the game
+	 * \return number of visible commands
+	 */
+	uint32_t update_benchmark_queue(size_t chunks);
+
+	/**
+	 * \brief groups the visible commands of the last update into instanced commands, like a frame does before drawing
+	 * \return number of instanced commands
+	 */
+	size_t compact_benchmark_queue() { compact_commands(queue_scene_.commands); return queue_scene_.draw_commands.size(); }
+
 	/**
 	 * \brief sets up indirect render calls, binds the data and calls the actual draw routine
 	 * it is assumed that draw_scene_shadow_map was called prior and no other vao was bound
@@ -183,9 +461,10 @@ public:
 	void draw_scene();
 
 	/**
-	 * \brief same as draw_scene, but nothing gets culled and no textures are bound
+	 * \brief draws the shadow casters that can reach the view of the camera into the bound shadow map, no textures are bound
+	 * \param shadow_size edge length of the shadow map in texels
 	 */
-	void draw_scene_shadow_map();
+	void draw_scene_shadow_map(int shadow_size);
 
 	/**
 	 * \brief generates a vector of rigid meshes, which are unmovable
@@ -206,4 +485,17 @@ public:
 	glm::mat4 get_tight_scene_frustum(glm::mat4 light_view) const;
 	
 	light_sources* get_lights() { return &lights_; }
+
+	// read access for the command line tools
+	const std::vector<sub_mesh>& get_meshes() const { return meshes_; }
+	const std::vector<float>& get_vertices() const { return vertices; }
+	const std::vector<unsigned int>& get_indices() const { return indices_; }
+	const std::vector<uint16_t>& get_short_indices() const { return short_indices_; }
+	const std::vector<meshlet>& get_meshlets() const { return meshlets_; }
+	const entity_table& get_scene() const { return scene_; }
+	entity_handle get_entity(const uint32_t index) { return scene_.get(index); }
+	const std::vector<std::string>& get_material_paths() const { return material_paths_; }
+	const light_sources& get_light_sources() const { return lights_; }
+	const std::vector<bounding_box>& get_cells() const { return cells_; }
+	const std::vector<bounding_box>& get_portals() const { return portals_; }
 };
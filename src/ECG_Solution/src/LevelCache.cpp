@@ -0,0 +1,380 @@
+#include "LevelCache.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+//---------------------------------------------------------------------------------------------------------------//
+// mapped file
+
+bool mapped_file::open(const char* path)
+{
+	release();
+#ifdef _WIN32
+	const HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	file_ = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		release();
+		return false;
+	}
+
+	mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_ == nullptr)
+	{
+		release();
+		return false;
+	}
+	data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+	size_ = static_cast<size_t>(size.QuadPart);
+#else
+	file_ = ::open(path, O_RDONLY);
+	if (file_ < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(file_, &st) != 0 || st.st_size == 0)
+	{
+		release();
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, file_, 0);
+	data_ = view == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(view);
+	size_ = static_cast<size_t>(st.st_size);
+#endif
+	if (data_ == nullptr)
+	{
+		release();
+		return false;
+	}
+	return true;
+}
+
+void mapped_file::release()
+{
+#ifdef _WIN32
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_) CloseHandle(mapping_);
+	if (file_) CloseHandle(file_);
+	mapping_ = nullptr;
+	file_ = nullptr;
+#else
+	if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+	if (file_ >= 0) close(file_);
+	file_ = -1;
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------//
+// serialization helpers
+
+namespace
+{
+	/// @brief appends plain data to the bake, keeps every section 4 byte aligned
+	class bake_writer
+	{
+	public:
+		explicit bake_writer(std::ofstream& out) : out_(out) {}
+
+		void write_raw(const void* data, const size_t size)
+		{
+			static const char zeros[4] = { 0,0,0,0 };
+			if (size != 0)
+				out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			out_.write(zeros, static_cast<std::streamsize>((4 - size % 4) % 4));
+		}
+
+		template <typename T>
+		void write_pod(const T& value) { write_raw(&value, sizeof(T)); }
+
+		template <typename T>
+		void write_array(const std::vector<T>& values) { write_raw(values.data(), values.size() * sizeof(T)); }
+
+		void write_string(const std::string& s)
+		{
+			write_pod(static_cast<uint32_t>(s.size()));
+			write_raw(s.data(), s.size());
+		}
+
+	private:
+		std::ofstream& out_;
+	};
+
+	/// @brief reads plain data from a mapped bake, every read is bounds checked
+	class bake_reader
+	{
+	public:
+		bake_reader(const uint8_t* data, const size_t size) : data_(data), size_(size) {}
+
+		bool ok() const { return ok_; }
+
+		const uint8_t* read_raw(const size_t size)
+		{
+			// checked before padding, a corrupt size close to the end of size_t wraps when it is rounded up
+			const size_t left = size_ - offset_;
+			const size_t padded = size <= left ? size + (4 - size % 4) % 4 : left + 1;
+			if (!ok_ || padded > left)
+			{
+				ok_ = false;
+				return nullptr;
+			}
+			const uint8_t* result = data_ + offset_;
+			offset_ += padded;
+			return result;
+		}
+
+		template <typename T>
+		T read_pod()
+		{
+			T value{};
+			const uint8_t* p = read_raw(sizeof(T));
+			if (p) memcpy(&value, p, sizeof(T));
+			return value;
+		}
+
+		template <typename T>
+		void read_array(std::vector<T>& values, const size_t count)
+		{
+			// a corrupt count wraps count * sizeof(T) on 32 bit, it must fail here instead of in values.resize
+			if (count > (size_ - offset_) / sizeof(T))
+			{
+				ok_ = false;
+				return;
+			}
+			const uint8_t* p = read_raw(count * sizeof(T));
+			if (!p) return;
+			values.resize(count);
+			if (count != 0) memcpy(values.data(), p, count * sizeof(T));
+		}
+
+		std::string read_string()
+		{
+			const auto length = read_pod<uint32_t>();
+			const uint8_t* p = read_raw(length);
+			return p ? std::string(reinterpret_cast<const char*>(p), length) : std::string();
+		}
+
+	private:
+		const uint8_t* data_;
+		size_t size_;
+		size_t offset_ = 0;
+		bool ok_ = true;
+	};
+
+	constexpr char bake_magic[4] = { 'G', 'L', 'V', 'L' };
+}
+
+//---------------------------------------------------------------------------------------------------------------//
+// level cache
+
+std::string level_cache::bake_path_of(const char* scene_path)
+{
+	std::string path = scene_path;
+	const size_t dot = path.find_last_of('.');
+	const size_t slash = path.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		path.erase(dot);
+	return path + ".level";
+}
+
+bool level_cache::file_stamp(const char* path, uint64_t& size, int64_t& time)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+	size = static_cast<uint64_t>(st.st_size);
+	time = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
+
+bool level_cache::is_stale(const char* bake_path, const char* scene_path)
+{
+	std::ifstream in(bake_path, std::ios::binary);
+	if (!in.is_open())
+		return true;
+
+	header h{};
+	in.read(reinterpret_cast<char*>(&h), sizeof(header));
+	if (!in || memcmp(h.magic, bake_magic, 4) != 0 || h.version != version)
+		return true;
+
+	uint64_t size; int64_t time;
+	if (!file_stamp(scene_path, size, time))
+		return false; // only the bake is shipped
+
+	return size != h.source_size || time != h.source_time;
+}
+
+bool level_cache::write(const char* bake_path, const char* scene_path, const level_data& data)
+{
+	std::ofstream out(bake_path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+		std::cerr << "ERROR: Couldn't write level bake " << bake_path << std::endl;
+		return false;
+	}
+
+	header h{};
+	memcpy(h.magic, bake_magic, 4);
+	h.version = version;
+	file_stamp(scene_path, h.source_size, h.source_time);
+	h.vertex_floats = static_cast<uint32_t>(data.vertices->size());
+	h.index_count = static_cast<uint32_t>(data.indices->size());
+	h.short_index_count = static_cast<uint32_t>(data.short_indices->size());
+	h.meshlet_count = static_cast<uint32_t>(data.meshlets->size());
+	h.mesh_count = static_cast<uint32_t>(data.meshes->size());
+	h.material_count = static_cast<uint32_t>(data.material_paths->size());
+	h.directional_count = static_cast<uint32_t>(data.lights->directional.size());
+	h.point_count = static_cast<uint32_t>(data.lights->point.size());
+	h.entity_count = static_cast<uint32_t>(data.scene->size());
+	h.lava = *data.lava;
+	h.lava_material = *data.lava_material;
+	h.cell_count = static_cast<uint32_t>(data.cells->size());
+	h.portal_count = static_cast<uint32_t>(data.portals->size());
+
+	bake_writer w(out);
+	w.write_pod(h);
+	w.write_array(*data.vertices);
+	w.write_array(*data.indices);
+	w.write_array(*data.short_indices);
+	w.write_array(*data.meshlets);
+
+	for (const sub_mesh& mesh : *data.meshes)
+	{
+		w.write_string(mesh.name);
+		w.write_pod(mesh.vertex_offset);
+		w.write_pod(mesh.vertex_count);
+		w.write_pod(mesh.material_index);
+		w.write_pod(static_cast<uint32_t>(mesh.short_indices));
+		w.write_pod(static_cast<uint32_t>(mesh.index_offset.size()));
+		w.write_array(mesh.index_offset);
+		w.write_array(mesh.index_count);
+		w.write_array(mesh.lod_error);
+		w.write_array(mesh.meshlet_offset);
+		w.write_array(mesh.meshlet_count);
+	}
+
+	for (size_t i = 0; i < data.material_paths->size(); i++)
+	{
+		w.write_string((*data.material_paths)[i]);
+		w.write_string((*data.material_names)[i]);
+	}
+
+	w.write_array(data.lights->directional);
+	w.write_array(data.lights->point);
+
+	const entity_table& scene = *data.scene;
+	for (uint32_t i = 0; i < scene.size(); i++)
+	{
+		w.write_string(scene.get_name(i));
+		w.write_pod(static_cast<uint32_t>(scene.render[i].type));
+		w.write_pod(scene.render[i].mesh_index);
+		w.write_pod(scene.transforms[i]);
+		w.write_pod(scene.model_bounds[i]);
+	}
+
+	w.write_array(*data.cells);
+	w.write_array(*data.portals);
+
+	return out.good();
+}
+
+bool level_cache::read(const char* bake_path, const level_data& data)
+{
+	mapped_file file;
+	if (!file.open(bake_path))
+		return false;
+
+	bake_reader r(file.data(), file.size());
+	const auto h = r.read_pod<header>();
+	if (!r.ok() || memcmp(h.magic, bake_magic, 4) != 0 || h.version != version)
+		return false;
+
+	// read into temporaries first, a corrupted bake must not leave a half filled level behind
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	r.read_array(vertices, h.vertex_floats);
+	r.read_array(indices, h.index_count);
+	std::vector<uint16_t> short_indices;
+	r.read_array(short_indices, h.short_index_count);
+	std::vector<meshlet> meshlets;
+	r.read_array(meshlets, h.meshlet_count);
+
+	std::vector<sub_mesh> meshes(h.mesh_count);
+	for (sub_mesh& mesh : meshes)
+	{
+		mesh.name = r.read_string();
+		mesh.vertex_offset = r.read_pod<uint32_t>();
+		mesh.vertex_count = r.read_pod<uint32_t>();
+		mesh.material_index = r.read_pod<uint32_t>();
+		mesh.short_indices = r.read_pod<uint32_t>() != 0;
+		const auto lods = r.read_pod<uint32_t>();
+		r.read_array(mesh.index_offset, lods);
+		r.read_array(mesh.index_count, lods);
+		r.read_array(mesh.lod_error, lods);
+		r.read_array(mesh.meshlet_offset, lods);
+		r.read_array(mesh.meshlet_count, lods);
+		if (!r.ok()) return false;
+	}
+
+	std::vector<std::string> material_paths(h.material_count), material_names(h.material_count);
+	for (uint32_t i = 0; i < h.material_count; i++)
+	{
+		material_paths[i] = r.read_string();
+		material_names[i] = r.read_string();
+	}
+
+	light_sources lights;
+	r.read_array(lights.directional, h.directional_count);
+	r.read_array(lights.point, h.point_count);
+
+	entity_table scene;
+	scene.reserve(r.ok() ? h.entity_count : 0);
+	for (uint32_t i = 0; r.ok() && i < h.entity_count; i++)
+	{
+		const std::string name = r.read_string();
+		const auto type = static_cast<entity_type>(r.read_pod<uint32_t>());
+		const auto mesh_index = r.read_pod<int32_t>();
+		const auto trs = r.read_pod<transformation>();
+		const auto model = r.read_pod<bounding_box>();
+		if (!r.ok()) return false;
+		scene.add(name, type, mesh_index, trs, model);
+	}
+
+	std::vector<bounding_box> cells, portals;
+	r.read_array(cells, h.cell_count);
+	r.read_array(portals, h.portal_count);
+
+	if (!r.ok())
+		return false;
+
+	*data.vertices = std::move(vertices);
+	*data.indices = std::move(indices);
+	*data.short_indices = std::move(short_indices);
+	*data.meshlets = std::move(meshlets);
+	*data.meshes = std::move(meshes);
+	*data.material_paths = std::move(material_paths);
+	*data.material_names = std::move(material_names);
+	*data.lights = std::move(lights);
+	*data.scene = std::move(scene);
+	*data.lava = h.lava;
+	*data.lava_material = h.lava_material;
+	*data.cells = std::move(cells);
+	*data.portals = std::move(portals);
+	return true;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "EntityTable.h"
+#include "LightSource.h"
+
+/// @brief read only memory mapping of a whole file, unmapped on destruction
+class mapped_file
+{
+private:
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+#ifdef _WIN32
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+
+	void release();
+
+public:
+	mapped_file() = default;
+	~mapped_file() { release(); }
+
+	/**
+	 * \brief maps a file into the address space of the process
+	 * \param path location of the file
+	 * \return false if the file doesn't exist or can't be mapped
+	 */
+	bool open(const char* path);
+
+	const uint8_t* data() const { return data_; }
+	size_t size() const { return size_; }
+
+	// ensure RAII compliance
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+};
+
+/// @brief points to all containers of a level that get written to or read from a bake
+/// the baked data is everything the level gets from assimp, so nothing needs to be parsed at startup
+struct level_data
+{
+	std::vector<sub_mesh>* meshes;
+	std::vector<float>* vertices;
+	std::vector<unsigned int>* indices;
+	std::vector<uint16_t>* short_indices;
+	std::vector<meshlet>* meshlets;
+	std::vector<std::string>* material_paths;	// texture path of the material, empty for invisible materials
+	std::vector<std::string>* material_names;
+	light_sources* lights;
+	entity_table* scene;
+	uint32_t* lava;								// entity index of the lava
+	int32_t* lava_material;						// material index of the lava, -1 if there is none
+	std::vector<bounding_box>* cells;			// bounds of the cells of the portal culling
+	std::vector<bounding_box>* portals;			// bounds of the openings between the cells
+};
+
+/// @brief a versioned binary level format, written once from an fbx file and afterwards memory mapped
+/// layout: header | vertices | indices | short indices | meshlets | meshes | materials | lights | entities | cells | portals
+/// every section starts 4 byte aligned, the vertex and index arrays are copied with a single memcpy
+class level_cache
+{
+public:
+	static constexpr uint32_t version = 6;
+
+	/**
+	 * \brief derives the location of the bake from the location of the fbx file, eg. "gameplay.fbx" -> "gameplay.level"
+	 * \param scene_path location of the fbx file
+	 * \return location of the bake
+	 */
+	static std::string bake_path_of(const char* scene_path);
+
+	/**
+	 * \brief checks if a bake exists, has the current version and was baked from the current fbx file
+	 * \param bake_path location of the bake
+	 * \param scene_path location of the fbx file, if it doesn't exist every valid bake is up to date
+	 * \return true if the bake has to be rebuilt
+	 */
+	static bool is_stale(const char* bake_path, const char* scene_path);
+
+	/**
+	 * \brief writes all level data into a bake
+	 * \param bake_path location of the bake
+	 * \param scene_path location of the fbx file the data was loaded from, stored for staleness checks
+	 * \param data the level data to write
+	 * \return false if the file couldn't be written
+	 */
+	static bool write(const char* bake_path, const char* scene_path, const level_data& data);
+
+	/**
+	 * \brief memory maps a bake and fills the level data from it
+	 * \param bake_path location of the bake
+	 * \param data containers that get filled, they are only touched if the whole bake is valid
+	 * \return false if the bake is missing, has the wrong version or is corrupted
+	 */
+	static bool read(const char* bake_path, const level_data& data);
+
+	/**
+	 * \brief reads size and modification time of a file, used to detect stale bakes and caches
+	 * \return false if the file doesn't exist
+	 */
+	static bool file_stamp(const char* path, uint64_t& size, int64_t& time);
+
+private:
+	/// @brief fixed size start of every bake
+	struct header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t source_size;		// size of the fbx file at bake time
+		int64_t source_time;		// last modification of the fbx file at bake time
+		uint32_t vertex_floats;
+		uint32_t index_count;
+		uint32_t mesh_count;
+		uint32_t material_count;
+		uint32_t directional_count;
+		uint32_t point_count;
+		uint32_t entity_count;
+		uint32_t lava;
+		int32_t lava_material;
+		uint32_t meshlet_count;
+		uint32_t short_index_count;
+		uint32_t cell_count;
+		uint32_t portal_count;
+		uint32_t padding;
+	};
+};
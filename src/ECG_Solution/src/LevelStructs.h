@@ -18,25 +18,74 @@ struct bounding_box
 	bounding_box(const glm::vec3& min, const glm::vec3& max) : min_(glm::min(min, max)), max_(glm::max(min, max)) {}
 };
 
+/// @brief bounding boxes of many models as structure of arrays, so the frustum culler can test 16 at once
+/// the arrays are padded to a multiple of 16 boxes, the padding boxes are empty and at the origin
+struct box_soa
+{
+	std::vector<float> min_x, min_y, min_z;
+	std::vector<float> max_x, max_y, max_z;
+	size_t count = 0;
+
+	void resize(const size_t n)
+	{
+		count = n;
+		const size_t padded = (n + 15) / 16 * 16;
+		for (std::vector<float>* v : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z })
+			v->resize(padded, 0.0f);
+	}
+
+	void set(const size_t i, const bounding_box& b)
+	{
+		min_x[i] = b.min_.x; min_y[i] = b.min_.y; min_z[i] = b.min_.z;
+		max_x[i] = b.max_.x; max_y[i] = b.max_.y; max_z[i] = b.max_.z;
+	}
+
+	/// @brief number of 32 bit words of a visibility mask with one bit per box
+	size_t mask_words() const { return (count + 31) / 32; }
+};
+
 /// @brief describes the position of a mesh in an index and vertex array 
 struct sub_mesh
 {
 	std::string name;						// name of the mesh, for debugging
-	std::vector<uint32_t> index_offset;		// start of mesh in vector indices_, [0] offset to original index - [8] offset to lowest LOD 
+	std::vector<uint32_t> index_offset;		// start of mesh in its index pool, [0] offset to original index - [8] offset to lowest LOD 
 	uint32_t vertex_offset{};				// start of mesh in vector vertices
 	std::vector<uint32_t> index_count;		// number of indices to render, [0] original index count - [8] lowest LOD
+	std::vector<float> lod_error;			// geometric error of every LOD against LOD 0 in model units, [0] = 0, never decreases
 	uint32_t vertex_count{};				// number of vertices to render
 	uint32_t material_index{};				// associated material
+	std::vector<uint32_t> meshlet_offset;	// start of the meshlets of every LOD in vector meshlets_
+	std::vector<uint32_t> meshlet_count;	// number of meshlets of every LOD
+	bool short_indices{};					// indices are stored in the 16 bit pool short_indices_ instead of indices_
+};
+
+/// @brief a cluster of up to 126 triangles of a mesh LOD, its triangles are stored contiguously in the index array
+/// std430 layout, bounds are in model space
+struct meshlet
+{
+	glm::vec4 sphere;			// xyz = center, w = radius
+	glm::vec4 cone_apex;		// xyz = apex of the normal cone, w = unused
+	glm::vec4 cone_axis;		// xyz = axis, w = cutoff, backfacing if dot(normalize(apex - view), axis) >= cutoff
+	uint32_t first_index;		// start of the triangles in the index pool of its mesh
+	uint32_t index_count;
+	uint32_t padding[2];
 };
 
 /// @brief describes one indirect command for glDraw_Indirect calls
 struct draw_elements_indirect_command
 {
 	uint32_t count_;			// number of indices that get drawn, eg for single quad = 6
-	uint32_t instanceCount_;	// number of instanced that get drawn, 0 means none, this programm doesn't use instanced rendering
+	uint32_t instanceCount_;	// number of instanced that get drawn, 0 means none, queued commands have 1 or 0, drawn ones one per model of their group
 	uint32_t firstIndex_;		// index offset, eg for LOD0 = 0, LOD1 = LOD0.idxcount, LOD1 = LOD0.idxcount + LOD1.idxcount, etc
 	uint32_t baseVertex_;		// offset added before selecting vertices
-	uint32_t baseInstance_;		// accessible in GLSL as "gl_BaseInstance", used for model matrix
+	uint32_t baseInstance_;		// accessible in GLSL as "gl_BaseInstance", first draw_instance of the command
+};
+
+/// @brief one model drawn by an instanced command, found in GLSL at gl_BaseInstance + gl_InstanceID, std430 layout
+struct draw_instance
+{
+	uint32_t model;				// index of the model matrix and the vertex dequantization of the model
+	uint32_t material;
 };
 
 
@@ -60,14 +109,13 @@ struct collectable_item_properties {
 /// @brief a collection of settings for an object in the game world
 struct game_properties {
 	std::string display_name = "Gameobject";
-	bool is_active = true; // only active items are rendered. only active items are allowed to interact with the physics world
 	bool is_collectable = false; // determines if the player can collect it
 	bool is_ground = true; // determines wether the player can jump off of it
 	collectable_item_properties collectableItemProperties; // if the gamobject is collectable this determines some extra properties
 };
 
 /// @brief implements a simple scene graph of hierarchical transformations
-///	DEPRECATED - use entity
+///	DEPRECATED - use entity_table
 struct hierarchy
 {
 	std::string name;
@@ -103,47 +151,26 @@ struct hierarchy
 
 enum entity_type { rigid, dynamic, decoration, lava };
 
-/**
- * \brief describes a single model in a scene
- */
-struct entity
-{
-	std::string name;
-	entity_type type;
-	int32_t mesh_index = -1;
-
-	transformation TRS;
-
-	mutable bounding_box world_bounds;					// pretransformed bounds
-	bounding_box model_bounds;					// bounds in model space
-
-	game_properties game_properties;
-
-	/// return TRS "model matrix" of the node
-	glm::mat4 get_node_matrix() const { return TRS.get_matrix(); }
-
-	/// @return memory efficient TRS data
-	transformation get_node_trs() const { return TRS; }
-
-	/// @brief set TRS "model matrix" of the node
-	void set_node_trs(const glm::vec3 T, const glm::quat R, const glm::vec3 S)
-	{
-		OPTICK_PUSH("set trs")
-			TRS.translate = T; TRS.rotation = R; TRS.scale = S;
-		TRS.local = glm::translate(T) * glm::toMat4(R);
-		auto min = TRS.local * glm::vec4(model_bounds.min_, 1.0f);
-		auto max = TRS.local * glm::vec4(model_bounds.max_, 1.0f);
-		world_bounds = { min, max };
-		OPTICK_POP()
-	}
-};
-
 /// @brief contains a list of draw commands and matching model matrices for models of the same material
 struct render_queue
 {
 	std::string material;
 	std::vector<draw_elements_indirect_command> commands;
 	std::vector<glm::mat4> model_matrices;
+	std::vector<uint32_t> entities;									// entity of every command
+	box_soa bounds;													// world bounds of every command for the frustum culler
+	std::vector<uint32_t> moving;									// commands of dynamic entities, their bounds change every frame
+	std::vector<uint32_t> visible;									// frustum culling result, one bit per command
+	std::vector<uint8_t> lods;										// LOD of every command, the LOD choice of the next frame starts from it
+	std::vector<uint8_t> shadow_lods;
+	std::vector<draw_elements_indirect_command> shadow_commands;	// copy of commands for the shadow map, with its own culling and LOD
+	std::vector<uint32_t> shadow_visible;							// shadow caster culling result, one bit per command
+	uint32_t short_commands = 0;									// commands with 16 bit indices, they come before the 32 bit ones
+	std::vector<draw_elements_indirect_command> draw_commands;		// one instanced command per visible mesh LOD of the current pass, in the order of commands
+	uint32_t short_draw_commands = 0;
+	std::vector<draw_instance> instances;							// models of draw_commands or meshlet_commands, grouped by command
+	std::vector<draw_elements_indirect_command> meshlet_commands;	// one command per visible meshlet
+	uint32_t short_meshlet_commands = 0;
 };
 
 /// @brief contains single mesh for bullet physics simulation
@@ -151,7 +178,7 @@ struct physics_mesh
 {
 	std::vector<float> vtx_positions;		// all positions (x,y,z) in model space
 	transformation model_trs;				// model tranformation into world space
-	entity* entity;						// pointer to set node matrices, only for dynamic objects
+	uint32_t entity;						// index in the entity table of the level, to set node matrices of dynamic objects
 };
 
 /// @brief needed for mesh optimizer
@@ -161,3 +188,22 @@ struct vertex
 	float nx, ny, nz;
 	float tx, ty;
 };
+
+/// @brief compact GPU vertex, 16 instead of 32 bytes
+struct packed_vertex
+{
+	uint16_t px, py, pz, pw;	// unorm16 position relative to the AABB of the mesh, pw is padding
+	int16_t nx, ny;				// snorm16 octahedral encoded normal
+	uint16_t tx, ty;			// unorm16 uv relative to the uv range of the mesh
+};
+
+/// @brief per mesh parameters to restore packed vertices, std430 layout for the shaders
+struct vertex_dequant
+{
+	glm::vec4 position_min{ 0.0f, 0.0f, 0.0f, 0.0f };	// w = 1 if the normals are octahedral encoded
+	glm::vec4 position_extent{ 1.0f, 1.0f, 1.0f, 0.0f };
+	glm::vec4 uv{ 0.0f, 0.0f, 1.0f, 1.0f };				// xy = min, zw = extent
+};
+
+static_assert(sizeof(packed_vertex) == 16, "packed vertices should be half of a float vertex");
+static_assert(sizeof(vertex_dequant) % 16 == 0, "vertex_dequant should be padded to 16 bytes for std430");
@@ -1,56 +1,42 @@
 #include "LodSystem.h"
+#include <algorithm>
+#include <cmath>
 
 float lod_system::near_plane = 0.1f;
-glm::vec4 lod_system::view_dir = glm::vec4(0, 0, -1, 1);
 glm::vec4 lod_system::view_pos = glm::vec4(0);
+float lod_system::pixels_per_unit = 1080.0f * 0.5f / std::tan(glm::radians(30.0f));	// 1080p with a vertical field of view of 60 degrees
+float lod_system::bias = 0.0f;
 
-uint32_t lod_system::decide_lod(int32_t lods, const bounding_box aabb)
+uint32_t lod_system::decide_lod(const sub_mesh& mesh, const bounding_box& aabb, const uint32_t current)
 {
-	if (lods == 1)
+	if (mesh.lod_error.size() <= 1)
 		return 0;
 
-	const auto center = glm::vec4((aabb.max_ + aabb.min_) / 2.0f, 1.0f);
-	const auto radius = glm::length(aabb.max_ - aabb.min_) / 2;
+	// models that contain the camera are as close as the near plane
+	const glm::vec3 view = glm::vec3(view_pos);
+	const glm::vec3 closest = glm::clamp(view, aabb.min_, aabb.max_);
+	const float distance = std::max(glm::length(closest - view), near_plane);
+	return select_lod(mesh.lod_error, pixels_per_unit / distance, current);
+}
 
-	const auto p = (lod_system::near_plane * radius) / glm::dot(lod_system::view_dir, (lod_system::view_pos - center));
-	const auto ratio = (glm::pi<float>() * p * p); // ratio of pixel/screen
-	
-	lods--;
-	while (lods != 0 && ratio < (1.0f / pow(2, lods)))
-	{
-		lods--;
-	}
-	return lods;
+uint32_t lod_system::decide_shadow_lod(const sub_mesh& mesh, const float texel_size, const uint32_t current)
+{
+	if (mesh.lod_error.size() <= 1)
+		return 0;
+	return select_lod(mesh.lod_error, 1.0f / texel_size, current);
+}
+
+uint32_t lod_system::select_lod(const std::vector<float>& errors, const float pixels, const uint32_t current)
+{
+	if (errors.empty())
+		return 0;
 
-	/*
-	if (lods > 7 && ratio < 1.0f / 128)
-	{
-		return 7;
-	}
-	if (lods > 6 && ratio < 1.0f / 64)
-	{
-		return 6;
-	}
-	if (lods > 5 && ratio < 1.0f / 32)
-	{
-		return 5;
-	}
-	if (lods > 4 && ratio < 1.0f / 16)
-	{
-		return 4;
-	}
-	if (lods > 3 && ratio < 1.0f / 8)
-	{
-		return 3;
-	}
-	if (lods > 2 && ratio < 1.0f / 4)
-	{
-		return 2;
-	}
-	if (lods > 1 && ratio < 1.0f / 2)
-	{
-		return 1;
-	}
-	return 0;*/
-	
-}
\ No newline at end of file
+	const float limit = max_error_pixels * std::exp2(bias);
+	const auto last = static_cast<uint32_t>(errors.size() - 1);
+	uint32_t lod = std::min(current, last);
+	while (lod > 0 && errors[lod] * pixels > limit * (1.0f + hysteresis))
+		lod--;
+	while (lod < last && errors[lod + 1] * pixels <= limit * (1.0f - hysteresis))
+		lod++;
+	return lod;
+}
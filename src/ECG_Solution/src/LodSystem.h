@@ -3,20 +3,45 @@
 #include "Utils.h"
 #include <glm\glm.hpp>
 
+/// @brief picks mesh LODs by the geometric error that a LOD would show on the screen or in the shadow map
+/// every model keeps its LOD until the error of the next one is clearly above or below the limit, so models near the limit don't pop
 class lod_system
 {
 public:
 
 	static float near_plane;
 	static glm::vec4 view_pos;
-	static glm::vec4 view_dir;
+	static float pixels_per_unit;	// size in pixels of one world unit at distance 1 from the camera
+	static float bias;				// global quality bias, every step doubles the error in pixels that a LOD may have
+
+	static constexpr float max_error_pixels = 1.0f;
+	static constexpr float hysteresis = 0.25f;		// the error may be this fraction above the limit before a finer LOD is picked
+													// and has to be this fraction below it before a coarser one is picked
 
 	/**
-	 * \brief selects a LOD based on the projected area of an estimated bounding sphere of a mesh
-	 * formula from : Real-Time Rendering, p862
-	 * \param lods number of lod meshes to select from
-	 * \param aabb the AABB bounds of the mesh
+	 * \brief selects a LOD from the screen space error of its mesh, the distance is measured to the closest point of the AABB
+	 * \param mesh the mesh with its LOD errors
+	 * \param aabb the AABB bounds of the model
+	 * \param current LOD of the model in the last frame
 	 * \return a number between 0 and lods-1
 	*/
-	static uint32_t decide_lod(int32_t lods, bounding_box aabb);
+	static uint32_t decide_lod(const sub_mesh& mesh, const bounding_box& aabb, uint32_t current);
+
+	/**
+	 * \brief selects a LOD for the shadow map from the error of its mesh in shadow map texels
+	 * \param mesh the mesh with its LOD errors
+	 * \param texel_size width of a shadow map texel in world units
+	 * \param current LOD of the model in the last shadow pass
+	 * \return a number between 0 and lods-1
+	 */
+	static uint32_t decide_shadow_lod(const sub_mesh& mesh, float texel_size, uint32_t current);
+
+	/**
+	 * \brief the coarsest LOD whose error is below the limit, starting from the current LOD and only leaving it outside of the hysteresis band
+	 * \param errors error of every LOD in world units, never decreasing
+	 * \param pixels size in pixels of one world unit
+	 * \param current LOD of the last frame
+	 * \return a number between 0 and errors.size()-1
+	 */
+	static uint32_t select_lod(const std::vector<float>& errors, float pixels, uint32_t current);
 };
@@ -10,6 +10,7 @@
  contains initialization, resource loading and render loop
 */
 
+#include <fstream>
 #include <sstream>
 #include <thread>
 #include "Camera.h"
@@ -25,6 +26,8 @@
 #include <optick/optick.h>
 
 #include "GameLogic.h"
+#include "Tools.h"
+#include "TextureRegistry.h"
 
 /* --------------------------------------------- */
 // Global variables
@@ -58,12 +61,14 @@ void registerInputCallbacks(glfw_app& app);
 
 int main(int argc, char** argv)
 {
+	if (argc > 1)
+		return tools::run(argc, argv);
+
 	printf("Starting program...\n");
 	OPTICK_THREAD("MainThread")
 	OPTICK_START_CAPTURE()
 	OPTICK_PUSH("init program")
-	while(true)
-	{
+
 	/* --------------------------------------------- */
 	// Load settings.ini
 	/* --------------------------------------------- */
@@ -80,7 +85,7 @@ int main(int argc, char** argv)
 	// Init framework
 	/* --------------------------------------------- */
 
-	// setup GLFW window
+	// setup GLFW window, it survives restarts so the GL context keeps all loaded textures
 	printf("Initializing GLFW...\n");
 	glfw_app glfw_app(state_);
 	registerInputCallbacks(glfw_app);
@@ -90,12 +95,16 @@ int main(int argc, char** argv)
 	glewExperimental = GL_TRUE;
 	if (glewInit() != GLEW_OK)
 		EXIT_WITH_ERROR("Failed to load GLEW\n");
+	Texture::s3tc_supported = GLEW_EXT_texture_compression_s3tc != 0;
+	level::indirect_count_supported = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
 	
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
 	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 	glDebugMessageCallback(debug::message_callback, nullptr);
 
+	while(true)
+	{
 	LoadingScreen loading_screen(state_->width, state_->height);
 	loading_screen.draw_progress();
 	glfw_app.swap_buffers();
@@ -124,6 +133,7 @@ int main(int argc, char** argv)
 	OPTICK_PUSH("load renderer")
 	renderer renderer(perframe_data_, *level.get_lights());
 	OPTICK_POP()
+	program_cache::print_stats();
 
 	loading_screen.draw_progress();
 	glfw_app.swap_buffers();
@@ -138,18 +148,18 @@ int main(int argc, char** argv)
 	for (auto& dynamicMeshe : dynamicMeshes)
 	{
 		Physics::PhysicsObject obj = physics.createPhysicsObject(
-			dynamicMeshe.entity,
+			level.get_entity(dynamicMeshe.entity),
 			dynamicMeshe.model_trs,
 			dynamicMeshe.vtx_positions,
 			Physics::ObjectMode::Dynamic
 		);
-		obj.modelGraphics->game_properties.is_collectable = true; // temporary solution
+		obj.modelGraphics.get_properties().is_collectable = true; // temporary solution
 	}
 
 	std::vector<physics_mesh> staticMeshes = level.get_rigid();
 	for (auto& staticMeshe : staticMeshes)
 		physics.createPhysicsObject(
-			staticMeshe.entity,
+			level.get_entity(staticMeshe.entity),
 			staticMeshe.model_trs,
 			staticMeshe.vtx_positions,
 			Physics::ObjectMode::Static
@@ -180,6 +190,11 @@ int main(int argc, char** argv)
 	float delta_seconds = 0.0f;
 	fps_counter fps_counter{};
 
+	// camera path for --bench-coherence, one view projection matrix per line
+	std::ofstream camera_path;
+	if (!state_->camera_path.empty())
+		camera_path.open(state_->camera_path, std::ios::app);
+
 	glfwSetInputMode(glfw_app.get_window(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	mouse_state_.pos = glm::vec2(0);
 	OPTICK_POP()
@@ -246,6 +261,11 @@ int main(int argc, char** argv)
 		perframe_data_.view_pos = glm::vec4(camera_.get_position(), 1.0f);
 		perframe_data_.view_inv = glm::inverse(view);
 		perframe_data_.proj_inv = glm::inverse(projection);
+		if (camera_path.is_open())
+		{
+			for (int i = 0; i < 16; i++)
+				camera_path << perframe_data_.view_proj[i / 4][i % 4] << (i < 15 ? ' ' : '\n');
+		}
 		perframe_data_.delta_time.x = delta_seconds;
 		if (!state_->paused)
 			perframe_data_.delta_time.y += delta_seconds;
@@ -256,11 +276,13 @@ int main(int argc, char** argv)
 		if (!state_->paused)
 			logic.update();
 
-		// actual draw call
+		// actual draw call, the ring buffers of the frame are fenced after its last draw
+		buffer::begin_frame();
 		renderer.draw(&level);
 		OPTICK_PUSH("debug physics")
 		if (state_->debug_draw_physics)
 			physics.debugDraw();
+		buffer::end_frame();
 
 		// swap buffers
 		OPTICK_POP()
@@ -276,14 +298,20 @@ int main(int argc, char** argv)
 	if (glfwWindowShouldClose(glfw_app.get_window()))
 		break;
 
-	renderer::state = std::make_shared<global_state>(load_settings());
+	// reset the shared state in place, the window keeps its size
+	const int width = state_->width;
+	const int height = state_->height;
+	*renderer::state = load_settings();
+	state_->width = width;
+	state_->height = height;
 	floating_positioner_.set_position(glm::vec3(-10.0f, 6.0f, 10.0f));
 
 	}
 	/* --------------------------------------------- */
 	// Destroy context and exit
 	/* --------------------------------------------- */
-	Texture::destroy_defaults();
+	texture_registry::clear();
+	program_cache::close();
 	OPTICK_STOP_CAPTURE()
 #ifdef _DEBUG
 	OPTICK_SAVE_CAPTURE("profiler_dump")
@@ -452,6 +480,11 @@ void registerInputCallbacks(glfw_app& app) {
 
 				perframe_data_.ssao2.w *= -1.0f;
 			}
+			if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+			{
+				state_->occlusion_cull = !state_->occlusion_cull;
+				printf("occlusion culling %s\n", state_->occlusion_cull ? "on" : "off");
+			}
 		});
 	glfwSetMouseButtonCallback(app.get_window(),
 		[](auto* window, int button, int action, int mods)
@@ -3,45 +3,44 @@
 
 void material::create(const char* tex_path, const char* name, material& mat) {
 	
-	// remove "/albedo.jpg" from path end
-	std::string path = tex_path;
-	const size_t start = path.length() - 11;
-	path.erase(start, 11);
-
-	// append "../assets/" to the start of the string
-	const auto file = new char[path.length() + 1];
-	strcpy(file, path.c_str());
-	char c[100];
-	strcpy(c, "../assets/");
-	strcat(c, file);
+	const std::string folder = get_folder(tex_path);
 
 	// load textures
 	GLuint handles[7];
 	uint64_t bindless[7];
-	Texture::load_texture_mt(c, handles, bindless);
+	Texture::load_texture_mt(folder.c_str(), handles, bindless);
 
-	mat.albedo_ = handles[0];
-	mat.normal_ = handles[1];
-	mat.metal_ = handles[2];
-	mat.rough_ = handles[3];
-	mat.ao_ = handles[4];
-	mat.emissive_ = handles[5];
-	mat.height_ = handles[6];
+	for (size_t i = 0; i < 7; i++)
+		set_texture(mat, i, handles[i], bindless[i]);
+}
+
+std::string material::get_folder(const char* tex_path)
+{
+	// remove "/albedo.jpg" from path end and append "../assets/" to the start of the string
+	std::string path = tex_path;
+	path.erase(path.length() - 11, 11);
+	return "../assets/" + path;
+}
 
-	mat.albedo64_ = bindless[0];
-	mat.normal64_ = bindless[1];
-	mat.metal64_ = bindless[2];
-	mat.rough64_ = bindless[3];
-	mat.ao64_ = bindless[4];
-	mat.emissive64_ = bindless[5];
-	mat.height64_ = bindless[6];
+void material::set_texture(material& mat, const size_t slot, const GLuint handle, const uint64_t bindless)
+{
+	switch (slot)
+	{
+	case 0: mat.albedo_ = handle; mat.albedo64_ = bindless; break;
+	case 1: mat.normal_ = handle; mat.normal64_ = bindless; break;
+	case 2: mat.metal_ = handle; mat.metal64_ = bindless; break;
+	case 3: mat.rough_ = handle; mat.rough64_ = bindless; break;
+	case 4: mat.ao_ = handle; mat.ao64_ = bindless; break;
+	case 5: mat.emissive_ = handle; mat.emissive64_ = bindless; break;
+	case 6: mat.height_ = handle; mat.height64_ = bindless; break;
+	default: break;
+	}
 }
 
 void material::clear(material& mat)
 {
 
 	GLuint handles[7];
-	uint64_t bindless[7];
 
 	handles[0] = mat.albedo_;
 	handles[1] = mat.normal_;
@@ -51,14 +50,6 @@ void material::clear(material& mat)
 	handles[5] = mat.emissive_;
 	handles[6] = mat.height_;
 
-	bindless[0] = mat.albedo64_;
-	bindless[1] = mat.normal64_;
-	bindless[2] = mat.metal64_;
-	bindless[3] = mat.rough64_;
-	bindless[4] = mat.ao64_;
-	bindless[5] = mat.emissive64_;
-	bindless[6] = mat.height64_;
-
-	Texture::destory_texture_mt(handles, bindless);
+	Texture::destory_texture_mt(handles);
 }
 
@@ -0,0 +1,489 @@
+#include "MeshAnalyzer.h"
+#include "Level.h"
+#include "Program.h"
+#include "JobSystem.h"
+#include <meshoptimizer/meshoptimizer.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr unsigned int cache_size = 16;
+	constexpr size_t error_samples = 256;
+	constexpr float min_change = 0.01f;	// relative change that the diff reports
+
+	glm::vec3 closest_point_on_triangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		// Real-Time Collision Detection, Christer Ericson, 5.1.5
+		const glm::vec3 ab = b - a;
+		const glm::vec3 ac = c - a;
+		const glm::vec3 ap = p - a;
+		const float d1 = glm::dot(ab, ap);
+		const float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			return a;
+
+		const glm::vec3 bp = p - b;
+		const float d3 = glm::dot(ab, bp);
+		const float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)
+			return b;
+
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			return a + ab * (d1 / (d1 - d3));
+
+		const glm::vec3 cp = p - c;
+		const float d5 = glm::dot(ab, cp);
+		const float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)
+			return c;
+
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			return a + ac * (d2 / (d2 - d6));
+
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		const float sum = va + vb + vc;
+		if (sum == 0.0f)
+			return a;
+		return a + ab * (vb / sum) + ac * (vc / sum);
+	}
+
+	/// @brief indices of one LOD from the index pool of its mesh
+	std::vector<unsigned int> lod_indices(const level& lvl, const sub_mesh& mesh, const size_t lod)
+	{
+		const uint32_t first = mesh.index_offset[lod];
+		const uint32_t count = mesh.index_count[lod];
+		if (mesh.short_indices)
+			return std::vector<unsigned int>(lvl.get_short_indices().begin() + first, lvl.get_short_indices().begin() + first + count);
+		return std::vector<unsigned int>(lvl.get_indices().begin() + first, lvl.get_indices().begin() + first + count);
+	}
+
+	std::string escape(const std::string& s)
+	{
+		std::string result;
+		for (const char c : s)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+			if (static_cast<unsigned char>(c) < 0x20)
+				result += ' ';
+			else
+				result += c;
+		}
+		return result;
+	}
+
+	/// @brief minimal json document, only what is needed to read the analyzer output back
+	struct json_value
+	{
+		enum kind_t { null_value, boolean, number, string, array, object } kind = null_value;
+		bool boolean_value = false;
+		double number_value = 0.0;
+		std::string string_value;
+		std::vector<json_value> items;
+		std::vector<std::pair<std::string, json_value>> members;
+
+		const json_value* find(const std::string& key) const
+		{
+			for (const auto& member : members)
+				if (member.first == key)
+					return &member.second;
+			return nullptr;
+		}
+
+		double get_number(const std::string& key) const
+		{
+			const json_value* v = find(key);
+			return v && v->kind == number ? v->number_value : 0.0;
+		}
+	};
+
+	class json_parser
+	{
+	public:
+		explicit json_parser(const std::string& text) : text_(text) {}
+
+		bool parse(json_value& value)
+		{
+			return parse_value(value) && (skip_space(), pos_ == text_.size());
+		}
+
+	private:
+		const std::string& text_;
+		size_t pos_ = 0;
+
+		void skip_space()
+		{
+			while (pos_ < text_.size() && isspace(static_cast<unsigned char>(text_[pos_])))
+				pos_++;
+		}
+
+		bool consume(const char c)
+		{
+			skip_space();
+			if (pos_ < text_.size() && text_[pos_] == c)
+			{
+				pos_++;
+				return true;
+			}
+			return false;
+		}
+
+		bool consume_word(const char* word)
+		{
+			const size_t length = strlen(word);
+			if (text_.compare(pos_, length, word) != 0)
+				return false;
+			pos_ += length;
+			return true;
+		}
+
+		bool parse_string(std::string& s)
+		{
+			if (!consume('"'))
+				return false;
+			while (pos_ < text_.size() && text_[pos_] != '"')
+			{
+				char c = text_[pos_++];
+				if (c == '\\' && pos_ < text_.size())
+				{
+					c = text_[pos_++];
+					switch (c)
+					{
+					case 'n': c = '\n'; break;
+					case 't': c = '\t'; break;
+					case 'r': c = '\r'; break;
+					case 'b': c = '\b'; break;
+					case 'f': c = '\f'; break;
+					case 'u': pos_ += 4; c = '?'; break;
+					default: break;
+					}
+				}
+				s += c;
+			}
+			return consume('"');
+		}
+
+		bool parse_value(json_value& value)
+		{
+			skip_space();
+			if (pos_ >= text_.size())
+				return false;
+
+			const char c = text_[pos_];
+			if (c == '{')
+			{
+				value.kind = json_value::object;
+				pos_++;
+				if (consume('}'))
+					return true;
+				do
+				{
+					std::pair<std::string, json_value> member;
+					if (!parse_string(member.first) || !consume(':') || !parse_value(member.second))
+						return false;
+					value.members.push_back(std::move(member));
+				} while (consume(','));
+				return consume('}');
+			}
+			if (c == '[')
+			{
+				value.kind = json_value::array;
+				pos_++;
+				if (consume(']'))
+					return true;
+				do
+				{
+					value.items.emplace_back();
+					if (!parse_value(value.items.back()))
+						return false;
+				} while (consume(','));
+				return consume(']');
+			}
+			if (c == '"')
+			{
+				value.kind = json_value::string;
+				return parse_string(value.string_value);
+			}
+			if (consume_word("true") || consume_word("false"))
+			{
+				value.kind = json_value::boolean;
+				value.boolean_value = text_[pos_ - 1] == 'e' && text_[pos_ - 2] == 'u';
+				return true;
+			}
+			if (consume_word("null"))
+				return true;
+
+			char* end = nullptr;
+			value.kind = json_value::number;
+			value.number_value = strtod(text_.c_str() + pos_, &end);
+			if (end == text_.c_str() + pos_)
+				return false;
+			pos_ = static_cast<size_t>(end - text_.c_str());
+			return true;
+		}
+	};
+
+	/// @brief prints a metric if it changed by more than min_change, smaller values are better
+	/// \return 1 if the metric got worse
+	size_t compare(const std::string& where, const char* metric, const double before, const double after, const double epsilon)
+	{
+		const double change = after - before;
+		if (std::abs(change) <= std::max(std::abs(before) * min_change, epsilon))
+			return 0;
+
+		std::cout << (change > 0.0 ? "regression: " : "improved:   ") << where << " " << metric << " " << before << " -> " << after;
+		if (before != 0.0)
+			std::cout << " (" << std::showpos << std::setprecision(3) << change / before * 100.0 << "%" << std::noshowpos << std::setprecision(6) << ")";
+		std::cout << "\n";
+		return change > 0.0 ? 1 : 0;
+	}
+}
+
+float mesh_analyzer::simplification_error(const float* vertices, const uint32_t vertex_count, const std::vector<unsigned int>& lod0, const std::vector<unsigned int>& lod)
+{
+	const auto position = [vertices](const unsigned int i) { return glm::vec3(vertices[i * 8], vertices[i * 8 + 1], vertices[i * 8 + 2]); };
+
+	std::vector<bool> used(vertex_count, false);
+	glm::vec3 min(std::numeric_limits<float>::max()), max(std::numeric_limits<float>::lowest());
+	for (const unsigned int i : lod0)
+	{
+		used[i] = true;
+		min = glm::min(min, position(i));
+		max = glm::max(max, position(i));
+	}
+	const float diagonal = glm::length(max - min);
+	if (lod.empty())
+		return 1.0f;
+	if (diagonal == 0.0f)
+		return 0.0f;
+
+	std::vector<unsigned int> samples;
+	for (unsigned int i = 0; i < vertex_count; i++)
+		if (used[i])
+			samples.push_back(i);
+	const size_t step = std::max<size_t>(1, samples.size() / error_samples);
+
+	float error = 0.0f;
+	for (size_t s = 0; s < samples.size(); s += step)
+	{
+		const glm::vec3 p = position(samples[s]);
+		float closest = std::numeric_limits<float>::max();
+		for (size_t t = 0; t + 2 < lod.size() && closest > 0.0f; t += 3)
+		{
+			const glm::vec3 d = p - closest_point_on_triangle(p, position(lod[t]), position(lod[t + 1]), position(lod[t + 2]));
+			closest = std::min(closest, glm::dot(d, d));
+		}
+		error = std::max(error, std::sqrt(closest));
+	}
+	return error / diagonal;
+}
+
+std::vector<mesh_analyzer::mesh_stats> mesh_analyzer::analyze(const level& lvl)
+{
+	const auto& meshes = lvl.get_meshes();
+	std::vector<mesh_stats> result(meshes.size());
+
+	job_system::instance().parallel_for(meshes.size(), [&lvl, &meshes, &result](const size_t m)
+	{
+		const sub_mesh& mesh = meshes[m];
+		const float* vertices = lvl.get_vertices().data() + mesh.vertex_offset * 8;
+		mesh_stats& stats = result[m];
+		stats.name = mesh.name;
+		stats.vertex_count = mesh.vertex_count;
+		stats.short_indices = mesh.short_indices;
+		stats.vertex_bytes = mesh.vertex_count * static_cast<uint32_t>(sizeof(packed_vertex));
+
+		const std::vector<unsigned int> lod0 = lod_indices(lvl, mesh, 0);
+		for (size_t l = 0; l < mesh.index_count.size(); l++)
+		{
+			const std::vector<unsigned int> indices = l == 0 ? lod0 : lod_indices(lvl, mesh, l);
+			lod_stats lod;
+			lod.index_count = static_cast<uint32_t>(indices.size());
+			lod.ratio = lod0.empty() ? 1.0f : static_cast<float>(indices.size()) / static_cast<float>(lod0.size());
+			lod.index_bytes = lod.index_count * (mesh.short_indices ? 2u : 4u);
+			lod.meshlet_count = l < mesh.meshlet_count.size() ? mesh.meshlet_count[l] : 0;
+
+			if (!indices.empty())
+			{
+				const meshopt_VertexCacheStatistics cache = meshopt_analyzeVertexCache(indices.data(), indices.size(), mesh.vertex_count, cache_size, 0, 0);
+				const meshopt_OverdrawStatistics overdraw = meshopt_analyzeOverdraw(indices.data(), indices.size(), vertices, mesh.vertex_count, sizeof(float) * 8);
+				const meshopt_VertexFetchStatistics fetch = meshopt_analyzeVertexFetch(indices.data(), indices.size(), mesh.vertex_count, sizeof(packed_vertex));
+				lod.acmr = cache.acmr;
+				lod.atvr = cache.atvr;
+				lod.overdraw = overdraw.overdraw;
+				lod.overfetch = fetch.overfetch;
+			}
+			lod.error = l == 0 ? 0.0f : simplification_error(vertices, mesh.vertex_count, lod0, indices);
+			stats.lods.push_back(lod);
+		}
+	});
+	return result;
+}
+
+void mesh_analyzer::write_json(std::ostream& out, const std::string& scene_path, const std::vector<mesh_stats>& meshes)
+{
+	size_t vertex_bytes = 0, index_bytes = 0, triangles = 0;
+	for (const auto& mesh : meshes)
+	{
+		vertex_bytes += mesh.vertex_bytes;
+		for (const auto& lod : mesh.lods)
+			index_bytes += lod.index_bytes;
+		if (!mesh.lods.empty())
+			triangles += mesh.lods[0].index_count / 3;
+	}
+
+	out << std::setprecision(6);
+	out << "{\n";
+	out << "  \"scene\": \"" << escape(scene_path) << "\",\n";
+	out << "  \"cache_size\": " << cache_size << ",\n";
+	out << "  \"vertex_size\": " << sizeof(packed_vertex) << ",\n";
+	out << "  \"totals\": { \"meshes\": " << meshes.size() << ", \"triangles\": " << triangles
+		<< ", \"vertex_bytes\": " << vertex_bytes << ", \"index_bytes\": " << index_bytes << " },\n";
+	out << "  \"meshes\": [";
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const mesh_stats& mesh = meshes[m];
+		out << (m ? ",\n" : "\n");
+		out << "    { \"name\": \"" << escape(mesh.name) << "\", \"vertices\": " << mesh.vertex_count
+			<< ", \"short_indices\": " << (mesh.short_indices ? "true" : "false") << ", \"vertex_bytes\": " << mesh.vertex_bytes << ", \"lods\": [";
+		for (size_t l = 0; l < mesh.lods.size(); l++)
+		{
+			const lod_stats& lod = mesh.lods[l];
+			out << (l ? ",\n" : "\n");
+			out << "      { \"indices\": " << lod.index_count << ", \"ratio\": " << lod.ratio << ", \"acmr\": " << lod.acmr
+				<< ", \"atvr\": " << lod.atvr << ", \"overdraw\": " << lod.overdraw << ", \"overfetch\": " << lod.overfetch
+				<< ", \"error\": " << lod.error << ", \"index_bytes\": " << lod.index_bytes << ", \"meshlets\": " << lod.meshlet_count << " }";
+		}
+		out << " ] }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+bool mesh_analyzer::read_json(const std::string& path, std::vector<mesh_stats>& meshes)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		std::cout << "could not read " << path << std::endl;
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+
+	json_value root;
+	const std::string content = text.str();
+	json_parser parser(content);
+	const json_value* list = parser.parse(root) ? root.find("meshes") : nullptr;
+	if (!list || list->kind != json_value::array)
+	{
+		std::cout << path << " is not a mesh analyzer report" << std::endl;
+		return false;
+	}
+
+	meshes.clear();
+	for (const json_value& m : list->items)
+	{
+		mesh_stats mesh;
+		const json_value* name = m.find("name");
+		const json_value* short_indices = m.find("short_indices");
+		mesh.name = name ? name->string_value : "";
+		mesh.vertex_count = static_cast<uint32_t>(m.get_number("vertices"));
+		mesh.short_indices = short_indices && short_indices->boolean_value;
+		mesh.vertex_bytes = static_cast<uint32_t>(m.get_number("vertex_bytes"));
+
+		const json_value* lods = m.find("lods");
+		if (lods)
+		{
+			for (const json_value& l : lods->items)
+			{
+				lod_stats lod;
+				lod.index_count = static_cast<uint32_t>(l.get_number("indices"));
+				lod.ratio = static_cast<float>(l.get_number("ratio"));
+				lod.acmr = static_cast<float>(l.get_number("acmr"));
+				lod.atvr = static_cast<float>(l.get_number("atvr"));
+				lod.overdraw = static_cast<float>(l.get_number("overdraw"));
+				lod.overfetch = static_cast<float>(l.get_number("overfetch"));
+				lod.error = static_cast<float>(l.get_number("error"));
+				lod.index_bytes = static_cast<uint32_t>(l.get_number("index_bytes"));
+				lod.meshlet_count = static_cast<uint32_t>(l.get_number("meshlets"));
+				mesh.lods.push_back(lod);
+			}
+		}
+		meshes.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+size_t mesh_analyzer::diff(const std::vector<mesh_stats>& before, const std::vector<mesh_stats>& after)
+{
+	// meshes with the same name are matched in the order they appear
+	std::unordered_map<std::string, std::vector<size_t>> after_by_name;
+	for (size_t i = 0; i < after.size(); i++)
+		after_by_name[after[i].name].push_back(i);
+	std::unordered_map<std::string, size_t> seen;
+	std::vector<bool> matched(after.size(), false);
+
+	size_t regressions = 0, compared = 0, removed = 0;
+	for (const mesh_stats& a : before)
+	{
+		const size_t occurrence = seen[a.name]++;
+		const auto candidates = after_by_name.find(a.name);
+		if (candidates == after_by_name.end() || occurrence >= candidates->second.size())
+		{
+			std::cout << "regression: " << a.name << " was removed\n";
+			regressions++;
+			removed++;
+			continue;
+		}
+		const size_t index = candidates->second[occurrence];
+		const mesh_stats& b = after[index];
+		matched[index] = true;
+		compared++;
+
+		regressions += compare(a.name, "vertex bytes", a.vertex_bytes, b.vertex_bytes, 0.0);
+		if (a.lods.size() != b.lods.size())
+			std::cout << "changed:    " << a.name << " LODs " << a.lods.size() << " -> " << b.lods.size() << "\n";
+
+		for (size_t l = 0; l < std::min(a.lods.size(), b.lods.size()); l++)
+		{
+			const lod_stats& x = a.lods[l];
+			const lod_stats& y = b.lods[l];
+			const std::string where = a.name + " LOD " + std::to_string(l);
+			if (x.index_count != y.index_count)
+				std::cout << "changed:    " << where << " indices " << x.index_count << " -> " << y.index_count << "\n";
+			regressions += compare(where, "acmr", x.acmr, y.acmr, 1e-3);
+			regressions += compare(where, "atvr", x.atvr, y.atvr, 1e-3);
+			regressions += compare(where, "overdraw", x.overdraw, y.overdraw, 1e-3);
+			regressions += compare(where, "overfetch", x.overfetch, y.overfetch, 1e-3);
+			regressions += compare(where, "error", x.error, y.error, 1e-4);
+			regressions += compare(where, "index bytes", x.index_bytes, y.index_bytes, 0.0);
+		}
+	}
+
+	size_t added = 0;
+	for (size_t i = 0; i < after.size(); i++)
+	{
+		if (!matched[i])
+		{
+			std::cout << "added:      " << after[i].name << "\n";
+			added++;
+		}
+	}
+
+	printf("%u meshes compared, %u added, %u removed, %u regressions\n", static_cast<unsigned>(compared),
+		static_cast<unsigned>(added), static_cast<unsigned>(removed), static_cast<unsigned>(regressions));
+	return regressions;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+class level;
+
+/// @brief measures how well the loader optimized and simplified the meshes of a level, without a GL context
+/// the statistics are written as json so two runs can be compared to catch regressions of assets or the loader
+class mesh_analyzer
+{
+public:
+	/// @brief statistics of one LOD, the vertex buffer is shared by all LODs of a mesh
+	struct lod_stats
+	{
+		uint32_t index_count = 0;
+		float ratio = 1.0f;			// index count relative to LOD 0
+		float acmr = 0.0f;			// transformed vertices per triangle, 16 entry FIFO cache
+		float atvr = 0.0f;			// transformed vertices per vertex
+		float overdraw = 0.0f;		// shaded per covered pixels from 6 directions
+		float overfetch = 0.0f;		// fetched per vertex buffer bytes, packed vertices
+		float error = 0.0f;			// largest distance of sampled LOD 0 vertices to this LOD, relative to the mesh size
+		uint32_t index_bytes = 0;
+		uint32_t meshlet_count = 0;
+	};
+
+	struct mesh_stats
+	{
+		std::string name;
+		uint32_t vertex_count = 0;
+		bool short_indices = false;
+		uint32_t vertex_bytes = 0;	// packed vertices
+		std::vector<lod_stats> lods;
+	};
+
+	/**
+	 * \brief analyzes every mesh and LOD of a level on the job system
+	 * \param lvl a headless level, it has to keep its float vertices
+	 * \return statistics in mesh order
+	 */
+	static std::vector<mesh_stats> analyze(const level& lvl);
+
+	/**
+	 * \brief one sided Hausdorff distance from evenly spread LOD 0 vertices to the surface of a LOD, also used to bake the LOD errors
+	 * \param vertices float vertices of the mesh, 8 floats per vertex
+	 * \param vertex_count number of vertices of the mesh
+	 * \param lod0 indices of the full mesh
+	 * \param lod indices of the simplified mesh
+	 * \return largest distance relative to the diagonal of LOD 0, 1 for an empty LOD
+	 */
+	static float simplification_error(const float* vertices, uint32_t vertex_count, const std::vector<unsigned int>& lod0, const std::vector<unsigned int>& lod);
+
+	/**
+	 * \brief writes the statistics as json, one mesh per object with an array of LODs
+	 * \param out target stream
+	 * \param scene_path source of the level, stored for reference
+	 * \param meshes statistics from analyze
+	 */
+	static void write_json(std::ostream& out, const std::string& scene_path, const std::vector<mesh_stats>& meshes);
+
+	/**
+	 * \brief reads statistics written by write_json
+	 * \param path location of the json file
+	 * \param meshes statistics in the order of the file
+	 * \return false if the file can't be read or isn't an analyzer report
+	 */
+	static bool read_json(const std::string& path, std::vector<mesh_stats>& meshes);
+
+	/**
+	 * \brief compares two runs mesh by mesh and prints every metric that got worse or better by more than 1%
+	 * meshes are matched by name, removed meshes count as regressions
+	 * \param before earlier run
+	 * \param after current run
+	 * \return number of regressions
+	 */
+	static size_t diff(const std::vector<mesh_stats>& before, const std::vector<mesh_stats>& after);
+};
@@ -0,0 +1,87 @@
+#include "MeshletCuller.h"
+#include <meshoptimizer/meshoptimizer.h>
+
+glm::vec3 meshlet_culler::cull_view_pos = glm::vec3(0);
+uint32_t meshlet_culler::meshlets_tested = 0;
+uint32_t meshlet_culler::meshlets_visible = 0;
+
+void meshlet_culler::build_meshlets(std::vector<unsigned int>& indices, const std::vector<float>& vertices, std::vector<meshlet>& meshlets)
+{
+	const size_t vertex_count = vertices.size() / 8;
+	std::vector<meshopt_Meshlet> clusters(meshopt_buildMeshletsBound(indices.size(), max_vertices, max_triangles));
+	clusters.resize(meshopt_buildMeshlets(clusters.data(), indices.data(), indices.size(), vertex_count, max_vertices, max_triangles));
+
+	std::vector<unsigned int> reordered;
+	reordered.reserve(indices.size());
+	meshlets.reserve(meshlets.size() + clusters.size());
+
+	for (const auto& cluster : clusters)
+	{
+		const meshopt_Bounds bounds = meshopt_computeMeshletBounds(&cluster, vertices.data(), vertex_count, sizeof(float) * 8);
+
+		meshlet m{};
+		m.sphere = glm::vec4(bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius);
+		m.cone_apex = glm::vec4(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2], 0.0f);
+		m.cone_axis = glm::vec4(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff);
+		m.first_index = static_cast<uint32_t>(reordered.size());
+		m.index_count = cluster.triangle_count * 3;
+		meshlets.push_back(m);
+
+		// micro indices point into the vertex list of the meshlet
+		for (unsigned int t = 0; t < cluster.triangle_count; t++)
+		{
+			reordered.push_back(cluster.vertices[cluster.indices[t][0]]);
+			reordered.push_back(cluster.vertices[cluster.indices[t][1]]);
+			reordered.push_back(cluster.vertices[cluster.indices[t][2]]);
+		}
+	}
+
+	indices.swap(reordered);
+}
+
+void meshlet_culler::normalize_planes(const glm::vec4* planes, glm::vec4* normalized)
+{
+	for (int i = 0; i < 6; i++)
+		normalized[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+}
+
+void meshlet_culler::cull(const meshlet* meshlets, const uint32_t count, const glm::mat4& model, const glm::vec4* planes,
+                          const glm::vec3& view_pos, const draw_elements_indirect_command& model_cmd,
+                          std::vector<draw_elements_indirect_command>& commands)
+{
+	// spheres grow with the largest axis scale, cones are only valid for uniform scale without mirroring
+	const glm::vec3 scale(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])));
+	const float max_scale = glm::max(scale.x, glm::max(scale.y, scale.z));
+	const float min_scale = glm::min(scale.x, glm::min(scale.y, scale.z));
+	const bool cone_cull = min_scale > 0.99f * max_scale && glm::determinant(glm::mat3(model)) > 0.0f;
+
+	meshlets_tested += count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const meshlet& m = meshlets[i];
+		const glm::vec4 center = model * glm::vec4(glm::vec3(m.sphere), 1.0f);
+		const float radius = m.sphere.w * max_scale;
+
+		bool visible = true;
+		for (int p = 0; p < 6 && visible; p++)
+			visible = glm::dot(planes[p], center) >= -radius;
+
+		if (visible && cone_cull && m.cone_axis.w < 1.0f)
+		{
+			const glm::vec3 apex = glm::vec3(model * glm::vec4(glm::vec3(m.cone_apex), 1.0f));
+			const glm::vec3 axis = glm::normalize(glm::mat3(model) * glm::vec3(m.cone_axis));
+			visible = glm::dot(glm::normalize(apex - view_pos), axis) < m.cone_axis.w;
+		}
+
+		if (visible)
+		{
+			commands.push_back(draw_elements_indirect_command{
+				m.index_count,
+				1,
+				m.first_index,
+				model_cmd.baseVertex_,
+				model_cmd.baseInstance_ });
+			meshlets_visible++;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include "LevelStructs.h"
+
+/// @brief culls the meshlets of visible models against the view frustum and by their normal cones
+/// works only on CPU data, so it can run and be benchmarked without a GL context
+class meshlet_culler
+{
+public:
+	static constexpr size_t max_vertices = 64;
+	static constexpr size_t max_triangles = 126;
+
+	static glm::vec3 cull_view_pos;
+	static uint32_t meshlets_tested;
+	static uint32_t meshlets_visible;
+
+	/**
+	 * \brief splits a LOD into meshlets and reorders its indices so the triangles of every meshlet are contiguous
+	 * \param indices index array of the LOD, gets reordered, the set of triangles stays the same
+	 * \param vertices vertices of the mesh (1 vertex consists of 8 floats)
+	 * \param meshlets target array, first_index of the new meshlets is relative to the start of the LOD
+	 */
+	static void build_meshlets(std::vector<unsigned int>& indices, const std::vector<float>& vertices, std::vector<meshlet>& meshlets);
+
+	/**
+	 * \brief normalizes the frustum planes, so distances to the planes can be compared with sphere radii
+	 * \param planes are the 6 planes of the view frustum
+	 * \param normalized target array of 6 planes
+	 */
+	static void normalize_planes(const glm::vec4* planes, glm::vec4* normalized);
+
+	/**
+	 * \brief culls all meshlets of one model and appends a draw command for every visible one
+	 * \param meshlets first meshlet of the drawn LOD
+	 * \param count number of meshlets of the LOD
+	 * \param model model matrix
+	 * \param planes the 6 normalized frustum planes
+	 * \param view_pos position of the camera in world space
+	 * \param model_cmd draw command of the whole model, the meshlet commands copy its base vertex and base instance
+	 * \param commands target command list
+	 */
+	static void cull(const meshlet* meshlets, uint32_t count, const glm::mat4& model, const glm::vec4* planes,
+	                 const glm::vec3& view_pos, const draw_elements_indirect_command& model_cmd,
+	                 std::vector<draw_elements_indirect_command>& commands);
+};
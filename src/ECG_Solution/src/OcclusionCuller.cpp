@@ -0,0 +1,242 @@
+#include "OcclusionCuller.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+uint32_t occlusion_culler::models_occluded = 0;
+
+namespace
+{
+	// clip space w below this is treated as crossing the near plane
+	constexpr float min_w = 1e-5f;
+
+	constexpr float far_depth = std::numeric_limits<float>::max();
+
+	/// @brief pixel coordinates and NDC depth of a vertex in front of the camera
+	glm::vec3 to_screen(const glm::vec4& clip)
+	{
+		const float inv_w = 1.0f / clip.w;
+		return glm::vec3(
+			(clip.x * inv_w * 0.5f + 0.5f) * occlusion_culler::width,
+			(clip.y * inv_w * 0.5f + 0.5f) * occlusion_culler::height,
+			clip.z * inv_w);
+	}
+
+	/// @brief true if all three vertices are outside of the same clip plane
+	bool outside_clip(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		return (a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w)
+			|| (a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w)
+			|| (a.z > a.w && b.z > b.w && c.z > c.w);
+	}
+}
+
+void occlusion_culler::add_occluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+	// vertices that only differ in normal or uv share a position
+	const auto less = [](const glm::vec3& a, const glm::vec3& b) { return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z))); };
+	std::map<glm::vec3, uint32_t, decltype(less)> merged(less);
+	std::vector<uint32_t> remap(positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		const auto it = merged.emplace(positions[i], static_cast<uint32_t>(positions_.size()));
+		if (it.second)
+			positions_.push_back(positions[i]);
+		remap[i] = it.first->second;
+	}
+
+	// an edge of only one triangle is on the outline
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> edge_users;
+	const auto edge = [](const uint32_t a, const uint32_t b) { return std::make_pair(std::min(a, b), std::max(a, b)); };
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		for (int e = 0; e < 3; e++)
+			edge_users[edge(remap[indices[i + e]], remap[indices[i + (e + 1) % 3]])]++;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		uint8_t outline = 0;
+		for (int e = 0; e < 3; e++)
+		{
+			indices_.push_back(remap[indices[i + e]]);
+			if (edge_users[edge(remap[indices[i + e]], remap[indices[i + (e + 1) % 3]])] != 2)
+				outline |= 1u << e;
+		}
+		outline_.push_back(outline);
+	}
+	occluders_++;
+}
+
+void occlusion_culler::clear_occluders()
+{
+	positions_.clear();
+	indices_.clear();
+	outline_.clear();
+	occluders_ = 0;
+}
+
+void occlusion_culler::render(const glm::mat4& view_proj)
+{
+	view_proj_ = view_proj;
+	std::fill(depth_.begin(), depth_.end(), far_depth);
+
+	clip_.resize(positions_.size());
+	for (size_t i = 0; i < positions_.size(); i++)
+		clip_[i] = view_proj * glm::vec4(positions_[i], 1.0f);
+	for (size_t i = 0; i + 2 < indices_.size(); i += 3)
+		rasterize(clip_[indices_[i]], clip_[indices_[i + 1]], clip_[indices_[i + 2]], outline_[i / 3]);
+
+	for (int ty = 0; ty < tiles_y; ty++)
+	{
+		for (int tx = 0; tx < tiles_x; tx++)
+		{
+			float farthest = 0.0f;
+			for (int y = ty * tile_size; y < (ty + 1) * tile_size; y++)
+				for (int x = tx * tile_size; x < (tx + 1) * tile_size; x++)
+					farthest = std::max(farthest, depth_[y * width + x]);
+			tile_depth_[ty * tiles_x + tx] = farthest;
+		}
+	}
+}
+
+void occlusion_culler::rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, uint32_t outline)
+{
+	// clipping would only make the occluders smaller, so triangles through the near plane are skipped
+	if (a.w < min_w || b.w < min_w || c.w < min_w || outside_clip(a, b, c))
+		return;
+
+	glm::vec3 p0 = to_screen(a), p1 = to_screen(b), p2 = to_screen(c);
+	float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+	if (!(std::abs(area) > 0.0f))
+		return;
+	// both sides of an occluder hide what is behind it
+	if (area < 0.0f)
+	{
+		// the edges are now ac, cb and ba
+		std::swap(p1, p2);
+		area = -area;
+		outline = (outline & 2) | (outline >> 2 & 1) | (outline << 2 & 4);
+	}
+
+	// pixels whose center is inside the bounds of the triangle
+	const int min_x = std::max(0, static_cast<int>(std::ceil(std::max(-1.0f, std::min({ p0.x, p1.x, p2.x })) - 0.5f)));
+	const int max_x = std::min(width - 1, static_cast<int>(std::floor(std::min(width + 1.0f, std::max({ p0.x, p1.x, p2.x })) - 0.5f)));
+	const int min_y = std::max(0, static_cast<int>(std::ceil(std::max(-1.0f, std::min({ p0.y, p1.y, p2.y })) - 0.5f)));
+	const int max_y = std::min(height - 1, static_cast<int>(std::floor(std::min(height + 1.0f, std::max({ p0.y, p1.y, p2.y })) - 0.5f)));
+	if (min_x > max_x || min_y > max_y)
+		return;
+
+	// edge functions, positive inside, and their steps per pixel
+	const glm::vec3 from[3] = { p0, p1, p2 };
+	const glm::vec3 to[3] = { p1, p2, p0 };
+	float step_x[3], step_y[3], origin[3];
+	const float start_x = (min_x & ~3) + 0.5f;
+	const float start_y = min_y + 0.5f;
+	for (int e = 0; e < 3; e++)
+	{
+		step_x[e] = from[e].y - to[e].y;
+		step_y[e] = to[e].x - from[e].x;
+		origin[e] = step_y[e] * (start_y - from[e].y) + step_x[e] * (start_x - from[e].x);
+		// moved inwards by half a pixel, so the corner of the pixel that is farthest out is tested instead of its center
+		if (outline >> e & 1)
+			origin[e] -= 0.5f * (std::abs(step_x[e]) + std::abs(step_y[e]));
+	}
+
+	// the farthest depth of the triangle inside a pixel, so a pixel never hides more than its triangle does
+	const float dz_dx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) / area;
+	const float dz_dy = ((p2.z - p0.z) * (p1.x - p0.x) - (p1.z - p0.z) * (p2.x - p0.x)) / area;
+	const float z_origin = p0.z + dz_dx * (start_x - p0.x) + dz_dy * (start_y - p0.y) + 0.5f * (std::abs(dz_dx) + std::abs(dz_dy));
+	const __m128 z_max = _mm_set1_ps(std::max({ p0.z, p1.z, p2.z }));
+
+	// 4 pixels of a row at once, the rows start at a multiple of 4 so the last group never leaves the row
+	const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 zero = _mm_setzero_ps();
+	for (int y = min_y; y <= max_y; y++)
+	{
+		const float row = static_cast<float>(y - min_y);
+		__m128 e0 = _mm_add_ps(_mm_set1_ps(origin[0] + step_y[0] * row), _mm_mul_ps(lanes, _mm_set1_ps(step_x[0])));
+		__m128 e1 = _mm_add_ps(_mm_set1_ps(origin[1] + step_y[1] * row), _mm_mul_ps(lanes, _mm_set1_ps(step_x[1])));
+		__m128 e2 = _mm_add_ps(_mm_set1_ps(origin[2] + step_y[2] * row), _mm_mul_ps(lanes, _mm_set1_ps(step_x[2])));
+		__m128 z = _mm_add_ps(_mm_set1_ps(z_origin + dz_dy * row), _mm_mul_ps(lanes, _mm_set1_ps(dz_dx)));
+		const __m128 e0_step = _mm_set1_ps(step_x[0] * 4.0f);
+		const __m128 e1_step = _mm_set1_ps(step_x[1] * 4.0f);
+		const __m128 e2_step = _mm_set1_ps(step_x[2] * 4.0f);
+		const __m128 z_step = _mm_set1_ps(dz_dx * 4.0f);
+
+		float* pixels = &depth_[y * width];
+		for (int x = min_x & ~3; x <= max_x; x += 4)
+		{
+			const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+			if (_mm_movemask_ps(inside))
+			{
+				const __m128 old_depth = _mm_loadu_ps(pixels + x);
+				const __m128 nearest = _mm_min_ps(old_depth, _mm_min_ps(z, z_max));
+				_mm_storeu_ps(pixels + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old_depth)));
+			}
+			e0 = _mm_add_ps(e0, e0_step);
+			e1 = _mm_add_ps(e1, e1_step);
+			e2 = _mm_add_ps(e2, e2_step);
+			z = _mm_add_ps(z, z_step);
+		}
+	}
+}
+
+bool occlusion_culler::is_box_visible(const bounding_box& b) const
+{
+	glm::vec2 lo(std::numeric_limits<float>::max()), hi(std::numeric_limits<float>::lowest());
+	float nearest = std::numeric_limits<float>::max();
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 corner(i & 1 ? b.max_.x : b.min_.x, i & 2 ? b.max_.y : b.min_.y, i & 4 ? b.max_.z : b.min_.z);
+		const glm::vec4 clip = view_proj_ * glm::vec4(corner, 1.0f);
+		if (!(clip.w >= min_w))
+			return true;
+		const glm::vec3 p = to_screen(clip);
+		lo = glm::min(lo, glm::vec2(p));
+		hi = glm::max(hi, glm::vec2(p));
+		nearest = std::min(nearest, p.z);
+	}
+	if (hi.x < 0.0f || hi.y < 0.0f || lo.x > width || lo.y > height)
+		return true;
+
+	// every pixel the box touches
+	const int x0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+	const int x1 = std::min(width - 1, static_cast<int>(std::floor(std::min(hi.x, static_cast<float>(width)))));
+	const int y0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+	const int y1 = std::min(height - 1, static_cast<int>(std::floor(std::min(hi.y, static_cast<float>(height)))));
+
+	for (int ty = y0 / tile_size; ty <= y1 / tile_size; ty++)
+	{
+		for (int tx = x0 / tile_size; tx <= x1 / tile_size; tx++)
+		{
+			if (nearest > tile_depth_[ty * tiles_x + tx])
+				continue;
+
+			// some pixel of the tile is not in front of the box, look at the ones the box covers
+			const int px0 = std::max(x0, tx * tile_size), px1 = std::min(x1, tx * tile_size + tile_size - 1);
+			const int py0 = std::max(y0, ty * tile_size), py1 = std::min(y1, ty * tile_size + tile_size - 1);
+			for (int y = py0; y <= py1; y++)
+				for (int x = px0; x <= px1; x++)
+					if (nearest <= depth_[y * width + x])
+						return true;
+		}
+	}
+	return false;
+}
+
+uint32_t occlusion_culler::cull(const box_soa& boxes, uint32_t* visible) const
+{
+	uint32_t culled = 0;
+	for (size_t i = 0; i < boxes.count; i++)
+	{
+		if ((visible[i / 32] >> (i % 32) & 1) == 0)
+			continue;
+		const bounding_box b(glm::vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]), glm::vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]));
+		if (!is_box_visible(b))
+		{
+			visible[i / 32] &= ~(1u << (i % 32));
+			culled++;
+		}
+	}
+	return culled;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "LevelStructs.h"
+#include <vector>
+
+/// @brief software occlusion culling on the CPU
+/// a few large occluders are rasterized into a small depth buffer, 4 pixels at once with SSE, and boxes that lie behind
+/// the occluders in every pixel they cover get culled. the farthest depth of every tile is kept as well, so most boxes
+/// are decided without reading single pixels. works only on CPU data, so it can run and be benchmarked without a GL context.
+/// along the outline of an occluder only fully covered pixels are written, so nothing can be seen through a gap between two occluders
+class occlusion_culler
+{
+public:
+	static constexpr int width = 256;
+	static constexpr int height = 128;
+	static constexpr int tile_size = 8;
+	static constexpr int tiles_x = width / tile_size;
+	static constexpr int tiles_y = height / tile_size;
+
+	static uint32_t models_occluded;
+
+	/**
+	 * \brief adds the triangles of an occluder
+	 * \param positions vertices in world space, vertices at the same position are merged to find the outline
+	 * \param indices 3 per triangle, relative to positions
+	 */
+	void add_occluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+
+	void clear_occluders();
+
+	/**
+	 * \brief clears the depth buffer and rasterizes all occluders, triangles that cross the near plane are left out
+	 * \param view_proj view projection matrix of the camera
+	 */
+	void render(const glm::mat4& view_proj);
+
+	/**
+	 * \brief tests a box against the depth buffer of the last render call
+	 * \param b the AABB of some mesh
+	 * \return false if the box is behind the occluders in every pixel it covers, boxes that cross the near plane are always visible
+	 */
+	bool is_box_visible(const bounding_box& b) const;
+
+	/**
+	 * \brief clears the bit of every visible box that is hidden by the occluders
+	 * \param boxes tested boxes
+	 * \param visible boxes.mask_words() words, like the result of frustum_culler::cull_boxes
+	 * \return number of boxes that got culled
+	 */
+	uint32_t cull(const box_soa& boxes, uint32_t* visible) const;
+
+	size_t get_occluder_count() const { return occluders_; }
+	size_t get_triangle_count() const { return indices_.size() / 3; }
+
+	/// @brief depth of every pixel after render, NDC z of the nearest occluder, rows from the bottom of the screen
+	const std::vector<float>& get_depth() const { return depth_; }
+
+private:
+	size_t occluders_ = 0;
+	std::vector<glm::vec3> positions_;
+	std::vector<uint32_t> indices_;
+	std::vector<uint8_t> outline_;						// bit e is set if edge e of the triangle is on the outline of its occluder
+	std::vector<glm::vec4> clip_;						// positions_ in clip space, only valid during render
+	std::vector<float> depth_ = std::vector<float>(width * height);
+	std::vector<float> tile_depth_ = std::vector<float>(tiles_x * tiles_y);	// farthest depth of every tile
+	glm::mat4 view_proj_{ 1.0f };
+
+	/**
+	 * \brief writes the depth of one triangle in clip space into the pixels whose centers it covers
+	 * \param outline edges ab, bc and ca in bits 0 to 2, pixels have to be fully inside of these edges
+	 */
+	void rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, uint32_t outline);
+};
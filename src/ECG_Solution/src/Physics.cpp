@@ -16,7 +16,7 @@ Physics::Physics() {
 }
 
 Physics::PhysicsObject& Physics::createPhysicsObject(
-	entity* modelGraphics,
+	entity_handle modelGraphics,
 	transformation modelMatrix,
 	std::vector<float> colliderVerticePositions,
 	ObjectMode mode)
@@ -35,7 +35,7 @@ Physics::PhysicsObject& Physics::createPhysicsObject(btVector3 pos, btCollisionS
 	btRigidBody* rigidbody = makeRigidbody(pos, col, rot, mass);
 	if (mode == Physics::ObjectMode::Dynamic_NoRotation)
 		rigidbody->setAngularFactor(0);
-	return addPhysicsObject(rigidbody, nullptr, mode);
+	return addPhysicsObject(rigidbody, entity_handle(), mode);
 }
 
 void Physics::simulateOneStep(float secondsBetweenFrames) {
@@ -52,10 +52,10 @@ void Physics::simulateOneStep(float secondsBetweenFrames) {
 }
 
 void Physics::excludeAndIncludePhysicsObject(Physics::PhysicsObject &obj) {
-	if (obj.modelGraphics == nullptr)
+	if (!obj.modelGraphics)
 		return;
 
-	if (!obj.modelGraphics->game_properties.is_active) {
+	if (!obj.modelGraphics.is_active()) {
 		obj.rigidbody->setActivationState(ISLAND_SLEEPING);
 		obj.rigidbody->setCollisionFlags(btCollisionObject::CF_NO_CONTACT_RESPONSE);
 	}
@@ -88,10 +88,14 @@ Physics::PhysicsObject* Physics::getPhysicsObjectByCollisionObject(const btColli
 
 void Physics::updateModelTransform(PhysicsObject* physicsObject) {
 	// only update objects with graphical representation
-	if (physicsObject->modelGraphics == nullptr)
+	if (!physicsObject->modelGraphics)
 		return;
 
+	// sleeping bodies don't move, their entities stay clean
 	const btRigidBody* rb = physicsObject->rigidbody;
+	if (!rb->isActive())
+		return;
+
 	glm::vec3 pos = btToGlm(rb->getCenterOfMassTransform().getOrigin());
 	float angle = static_cast<float>(rb->getOrientation().getAngle());
 	glm::vec3 axis = btToGlm(rb->getOrientation().getAxis());
@@ -99,10 +103,10 @@ void Physics::updateModelTransform(PhysicsObject* physicsObject) {
 
 	glm::quat rot = glm::angleAxis(angle, axis);
 
-	physicsObject->modelGraphics->set_node_trs(pos, rot, scale);
+	physicsObject->modelGraphics.set_node_trs(pos, rot, scale);
 }
 
-Physics::PhysicsObject& Physics::addPhysicsObject(btRigidBody* rigidbody, entity* modelGraphics, Physics::ObjectMode mode) {
+Physics::PhysicsObject& Physics::addPhysicsObject(btRigidBody* rigidbody, entity_handle modelGraphics, Physics::ObjectMode mode) {
 	// add it to physics world
 	dynamics_world->addRigidBody(rigidbody);
 
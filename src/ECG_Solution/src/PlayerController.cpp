@@ -78,11 +78,11 @@ bool player_controller::is_ground_under_player()
 	const btVector3 ray_cast_end_point = ray_cast_start_point + btVector3(0, -max_ground_distance_, 0);
 	Physics::PhysicsObject *hit_object = physics_.rayCast(ray_cast_start_point, ray_cast_end_point);
 
-	if (hit_object == nullptr || hit_object->modelGraphics == nullptr)
+	if (hit_object == nullptr || !hit_object->modelGraphics)
 		return false;
-	if (!hit_object->modelGraphics->game_properties.is_active)
+	if (!hit_object->modelGraphics.is_active())
 		return false;
-	if (hit_object->modelGraphics->game_properties.is_ground)
+	if (hit_object->modelGraphics.get_properties().is_ground)
 		return true;
 	return false;
 }
@@ -127,11 +127,11 @@ Physics::PhysicsObject *player_controller::get_collectable_in_front_of_player()
 	const btVector3 ray_cast_end_point = physics_.glmToBt(camera_position + camera_aim_direction * reach_);
 	Physics::PhysicsObject *hit_object = physics_.rayCast(ray_cast_start_point, ray_cast_end_point);
 
-	if (hit_object == nullptr || hit_object->modelGraphics == nullptr)
+	if (hit_object == nullptr || !hit_object->modelGraphics)
 		return nullptr;
-	if (!hit_object->modelGraphics->game_properties.is_active)
+	if (!hit_object->modelGraphics.is_active())
 		return nullptr;
-	if (hit_object->modelGraphics->game_properties.is_collectable)
+	if (hit_object->modelGraphics.get_properties().is_collectable)
 		return hit_object;
 	return nullptr;
 }
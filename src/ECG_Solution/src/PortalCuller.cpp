@@ -0,0 +1,265 @@
+#include "PortalCuller.h"
+#include <algorithm>
+#include <bitset>
+#include <limits>
+
+uint32_t portal_culler::models_hidden = 0;
+
+namespace
+{
+	// the edge planes of a portal are moved this far outwards, so rounding never hides what is seen right at its edge
+	constexpr float edge_slack = 1e-3f;
+
+	bool touches(const bounding_box& a, const bounding_box& b)
+	{
+		return glm::all(glm::lessThanEqual(a.min_, b.max_)) && glm::all(glm::greaterThanEqual(a.max_, b.min_));
+	}
+
+	float distance_to(const bounding_box& b, const glm::vec3& p)
+	{
+		return glm::length(glm::clamp(p, b.min_, b.max_) - p);
+	}
+
+	bounding_box merge(const bounding_box& a, const bounding_box& b)
+	{
+		return bounding_box(glm::min(a.min_, b.min_), glm::max(a.max_, b.max_));
+	}
+}
+
+uint32_t portal_culler::build(const std::vector<bounding_box>& cells, const std::vector<bounding_box>& portals)
+{
+	cells_ = cells;
+	portals_.clear();
+	visible_cells_.assign(cells_.size(), 0);
+	camera_cell_ = false;
+	visible_count_ = 0;
+
+	// the links of every portal to all cells it opens into, then sorted by cell
+	std::vector<std::pair<uint32_t, link>> cell_links;
+	uint32_t unlinked = 0;
+	for (const bounding_box& b : portals)
+	{
+		// the opening is the rectangle across the two longer axes, in the middle of the thinnest one
+		const glm::vec3 size = b.max_ - b.min_;
+		const int normal = size.x <= size.y && size.x <= size.z ? 0 : size.y <= size.z ? 1 : 2;
+		const int u = (normal + 1) % 3, v = (normal + 2) % 3;
+		const float middle = (b.min_[normal] + b.max_[normal]) * 0.5f;
+
+		// cells that share some area with the opening and reach its plane, a door on the floor doesn't open into the room below
+		std::vector<uint32_t> touched;
+		for (uint32_t c = 0; c < cells_.size(); c++)
+		{
+			const bounding_box& cell = cells_[c];
+			if (b.min_[u] < cell.max_[u] && b.max_[u] > cell.min_[u] && b.min_[v] < cell.max_[v] && b.max_[v] > cell.min_[v]
+				&& middle - link_margin <= cell.max_[normal] && middle + link_margin >= cell.min_[normal])
+				touched.push_back(c);
+		}
+		if (touched.size() < 2)
+		{
+			unlinked++;
+			continue;
+		}
+
+		portal p;
+		p.bounds = b;
+		for (int i = 0; i < 4; i++)
+		{
+			p.corners[i][normal] = (b.min_[normal] + b.max_[normal]) * 0.5f;
+			p.corners[i][u] = i == 1 || i == 2 ? b.max_[u] : b.min_[u];
+			p.corners[i][v] = i >= 2 ? b.max_[v] : b.min_[v];
+		}
+		const auto index = static_cast<uint32_t>(portals_.size());
+		portals_.push_back(p);
+		for (const uint32_t from : touched)
+			for (const uint32_t to : touched)
+				if (from != to)
+					cell_links.push_back({ from, link{ index, to } });
+	}
+
+	std::stable_sort(cell_links.begin(), cell_links.end(), [](const std::pair<uint32_t, link>& a, const std::pair<uint32_t, link>& b) { return a.first < b.first; });
+	first_link_.assign(cells_.size() + 1, 0);
+	links_.clear();
+	for (const auto& l : cell_links)
+	{
+		first_link_[l.first + 1]++;
+		links_.push_back(l.second);
+	}
+	for (size_t c = 0; c < cells_.size(); c++)
+		first_link_[c + 1] += first_link_[c];
+	return unlinked;
+}
+
+void portal_culler::assign(const box_soa& boxes, const std::vector<uint32_t>& moving)
+{
+	always_.assign(boxes.mask_words(), 0u);
+	for (const uint32_t i : moving)
+		always_[i / 32] |= 1u << (i % 32);
+
+	// collected per cell first, then stored one cell after another
+	std::vector<std::vector<uint32_t>> in_cell(cells_.size());
+	has_outside_ = false;
+	for (uint32_t i = 0; i < boxes.count; i++)
+	{
+		if ((always_[i / 32] >> (i % 32) & 1) != 0)
+			continue;
+		const bounding_box b(glm::vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]), glm::vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]));
+		bool inside = false;
+		for (uint32_t c = 0; c < cells_.size(); c++)
+		{
+			if (!touches(b, cells_[c]))
+				continue;
+			in_cell[c].push_back(i);
+			inside = true;
+		}
+		if (inside)
+			continue;
+		always_[i / 32] |= 1u << (i % 32);
+		outside_bounds_ = has_outside_ ? merge(outside_bounds_, b) : b;
+		has_outside_ = true;
+	}
+
+	first_box_.assign(cells_.size() + 1, 0);
+	cell_boxes_.clear();
+	for (size_t c = 0; c < cells_.size(); c++)
+	{
+		cell_boxes_.insert(cell_boxes_.end(), in_cell[c].begin(), in_cell[c].end());
+		first_box_[c + 1] = static_cast<uint32_t>(cell_boxes_.size());
+	}
+	mask_ = always_;
+}
+
+bool portal_culler::update(const glm::vec3& eye, const glm::vec4* planes)
+{
+	eye_ = eye;
+	visits_ = 0;
+	visible_count_ = 0;
+	camera_cell_ = false;
+	std::fill(visible_cells_.begin(), visible_cells_.end(), 0);
+
+	// a camera on the border of two cells starts in both
+	view_cone cone;
+	std::copy(planes, planes + 6, cone.planes);
+	cone.count = 6;
+	for (uint32_t c = 0; c < cells_.size(); c++)
+	{
+		if (distance_to(cells_[c], eye) > 0.0f)
+			continue;
+		camera_cell_ = true;
+		visit(c, no_portal, cone, 0);
+	}
+	if (!camera_cell_)
+		return false;
+	if (visits_ > max_visits)
+		std::fill(visible_cells_.begin(), visible_cells_.end(), 1);
+
+	mask_ = always_;
+	for (uint32_t c = 0; c < cells_.size(); c++)
+	{
+		if (visible_cells_[c] == 0)
+			continue;
+		visible_count_++;
+		for (uint32_t b = first_box_[c]; b < first_box_[c + 1]; b++)
+			mask_[cell_boxes_[b] / 32] |= 1u << (cell_boxes_[b] % 32);
+	}
+	return true;
+}
+
+void portal_culler::visit(const uint32_t cell, const uint32_t from_portal, const view_cone& cone, const uint32_t depth)
+{
+	if (++visits_ > max_visits)
+		return;
+	visible_cells_[cell] = 1;
+	if (depth == max_depth)
+		return;
+
+	for (uint32_t l = first_link_[cell]; l < first_link_[cell + 1]; l++)
+	{
+		const link& next_cell = links_[l];
+		if (next_cell.portal == from_portal)
+			continue;
+		const portal& p = portals_[next_cell.portal];
+
+		// standing in the opening, everything behind it is seen through the same view
+		if (distance_to(p.bounds, eye_) < portal_margin)
+		{
+			visit(next_cell.cell, next_cell.portal, cone, depth + 1);
+			continue;
+		}
+
+		// the part of the opening inside of the cone, nothing behind it can be seen if none is left
+		glm::vec3 polygon[2][max_vertices];
+		std::copy(p.corners, p.corners + 4, polygon[0]);
+		uint32_t count = 4, current = 0;
+		for (uint32_t i = 0; i < cone.count && count >= 3; i++)
+		{
+			count = clip(cone.planes[i], polygon[current], count, polygon[1 - current]);
+			current = 1 - current;
+		}
+		if (count < 3)
+			continue;
+
+		// the frustum planes and one plane through the camera and every edge of what is left of the opening
+		view_cone narrowed;
+		std::copy(cone.planes, cone.planes + 6, narrowed.planes);
+		narrowed.count = 6;
+		glm::vec3 center(0.0f);
+		for (uint32_t i = 0; i < count; i++)
+			center += polygon[current][i];
+		center /= static_cast<float>(count);
+		for (uint32_t i = 0; i < count && narrowed.count < max_planes; i++)
+		{
+			glm::vec3 normal = glm::cross(polygon[current][i] - eye_, polygon[current][(i + 1) % count] - eye_);
+			const float length = glm::length(normal);
+			if (!(length > std::numeric_limits<float>::epsilon()))
+				continue;
+			normal /= length;
+			if (glm::dot(normal, center - eye_) < 0.0f)
+				normal = -normal;
+			narrowed.planes[narrowed.count++] = glm::vec4(normal, edge_slack - glm::dot(normal, eye_));
+		}
+		visit(next_cell.cell, next_cell.portal, narrowed, depth + 1);
+	}
+}
+
+uint32_t portal_culler::clip(const glm::vec4& plane, const glm::vec3* in, const uint32_t count, glm::vec3* out)
+{
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const glm::vec3& a = in[i];
+		const glm::vec3& b = in[(i + 1) % count];
+		const float da = glm::dot(glm::vec3(plane), a) + plane.w;
+		const float db = glm::dot(glm::vec3(plane), b) + plane.w;
+		if (da >= 0.0f)
+			out[written++] = a;
+		if ((da >= 0.0f) != (db >= 0.0f))
+			out[written++] = a + (b - a) * (da / (da - db));
+	}
+	return written;
+}
+
+uint32_t portal_culler::cull(uint32_t* visible) const
+{
+	if (!camera_cell_)
+		return 0;
+	uint32_t culled = 0;
+	for (size_t w = 0; w < mask_.size(); w++)
+	{
+		culled += static_cast<uint32_t>(std::bitset<32>(visible[w] & ~mask_[w]).count());
+		visible[w] &= mask_[w];
+	}
+	return culled;
+}
+
+bounding_box portal_culler::get_visible_bounds() const
+{
+	bounding_box result;
+	result.min_ = glm::vec3(std::numeric_limits<float>::max());
+	result.max_ = glm::vec3(std::numeric_limits<float>::lowest());
+	for (uint32_t c = 0; c < cells_.size(); c++)
+		if (visible_cells_[c] != 0)
+			result = merge(result, cells_[c]);
+	if (has_outside_)
+		result = merge(result, outside_bounds_);
+	return result;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "LevelStructs.h"
+#include <vector>
+
+/// @brief cell and portal visibility on the CPU, for levels made of rooms like the stacked chambers of the tower
+/// the level tags cells, boxes of space, and portals, flat boxes that are the openings between them. starting in the cells that
+/// contain the camera, every portal that can be seen is followed into the cells behind it, with the view narrowed to the
+/// part of the portal that is seen through all portals before. models are in every cell they touch, a model in no visible cell
+/// is culled. models in no cell and moving models are never culled, so a level without cells is drawn like before.
+/// works only on CPU data, so it can run and be verified without a GL context
+class portal_culler
+{
+public:
+	static constexpr uint32_t max_depth = 16;		// portals behind each other that are followed
+	static constexpr uint32_t max_visits = 1024;	// cells entered by one update, if that isn't enough every cell is visible
+	static constexpr uint32_t max_planes = 16;		// of a narrowed view, edges of a portal that don't fit are left out
+	static constexpr float portal_margin = 0.5f;	// a camera closer than this to a portal sees through all of it
+	static constexpr float link_margin = 0.05f;		// a portal links the cells that overlap its opening and are at most this far from its plane
+
+	static uint32_t models_hidden;
+
+	/**
+	 * \brief sets the cells and links every portal to the cells it opens into
+	 * \param cells bounds of every cell
+	 * \param portals bounds of every portal, flat along one axis, the opening is the rectangle in the middle of that axis
+	 * \return number of portals that open into fewer than 2 cells, they are left out
+	 */
+	uint32_t build(const std::vector<bounding_box>& cells, const std::vector<bounding_box>& portals);
+
+	/**
+	 * \brief puts every box into the cells it touches
+	 * \param boxes culled boxes, in the order of the visibility masks of cull
+	 * \param moving boxes that are never culled, they can leave their cells
+	 */
+	void assign(const box_soa& boxes, const std::vector<uint32_t>& moving);
+
+	/**
+	 * \brief finds the cells that can be seen from the camera through the portals
+	 * \param eye position of the camera
+	 * \param planes the 6 planes of the view frustum
+	 * \return false if the camera is in no cell, then everything counts as visible
+	 */
+	bool update(const glm::vec3& eye, const glm::vec4* planes);
+
+	/**
+	 * \brief clears the bit of every box that is in none of the cells found by the last update
+	 * \param visible boxes.mask_words() words, like the result of frustum_culler::cull_boxes
+	 * \return number of boxes that got culled
+	 */
+	uint32_t cull(uint32_t* visible) const;
+
+	/// @brief bounds of the visible cells and of the static boxes in no cell, all that can be seen after the last update
+	bounding_box get_visible_bounds() const;
+
+	bool has_camera_cell() const { return camera_cell_; }
+	bool is_cell_visible(const uint32_t cell) const { return visible_cells_[cell] != 0; }
+	size_t get_cell_count() const { return cells_.size(); }
+	size_t get_portal_count() const { return portals_.size(); }
+	uint32_t get_visible_cell_count() const { return visible_count_; }
+
+	/// @brief cells entered by the last update, a cell seen through several portals is entered once for each
+	uint32_t get_visits() const { return visits_; }
+
+private:
+	static constexpr uint32_t no_portal = 0xffffffff;
+	static constexpr uint32_t max_vertices = 4 + max_planes;	// every clipping plane adds at most one vertex to a portal
+
+	struct portal
+	{
+		glm::vec3 corners[4];	// the opening, in order around it
+		bounding_box bounds;
+	};
+
+	/// @brief a portal of a cell and the cell on its other side
+	struct link
+	{
+		uint32_t portal;
+		uint32_t cell;
+	};
+
+	/// @brief the planes a cell is seen through, the frustum planes and the edges of the last portal
+	struct view_cone
+	{
+		glm::vec4 planes[max_planes];
+		uint32_t count;
+	};
+
+	std::vector<bounding_box> cells_;
+	std::vector<portal> portals_;
+	std::vector<uint32_t> first_link_;		// links of cell c are [first_link_[c], first_link_[c + 1])
+	std::vector<link> links_;
+	std::vector<uint32_t> first_box_;		// boxes of cell c are [first_box_[c], first_box_[c + 1])
+	std::vector<uint32_t> cell_boxes_;
+	std::vector<uint32_t> always_;			// mask of the boxes in no cell and the moving ones
+	bounding_box outside_bounds_;			// static boxes in no cell, valid if has_outside_
+	bool has_outside_ = false;
+
+	// result of the last update
+	glm::vec3 eye_{ 0.0f };
+	std::vector<uint8_t> visible_cells_;
+	std::vector<uint32_t> mask_;			// always_ and the boxes of the visible cells
+	bool camera_cell_ = false;
+	uint32_t visible_count_ = 0;
+	uint32_t visits_ = 0;
+
+	/**
+	 * \brief marks a cell visible and follows its portals that can be seen through the cone
+	 * \param from_portal the portal the cell was entered through, it isn't followed back
+	 */
+	void visit(uint32_t cell, uint32_t from_portal, const view_cone& cone, uint32_t depth);
+
+	/**
+	 * \brief the part of a convex polygon in front of a plane, Sutherland-Hodgman
+	 * \return number of vertices written to out
+	 */
+	static uint32_t clip(const glm::vec4& plane, const glm::vec3* in, uint32_t count, glm::vec3* out);
+};
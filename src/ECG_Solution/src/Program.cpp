@@ -2,49 +2,47 @@
 
 void program::build_from(Shader& a) const
 {
-	glAttachShader(program_id_, *a.get_id());
-	glLinkProgram(program_id_);
-
-	compile_errors();
+	build({ &a });
 }
 void program::build_from(Shader& a, Shader& b) const
 {
-	glAttachShader(program_id_, *a.get_id());
-	glAttachShader(program_id_, *b.get_id());
-	glLinkProgram(program_id_);
-
-	compile_errors();
+	build({ &a, &b });
 }
 void program::build_from(Shader& a, Shader& b, Shader& c) const
 {
-	glAttachShader(program_id_, *a.get_id());
-	glAttachShader(program_id_, *b.get_id());
-	glAttachShader(program_id_, *c.get_id());
-	glLinkProgram(program_id_);
-
-	compile_errors();
+	build({ &a, &b, &c });
 }
 void program::build_from(Shader& a, Shader& b, Shader& c, Shader& d) const
 {
-	glAttachShader(program_id_, *a.get_id());
-	glAttachShader(program_id_, *b.get_id());
-	glAttachShader(program_id_, *c.get_id());
-	glAttachShader(program_id_, *d.get_id());
-	glLinkProgram(program_id_);
-
-	compile_errors();
+	build({ &a, &b, &c, &d });
 }
 void program::build_from(Shader& a, Shader& b, Shader& c, Shader& d, Shader& e) const
 {
-	glAttachShader(program_id_, *a.get_id());
-	glAttachShader(program_id_, *b.get_id());
-	glAttachShader(program_id_, *c.get_id());
-	glAttachShader(program_id_, *d.get_id());
-	glAttachShader(program_id_, *e.get_id());
+	build({ &a, &b, &c, &d, &e });
+}
+
+void program::build(const std::initializer_list<Shader*> shaders) const
+{
+	uint64_t key = program_cache::hash(nullptr, 0);
+	for (const Shader* shader : shaders)
+	{
+		const uint64_t shader_hash = shader->get_hash();
+		key = program_cache::hash(&shader_hash, sizeof(shader_hash), key);
+	}
+	if (program_cache::load(key, program_id_))
+		return;
+
+	for (Shader* shader : shaders)
+		glAttachShader(program_id_, shader->compile());
+	glProgramParameteri(program_id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program_id_);
 
-	compile_errors();
+	// detached shaders can be deleted as soon as no other program needs them
+	for (Shader* shader : shaders)
+		glDetachShader(program_id_, shader->compile());
 
+	if (compile_errors())
+		program_cache::store(key, program_id_);
 }
 
 program::program()
@@ -90,7 +88,7 @@ void program::set_mat4(const std::string& name, glm::mat4 value) const
 }
 
 /// @brief check for compile errors
-void program::compile_errors() const
+bool program::compile_errors() const
 {
 	GLint succeded;
 
@@ -104,4 +102,5 @@ void program::compile_errors() const
 		std::cerr <<message;
 		delete[] message;
 	}
+	return succeded != GL_FALSE;
 }
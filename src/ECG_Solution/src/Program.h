@@ -14,6 +14,9 @@ private:
 	// Reference ID of the Shader Program
 	GLuint program_id_ = 0;
 
+	/// @brief loads the program from the program_cache, or compiles the shaders, links and stores it
+	void build(std::initializer_list<Shader*> shaders) const;
+
 	
 	void release()
 	{
@@ -24,6 +27,7 @@ private:
 public:
 
 	/// @brief build a shader program from shaders and check for compile errors
+	/// the shaders only get compiled if the program binary isn't cached yet
 	/// all buildFrom() functions do the same thing but with more shaders
 	/// @param a is a valid shader
 	void build_from(Shader& a) const;
@@ -73,5 +77,7 @@ public:
 
 	GLuint get_handle() const { return program_id_; }
 
-	void compile_errors() const;
+	/// @brief prints the link log if linking failed
+	/// @return true if the program is linked
+	bool compile_errors() const;
 };
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "ProgramCache.h"
+#include <fstream>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+	const char cache_magic[4] = { 'P', 'R', 'G', 'C' };
+
+	/// @brief start of every binary in the cache file
+	struct entry_header
+	{
+		uint64_t key;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	// a binary larger than this means the file is corrupted
+	constexpr uint32_t max_binary_length = 64 * 1024 * 1024;
+}
+
+std::unordered_map<uint64_t, program_cache::binary> program_cache::binaries_;
+std::unordered_map<uint64_t, program_cache::shared_shader> program_cache::shaders_;
+std::unordered_set<uint64_t> program_cache::used_;
+size_t program_cache::file_entries_ = 0;
+bool program_cache::opened_ = false;
+bool program_cache::supported_ = false;
+uint64_t program_cache::driver_ = 0;
+uint32_t program_cache::loaded_ = 0;
+uint32_t program_cache::linked_ = 0;
+uint32_t program_cache::compiled_ = 0;
+uint32_t program_cache::shared_ = 0;
+std::string program_cache::path = "../assets/shaders/programs.cache";
+
+uint64_t program_cache::hash(const void* data, const size_t size, uint64_t seed)
+{
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		seed ^= bytes[i];
+		seed *= 1099511628211ull;
+	}
+	return seed;
+}
+
+void program_cache::write_entry(std::ofstream& out, const uint64_t key, const binary& b)
+{
+	const entry_header e{ key, b.format, static_cast<uint32_t>(b.data.size()) };
+	out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+	out.write(reinterpret_cast<const char*>(b.data.data()), static_cast<std::streamsize>(b.data.size()));
+}
+
+void program_cache::rewrite()
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	header h{};
+	memcpy(h.magic, cache_magic, 4);
+	h.version = version;
+	h.driver = driver_;
+	out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	for (const auto& b : binaries_)
+		write_entry(out, b.first, b.second);
+	file_entries_ = binaries_.size();
+}
+
+void program_cache::open()
+{
+	opened_ = true;
+	used_.clear();
+	file_entries_ = 0;
+
+	// drivers without binary formats, eg. some software renderers, always link
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	supported_ = formats > 0;
+	if (!supported_)
+	{
+		printf("program binaries are not supported, shaders get compiled on every start\n");
+		return;
+	}
+
+	// binaries only work with the driver that created them
+	driver_ = hash(nullptr, 0);
+	for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+	{
+		const auto* s = reinterpret_cast<const char*>(glGetString(name));
+		driver_ = hash(s, s ? strlen(s) : 0, driver_);
+	}
+
+	std::ifstream in(path, std::ios::binary);
+	header h{};
+	if (in.read(reinterpret_cast<char*>(&h), sizeof(h)) && memcmp(h.magic, cache_magic, 4) == 0 && h.version == version && h.driver == driver_)
+	{
+		// a later entry of the same key replaces an earlier one
+		entry_header e;
+		while (in.read(reinterpret_cast<char*>(&e), sizeof(e)) && e.length <= max_binary_length)
+		{
+			binary b{ e.format, std::vector<uint8_t>(e.length) };
+			if (!in.read(reinterpret_cast<char*>(b.data.data()), e.length))
+				break;
+			binaries_[e.key] = std::move(b);
+			file_entries_++;
+		}
+		if (in.eof() && in.gcount() == 0 && file_entries_ == binaries_.size())
+			return;
+	}
+	in.close();
+
+	// missing, outdated, from another driver, corrupted or with replaced entries, start a new file with the intact binaries
+	rewrite();
+}
+
+bool program_cache::load(const uint64_t key, const GLuint program)
+{
+	if (!opened_)
+		open();
+
+	const auto it = binaries_.find(key);
+	if (!supported_ || it == binaries_.end())
+		return false;
+
+	glProgramBinary(program, it->second.format, it->second.data.data(), static_cast<GLsizei>(it->second.data.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE)
+	{
+		// the driver may reject binaries of an older build of itself, the program gets linked and stored again
+		binaries_.erase(it);
+		return false;
+	}
+	used_.insert(key);
+	loaded_++;
+	return true;
+}
+
+void program_cache::store(const uint64_t key, const GLuint program)
+{
+	linked_++;
+	if (!supported_)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	binary b{ 0, std::vector<uint8_t>(length) };
+	glGetProgramBinary(program, length, nullptr, &b.format, b.data.data());
+
+	std::ofstream out(path, std::ios::binary | std::ios::app);
+	write_entry(out, key, b);
+	file_entries_++;
+	used_.insert(key);
+	binaries_[key] = std::move(b);
+}
+
+GLuint program_cache::acquire_shader(const uint64_t key, const GLenum type, bool& created)
+{
+	const auto it = shaders_.find(key);
+	created = it == shaders_.end();
+	if (!created)
+	{
+		it->second.users++;
+		shared_++;
+		return it->second.id;
+	}
+
+	const GLuint id = glCreateShader(type);
+	shaders_[key] = { id, 1 };
+	compiled_++;
+	return id;
+}
+
+void program_cache::release_shader(const uint64_t key)
+{
+	const auto it = shaders_.find(key);
+	if (it == shaders_.end() || --it->second.users > 0)
+		return;
+	glDeleteShader(it->second.id);
+	shaders_.erase(it);
+}
+
+void program_cache::close()
+{
+	if (!opened_)
+		return;
+	opened_ = false;
+
+	// binaries of old sources and of programs this run didn't build would stay in the file forever
+	if (supported_)
+	{
+		for (auto it = binaries_.begin(); it != binaries_.end();)
+			it = used_.count(it->first) != 0 ? std::next(it) : binaries_.erase(it);
+		if (file_entries_ != binaries_.size())
+			rewrite();
+	}
+	binaries_.clear();
+	used_.clear();
+}
+
+void program_cache::print_stats()
+{
+	printf("programs: %u from cache, %u linked, %u shaders compiled, %u shared\n", loaded_, linked_, compiled_, shared_);
+	loaded_ = linked_ = compiled_ = shared_ = 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "Utils.h"
+#include <string>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+/// @brief keeps linked programs on disk as driver binaries, so later starts neither compile nor link them
+/// programs are keyed by a hash of their final shader sources, the whole cache is dropped when the driver changes.
+/// new binaries are appended, the file is compacted when it is opened with replaced entries and on close,
+/// where it keeps only the binaries used in this run.
+/// within one run it also shares shader objects, identical sources are compiled once while a Shader uses them
+class program_cache
+{
+private:
+	struct binary
+	{
+		GLenum format;
+		std::vector<uint8_t> data;
+	};
+
+	struct shared_shader
+	{
+		GLuint id;
+		uint32_t users;
+	};
+
+	/// @brief fixed size start of the cache file, followed by entries of key, format, length and binary
+	struct header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t driver;		// hash of vendor, renderer and version string
+	};
+
+	static std::unordered_map<uint64_t, binary> binaries_;
+	static std::unordered_map<uint64_t, shared_shader> shaders_;
+	static std::unordered_set<uint64_t> used_;	// keys loaded or stored since the file was opened
+	static size_t file_entries_;				// entries in the file, replaced and rejected ones included
+	static bool opened_;
+	static bool supported_;
+	static uint64_t driver_;
+	static uint32_t loaded_, linked_, compiled_, shared_;
+
+	/// @brief reads the cache file on first use, needs a current GL context
+	static void open();
+
+	static void write_entry(std::ofstream& out, uint64_t key, const binary& b);
+
+	/// @brief writes a new file with only the binaries in memory
+	static void rewrite();
+
+public:
+	static constexpr uint32_t version = 1;
+	static std::string path;	// location of the cache file, only changed by tools before the first program
+
+	/**
+	 * \brief 64 bit FNV-1a hash
+	 * \param data bytes to hash
+	 * \param size number of bytes
+	 * \param seed result of a previous call to chain hashes
+	 */
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+	/**
+	 * \brief replaces the program with the cached binary of the key
+	 * \param key hash of the shader sources of the program
+	 * \param program handle of a program without attached shaders
+	 * \return false if there is no binary or the driver rejects it, the program has to be linked then
+	 */
+	static bool load(uint64_t key, GLuint program);
+
+	/**
+	 * \brief adds the binary of a linked program to the cache file
+	 * \param key hash of the shader sources of the program
+	 * \param program a successfully linked program
+	 */
+	static void store(uint64_t key, GLuint program);
+
+	/**
+	 * \brief returns the shader object of a source and adds a user to it
+	 * \param key hash of type and source of the shader
+	 * \param type GL shader type
+	 * \param created true if the shader object is new and still has to be compiled
+	 */
+	static GLuint acquire_shader(uint64_t key, GLenum type, bool& created);
+
+	/**
+	 * \brief removes a user from a shader object, it gets deleted once it has none
+	 */
+	static void release_shader(uint64_t key);
+
+	/**
+	 * \brief drops the binaries of programs that weren't built since the cache was opened, eg. of edited shaders,
+	 * and rewrites the file if it holds any of them or replaced binaries. the next program opens the file again
+	 */
+	static void close();
+
+	/**
+	 * \brief prints how many programs came from the cache since the last call and resets the counters
+	 */
+	static void print_stats();
+
+	static uint32_t get_loaded() { return loaded_; }
+	static uint32_t get_linked() { return linked_; }
+	static size_t get_file_entries() { return file_entries_; }
+};
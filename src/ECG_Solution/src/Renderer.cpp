@@ -32,12 +32,13 @@ renderer::renderer(PerFrameData& perframe_data, light_sources& sources)
 	OPTICK_POP()
 }
 
-void renderer::fill_buffers() const
+void renderer::fill_buffers()
 {
 	// create Uniform Buffer Objects from light source struct vectors
 	directional_lights_.reserve_memory(1, lights_.directional.size() * sizeof(directional_light), lights_.directional.data());
 	positional_lights_.reserve_memory(2, lights_.point.size() * sizeof(positional_light), lights_.point.data());
-	perframe_buffer_.reserve_memory(0, sizeof(PerFrameData), perframe_data_);
+	perframe_buffer_.reserve_ring(sizeof(PerFrameData));
+	perframe_buffer_.bind_range(0, perframe_buffer_.push(sizeof(PerFrameData), perframe_data_), sizeof(PerFrameData));
 }
 
 void renderer::set_render_settings() const
@@ -156,7 +157,7 @@ void renderer::draw(level* level)
 	perframe_data_->light_view = light_view;
 	perframe_data_->light_view_proj = light_proj * light_view;
 
-	perframe_buffer_.update(sizeof(PerFrameData), perframe_data_);
+	perframe_buffer_.bind_range(0, perframe_buffer_.push(sizeof(PerFrameData), perframe_data_), sizeof(PerFrameData));
 
 
 	if (!state->paused)
@@ -169,7 +170,7 @@ void renderer::draw(level* level)
 	depth_map_fb_.bind();
 		glClearNamedFramebufferfi(depth_map_fb_.get_handle(), GL_DEPTH_STENCIL, 0, 1.0f, 0);
 		depth_map_.use();
-		level->draw_scene_shadow_map();
+		level->draw_scene_shadow_map(depth_map_fb_.get_width());
 	depth_map_fb_.unbind();
 	glBindTextureUnit(12, depth_map_fb_.get_texture_depth().get_handle());
 	OPTICK_POP()
@@ -100,7 +100,7 @@ private:
 	/**
 	 * \brief bind light sources to binding points
 	 */
-	void fill_buffers() const;
+	void fill_buffers();
 
 	/// @brief compiles all needed shaders for the render loop
 	void build_shader_programs();
@@ -52,31 +52,38 @@ int Shader::ends_with(const char* s, const char* part) const
 Shader::Shader(const char* file_name)
 {
 	type = gl_shader_type_from_file_name(file_name);
-	shader_id = glCreateShader(type);
-
-	const std::string shader = read_code_from(file_name);
-	const char* shader_code = shader.c_str();
-
-	glShaderSource(shader_id, 1, &shader_code, nullptr);
-	glCompileShader(shader_id);
-
-	compile_errors();
+	set_source(read_code_from(file_name));
 }
 
 Shader::Shader(const char* file_name, const glm::ivec3 lights)
 {
 	type = gl_shader_type_from_file_name(file_name);
-	shader_id = glCreateShader(type);
+	set_source(insert_lightcount(read_code_from(file_name), lights.x, lights.y));
+}
 
-	std::string shader = read_code_from(file_name);
-	shader = insert_lightcount(shader, lights.x, lights.y);
-	const char* shader_code = shader.c_str();
+void Shader::set_source(std::string source)
+{
+	source_ = std::move(source);
+	hash_ = program_cache::hash(&type, sizeof(type));
+	hash_ = program_cache::hash(source_.data(), source_.size(), hash_);
+}
 
+GLuint Shader::compile()
+{
+	if (shader_id != 0)
+		return shader_id;
 
-	glShaderSource(shader_id, 1, &shader_code, nullptr);
-	glCompileShader(shader_id);
+	bool created;
+	shader_id = program_cache::acquire_shader(hash_, type, created);
+	if (created)
+	{
+		const char* shader_code = source_.c_str();
+		glShaderSource(shader_id, 1, &shader_code, nullptr);
+		glCompileShader(shader_id);
 
-	compile_errors();
+		compile_errors();
+	}
+	return shader_id;
 }
 
 void Shader::compile_errors() const
@@ -1,15 +1,17 @@
 #pragma once
 #include <fstream>
 #include "Utils.h"
+#include "ProgramCache.h"
 
 
 /// @brief Shader is some GLSL shader from some file location
-/// it contains a handle to the shader object and loads, compiles and checks for compilation error
+/// it loads the source and compiles it only when a program isn't in the program_cache,
+/// shaders with the same type and source share one shader object
 class Shader
 {
 public:
 
-	// Reference ID of the Shader Program
+	// Reference ID of the Shader Program, 0 until compile() is called
 	GLuint shader_id = 0;
 	GLenum type{};
 
@@ -22,13 +24,18 @@ public:
 	/// @param lights is the number of lights (dir,point,spot)
 	Shader(const char* file_name, glm::ivec3 lights);
 
-	GLuint* get_id() { return &shader_id; }
+	/// @brief compiles the shader on first use, or picks up the shader object of an identical source
+	/// @return handle of the shader object
+	GLuint compile();
+
+	/// @brief hash of type and final source, identifies the shader in the program_cache
+	uint64_t get_hash() const { return hash_; }
 
 	// ensure RAII compliance
 	Shader(const Shader&) = delete;
 	Shader& operator=(const Shader&) = delete;
 
-	Shader(Shader&& other)noexcept : shader_id(other.shader_id)
+	Shader(Shader&& other)noexcept : shader_id(other.shader_id), type(other.type), source_(std::move(other.source_)), hash_(other.hash_)
 	{
 		other.shader_id = 0; //Use the "null" ID for the old object.
 	}
@@ -41,12 +48,22 @@ public:
 			release();
 			//obj_ is now 0.
 			std::swap(shader_id, other.shader_id);
+			type = other.type;
+			source_ = std::move(other.source_);
+			hash_ = other.hash_;
 		}
+		return *this;
 	}
 
 	~Shader() { release(); }
 
 private:
+	std::string source_;	// final source after inserting the light count
+	uint64_t hash_ = 0;
+
+	/// @brief sets the source and its hash
+	void set_source(std::string source);
+
 	/// @brief find correct shader type based on file ending
 	/// @param file_name is the path to some shader program
 	/// @return suitable shader type in gl form
@@ -73,7 +90,8 @@ private:
 
 	void release()
 	{
-		glDeleteShader(shader_id);
+		if (shader_id != 0)
+			program_cache::release_shader(hash_);
 		shader_id = 0;
 	}
 };
\ No newline at end of file
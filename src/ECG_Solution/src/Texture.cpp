@@ -1,11 +1,13 @@
 #include "Texture.h"
+#include "TextureRegistry.h"
+#include "Ktx2.h"
+#include "BlockCompressor.h"
+#include "ColorLut.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/noise.hpp>
 #include <thread>
 
-GLuint Texture::defaults_[7] = { 0,0,0,0,0,0,0 };
-uint64_t Texture::defaults64_[7] = { 0,0,0,0,0,0,0 };
 
 Texture::Texture(const GLenum type, const int width, const int height, const GLenum internal_format)
 	: type_(type)
@@ -50,120 +52,124 @@ GLuint Texture::load_texture(const char* tex_path)
 	return handle;
 }
 
-void Texture::load_texture_mt(const char* tex_path, GLuint handles[], uint64_t bindless[])
+const char* const Texture::material_files[7] = {
+	"/albedo.ktx", "/normal.ktx", "/metal.ktx", "/rough.ktx", "/ao.ktx", "/emissive.ktx", "/height.ktx" };
+
+bool Texture::s3tc_supported = true;
+
+gli::texture Texture::read_image(const std::string& path)
 {
-	
-	gli::texture img_data[7];
+	gli::texture image = ktx2::load(path + "2");
+	if (image.empty())
+		return gli::load_ktx(path);
 
-	img_data[0] = gli::load_ktx(append(tex_path, "/albedo.ktx"));
-	img_data[1] = gli::load_ktx(append(tex_path, "/normal.ktx"));
-	img_data[2] = gli::load_ktx(append(tex_path, "/metal.ktx"));
-	img_data[3] = gli::load_ktx(append(tex_path, "/rough.ktx"));
-	img_data[4] = gli::load_ktx(append(tex_path, "/ao.ktx"));
-	img_data[5] = gli::load_ktx(append(tex_path, "/emissive.ktx"));
-	img_data[6] = gli::load_ktx(append(tex_path, "/height.ktx"));
+	if (gli::is_compressed(image.format()) && !s3tc_supported)
+		return block_compressor::decompress(image);
+	return image;
+}
 
+void Texture::load_texture_mt(const char* tex_path, GLuint handles[], uint64_t bindless[])
+{
 	for (size_t i = 0; i < 7; i++)
 	{
-		if (!img_data[i].empty())
+		const std::string path = texture_registry::canonical_path(append(tex_path, material_files[i]));
+		if (texture_registry::acquire(path, handles[i], bindless[i]))
+			continue;
+
+		const gli::texture img_data = read_image(path);
+		if (!img_data.empty())
 		{
-			//img_data[i] = flip(img_data[i]);
-			const gli::gl GL(gli::gl::PROFILE_KTX);
-			gli::gl::format const format = GL.translate(img_data[i].format(), img_data[i].swizzles());
-			const glm::tvec3<GLsizei> extent(img_data[i].extent(0));
-			const int w = extent.x;
-			const int h = extent.y;
-			const int mipMapLevel = get_num_mip_map_levels_2d(w, h);
-			glCreateTextures(GL_TEXTURE_2D, 1, &handles[i]);
-
-			glTextureParameteri(handles[i], GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTextureParameteri(handles[i], GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTextureParameteri(handles[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTextureParameteri(handles[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			glTextureStorage2D(handles[i], mipMapLevel, format.Internal, w, h);
-			glTextureSubImage2D(handles[i], 0, 0, 0, w, h, format.External, format.Type, img_data[i].data(0, 0, 0));
-			glGenerateTextureMipmap(handles[i]);
-			glTextureParameteri(handles[i], GL_TEXTURE_MAX_LEVEL, mipMapLevel - 1);
-			glTextureParameteri(handles[i], GL_TEXTURE_MAX_ANISOTROPY, 16);
-			bindless[i] = glGetTextureHandleARB(handles[i]);
-			glMakeTextureHandleResidentARB(bindless[i]);
+			//img_data = flip(img_data);
+			upload_material_texture(img_data, handles[i], bindless[i]);
+			texture_registry::add(path, handles[i], bindless[i], 1);
 		}
 		else
 		{
 #ifdef _DEBUG
 			std::cout << "could not load texture nr " <<i << " from " << tex_path << "\n"<<"using fallback...\n";
 #endif
-			if (defaults_[0] == 0)
-			{
-				load_texture_mt("../assets/textures/default", defaults_, defaults64_);
-			}
-			handles[i] = defaults_[i];
+			get_default(i, handles[i], bindless[i]);
 		}
 	}
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-GLuint Texture::load_3dlut(const char* tex_path)
+void Texture::upload_material_texture(const gli::texture& image, GLuint& handle, uint64_t& bindless)
 {
-	// Load .CUBE file 
-	printf("Loading LUT file \n");
-	FILE* file = fopen(tex_path, "r");
-
-	if (file == nullptr) {
-		printf("Could not open file \n");
-		return false;
-	}
-
-	float* lut_data = nullptr;
-	int size = 0;
+	const gli::gl GL(gli::gl::PROFILE_KTX);
+	gli::gl::format const format = GL.translate(image.format(), image.swizzles());
+	const glm::tvec3<GLsizei> extent(image.extent(0));
+	const int w = extent.x;
+	const int h = extent.y;
+	// block compressed images can't generate their mips, they always use the levels of the file
+	const bool generate_mips = image.levels() == 1 && !gli::is_compressed(image.format());
+	const int mipMapLevel = generate_mips ? get_num_mip_map_levels_2d(w, h) : static_cast<int>(image.levels());
+	glCreateTextures(GL_TEXTURE_2D, 1, &handle);
 
-	// Iterate through lines
-	while (true) {
-		char line[128];
-		fscanf(file, "%128[^\n]\n", line);
+	glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTextureStorage2D(handle, mipMapLevel, format.Internal, w, h);
+	for (size_t level = 0; level < image.levels(); level++)
+	{
+		const glm::tvec3<GLsizei> size(image.extent(level));
+		if (gli::is_compressed(image.format()))
+			glCompressedTextureSubImage2D(handle, static_cast<GLint>(level), 0, 0, size.x, size.y, format.Internal,
+				static_cast<GLsizei>(image.size(level)), image.data(0, 0, level));
+		else
+			glTextureSubImage2D(handle, static_cast<GLint>(level), 0, 0, size.x, size.y, format.External, format.Type, image.data(0, 0, level));
+	}
+	if (generate_mips)
+		glGenerateTextureMipmap(handle);
+	glTextureParameteri(handle, GL_TEXTURE_MAX_LEVEL, mipMapLevel - 1);
+	glTextureParameteri(handle, GL_TEXTURE_MAX_ANISOTROPY, 16);
+	bindless = glGetTextureHandleARB(handle);
+	glMakeTextureHandleResidentARB(bindless);
+}
 
+void Texture::get_default(const size_t slot, GLuint& handle, uint64_t& bindless)
+{
+	const std::string path = texture_registry::canonical_path(append("../assets/textures/default", material_files[slot]));
+	if (texture_registry::acquire(path, handle, bindless))
+		return;
 
-		if (strcmp(line, "#LUT size") == 0) {
-			// Read LUT size
-			fscanf(file, "%s %i\n", &line, &size);
-			lut_data = new float[size * size * size * 3];
-		}
-		else if (strcmp(line, "#LUT data points") == 0) {
-
-			// Read colors
-			int row = 0;
-			do {
-				float r, g, b;
-				fscanf(file, "%f %f %f\n", &r, &g, &b);
-				lut_data[row * 3 + 0] = r;
-				lut_data[row * 3 + 1] = g;
-				lut_data[row * 3 + 2] = b;
-				row++;
-			} while (row < size * size * size);
-			break;
-		}
+	const gli::texture img_data = read_image(path);
+	if (img_data.empty())
+	{
+		std::cout << "could not load default texture " << path << std::endl;
+		handle = 0;
+		bindless = 0;
+		return;
 	}
-	fclose(file);
+	upload_material_texture(img_data, handle, bindless);
+	texture_registry::add(path, handle, bindless, 1);
+}
+
+GLuint Texture::load_3dlut(const char* tex_path)
+{
+	color_lut::lut_data lut;
+	if (!color_lut::load(tex_path, lut))
+		return 0;
 
-	// Create texture
 	GLuint texture;
 	glCreateTextures(GL_TEXTURE_3D, 1, &texture);
+	glTextureStorage3D(texture, 1, GL_RGB16F, lut.size, lut.size, lut.size);
 
-	// Load data to texture
-	glTexImage3D(GL_TEXTURE_3D,0,GL_RGB,size, size, size,0,GL_RGB,GL_FLOAT,lut_data);
+	// rows of odd sized luts aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTextureSubImage3D(texture, 0, 0, 0, 0, lut.size, lut.size, lut.size, GL_RGB, GL_HALF_FLOAT, lut.texels.data());
 
 	// Set sampling parameters
 	glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP);
-	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP);
-	glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
 	return texture;
-
 }
 
 int Texture::get_num_mip_map_levels_2d(const int w, const int h)
@@ -259,25 +265,10 @@ GLuint Texture::get_3D_noise(int size, float base_freq) // todo
 	return tex_id_;
 }
 
-void Texture::destory_texture_mt(GLuint handles[], uint64_t bindless[])
+void Texture::destory_texture_mt(GLuint handles[])
 {
 	for (size_t i = 0; i < 7; i++)
-	{
-		if (defaults_[i] != handles[i] && glIsTexture(handles[i]))
-		{
-			glMakeTextureHandleNonResidentARB(bindless[i]);
-			glDeleteTextures(1, &handles[i]);
-		}
-	}
-}
-
-void Texture::destroy_defaults()
-{
-	for (size_t i = 0; i < 7; i++)
-	{
-		glMakeTextureHandleNonResidentARB(defaults64_[i]);
-		glDeleteTextures(1, &defaults_[i]);
-	}
+		texture_registry::release(handles[i]);
 }
 
 std::string Texture::append(const char* tex_path, const char* tex_type)
@@ -17,8 +17,6 @@ class Texture
 private:
 	GLuint tex_id_ = 0;
 	GLenum type_ = 0;
-	static GLuint defaults_[7];
-	static uint64_t defaults64_[7];
 
 	void release()
 	{
@@ -59,18 +57,48 @@ public:
 	static GLuint load_texture(const char* tex_path);
 
 	/**
-	 * \brief loads a full material from ktx files
+	 * \brief loads a full material from ktx files, textures that are already loaded are shared
 	 * \param tex_path location of the material
 	 * \param handles GL handles for the textures after function call
 	 * \param bindless Gl handles for the bindless textures after fucntion call
 	 */
 	static void load_texture_mt(const char* tex_path, GLuint handles[], uint64_t bindless[]);
 
+	/// @brief file names of the 7 textures of a material, in the order of the material handles
+	static const char* const material_files[7];
+
+	/// @brief true if the driver can sample BC1 textures, otherwise block compressed images get decoded before the upload
+	static bool s3tc_supported;
+
+	/**
+	 * \brief reads a material image, prefers a ktx2 file next to the ktx file, can run on any thread
+	 * \param path location of the ktx file, the ktx2 file has the same name with a 2 appended
+	 * \return decoded image, empty if neither file could be loaded
+	 */
+	static gli::texture read_image(const std::string& path);
+
+	/**
+	 * \brief creates a mipmapped, repeating texture from a decoded ktx image and makes it resident
+	 * the mip chain of the image is used if it has one, otherwise it gets generated
+	 * \param image decoded image, must not be empty
+	 * \param handle GL handle of the texture after the function call
+	 * \param bindless bindless handle of the texture after the function call
+	 */
+	static void upload_material_texture(const gli::texture& image, GLuint& handle, uint64_t& bindless);
+
+	/**
+	 * \brief returns the fallback texture for a material slot and adds a user to it, loads it on first use
+	 * \param slot index of the texture in the material
+	 * \param handle GL handle of the fallback texture
+	 * \param bindless bindless handle of the fallback texture
+	 */
+	static void get_default(size_t slot, GLuint& handle, uint64_t& bindless);
+
 	/**
-	 * \brief loads a 3dlut in .cube format, used for color grading in Renderer
-	 *code from https://svnte.se/3d-lut
+	 * \brief loads a 3dlut in .cube format as RGB16F texture, used for color grading in Renderer
+	 * the text is only parsed when its binary cache is missing or stale, see color_lut
 	 * \param tex_path is the location of the lut
-	 * \return the created texture handle
+	 * \return the created texture handle, 0 if the lut can't be loaded
 	 */
 	static GLuint load_3dlut(const char* tex_path);
 
@@ -84,13 +112,10 @@ public:
 	static GLuint get_3D_noise(int size, float base_freq);
 
 	/**
-	 * \brief deletes textures
+	 * \brief releases the textures of a material, they get deleted once no material uses them anymore
 	 * \param handles of texture
-	 * \param bindless handles of texture
 	 */
-	static void destory_texture_mt(GLuint handles[], uint64_t bindless[]);
-
-	static void destroy_defaults();
+	static void destory_texture_mt(GLuint handles[]);
 
 	
 	// ensure RAII compliance
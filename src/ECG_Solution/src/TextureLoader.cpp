@@ -0,0 +1,133 @@
+#include "TextureLoader.h"
+#include "JobSystem.h"
+#include "TextureRegistry.h"
+
+namespace
+{
+	double seconds_between(const std::chrono::high_resolution_clock::time_point start, const std::chrono::high_resolution_clock::time_point end)
+	{
+		return std::chrono::duration<double>(end - start).count();
+	}
+}
+
+texture_loader::texture_loader(const bool upload) : upload_(upload)
+{
+}
+
+void texture_loader::load_material(const std::string& folder, material* target)
+{
+	for (size_t i = 0; i < 7; i++)
+		load_image(folder + Texture::material_files[i], target, i);
+}
+
+void texture_loader::load_image(const std::string& file, material* target, const size_t slot)
+{
+	const std::string path = texture_registry::canonical_path(file);
+
+	GLuint handle;
+	uint64_t bindless;
+	if (upload_ && texture_registry::acquire(path, handle, bindless))
+	{
+		material::set_texture(*target, slot, handle, bindless);
+		report_.reused++;
+		return;
+	}
+
+	auto& slots = pending_[path];
+	slots.push_back(target_slot{ target, slot });
+	if (slots.size() > 1)
+	{
+		report_.reused++;
+		return;
+	}
+
+	if (queued_ == 0)
+		start_ = clock::now();
+	queued_++;
+
+	job_system::instance().submit([this, path]
+	{
+		const auto start = clock::now();
+		auto image = std::unique_ptr<decoded_image>(new decoded_image{ Texture::read_image(path), path });
+		const double decode = seconds_between(start, clock::now());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			report_.decode += decode;
+			decoded_.push(std::move(image));
+		}
+		ready_.notify_one();
+	});
+}
+
+void texture_loader::upload(decoded_image& image)
+{
+	const auto slots = pending_.find(image.path);
+	report_.images++;
+	if (image.image.empty())
+	{
+		report_.missing++;
+		if (upload_)
+		{
+			for (const auto& s : slots->second)
+			{
+				GLuint handle;
+				uint64_t bindless;
+				Texture::get_default(s.slot, handle, bindless);
+				material::set_texture(*s.target, s.slot, handle, bindless);
+			}
+		}
+		pending_.erase(slots);
+		return;
+	}
+
+	report_.bytes += image.image.size();
+	if (upload_)
+	{
+		GLuint handle;
+		uint64_t bindless;
+		Texture::upload_material_texture(image.image, handle, bindless);
+		texture_registry::add(image.path, handle, bindless, static_cast<uint32_t>(slots->second.size()));
+		for (const auto& s : slots->second)
+			material::set_texture(*s.target, s.slot, handle, bindless);
+	}
+	pending_.erase(slots);
+}
+
+texture_loader::report texture_loader::finish()
+{
+	for (size_t uploaded = 0; uploaded < queued_; uploaded++)
+	{
+		std::unique_ptr<decoded_image> image;
+		{
+			const auto start = clock::now();
+			std::unique_lock<std::mutex> lock(mutex_);
+			ready_.wait(lock, [this] { return !decoded_.empty(); });
+			image = std::move(decoded_.front());
+			decoded_.pop();
+			report_.wait += seconds_between(start, clock::now());
+		}
+
+		const auto start = clock::now();
+		upload(*image);
+		report_.upload += seconds_between(start, clock::now());
+	}
+	if (upload_)
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+	// every job has pushed its image, so no worker touches the report anymore
+	report result = report_;
+	result.wall = queued_ ? seconds_between(start_, clock::now()) : 0.0;
+	report_ = report();
+	queued_ = 0;
+	return result;
+}
+
+void texture_loader::print_report(const report& r)
+{
+	// everything above 1 means decoding and uploading ran at the same time
+	const double overlap = r.wall > 0.0 ? (r.decode + r.upload) / r.wall : 0.0;
+	printf("textures: %u images (%u missing, %u reused), %.1f MB in %.3fs, %.1f MB/s\n", static_cast<unsigned>(r.images), static_cast<unsigned>(r.missing), static_cast<unsigned>(r.reused),
+		static_cast<double>(r.bytes) / (1024.0 * 1024.0), r.wall, r.wall > 0.0 ? static_cast<double>(r.bytes) / (1024.0 * 1024.0) / r.wall : 0.0);
+	printf("  decode %.3fs on workers, upload %.3fs and wait %.3fs on the GL thread, overlap %.2fx\n", r.decode, r.upload, r.wait, overlap);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "Material.h"
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+
+/// @brief loads material textures in two stages
+/// worker threads of the job system read and decode ktx files into staging memory,
+/// the GL thread only creates textures and uploads the decoded images from a queue
+/// files that are already in the texture registry or queued in the same run are not decoded again
+class texture_loader
+{
+public:
+	/// @brief timings of one loader run, all in seconds
+	struct report
+	{
+		double wall = 0.0;		// from the first queued image until the last upload
+		double decode = 0.0;	// summed up time of all workers reading and decoding
+		double upload = 0.0;	// time the GL thread spent creating and uploading textures
+		double wait = 0.0;		// time the GL thread waited for decoded images
+		size_t images = 0;		// decoded files
+		size_t reused = 0;		// textures taken from the registry or shared with a file queued before
+		size_t missing = 0;		// images that were replaced by the default textures
+		size_t bytes = 0;		// decoded image data
+	};
+
+private:
+	using clock = std::chrono::high_resolution_clock;
+
+	/// @brief a material slot waiting for a texture
+	struct target_slot
+	{
+		material* target;
+		size_t slot;
+	};
+
+	/// @brief a decoded image waiting for its upload
+	struct decoded_image
+	{
+		gli::texture image;
+		std::string path;
+	};
+
+	bool upload_;
+	size_t queued_ = 0;
+	clock::time_point start_;
+	report report_;
+
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::queue<std::unique_ptr<decoded_image>> decoded_;
+	// only used by the GL thread, every queued file with all slots that get its texture
+	std::unordered_map<std::string, std::vector<target_slot>> pending_;
+
+	/**
+	 * \brief queues a single image for decoding, unless it is loaded or queued already
+	 * \param path location of the ktx file
+	 * \param target material that receives the texture, unused without upload
+	 * \param slot texture index in the material
+	 */
+	void load_image(const std::string& file, material* target, size_t slot);
+
+	/**
+	 * \brief creates the texture of a decoded image for all its slots, or assigns the default texture if it couldn't be loaded
+	 */
+	void upload(decoded_image& image);
+
+public:
+	/**
+	 * \param upload if false images are only decoded and dropped, no GL context is needed
+	 */
+	explicit texture_loader(bool upload = true);
+
+	/**
+	 * \brief queues all 7 textures of a material, they get decoded immediately by the job system
+	 * \param folder folder containing the ktx files of the material
+	 * \param target material that receives the textures, has to stay at the same address until finish returns
+	 */
+	void load_material(const std::string& folder, material* target);
+
+	/**
+	 * \brief uploads decoded images as soon as they are ready, returns when every queued image is uploaded
+	 * has to be called from the GL thread if the loader uploads
+	 * \return timings of all images queued since the last call
+	 */
+	report finish();
+
+	/**
+	 * \brief prints how much of the decoding was hidden behind uploads and vice versa
+	 */
+	static void print_report(const report& r);
+};
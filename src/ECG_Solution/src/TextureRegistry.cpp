@@ -0,0 +1,87 @@
+#include "TextureRegistry.h"
+#include <climits>
+#include <cstdlib>
+
+std::unordered_map<std::string, texture_registry::entry> texture_registry::textures_;
+std::unordered_map<GLuint, std::string> texture_registry::paths_;
+
+std::string texture_registry::canonical_path(const std::string& path)
+{
+#ifdef _WIN32
+	char full[_MAX_PATH];
+	if (_fullpath(full, path.c_str(), _MAX_PATH) == nullptr)
+		return path;
+	// windows paths are case insensitive
+	std::string result = full;
+	for (char& c : result)
+		c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	return result;
+#else
+	char full[PATH_MAX];
+	if (realpath(path.c_str(), full) == nullptr)
+		return path;
+	return full;
+#endif
+}
+
+bool texture_registry::acquire(const std::string& path, GLuint& handle, uint64_t& bindless)
+{
+	const auto it = textures_.find(path);
+	if (it == textures_.end())
+		return false;
+
+	it->second.users++;
+	handle = it->second.handle;
+	bindless = it->second.bindless;
+	return true;
+}
+
+void texture_registry::add(const std::string& path, const GLuint handle, const uint64_t bindless, const uint32_t users)
+{
+	textures_[path] = entry{ handle, bindless, users };
+	paths_[handle] = path;
+}
+
+void texture_registry::release(const GLuint handle)
+{
+	const auto path = paths_.find(handle);
+	if (path == paths_.end())
+		return;
+
+	entry& e = textures_.at(path->second);
+	if (e.users > 0)
+		e.users--;
+}
+
+size_t texture_registry::purge_unused()
+{
+	size_t purged = 0;
+	for (auto it = textures_.begin(); it != textures_.end();)
+	{
+		if (it->second.users == 0)
+		{
+			destroy(it->second);
+			paths_.erase(it->second.handle);
+			it = textures_.erase(it);
+			purged++;
+		}
+		else
+			++it;
+	}
+	return purged;
+}
+
+void texture_registry::clear()
+{
+	for (const auto& texture : textures_)
+		destroy(texture.second);
+	textures_.clear();
+	paths_.clear();
+}
+
+void texture_registry::destroy(const entry& e)
+{
+	if (e.bindless)
+		glMakeTextureHandleNonResidentARB(e.bindless);
+	glDeleteTextures(1, &e.handle);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "Utils.h"
+#include <string>
+#include <unordered_map>
+
+/// @brief shares textures between every material that uses the same file
+/// textures are counted by their users, a texture without users stays resident until purge_unused is called,
+/// so a restarted level can pick up the textures of the previous one
+class texture_registry
+{
+private:
+	struct entry
+	{
+		GLuint handle;
+		uint64_t bindless;
+		uint32_t users;
+	};
+
+	static std::unordered_map<std::string, entry> textures_;
+	static std::unordered_map<GLuint, std::string> paths_;
+
+	static void destroy(const entry& e);
+
+public:
+	/**
+	 * \brief resolves relative parts of a path, so different spellings of one file get the same key
+	 * \param path location of a file
+	 * \return absolute path, or the given path if it can't be resolved
+	 */
+	static std::string canonical_path(const std::string& path);
+
+	/**
+	 * \brief looks up a texture and adds a user to it
+	 * \param path canonical location of the texture file
+	 * \param handle GL handle of the texture if it was found
+	 * \param bindless bindless handle of the texture if it was found
+	 * \return false if the texture isn't loaded yet
+	 */
+	static bool acquire(const std::string& path, GLuint& handle, uint64_t& bindless);
+
+	/**
+	 * \brief registers a newly loaded texture
+	 * \param path canonical location of the texture file
+	 * \param handle GL handle of the texture
+	 * \param bindless bindless handle of the texture
+	 * \param users number of materials that already use the texture
+	 */
+	static void add(const std::string& path, GLuint handle, uint64_t bindless, uint32_t users);
+
+	/**
+	 * \brief removes a user from a texture, the texture stays loaded until purge_unused
+	 * \param handle GL handle of the texture, unknown handles are ignored
+	 */
+	static void release(GLuint handle);
+
+	/**
+	 * \brief deletes every texture without users, called once a level has acquired all its textures
+	 * \return number of deleted textures
+	 */
+	static size_t purge_unused();
+
+	/**
+	 * \brief deletes every texture, users or not
+	 */
+	static void clear();
+
+	static size_t get_count() { return textures_.size(); }
+};
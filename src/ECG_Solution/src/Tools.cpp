@@ -0,0 +1,2271 @@
+#include "Tools.h"
+#include "Level.h"
+#include "Program.h"
+#include "VertexQuantizer.h"
+#include "MeshletCuller.h"
+#include "FrustumCuller.h"
+#include "TextureLoader.h"
+#include "JobSystem.h"
+#include "Ktx2.h"
+#include "BlockCompressor.h"
+#include "MeshAnalyzer.h"
+#include "ColorLut.h"
+#include "EntityBvh.h"
+#include "OcclusionCuller.h"
+#include "VisibilityCache.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <unordered_set>
+#include <bitset>
+#include <iterator>
+
+namespace
+{
+	const char* default_scene = "../assets/gameplay.fbx";
+
+	/// @brief scene path given after the tool name, or the default level
+	const char* scene_argument(const int argc, char** argv, const int index = 2)
+	{
+		return argc > index ? argv[index] : default_scene;
+	}
+
+	/// @brief seconds since some start time
+	double seconds_since(const std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	/// @brief counts and prints a mismatch between the fbx and the baked level
+	template <typename T>
+	bool expect_equal(const char* what, const T& fbx, const T& bake, int& errors)
+	{
+		if (fbx == bake)
+			return true;
+		std::cout << "mismatch: " << what << std::endl;
+		errors++;
+		return false;
+	}
+
+	size_t file_size(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		return file ? static_cast<size_t>(file.tellg()) : 0;
+	}
+
+	bool same_bytes(const void* a, const void* b, const size_t size)
+	{
+		return size == 0 || memcmp(a, b, size) == 0;
+	}
+
+	/// @brief instruction sets of the batched culling that the CPU supports, narrowest first
+	std::vector<frustum_culler::simd_level> supported_simd_levels()
+	{
+		std::vector<frustum_culler::simd_level> levels;
+		for (const auto level : { frustum_culler::simd_scalar, frustum_culler::simd_sse, frustum_culler::simd_avx, frustum_culler::simd_avx512 })
+			if (level <= frustum_culler::get_simd_level())
+				levels.push_back(level);
+		return levels;
+	}
+
+	/// @brief a perspective or orthographic view from a random position in a random direction
+	glm::mat4 random_view_proj(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+		const glm::vec3 eye(position(rng), position(rng), position(rng));
+		glm::vec3 direction(position(rng), position(rng), position(rng));
+		if (glm::length(direction) < 1.0f)
+			direction = glm::vec3(0, 0, -1);
+		const glm::vec3 up = unit(rng) < 0.5f ? glm::vec3(0, 1, 0) : glm::normalize(glm::vec3(position(rng), position(rng), position(rng)) + glm::vec3(0.0f, 0.1f, 0.0f));
+		const glm::mat4 view = glm_look_at(eye, eye + direction, glm::cross(direction, up) == glm::vec3(0.0f) ? glm::vec3(1, 0, 0) : up);
+
+		const float near_plane = 0.01f + unit(rng);
+		const float far_plane = near_plane * (10.0f + unit(rng) * 1000.0f);
+		if (unit(rng) < 0.2f)
+		{
+			const float size = 1.0f + unit(rng) * 100.0f;
+			return glm::ortho(-size, size, -size * 0.75f, size * 0.75f, near_plane, far_plane) * view;
+		}
+		return glm::perspective(glm::radians(20.0f + unit(rng) * 100.0f), 0.5f + unit(rng) * 2.5f, near_plane, far_plane) * view;
+	}
+
+	/// @brief random boxes of all sizes around a frustum, some of them have a face exactly on a frustum corner
+	std::vector<bounding_box> random_boxes(std::mt19937& rng, const glm::vec4* corners, const size_t count)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_int_distribution<int> corner(0, 7);
+		glm::vec3 lo(corners[0]), hi(corners[0]);
+		for (int i = 1; i < 8; i++)
+		{
+			lo = glm::min(lo, glm::vec3(corners[i]));
+			hi = glm::max(hi, glm::vec3(corners[i]));
+		}
+		const glm::vec3 extent = hi - lo;
+
+		std::vector<bounding_box> boxes(count);
+		for (bounding_box& b : boxes)
+		{
+			const glm::vec3 center = lo - extent * 0.25f + glm::vec3(unit(rng), unit(rng), unit(rng)) * extent * 1.5f;
+			const float scale = unit(rng) < 0.1f ? 0.0f : std::pow(10.0f, unit(rng) * 4.0f - 3.0f);
+			const glm::vec3 half = glm::vec3(unit(rng), unit(rng), unit(rng)) * extent * scale;
+			b = bounding_box(center - half, center + half);
+
+			const float snap = unit(rng);
+			if (snap < 0.1f)
+				b.min_[corner(rng) % 3] = corners[corner(rng)][corner(rng) % 3];
+			else if (snap < 0.2f)
+				b.max_[corner(rng) % 3] = corners[corner(rng)][corner(rng) % 3];
+			b = bounding_box(b.min_, b.max_);
+		}
+		return boxes;
+	}
+
+	box_soa to_soa(const std::vector<bounding_box>& boxes)
+	{
+		box_soa soa;
+		soa.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++)
+			soa.set(i, boxes[i]);
+		return soa;
+	}
+
+	/// @brief times the per box test and every supported instruction set on the same boxes and views
+	void bench_cull_boxes(const char* name, const std::vector<bounding_box>& boxes, const std::vector<glm::mat4>& view_projs, const int iterations)
+	{
+		const box_soa soa = to_soa(boxes);
+		std::vector<uint32_t> visible(soa.mask_words());
+		std::vector<glm::vec4> planes(6 * view_projs.size()), corners(8 * view_projs.size());
+		for (size_t v = 0; v < view_projs.size(); v++)
+		{
+			frustum_culler::get_frustum_planes(view_projs[v], &planes[v * 6]);
+			frustum_culler::get_frustum_corners(view_projs[v], &corners[v * 8]);
+		}
+
+		size_t inside = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; it++)
+			for (size_t v = 0; v < view_projs.size(); v++)
+				for (const bounding_box& b : boxes)
+					inside += frustum_culler::is_box_in_frustum(&planes[v * 6], &corners[v * 8], b) ? 1 : 0;
+		const double reference = seconds_since(start);
+		const double tests = static_cast<double>(iterations) * view_projs.size() * boxes.size();
+		printf("%s: %u boxes, %.1f%% visible\n", name, static_cast<unsigned>(boxes.size()), 100.0 * inside / tests);
+		printf("  is_box_in_frustum %7.2f ns per box\n", reference / tests * 1e9);
+
+		for (const auto level : supported_simd_levels())
+		{
+			start = std::chrono::high_resolution_clock::now();
+			for (int it = 0; it < iterations; it++)
+				for (size_t v = 0; v < view_projs.size(); v++)
+					frustum_culler::cull_boxes(&planes[v * 6], &corners[v * 8], soa, visible.data(), level);
+			const double time = seconds_since(start);
+			printf("  %-17s %7.2f ns per box (%.1fx)\n", frustum_culler::get_simd_name(level), time / tests * 1e9, reference / time);
+		}
+	}
+
+	/// @brief boxes of 0.5 to 10 units scattered over a flat world of the given size, like props on a large map
+	std::vector<bounding_box> world_boxes(std::mt19937& rng, const float size, const size_t count)
+	{
+		std::uniform_real_distribution<float> position(-size * 0.5f, size * 0.5f);
+		std::uniform_real_distribution<float> height(0.0f, 20.0f);
+		std::uniform_real_distribution<float> extent(0.25f, 5.0f);
+		std::vector<bounding_box> boxes(count);
+		for (bounding_box& b : boxes)
+		{
+			const glm::vec3 center(position(rng), height(rng), position(rng));
+			const glm::vec3 half(extent(rng), extent(rng), extent(rng));
+			b = bounding_box(center - half, center + half);
+		}
+		return boxes;
+	}
+
+	/**
+	 * \brief times building, culling and refitting an entity_bvh against testing every box, and checks that both cull the same boxes
+	 * \return number of boxes the bvh culled differently
+	 */
+	size_t bench_bvh_boxes(const char* name, std::vector<bounding_box> boxes, const std::vector<glm::mat4>& view_projs, const int iterations)
+	{
+		std::vector<glm::vec4> planes(6 * view_projs.size()), corners(8 * view_projs.size());
+		for (size_t v = 0; v < view_projs.size(); v++)
+		{
+			frustum_culler::get_frustum_planes(view_projs[v], &planes[v * 6]);
+			frustum_culler::get_frustum_corners(view_projs[v], &corners[v * 8]);
+		}
+
+		entity_bvh bvh;
+		auto start = std::chrono::high_resolution_clock::now();
+		bvh.build(boxes);
+		printf("%s: %u boxes, %u nodes, built in %.2f ms\n", name, static_cast<unsigned>(boxes.size()), static_cast<unsigned>(bvh.get_node_count()), seconds_since(start) * 1e3);
+
+		box_soa soa = to_soa(boxes);
+		std::vector<uint32_t> flat(soa.mask_words()), hierarchical(soa.mask_words());
+		const double culls = static_cast<double>(iterations) * view_projs.size();
+
+		start = std::chrono::high_resolution_clock::now();
+		size_t inside = 0;
+		for (int it = 0; it < iterations; it++)
+			for (size_t v = 0; v < view_projs.size(); v++)
+				for (const bounding_box& b : boxes)
+					inside += frustum_culler::is_box_in_frustum(&planes[v * 6], &corners[v * 8], b) ? 1 : 0;
+		const double reference = seconds_since(start);
+		printf("  %.1f%% visible\n", 100.0 * inside / (culls * boxes.size()));
+		printf("  is_box_in_frustum %8.1f us per frustum\n", reference / culls * 1e6);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; it++)
+			for (size_t v = 0; v < view_projs.size(); v++)
+				frustum_culler::cull_boxes(&planes[v * 6], &corners[v * 8], soa, flat.data());
+		const double batched = seconds_since(start);
+		printf("  cull_boxes %-6s %8.1f us per frustum (%.1fx)\n", frustum_culler::get_simd_name(frustum_culler::get_simd_level()), batched / culls * 1e6, reference / batched);
+
+		size_t visited = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; it++)
+			for (size_t v = 0; v < view_projs.size(); v++)
+				visited += bvh.cull(&planes[v * 6], &corners[v * 8], hierarchical.data());
+		const double tree = seconds_since(start);
+		printf("  entity_bvh        %8.1f us per frustum (%.1fx), %.0f nodes visited\n", tree / culls * 1e6, reference / tree, visited / culls);
+
+		const auto compare = [&]()
+		{
+			size_t different = 0;
+			for (size_t v = 0; v < view_projs.size(); v++)
+			{
+				frustum_culler::cull_boxes(&planes[v * 6], &corners[v * 8], soa, flat.data());
+				bvh.cull(&planes[v * 6], &corners[v * 8], hierarchical.data());
+				for (size_t i = 0; i < boxes.size(); i++)
+					different += (flat[i / 32] >> (i % 32) & 1) != (hierarchical[i / 32] >> (i % 32) & 1);
+			}
+			return different;
+		};
+		const size_t mismatches = compare();
+
+		// 1% of the boxes move, the tree gets refit and has to cull like the flat scan again
+		std::mt19937 rng(3);
+		std::uniform_int_distribution<size_t> pick(0, boxes.size() - 1);
+		std::uniform_real_distribution<float> offset(-20.0f, 20.0f);
+		std::vector<size_t> moving(std::max<size_t>(1, boxes.size() / 100));
+		for (size_t& m : moving)
+			m = pick(rng);
+		start = std::chrono::high_resolution_clock::now();
+		for (const size_t m : moving)
+		{
+			const glm::vec3 shift(offset(rng), offset(rng) * 0.1f, offset(rng));
+			boxes[m] = bounding_box(boxes[m].min_ + shift, boxes[m].max_ + shift);
+			bvh.refit(static_cast<uint32_t>(m), boxes[m]);
+			soa.set(m, boxes[m]);
+		}
+		printf("  refit of %u boxes  %8.1f us\n", static_cast<unsigned>(moving.size()), seconds_since(start) * 1e6);
+
+		const size_t refit_mismatches = compare();
+		printf("  %u mismatches before and %u after the refit\n", static_cast<unsigned>(mismatches), static_cast<unsigned>(refit_mismatches));
+		return mismatches + refit_mismatches;
+	}
+
+	/// @brief distance along the ray to the triangle, Moeller-Trumbore, negative if the ray misses it
+	float intersect_triangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		const glm::vec3 ab = b - a, ac = c - a;
+		const glm::vec3 p = glm::cross(direction, ac);
+		const float det = glm::dot(ab, p);
+		if (std::abs(det) < 1e-12f)
+			return -1.0f;
+		const glm::vec3 s = origin - a;
+		const float u = glm::dot(s, p) / det;
+		const glm::vec3 q = glm::cross(s, ab);
+		const float v = glm::dot(direction, q) / det;
+		if (u < 0.0f || v < 0.0f || u + v > 1.0f)
+			return -1.0f;
+		return glm::dot(ac, q) / det;
+	}
+
+	/// @brief stacked chambers like the tower level, with their cells, portals and the triangles of every wall, 3 per triangle
+	struct portal_tower
+	{
+		std::vector<bounding_box> cells;
+		std::vector<bounding_box> portals;
+		std::vector<glm::vec3> walls;
+	};
+
+	/**
+	 * \brief adds the triangles of a wall with a rectangular opening, which may be empty
+	 * \param normal axis the wall faces, at its coordinate along that axis
+	 * \param lo, hi corners of the wall along the two other axes, in the order of (normal + 1) % 3 and (normal + 2) % 3
+	 * \param hole_lo, hole_hi corners of the opening, in the same order
+	 */
+	void add_wall(std::vector<glm::vec3>& triangles, const int normal, const float at, const glm::vec2& lo, const glm::vec2& hi, const glm::vec2& hole_lo, const glm::vec2& hole_hi)
+	{
+		const auto point = [normal, at](const float u, const float v)
+		{
+			glm::vec3 p;
+			p[normal] = at;
+			p[(normal + 1) % 3] = u;
+			p[(normal + 2) % 3] = v;
+			return p;
+		};
+		const auto rectangle = [&](const glm::vec2& a, const glm::vec2& b)
+		{
+			if (a.x >= b.x || a.y >= b.y)
+				return;
+			const glm::vec3 corners[4] = { point(a.x, a.y), point(b.x, a.y), point(b.x, b.y), point(a.x, b.y) };
+			for (const int i : { 0, 1, 2, 0, 2, 3 })
+				triangles.push_back(corners[i]);
+		};
+		// the strips on both sides of the opening along v, then the parts next to it along u
+		rectangle(lo, glm::vec2(hi.x, hole_lo.y));
+		rectangle(glm::vec2(lo.x, hole_hi.y), hi);
+		rectangle(glm::vec2(lo.x, hole_lo.y), glm::vec2(hole_lo.x, hole_hi.y));
+		rectangle(glm::vec2(hole_hi.x, hole_lo.y), glm::vec2(hi.x, hole_hi.y));
+	}
+
+	/// @brief 3 to 8 floors of 20 x 5 x 20 units, each with an opening to the one below, half of them split in two rooms by a wall with a door
+	portal_tower build_portal_tower(std::mt19937& rng)
+	{
+		constexpr float half = 10.0f, height = 5.0f;
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const glm::vec2 closed(0.0f);
+		portal_tower tower;
+		const int floors = 3 + static_cast<int>(rng() % 6);
+		for (int f = 0; f < floors; f++)
+		{
+			const float bottom = f * height, top = bottom + height;
+			add_wall(tower.walls, 0, -half, glm::vec2(bottom, -half), glm::vec2(top, half), closed, closed);
+			add_wall(tower.walls, 0, half, glm::vec2(bottom, -half), glm::vec2(top, half), closed, closed);
+			add_wall(tower.walls, 2, -half, glm::vec2(-half, bottom), glm::vec2(half, top), closed, closed);
+			add_wall(tower.walls, 2, half, glm::vec2(-half, bottom), glm::vec2(half, top), closed, closed);
+
+			if (f == 0)
+				add_wall(tower.walls, 1, bottom, glm::vec2(-half), glm::vec2(half), closed, closed);
+			else
+			{
+				// z and x of the opening in the floor
+				const glm::vec2 hole(unit(rng) * 15.0f - 9.0f, unit(rng) * 15.0f - 9.0f);
+				add_wall(tower.walls, 1, bottom, glm::vec2(-half), glm::vec2(half), hole, hole + 3.0f);
+				tower.portals.emplace_back(glm::vec3(hole.y, bottom, hole.x), glm::vec3(hole.y + 3.0f, bottom, hole.x + 3.0f));
+			}
+
+			if (unit(rng) < 0.5f)
+			{
+				const float split = unit(rng) * 8.0f - 4.0f;
+				const float door = unit(rng) * 14.0f - 8.0f;
+				add_wall(tower.walls, 0, split, glm::vec2(bottom, -half), glm::vec2(top, half), glm::vec2(bottom, door), glm::vec2(bottom + 3.0f, door + 2.0f));
+				tower.portals.emplace_back(glm::vec3(split, bottom, door), glm::vec3(split, bottom + 3.0f, door + 2.0f));
+				tower.cells.emplace_back(glm::vec3(-half, bottom, -half), glm::vec3(split, top, half));
+				tower.cells.emplace_back(glm::vec3(split, bottom, -half), glm::vec3(half, top, half));
+			}
+			else
+				tower.cells.emplace_back(glm::vec3(-half, bottom, -half), glm::vec3(half, top, half));
+		}
+		add_wall(tower.walls, 1, floors * height, glm::vec2(-half), glm::vec2(half), closed, closed);
+		return tower;
+	}
+
+	/// @brief parses the data lines of a .cube file with sscanf, like the loader did before color_lut
+	std::vector<float> scanf_lut(const std::string& text)
+	{
+		std::vector<float> rgb;
+		std::istringstream lines(text);
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			float r, g, b;
+			const size_t first = line.find_first_not_of(" \t");
+			if (first != std::string::npos && (isdigit(static_cast<unsigned char>(line[first])) || line[first] == '-' || line[first] == '.')
+				&& sscanf(line.c_str(), "%f %f %f", &r, &g, &b) == 3)
+				rgb.insert(rgb.end(), { r, g, b });
+		}
+		return rgb;
+	}
+
+	/// @brief parses a lut with both parsers, prints their times and compares the floats
+	bool compare_lut_parsers(const char* name, const std::string& text)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		const std::vector<float> reference = scanf_lut(text);
+		const double scanf_time = seconds_since(start);
+
+		// best of a few runs, the first one also pays for waking the workers
+		uint32_t size = 0;
+		std::vector<float> rgb;
+		double parse_time = std::numeric_limits<double>::max();
+		for (int run = 0; run < 5; run++)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			if (!color_lut::parse_cube(text.data(), text.size(), size, rgb))
+				return false;
+			parse_time = std::min(parse_time, seconds_since(start));
+		}
+
+		const bool equal = rgb.size() == reference.size() && same_bytes(rgb.data(), reference.data(), rgb.size() * sizeof(float));
+		printf("%s: %u^3, %.1f kB, sscanf %.2f ms, parser %.2f ms (%.1fx), %s\n", name, size, text.size() / 1024.0,
+			scanf_time * 1000.0, parse_time * 1000.0, scanf_time / parse_time, equal ? "identical" : "MISMATCH");
+		return equal;
+	}
+
+	/// @brief what the program cache did during one simulated start of the game
+	struct cache_run
+	{
+		uint32_t loaded, linked;
+		uint32_t value;			// written by the compute program, shows if an old binary of an edited shader ran
+		size_t file_entries;	// after closing the cache
+	};
+
+	/// @brief writes the sources of the programs --verify-program-cache builds, the compute shader writes value
+	void write_cache_shaders(const uint32_t value)
+	{
+		std::ofstream("verify_cache.vert") << "#version 450 core\nvoid main() { gl_Position = vec4(gl_VertexID & 1, gl_VertexID >> 1, 0.0, 1.0); }\n";
+		std::ofstream("verify_cache_a.frag") << "#version 450 core\nout vec4 color;\nvoid main() { color = vec4(1.0, 0.0, 0.0, 1.0); }\n";
+		std::ofstream("verify_cache_b.frag") << "#version 450 core\nout vec4 color;\nvoid main() { color = vec4(0.0, 1.0, 0.0, 1.0); }\n";
+		std::ofstream("verify_cache.comp") << "#version 450 core\nlayout(local_size_x = 1) in;\nlayout(std430, binding = 0) buffer result { uint value; };\n"
+			<< "void main() { value = " << value << "u; }\n";
+	}
+
+	/// @brief builds the programs like a start of the game, two of them share their vertex shader,
+	/// runs the compute one and closes the cache like the game does at exit
+	cache_run run_cached_programs(const char* step)
+	{
+		cache_run r{};
+		{
+			Shader vert("verify_cache.vert");
+			Shader frag_a("verify_cache_a.frag");
+			Shader frag_b("verify_cache_b.frag");
+			Shader comp("verify_cache.comp");
+			const program a, b, c;
+			a.build_from(vert, frag_a);
+			b.build_from(vert, frag_b);
+			c.build_from(comp);
+
+			buffer result(GL_SHADER_STORAGE_BUFFER);
+			result.reserve_memory(0, sizeof(uint32_t), &r.value);
+			c.use();
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			glGetNamedBufferSubData(result.get_id(), 0, sizeof(uint32_t), &r.value);
+		}
+		r.loaded = program_cache::get_loaded();
+		r.linked = program_cache::get_linked();
+		printf("%-22s ", step);
+		program_cache::print_stats();
+		program_cache::close();
+		r.file_entries = program_cache::get_file_entries();
+		return r;
+	}
+
+	/// @brief an entity as one struct, the layout before the scene was split into the component arrays of entity_table
+	struct legacy_entity
+	{
+		std::string name;
+		entity_type type;
+		int32_t mesh_index = -1;
+		transformation TRS;
+		bounding_box world_bounds;
+		bounding_box model_bounds;
+		bool bounds_dirty = false;
+		bool is_active = true;
+		game_properties properties;
+	};
+
+	/// @brief view projection of every frame of a camera flight
+	struct camera_path
+	{
+		std::string name;
+		std::vector<glm::mat4> frames;
+	};
+
+	/// @brief reads a path recorded by the game with recordPath, the 16 floats of one view projection matrix per line
+	camera_path read_camera_path(const char* file_name)
+	{
+		camera_path path{ file_name, {} };
+		std::ifstream file(file_name);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream values(line);
+			glm::mat4 m;
+			int read = 0;
+			while (read < 16 && values >> m[read / 4][read % 4])
+				read++;
+			if (read == 16)
+				path.frames.push_back(m);
+		}
+		return path;
+	}
+
+	/// @brief 10 seconds at 60 fps of a camera walking, turning in place, orbiting and standing still inside of a sphere
+	std::vector<camera_path> builtin_camera_paths(const glm::vec3& center, const float radius, const float far_plane)
+	{
+		constexpr int frames = 600;
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, far_plane);
+		const glm::vec3 up(0, 1, 0);
+		std::vector<camera_path> paths = { { "walk", {} }, { "turn", {} }, { "orbit", {} }, { "frozen", {} } };
+		for (int f = 0; f < frames; f++)
+		{
+			const float t = static_cast<float>(f) / frames;
+			const float angle = glm::two_pi<float>() * t;
+			const glm::vec3 walk = center + glm::vec3(radius * 0.1f * t, 0.0f, radius * 0.01f * std::sin(angle));
+			paths[0].frames.push_back(projection * glm_look_at(walk, walk + glm::vec3(1.0f, 0.0f, 0.2f * std::cos(angle)), up));
+			paths[1].frames.push_back(projection * glm_look_at(center, center + glm::vec3(std::cos(angle * 0.5f), 0.0f, std::sin(angle * 0.5f)), up));
+			const glm::vec3 orbit = center + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * radius * 0.6f;
+			paths[2].frames.push_back(projection * glm_look_at(orbit, center, up));
+			paths[3].frames.push_back(paths[0].frames.front());
+		}
+		return paths;
+	}
+
+	/**
+	 * \brief culls boxes along camera paths with a visibility_cache and with cull_boxes and compares both every frame,
+	 * every 200th box moves like a dynamic entity
+	 * \return number of boxes the cache culled differently
+	 */
+	size_t bench_coherence_paths(const char* name, std::vector<bounding_box> boxes, const std::vector<camera_path>& paths)
+	{
+		glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+		for (const bounding_box& b : boxes)
+		{
+			vmin = glm::min(vmin, b.min_);
+			vmax = glm::max(vmax, b.max_);
+		}
+		const std::vector<bounding_box> start_boxes = boxes;
+		const float amplitude = glm::length(vmax - vmin) * 0.001f;
+		const bounding_box bounds(vmin - amplitude, vmax + amplitude);
+		printf("%s: %u boxes\n", name, static_cast<unsigned>(boxes.size()));
+
+		size_t mismatches = 0;
+		for (const camera_path& path : paths)
+		{
+			box_soa soa = to_soa(boxes);
+			std::vector<uint32_t> full(soa.mask_words()), cached(soa.mask_words());
+			visibility_cache cache;
+			cache.reset(boxes.size());
+
+			uint64_t tests = 0, retested = 0, visible = 0;
+			size_t different = 0;
+			double full_time = 0.0, cache_time = 0.0;
+			for (size_t f = 0; f < path.frames.size(); f++)
+			{
+				for (size_t i = 0; i < boxes.size(); i += 200)
+				{
+					const glm::vec3 shift(0.0f, amplitude * std::sin(static_cast<float>(f) * 0.1f + static_cast<float>(i)), 0.0f);
+					boxes[i] = bounding_box(start_boxes[i].min_ + shift, start_boxes[i].max_ + shift);
+					soa.set(i, boxes[i]);
+					cache.invalidate(static_cast<uint32_t>(i));
+				}
+
+				glm::vec4 planes[6], corners[8];
+				frustum_culler::get_frustum_planes(path.frames[f], planes);
+				frustum_culler::get_frustum_corners(path.frames[f], corners);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				frustum_culler::cull_boxes(planes, corners, soa, full.data());
+				full_time += seconds_since(start);
+
+				start = std::chrono::high_resolution_clock::now();
+				tests += cache.cull(planes, corners, soa, bounds, cached.data());
+				cache_time += seconds_since(start);
+				retested += cache.get_retested();
+
+				for (size_t w = 0; w < full.size(); w++)
+				{
+					for (uint32_t bits = full[w] ^ cached[w]; bits != 0; bits &= bits - 1)
+						different++;
+					for (uint32_t bits = full[w]; bits != 0; bits &= bits - 1)
+						visible++;
+				}
+			}
+
+			const double frames = static_cast<double>(std::max<size_t>(1, path.frames.size()));
+			const double full_tests = static_cast<double>(visibility_cache::test_count) * boxes.size();
+			printf("  %-8s %5u frames, %4.1f%% visible, %9.0f tests per frame of %.0f (%4.1f%%), %7.0f boxes retested, cull_boxes %7.1f us, cache %7.1f us%s\n",
+				path.name.c_str(), static_cast<unsigned>(path.frames.size()), 100.0 * visible / (frames * boxes.size()),
+				tests / frames, full_tests, 100.0 * tests / (frames * full_tests), retested / frames,
+				full_time / frames * 1e6, cache_time / frames * 1e6, different ? " MISMATCH" : "");
+			mismatches += different;
+		}
+		return mismatches;
+	}
+
+	/**
+	 * \brief culls the benchmark queue of a level with the compute shaders of the GPU culling and with frustum_culler and
+	 * lod_system, along a walk through the copies and from an orthographic light that grows, and compares every model and LOD
+	 * \return number of frames with a different model, LOD or number of commands
+	 */
+	size_t verify_gpu_passes(level& lvl, const size_t count)
+	{
+		lvl.build_benchmark_queue(count);
+		lvl.setup_gpu_culling();
+		gpu_culler& gpu = lvl.get_gpu_culler();
+		const render_queue& queue = lvl.get_render_queue();
+		const entity_table& scene = lvl.get_scene();
+		const std::vector<sub_mesh>& meshes = lvl.get_meshes();
+		const size_t models = queue.commands.size();
+
+		glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+		for (const bounding_box& b : scene.world_bounds)
+		{
+			vmin = glm::min(vmin, b.min_);
+			vmax = glm::max(vmax, b.max_);
+		}
+		const glm::vec3 center = (vmin + vmax) * 0.5f;
+		const float size = glm::length(vmax - vmin);
+
+		constexpr int frames = 300;
+		constexpr float screen_height = 1080.0f;
+		constexpr float shadow_size = 4096.0f;
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, size * 0.25f);
+		const glm::mat4 light_view = glm_look_at(center + glm::vec3(0.3f, 1.0f, 0.2f) * size, center, glm::vec3(0, 0, 1));
+		std::mt19937 rng(24);
+		std::normal_distribution<float> shake(0.0f, size * 0.0005f);
+		lod_system::near_plane = 0.1f;
+		lod_system::pixels_per_unit = 0.5f * screen_height / std::tan(glm::radians(30.0f));
+
+		std::vector<uint32_t> cpu_visible(queue.bounds.mask_words()), gpu_visible;
+		std::vector<uint8_t> cpu_lods[gpu_culler::pass_count], gpu_lods;
+		for (std::vector<uint8_t>& lods : cpu_lods)
+			lods.assign(models, 0);
+		size_t mismatches = 0;
+		uint64_t visible = 0, commands = 0;
+		double cpu_time = 0.0, gpu_time = 0.0;
+		buffer::bytes_uploaded = 0;
+		for (int f = 0; f < frames * 2; f++)
+		{
+			// the camera walks first, then the light covers more and more of the copies with coarser texels
+			const bool shadow = f >= frames;
+			const gpu_culler::pass pass = shadow ? gpu_culler::shadow_pass : gpu_culler::main_pass;
+			const float t = static_cast<float>(f % frames) / frames;
+			const glm::vec3 eye = vmin + (vmax - vmin) * glm::vec3(0.1f + 0.8f * t, 0.5f, 0.5f) + glm::vec3(shake(rng), shake(rng), shake(rng));
+			const float angle = glm::two_pi<float>() * t;
+			const float extent = size * (0.1f + 0.4f * t);
+			const float texel = 2.0f * extent / shadow_size;
+			const glm::mat4 view_proj = shadow ? glm::ortho(-extent, extent, -extent, extent, 0.0f, size * 2.0f) * light_view
+				: projection * glm_look_at(eye, eye + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0, 1, 0));
+
+			gpu_culler::view v;
+			frustum_culler::get_frustum_planes(view_proj, v.planes);
+			frustum_culler::get_frustum_corners(view_proj, v.corners);
+			v.position = eye;
+			v.near_plane = lod_system::near_plane;
+			v.pixels_per_unit = shadow ? 1.0f / texel : lod_system::pixels_per_unit;
+			v.by_distance = !shadow;
+			lod_system::view_pos = glm::vec4(eye, 1.0f);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			gpu.cull(pass, v);
+			glFinish();
+			gpu_time += seconds_since(start);
+
+			// the culling and the LODs of the CPU path
+			start = std::chrono::high_resolution_clock::now();
+			frustum_culler::cull_boxes(v.planes, v.corners, queue.bounds, cpu_visible.data());
+			std::vector<uint8_t>& lods = cpu_lods[pass];
+			for (size_t i = 0; i < models; i++)
+			{
+				const uint32_t e = queue.entities[i];
+				const sub_mesh& mesh = meshes[scene.render[e].mesh_index];
+				lods[i] = static_cast<uint8_t>(shadow ? lod_system::decide_shadow_lod(mesh, texel, lods[i])
+					: lod_system::decide_lod(mesh, scene.world_bounds[e], lods[i]));
+				if (!scene.render[e].is_active)
+					cpu_visible[i / 32] &= ~(1u << (i % 32));
+			}
+			cpu_time += seconds_since(start);
+
+			// one instanced command per mesh LOD with a visible model
+			std::unordered_set<uint64_t> mesh_lods;
+			uint64_t frame_visible = 0;
+			for (size_t i = 0; i < models; i++)
+			{
+				if ((cpu_visible[i / 32] >> (i % 32) & 1) == 0)
+					continue;
+				frame_visible++;
+				mesh_lods.insert(static_cast<uint64_t>(scene.render[queue.entities[i]].mesh_index) << 8 | lods[i]);
+			}
+			visible += frame_visible;
+			commands += mesh_lods.size();
+
+			const int64_t draws = gpu.read_results(pass, gpu_visible, gpu_lods);
+			if (draws == static_cast<int64_t>(mesh_lods.size()) && gpu_visible == cpu_visible && gpu_lods == lods)
+				continue;
+			if (mismatches++ < 10)
+			{
+				size_t models_differ = 0, lods_differ = 0;
+				for (size_t i = 0; i < models; i++)
+				{
+					models_differ += (gpu_visible[i / 32] >> (i % 32) & 1) != (cpu_visible[i / 32] >> (i % 32) & 1);
+					lods_differ += gpu_lods[i] != lods[i];
+				}
+				printf("mismatch: %s frame %d, %u models and %u LODs differ, %lld commands instead of %u\n", shadow ? "shadow" : "main", f % frames,
+					static_cast<unsigned>(models_differ), static_cast<unsigned>(lods_differ), static_cast<long long>(draws), static_cast<unsigned>(mesh_lods.size()));
+			}
+		}
+
+		// the CPU path pushes the matrices once and the instances and commands of both passes every frame
+		const double cpu_bytes = 64.0 * models + (8.0 * visible + 20.0 * commands) / frames;
+		printf("%u models in %u command slots, %.0f visible and %.0f commands per pass and frame, %llu mismatches\n",
+			static_cast<unsigned>(models), gpu.get_slot_count(), static_cast<double>(visible) / (2 * frames), static_cast<double>(commands) / (2 * frames),
+			static_cast<unsigned long long>(mismatches));
+		printf("CPU culling and LOD %.3f ms per pass, compute shaders %.3f ms including the wait for them\n",
+			cpu_time / (2 * frames) * 1e3, gpu_time / (2 * frames) * 1e3);
+		printf("uploads per frame: %.0f kB with the CPU path, %llu bytes with the compute shaders\n",
+			cpu_bytes / 1024.0, static_cast<unsigned long long>(buffer::bytes_uploaded / frames));
+		return mismatches;
+	}
+
+	/**
+	 * \brief culls random models of 40 synthetic meshes with the compute shaders of the GPU culling and with frustum_culler and
+	 * lod_system, along a camera walk and a growing shadow view, for machines without the level. at frame 50 a model moves,
+	 * one gets activated and one deactivated, like the level updates the culler
+	 * \return number of frames with a different model, LOD or number of commands
+	 */
+	size_t verify_gpu_synthetic(const size_t count, const bool count_from_buffer)
+	{
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		// 1 to 6 LODs with growing errors, every third mesh has 32 bit indices, the last ones have no models
+		std::vector<sub_mesh> meshes(40);
+		uint32_t index_offset = 0;
+		for (uint32_t m = 0; m < meshes.size(); m++)
+		{
+			sub_mesh& mesh = meshes[m];
+			mesh.short_indices = m % 3 != 0;
+			mesh.material_index = m % 5;
+			mesh.vertex_offset = m * 100;
+			const uint32_t lods = m % 7 == 0 ? 1 : 1 + rng() % 6;
+			float error = 0.0f;
+			for (uint32_t lod = 0; lod < lods; lod++)
+			{
+				mesh.index_count.push_back(300 - lod * 30);
+				mesh.index_offset.push_back(index_offset);
+				index_offset += 300;
+				mesh.lod_error.push_back(error);
+				error += unit(rng) * 0.05f;
+			}
+		}
+
+		std::vector<uint32_t> model_meshes(count), flags(count);
+		std::vector<bounding_box> bounds(count);
+		const std::vector<glm::mat4> matrices(count, glm::mat4(1.0f));
+		for (size_t i = 0; i < count; i++)
+		{
+			model_meshes[i] = static_cast<uint32_t>(rng() % (meshes.size() - 3));
+			const glm::vec3 center(unit(rng) * 200.0f - 100.0f, unit(rng) * 20.0f - 10.0f, unit(rng) * 200.0f - 100.0f);
+			const float radius = unit(rng) * 2.0f + 0.1f;
+			bounds[i] = bounding_box(center - radius, center + radius);
+			flags[i] = rng() % 10 != 0 ? gpu_culler::model_drawn : 0;
+		}
+		box_soa soa = to_soa(bounds);
+
+		gpu_culler gpu;
+		gpu.build(meshes, 1 << 20, model_meshes, bounds, matrices, flags, count_from_buffer);
+
+		constexpr int frames = 200;
+		constexpr float screen_height = 1080.0f;
+		constexpr float shadow_size = 4096.0f;
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 120.0f);
+		const glm::mat4 light_view = glm_look_at(glm::vec3(60.0f, 200.0f, 40.0f), glm::vec3(0.0f), glm::vec3(0, 0, 1));
+		lod_system::near_plane = 0.1f;
+		lod_system::pixels_per_unit = 0.5f * screen_height / std::tan(glm::radians(30.0f));
+
+		std::vector<uint32_t> cpu_visible(soa.mask_words()), gpu_visible;
+		std::vector<uint8_t> cpu_lods[gpu_culler::pass_count], gpu_lods;
+		for (std::vector<uint8_t>& lods : cpu_lods)
+			lods.assign(count, 0);
+		size_t mismatches = 0;
+		uint64_t visible = 0;
+		for (int f = 0; f < frames * 2; f++)
+		{
+			// the camera walks and turns first, then the light covers more and more models with coarser texels
+			const bool shadow = f >= frames;
+			const gpu_culler::pass pass = shadow ? gpu_culler::shadow_pass : gpu_culler::main_pass;
+			const float t = static_cast<float>(f % frames) / frames;
+			const glm::vec3 eye(-90.0f + 180.0f * t, 0.0f, 5.0f * std::sin(t * 20.0f));
+			const float angle = glm::two_pi<float>() * 3.0f * t;
+			const float extent = 10.0f + 60.0f * t;
+			const float texel = 2.0f * extent / shadow_size;
+			const glm::mat4 view_proj = shadow ? glm::ortho(-extent, extent, -extent, extent, 0.0f, 400.0f) * light_view
+				: projection * glm_look_at(eye, eye + glm::vec3(std::cos(angle), 0.1f, std::sin(angle)), glm::vec3(0, 1, 0));
+
+			if (f == 50 && count > 7)
+			{
+				bounds[5] = bounding_box(glm::vec3(-1.0f), glm::vec3(1.0f));
+				soa.set(5, bounds[5]);
+				gpu.update_model(5, bounds[5], glm::mat4(2.0f));
+				flags[6] = gpu_culler::model_drawn;
+				gpu.set_flags(6, flags[6]);
+				flags[7] = 0;
+				gpu.set_flags(7, flags[7]);
+			}
+
+			gpu_culler::view v;
+			frustum_culler::get_frustum_planes(view_proj, v.planes);
+			frustum_culler::get_frustum_corners(view_proj, v.corners);
+			v.position = eye;
+			v.near_plane = lod_system::near_plane;
+			v.pixels_per_unit = shadow ? 1.0f / texel : lod_system::pixels_per_unit;
+			v.by_distance = !shadow;
+			lod_system::view_pos = glm::vec4(eye, 1.0f);
+			gpu.cull(pass, v);
+
+			frustum_culler::cull_boxes(v.planes, v.corners, soa, cpu_visible.data());
+			std::vector<uint8_t>& lods = cpu_lods[pass];
+			std::unordered_set<uint64_t> mesh_lods;
+			for (size_t i = 0; i < count; i++)
+			{
+				const sub_mesh& mesh = meshes[model_meshes[i]];
+				lods[i] = static_cast<uint8_t>(shadow ? lod_system::decide_shadow_lod(mesh, texel, lods[i]) : lod_system::decide_lod(mesh, bounds[i], lods[i]));
+				if (flags[i] != gpu_culler::model_drawn)
+					cpu_visible[i / 32] &= ~(1u << (i % 32));
+				if ((cpu_visible[i / 32] >> (i % 32) & 1) == 0)
+					continue;
+				visible++;
+				mesh_lods.insert(static_cast<uint64_t>(model_meshes[i]) << 8 | lods[i]);
+			}
+
+			const int64_t draws = gpu.read_results(pass, gpu_visible, gpu_lods);
+			if (draws == static_cast<int64_t>(mesh_lods.size()) && gpu_visible == cpu_visible && gpu_lods == lods)
+				continue;
+			if (mismatches++ < 10)
+			{
+				size_t models_differ = 0, lods_differ = 0;
+				for (size_t i = 0; i < count; i++)
+				{
+					models_differ += (gpu_visible[i / 32] >> (i % 32) & 1) != (cpu_visible[i / 32] >> (i % 32) & 1);
+					lods_differ += gpu_lods[i] != lods[i];
+				}
+				printf("mismatch: %s frame %d, %u models and %u LODs differ, %lld commands instead of %u\n", shadow ? "shadow" : "main", f % frames,
+					static_cast<unsigned>(models_differ), static_cast<unsigned>(lods_differ), static_cast<long long>(draws), static_cast<unsigned>(mesh_lods.size()));
+			}
+		}
+		printf("%u synthetic models in %u command slots, %s, %.0f visible per pass and frame, %llu mismatches\n",
+			static_cast<unsigned>(count), gpu.get_slot_count(), count_from_buffer ? "draw counts from the GPU" : "every slot drawn",
+			static_cast<double>(visible) / (2 * frames), static_cast<unsigned long long>(mismatches));
+		return mismatches;
+	}
+
+	/**
+	 * \brief creates a hidden window with an OpenGL 4.5 core context and loads GLEW, a software renderer like Mesa llvmpipe is enough
+	 * \return the window, nullptr if there is no such context
+	 */
+	GLFWwindow* create_hidden_context(const char* title)
+	{
+		if (!glfwInit())
+			return nullptr;
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		GLFWwindow* window = glfwCreateWindow(64, 64, title, nullptr, nullptr);
+		if (window)
+		{
+			glfwMakeContextCurrent(window);
+			glewExperimental = GL_TRUE;
+			if (glewInit() == GLEW_OK)
+			{
+				printf("%s\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+				return window;
+			}
+			glfwDestroyWindow(window);
+		}
+		printf("no OpenGL 4.5 context\n");
+		glfwTerminate();
+		return nullptr;
+	}
+}
+
+int tools::run(const int argc, char** argv)
+{
+	if (strcmp(argv[1], "--bake") == 0)
+		return bake(argc, argv);
+	if (strcmp(argv[1], "--verify-bake") == 0)
+		return verify_bake(argc, argv);
+	if (strcmp(argv[1], "--verify-packing") == 0)
+		return verify_packing(argc, argv);
+	if (strcmp(argv[1], "--bench-meshlets") == 0)
+		return bench_meshlets(argc, argv);
+	if (strcmp(argv[1], "--bench-textures") == 0)
+		return bench_textures(argc, argv);
+	if (strcmp(argv[1], "--convert-ktx2") == 0)
+		return convert_ktx2(argc, argv);
+	if (strcmp(argv[1], "--analyze") == 0)
+		return analyze(argc, argv);
+	if (strcmp(argv[1], "--analyze-diff") == 0)
+		return analyze_diff(argc, argv);
+	if (strcmp(argv[1], "--bench-lut") == 0)
+		return bench_lut(argc, argv);
+	if (strcmp(argv[1], "--verify-program-cache") == 0)
+		return verify_program_cache(argc, argv);
+	if (strcmp(argv[1], "--verify-cull") == 0)
+		return verify_cull(argc, argv);
+	if (strcmp(argv[1], "--bench-cull") == 0)
+		return bench_cull(argc, argv);
+	if (strcmp(argv[1], "--bench-bvh") == 0)
+		return bench_bvh(argc, argv);
+	if (strcmp(argv[1], "--bench-queue") == 0)
+		return bench_queue(argc, argv);
+	if (strcmp(argv[1], "--verify-occlusion") == 0)
+		return verify_occlusion(argc, argv);
+	if (strcmp(argv[1], "--bench-occlusion") == 0)
+		return bench_occlusion(argc, argv);
+	if (strcmp(argv[1], "--bench-entities") == 0)
+		return bench_entities(argc, argv);
+	if (strcmp(argv[1], "--bench-lod") == 0)
+		return bench_lod(argc, argv);
+	if (strcmp(argv[1], "--bench-coherence") == 0)
+		return bench_coherence(argc, argv);
+	if (strcmp(argv[1], "--verify-ring") == 0)
+		return verify_ring(argc, argv);
+	if (strcmp(argv[1], "--verify-gpu-cull") == 0)
+		return verify_gpu_cull(argc, argv);
+	if (strcmp(argv[1], "--verify-portals") == 0)
+		return verify_portals(argc, argv);
+
+	std::cout << "usage:\n"
+		<< "  --bake [scene.fbx]          import an fbx file and write its bake\n"
+		<< "  --verify-bake [scene.fbx]   compare the baked level with the fbx import\n"
+		<< "  --verify-packing [scene.fbx] measure the round trip error of packed vertices\n"
+		<< "  --bench-meshlets [scene.fbx] benchmark meshlet culling on the CPU\n"
+		<< "  --bench-textures [scene.fbx] benchmark decoding the material textures\n"
+		<< "  --convert-ktx2 [scene.fbx]  write mipmapped, block compressed, Zstd supercompressed ktx2 files of the material textures\n"
+		<< "  --analyze [scene.fbx] [report.json] write mesh and LOD quality statistics as json\n"
+		<< "  --analyze-diff before.json after.json compare two reports, fails on regressions\n"
+		<< "  --bench-lut [look.cube]     benchmark and verify the lut parser and its binary cache\n"
+		<< "  --verify-program-cache      check hits, misses, edits and corruption of the program binary cache\n"
+		<< "  --verify-cull [frusta]      compare batched frustum culling with the per box test\n"
+		<< "  --bench-cull [scene.fbx]    benchmark batched frustum culling against the per box test\n";
+	return EXIT_FAILURE;
+}
+
+int tools::bake(const int argc, char** argv)
+{
+	const char* scene_path = scene_argument(argc, argv);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	level lvl(scene_path, false);
+	if (lvl.get_meshes().empty())
+		return EXIT_FAILURE;
+	const double import_time = seconds_since(start);
+
+	if (!lvl.save_bake())
+		return EXIT_FAILURE;
+
+	printf("baked %u meshes, %u entities in %.3fs\n", static_cast<unsigned>(lvl.get_meshes().size()),
+		static_cast<unsigned>(lvl.get_scene().size()), import_time);
+	lvl.print_index_memory();
+	return EXIT_SUCCESS;
+}
+
+int tools::verify_bake(const int argc, char** argv)
+{
+	const char* scene_path = scene_argument(argc, argv);
+	const std::string bake_path = level_cache::bake_path_of(scene_path);
+	if (level_cache::is_stale(bake_path.c_str(), scene_path))
+	{
+		std::cout << "bake " << bake_path << " is missing or stale, run --bake first" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	const level fbx(scene_path, false);
+	const double fbx_time = seconds_since(start);
+
+	start = std::chrono::high_resolution_clock::now();
+	const level bake(scene_path, true);
+	const double bake_time = seconds_since(start);
+
+	int errors = 0;
+	expect_equal("vertex count", fbx.get_vertices().size(), bake.get_vertices().size(), errors);
+	expect_equal("index count", fbx.get_indices().size(), bake.get_indices().size(), errors);
+	expect_equal("16 bit index count", fbx.get_short_indices().size(), bake.get_short_indices().size(), errors);
+	expect_equal("mesh count", fbx.get_meshes().size(), bake.get_meshes().size(), errors);
+	expect_equal("meshlet count", fbx.get_meshlets().size(), bake.get_meshlets().size(), errors);
+	expect_equal("entity count", fbx.get_scene().size(), bake.get_scene().size(), errors);
+	expect_equal("materials", fbx.get_material_paths(), bake.get_material_paths(), errors);
+	expect_equal("directional lights", fbx.get_light_sources().directional.size(), bake.get_light_sources().directional.size(), errors);
+	expect_equal("point lights", fbx.get_light_sources().point.size(), bake.get_light_sources().point.size(), errors);
+	expect_equal("cell count", fbx.get_cells().size(), bake.get_cells().size(), errors);
+	expect_equal("portal count", fbx.get_portals().size(), bake.get_portals().size(), errors);
+	if (errors != 0)
+		return EXIT_FAILURE;
+
+	if (!same_bytes(fbx.get_vertices().data(), bake.get_vertices().data(), fbx.get_vertices().size() * sizeof(float)))
+		expect_equal("vertex data", 0, 1, errors);
+	if (!same_bytes(fbx.get_indices().data(), bake.get_indices().data(), fbx.get_indices().size() * sizeof(unsigned int)))
+		expect_equal("index data", 0, 1, errors);
+	if (!same_bytes(fbx.get_short_indices().data(), bake.get_short_indices().data(), fbx.get_short_indices().size() * sizeof(uint16_t)))
+		expect_equal("16 bit index data", 0, 1, errors);
+	if (!same_bytes(fbx.get_meshlets().data(), bake.get_meshlets().data(), fbx.get_meshlets().size() * sizeof(meshlet)))
+		expect_equal("meshlet data", 0, 1, errors);
+	if (!same_bytes(fbx.get_light_sources().directional.data(), bake.get_light_sources().directional.data(), fbx.get_light_sources().directional.size() * sizeof(directional_light)) ||
+		!same_bytes(fbx.get_light_sources().point.data(), bake.get_light_sources().point.data(), fbx.get_light_sources().point.size() * sizeof(positional_light)))
+		expect_equal("light data", 0, 1, errors);
+	if (!same_bytes(fbx.get_cells().data(), bake.get_cells().data(), fbx.get_cells().size() * sizeof(bounding_box)) ||
+		!same_bytes(fbx.get_portals().data(), bake.get_portals().data(), fbx.get_portals().size() * sizeof(bounding_box)))
+		expect_equal("cell and portal data", 0, 1, errors);
+
+	for (size_t i = 0; i < fbx.get_meshes().size(); i++)
+	{
+		const sub_mesh& a = fbx.get_meshes()[i];
+		const sub_mesh& b = bake.get_meshes()[i];
+		const bool same = a.name == b.name && a.vertex_offset == b.vertex_offset && a.vertex_count == b.vertex_count &&
+			a.material_index == b.material_index && a.index_offset == b.index_offset && a.index_count == b.index_count && a.lod_error == b.lod_error &&
+			a.meshlet_offset == b.meshlet_offset && a.meshlet_count == b.meshlet_count && a.short_indices == b.short_indices;
+		expect_equal(("mesh " + a.name).c_str(), same, true, errors);
+	}
+
+	for (size_t i = 0; i < fbx.get_scene().size(); i++)
+	{
+		const entity_table& a = fbx.get_scene();
+		const entity_table& b = bake.get_scene();
+		const bool same = a.get_name(i) == b.get_name(i) && a.render[i].type == b.render[i].type && a.render[i].mesh_index == b.render[i].mesh_index &&
+			same_bytes(&a.transforms[i], &b.transforms[i], sizeof(transformation)) &&
+			same_bytes(&a.model_bounds[i], &b.model_bounds[i], sizeof(bounding_box));
+		expect_equal(("entity " + a.get_name(i)).c_str(), same, true, errors);
+	}
+
+	printf("fbx import: %.3fs, bake load: %.3fs, %d mismatches\n", fbx_time, bake_time, errors);
+	return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_packing(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+	const std::vector<float>& vertices = lvl.get_vertices();
+
+	int errors = 0;
+	vertex_quantizer::error worst;
+	for (const sub_mesh& mesh : lvl.get_meshes())
+	{
+		const vertex_quantizer::error e = vertex_quantizer::round_trip_error(vertices.data() + mesh.vertex_offset * 8, mesh.vertex_count);
+		worst.position = std::max(worst.position, e.position);
+		worst.normal = std::max(worst.normal, e.normal);
+		worst.uv = std::max(worst.uv, e.uv);
+
+		if (!vertex_quantizer::is_within_tolerance(e))
+		{
+			printf("mesh %s: position %g, normal %g rad, uv %g\n", mesh.name.c_str(), e.position, e.normal, e.uv);
+			errors++;
+		}
+	}
+
+	printf("%u meshes, %u kB float vertices, %u kB packed vertices\n", static_cast<unsigned>(lvl.get_meshes().size()),
+		static_cast<unsigned>(vertices.size() * sizeof(float) / 1024), static_cast<unsigned>(vertices.size() / 8 * sizeof(packed_vertex) / 1024));
+	printf("largest error: position %g, normal %g rad, uv %g, %d meshes out of tolerance\n", worst.position, worst.normal, worst.uv, errors);
+	return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_meshlets(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+	const entity_table& scene = lvl.get_scene();
+	const std::vector<sub_mesh>& meshes = lvl.get_meshes();
+	const std::vector<meshlet>& meshlets = lvl.get_meshlets();
+	if (scene.empty())
+		return EXIT_FAILURE;
+
+	std::vector<glm::mat4> models;
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (uint32_t i = 0; i < scene.size(); i++)
+	{
+		models.push_back(scene.get_node_matrix(i));
+		vmin = glm::min(vmin, scene.world_bounds[i].min_);
+		vmax = glm::max(vmax, scene.world_bounds[i].max_);
+	}
+
+	// cameras on a ring around the level, looking at its center
+	constexpr int views = 16;
+	constexpr int iterations = 100;
+	const glm::vec3 center = (vmin + vmax) * 0.5f;
+	const float radius = glm::length(vmax - vmin) * 0.5f;
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, radius * 4.0f);
+
+	uint64_t model_triangles = 0, meshlet_triangles = 0;
+	double cull_time = 0.0;
+	std::vector<draw_elements_indirect_command> commands;
+	for (int v = 0; v < views; v++)
+	{
+		const float angle = glm::two_pi<float>() * static_cast<float>(v) / views;
+		const glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * radius * 0.6f;
+		const glm::mat4 view_proj = projection * glm_look_at(eye, center, glm::vec3(0, 1, 0));
+
+		glm::vec4 planes[6], corners[8], normalized[6];
+		frustum_culler::get_frustum_planes(view_proj, planes);
+		frustum_culler::get_frustum_corners(view_proj, corners);
+		meshlet_culler::normalize_planes(planes, normalized);
+
+		std::vector<uint32_t> visible;
+		for (uint32_t i = 0; i < scene.size(); i++)
+		{
+			if (!frustum_culler::is_box_in_frustum(planes, corners, scene.world_bounds[i]))
+				continue;
+			visible.push_back(i);
+			model_triangles += meshes[scene.render[i].mesh_index].index_count[0] / 3;
+		}
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; it++)
+		{
+			commands.clear();
+			for (const uint32_t i : visible)
+			{
+				const sub_mesh& mesh = meshes[scene.render[i].mesh_index];
+				const draw_elements_indirect_command cmd{ mesh.index_count[0], 1, mesh.index_offset[0], mesh.vertex_offset, i };
+				meshlet_culler::cull(meshlets.data() + mesh.meshlet_offset[0], mesh.meshlet_count[0], models[i], normalized, eye, cmd, commands);
+			}
+		}
+		cull_time += seconds_since(start) / iterations;
+
+		for (const auto& cmd : commands)
+			meshlet_triangles += cmd.count_ / 3;
+	}
+
+	printf("%u meshlets, %u entities, %d views\n", static_cast<unsigned>(meshlets.size()), static_cast<unsigned>(scene.size()), views);
+	printf("triangles per view: %llu after model culling, %llu after meshlet culling (%.1f%%)\n",
+		static_cast<unsigned long long>(model_triangles / views), static_cast<unsigned long long>(meshlet_triangles / views),
+		model_triangles ? 100.0 * static_cast<double>(meshlet_triangles) / static_cast<double>(model_triangles) : 0.0);
+	printf("meshlet culling: %.3f ms per view\n", cull_time / views * 1000.0);
+	return EXIT_SUCCESS;
+}
+
+int tools::bench_textures(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+
+	// the materials only exist as upload targets, nothing gets written to them without upload
+	texture_loader loader(false);
+	std::vector<material> materials(lvl.get_material_paths().size());
+	for (size_t m = 0; m < materials.size(); m++)
+	{
+		if (!lvl.get_material_paths()[m].empty())
+			loader.load_material(material::get_folder(lvl.get_material_paths()[m].c_str()), &materials[m]);
+	}
+
+	const texture_loader::report r = loader.finish();
+	printf("%u decode threads\n", job_system::instance().get_thread_count());
+	texture_loader::print_report(r);
+	return r.images != r.missing ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::convert_ktx2(const int argc, char** argv)
+{
+	// BC1 of natural textures usually lands between 32 and 40 dB, BC5 of normals higher, less means the encoder broke something
+	constexpr double min_psnr = 28.0;
+	constexpr size_t normal_slot = 1;
+
+	const level lvl(scene_argument(argc, argv), true);
+
+	struct conversion
+	{
+		std::string path;
+		size_t slot;
+		size_t ktx_bytes = 0;
+		size_t ktx2_bytes = 0;
+		double psnr = 0.0;
+		double load_time = 0.0;
+		bool compressed = false;
+		bool ok = false;
+	};
+	std::vector<conversion> files;
+	for (const auto& material_path : lvl.get_material_paths())
+	{
+		if (material_path.empty())
+			continue;
+		const std::string folder = material::get_folder(material_path.c_str());
+		for (size_t i = 0; i < 7; i++)
+		{
+			conversion c;
+			c.path = folder + Texture::material_files[i];
+			c.slot = i;
+			if (std::find_if(files.begin(), files.end(), [&c](const conversion& f) { return f.path == c.path; }) == files.end())
+				files.push_back(c);
+		}
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	job_system::instance().parallel_for(files.size(), [&files](const size_t i)
+	{
+		conversion& c = files[i];
+		gli::texture reference = gli::load_ktx(c.path);
+		if (reference.empty())
+			return;
+		c.ktx_bytes = file_size(c.path);
+
+		// BC1 smears normals too much, their x and y go into the two channels of BC5 and the shader rebuilds z.
+		// normal maps in other formats keep them
+		const bool normals = c.slot == normal_slot;
+		if (normals && reference.format() == gli::FORMAT_RGB8_UNORM_PACK8)
+			reference = block_compressor::normal_xy(reference);
+		gli::texture image = block_compressor::build_mips(reference);
+		if (image.empty() || !ktx2::is_supported(image.format()))
+			return;
+		if (block_compressor::can_compress(image.format()) && (!normals || image.format() == gli::FORMAT_RG8_UNORM_PACK8))
+		{
+			image = block_compressor::compress(image);
+			c.compressed = true;
+		}
+		if (!ktx2::save(c.path + "2", image, ktx2::zstd_level))
+			return;
+		c.ktx2_bytes = file_size(c.path + "2");
+
+		// read the file back the same way the game does and compare the decoded first level with the source
+		const auto load_start = std::chrono::high_resolution_clock::now();
+		const gli::texture loaded = ktx2::load(c.path + "2");
+		c.load_time = seconds_since(load_start);
+		if (loaded.empty() || loaded.levels() != image.levels())
+			return;
+		if (c.compressed)
+			c.psnr = block_compressor::psnr(reference, block_compressor::decompress(loaded));
+		else if (same_bytes(reference.data(0, 0, 0), loaded.data(0, 0, 0), reference.size(0)))
+			c.psnr = std::numeric_limits<double>::infinity();
+		c.ok = c.psnr >= min_psnr;
+	});
+	const double time = seconds_since(start);
+
+	size_t converted = 0, compressed = 0, failed = 0, ktx_bytes = 0, ktx2_bytes = 0;
+	double load_time = 0.0;
+	const conversion* worst = nullptr;
+	for (const auto& c : files)
+	{
+		if (c.ktx_bytes == 0)
+			continue;
+		if (!c.ok)
+		{
+			std::cout << "failed: " << c.path << " (" << c.psnr << " dB)" << std::endl;
+			failed++;
+			continue;
+		}
+		converted++;
+		compressed += c.compressed;
+		ktx_bytes += c.ktx_bytes;
+		ktx2_bytes += c.ktx2_bytes;
+		load_time += c.load_time;
+		if (c.compressed && (!worst || c.psnr < worst->psnr))
+			worst = &c;
+	}
+
+	printf("converted %u textures in %.3fs, %u block compressed, %u failed\n", static_cast<unsigned>(converted), time,
+		static_cast<unsigned>(compressed), static_cast<unsigned>(failed));
+	printf("ktx %.1f MB without mips, ktx2 %.1f MB with mips and Zstd, read and inflated in %.3fs on one thread\n", static_cast<double>(ktx_bytes) / (1024.0 * 1024.0),
+		static_cast<double>(ktx2_bytes) / (1024.0 * 1024.0), load_time);
+	if (worst)
+		printf("lowest psnr %.2f dB in %s\n", worst->psnr, worst->path.c_str());
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::analyze(const int argc, char** argv)
+{
+	const char* scene_path = scene_argument(argc, argv);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	const level lvl(scene_path, true);
+	if (lvl.get_meshes().empty())
+		return EXIT_FAILURE;
+	const std::vector<mesh_analyzer::mesh_stats> stats = mesh_analyzer::analyze(lvl);
+
+	// the level prints while loading, so the report doesn't go to stdout
+	const std::string report_path = argc > 3 ? argv[3] : std::string(scene_path) + ".analysis.json";
+	std::ofstream out(report_path);
+	mesh_analyzer::write_json(out, scene_path, stats);
+	if (!out)
+	{
+		std::cout << "could not write " << report_path << std::endl;
+		return EXIT_FAILURE;
+	}
+	printf("analyzed %u meshes in %.3fs, report written to %s\n", static_cast<unsigned>(stats.size()), seconds_since(start), report_path.c_str());
+	return EXIT_SUCCESS;
+}
+
+int tools::analyze_diff(const int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cout << "usage: --analyze-diff before.json after.json" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<mesh_analyzer::mesh_stats> before, after;
+	if (!mesh_analyzer::read_json(argv[2], before) || !mesh_analyzer::read_json(argv[3], after))
+		return EXIT_FAILURE;
+	return mesh_analyzer::diff(before, after) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_lut(const int argc, char** argv)
+{
+	const char* cube_path = argc > 2 ? argv[2] : "../assets/textures/look32.CUBE";
+	std::ifstream in(cube_path, std::ios::binary);
+	if (!in)
+	{
+		std::cout << "could not read " << cube_path << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::stringstream file;
+	file << in.rdbuf();
+	bool passed = compare_lut_parsers(cube_path, file.str());
+
+	// the largest supported lut, written the way photoshop exports them
+	const uint32_t size = color_lut::max_size;
+	std::string text = "TITLE \"generated\"\nLUT_3D_SIZE 65\nDOMAIN_MIN 0.0 0.0 0.0\nDOMAIN_MAX 1.0 1.0 1.0\n";
+	char line[64];
+	for (uint32_t b = 0; b < size; b++)
+		for (uint32_t g = 0; g < size; g++)
+			for (uint32_t r = 0; r < size; r++)
+			{
+				snprintf(line, sizeof(line), "%.6f %.6f %.6f\n", pow(r / (size - 1.0), 1.1), g / (size - 1.0), sqrt(b / (size - 1.0)));
+				text += line;
+			}
+	passed = compare_lut_parsers("generated", text) && passed;
+
+	// the cache has to give back exactly the converted texels
+	uint32_t parsed_size;
+	std::vector<float> rgb;
+	color_lut::lut_data converted, cached;
+	color_lut::parse_cube(text.data(), text.size(), parsed_size, rgb);
+	color_lut::to_half(parsed_size, rgb, converted);
+	const std::string cache_path = "generated.CUBE.lut";
+	if (!color_lut::write_cache(cache_path, "generated.CUBE", converted))
+	{
+		std::cout << "could not write " << cache_path << std::endl;
+		return EXIT_FAILURE;
+	}
+	const auto start = std::chrono::high_resolution_clock::now();
+	const bool read = color_lut::read_cache(cache_path, "generated.CUBE", cached);
+	const double cache_time = seconds_since(start);
+	remove(cache_path.c_str());
+
+	const bool equal = read && cached.size == converted.size && cached.texels == converted.texels;
+	printf("cache: %.1f kB, read in %.2f ms, %s\n", converted.texels.size() * sizeof(uint16_t) / 1024.0, cache_time * 1000.0, equal ? "identical" : "MISMATCH");
+	return passed && equal ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_program_cache(const int argc, char** argv)
+{
+	GLFWwindow* window = create_hidden_context("verify program cache");
+	if (!window)
+		return EXIT_FAILURE;
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	int failures = formats > 0 ? 0 : 1;
+	if (formats == 0)
+		printf("the driver has no program binary formats\n");
+
+	// a cache and shaders of its own, the one of the game stays untouched
+	const std::string game_path = program_cache::path;
+	program_cache::path = "verify_programs.cache";
+	remove(program_cache::path.c_str());
+	write_cache_shaders(1);
+
+	const auto expect = [&](const cache_run& r, const uint32_t loaded, const uint32_t linked, const uint32_t value)
+	{
+		// closing leaves only the binaries of the three programs
+		const bool passed = r.loaded == loaded && r.linked == linked && r.value == value && r.file_entries == 3;
+		printf("%-22s compute result %u, %u binaries in the file%s\n", "", r.value, static_cast<unsigned>(r.file_entries), passed ? "" : " FAILED");
+		failures += passed ? 0 : 1;
+	};
+
+	const auto read_cache = [&]()
+	{
+		std::ifstream in(program_cache::path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	};
+	const auto write_cache = [&](const std::string& bytes)
+	{
+		std::ofstream(program_cache::path, std::ios::binary | std::ios::trunc) << bytes;
+	};
+	constexpr size_t header_size = 16;	// magic, version and driver hash
+
+	if (failures == 0)
+	{
+		expect(run_cached_programs("first start"), 0, 3, 1);
+		expect(run_cached_programs("second start"), 3, 0, 1);
+
+		// only the edited program links again, closing drops the binary of the old source
+		write_cache_shaders(2);
+		expect(run_cached_programs("edited compute shader"), 2, 1, 2);
+		expect(run_cached_programs("after the edit"), 3, 0, 2);
+
+		// every binary twice, like appended by runs that never closed the cache, opening compacts the file again
+		const std::string compact = read_cache();
+		write_cache(compact + compact.substr(header_size));
+		expect(run_cached_programs("duplicated binaries"), 3, 0, 2);
+		if (read_cache().size() != compact.size())
+		{
+			printf("the duplicated binaries were not removed FAILED\n");
+			failures++;
+		}
+
+		// the last binary gets cut off, then the header is overwritten
+		write_cache(compact.substr(0, compact.size() - 16));
+		expect(run_cached_programs("truncated file"), 2, 1, 2);
+		std::string corrupted = read_cache();
+		corrupted.replace(0, 4, "XXXX");
+		write_cache(corrupted);
+		expect(run_cached_programs("corrupted header"), 0, 3, 2);
+		expect(run_cached_programs("after the corruption"), 3, 0, 2);
+	}
+
+	for (const char* file : { "verify_cache.vert", "verify_cache_a.frag", "verify_cache_b.frag", "verify_cache.comp" })
+		remove(file);
+	remove(program_cache::path.c_str());
+	program_cache::path = game_path;
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_cull(const int argc, char** argv)
+{
+	const int frusta = argc > 2 ? atoi(argv[2]) : 2000;
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<size_t> tail(0, 15);
+	const std::vector<frustum_culler::simd_level> levels = supported_simd_levels();
+
+	size_t tested = 0, mismatches = 0;
+	for (int f = 0; f < frusta; f++)
+	{
+		glm::vec4 planes[6], corners[8];
+		const glm::mat4 view_proj = random_view_proj(rng);
+		frustum_culler::get_frustum_planes(view_proj, planes);
+		frustum_culler::get_frustum_corners(view_proj, corners);
+
+		// an odd count, so the boxes behind the last full simd group are tested too
+		const std::vector<bounding_box> boxes = random_boxes(rng, corners, 1024 + tail(rng));
+		const box_soa soa = to_soa(boxes);
+		std::vector<uint32_t> visible(soa.mask_words());
+		for (const auto level : levels)
+		{
+			frustum_culler::cull_boxes(planes, corners, soa, visible.data(), level);
+			for (size_t i = 0; i < boxes.size(); i++)
+			{
+				const bool expected = frustum_culler::is_box_in_frustum(planes, corners, boxes[i]);
+				if (expected == ((visible[i / 32] >> (i % 32) & 1) != 0))
+					continue;
+				if (mismatches++ < 10)
+					printf("mismatch: %s frustum %d box %u, expected %s\n", frustum_culler::get_simd_name(level), f, static_cast<unsigned>(i), expected ? "visible" : "culled");
+			}
+			// bits behind the last box have to stay clear
+			if (boxes.size() % 32 != 0 && visible.back() >> (boxes.size() % 32) != 0)
+				mismatches++;
+			tested += boxes.size();
+		}
+	}
+
+	printf("%s support, %llu box tests, %llu mismatches\n", frustum_culler::get_simd_name(frustum_culler::get_simd_level()),
+		static_cast<unsigned long long>(tested), static_cast<unsigned long long>(mismatches));
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_cull(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+	const entity_table& scene = lvl.get_scene();
+	if (scene.empty())
+		return EXIT_FAILURE;
+
+	std::vector<bounding_box> boxes;
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const bounding_box& b : scene.world_bounds)
+	{
+		boxes.push_back(b);
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+	}
+
+	// cameras on a ring around the level, looking at its center, like --bench-meshlets
+	constexpr int views = 16;
+	const glm::vec3 center = (vmin + vmax) * 0.5f;
+	const float radius = glm::length(vmax - vmin) * 0.5f;
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, radius * 4.0f);
+	std::vector<glm::mat4> view_projs;
+	for (int v = 0; v < views; v++)
+	{
+		const float angle = glm::two_pi<float>() * static_cast<float>(v) / views;
+		const glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * radius * 0.6f;
+		view_projs.push_back(projection * glm_look_at(eye, center, glm::vec3(0, 1, 0)));
+	}
+	bench_cull_boxes("level", boxes, view_projs, 1000);
+
+	std::mt19937 rng(7);
+	glm::vec4 corners[8];
+	frustum_culler::get_frustum_corners(view_projs[0], corners);
+	bench_cull_boxes("random", random_boxes(rng, corners, 65536), view_projs, 10);
+	return EXIT_SUCCESS;
+}
+
+int tools::bench_bvh(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+	const entity_table& scene = lvl.get_scene();
+	if (scene.empty())
+		return EXIT_FAILURE;
+
+	std::vector<bounding_box> boxes;
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const bounding_box& b : scene.world_bounds)
+	{
+		boxes.push_back(b);
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+	}
+
+	// the same ring of cameras as --bench-cull
+	constexpr int views = 16;
+	const glm::vec3 center = (vmin + vmax) * 0.5f;
+	const float radius = glm::length(vmax - vmin) * 0.5f;
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, radius * 4.0f);
+	std::vector<glm::mat4> view_projs;
+	for (int v = 0; v < views; v++)
+	{
+		const float angle = glm::two_pi<float>() * static_cast<float>(v) / views;
+		const glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * radius * 0.6f;
+		view_projs.push_back(projection * glm_look_at(eye, center, glm::vec3(0, 1, 0)));
+	}
+	size_t mismatches = bench_bvh_boxes("level", boxes, view_projs, 1000);
+
+	// large worlds seen from the ground, where most of the boxes are far behind or beside the camera
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> angle(0.0f, glm::two_pi<float>());
+	const glm::mat4 ground_projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+	view_projs.clear();
+	for (int v = 0; v < views; v++)
+	{
+		const glm::vec3 eye(position(rng), 2.0f, position(rng));
+		const float a = angle(rng);
+		view_projs.push_back(ground_projection * glm_look_at(eye, eye + glm::vec3(std::cos(a), -0.1f, std::sin(a)), glm::vec3(0, 1, 0)));
+	}
+	mismatches += bench_bvh_boxes("world 10k", world_boxes(rng, 2000.0f, 10000), view_projs, 100);
+	mismatches += bench_bvh_boxes("world 100k", world_boxes(rng, 2000.0f, 100000), view_projs, 10);
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_queue(const int argc, char** argv)
+{
+	const size_t count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+	const char* scene_path = scene_argument(argc, argv, 3);
+	level lvl(scene_path, true);
+	if (lvl.get_scene().empty() && argc <= 3)
+	{
+		printf("no level at %s, using %u synthetic entities\n", scene_path, static_cast<unsigned>(count));
+		lvl.build_synthetic_scene(count);
+	}
+	if (lvl.get_scene().empty() || count == 0)
+		return EXIT_FAILURE;
+	lvl.build_benchmark_queue(count);
+
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const bounding_box& b : lvl.get_scene().world_bounds)
+	{
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+	}
+
+	// cameras inside the grid of copies, looking along it
+	constexpr int views = 16;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const float far_plane = glm::length(vmax - vmin) * 0.25f;
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, far_plane);
+	std::vector<glm::mat4> view_projs;
+	std::vector<glm::vec3> eyes;
+	for (int v = 0; v < views; v++)
+	{
+		const glm::vec3 eye = vmin + (vmax - vmin) * glm::vec3(unit(rng), 0.5f, unit(rng));
+		const float angle = glm::two_pi<float>() * unit(rng);
+		eyes.push_back(eye);
+		view_projs.push_back(projection * glm_look_at(eye, eye + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0, 1, 0)));
+	}
+
+	const auto set_view = [&](const int v)
+	{
+		frustum_culler::cull_view_proj = view_projs[v];
+		frustum_culler::get_frustum_planes(view_projs[v], frustum_culler::frustum_planes);
+		frustum_culler::get_frustum_corners(view_projs[v], frustum_culler::frustum_corners);
+		lod_system::view_pos = glm::vec4(eyes[v], 1.0f);
+	};
+
+	const auto run = [&](const size_t chunks, const int iterations, uint64_t& visible)
+	{
+		visible = 0;
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; it++)
+		{
+			for (int v = 0; v < views; v++)
+			{
+				set_view(v);
+				visible += lvl.update_benchmark_queue(chunks);
+			}
+		}
+		return seconds_since(start) / (static_cast<double>(iterations) * views);
+	};
+
+	const unsigned threads = job_system::instance().get_thread_count() + 1;
+	const int iterations = std::max(1, static_cast<int>(2000000 / count));
+	uint64_t expected;
+	run(1, 1, expected);
+	printf("%u commands, %.1f%% visible, %u threads\n", static_cast<unsigned>(count), 100.0 * expected / (static_cast<double>(count) * views), threads);
+
+	// commands of the same mesh and LOD are drawn as one
+	uint64_t instanced = 0;
+	for (int v = 0; v < views; v++)
+	{
+		set_view(v);
+		lvl.update_benchmark_queue(0);
+		instanced += lvl.compact_benchmark_queue();
+	}
+	printf("%llu visible commands drawn by %llu instanced commands per frame\n", static_cast<unsigned long long>(expected / views),
+		static_cast<unsigned long long>(instanced / views));
+
+	double single = 0.0;
+	bool same = true;
+	// always 1, 2, 4 and 8 jobs so runs on different machines compare, then every power of two up to all threads
+	std::vector<size_t> chunk_counts;
+	for (size_t t = 1; t <= 8 || t < threads; t *= 2)
+		chunk_counts.push_back(t);
+	if (chunk_counts.back() < threads)
+		chunk_counts.push_back(threads);
+	chunk_counts.push_back(0);
+	for (const size_t chunks : chunk_counts)
+	{
+		uint64_t visible;
+		const double time = run(chunks, iterations, visible);
+		visible /= iterations;
+		same = same && visible == expected;
+		if (chunks == 1)
+			single = time;
+		char label[32];
+		snprintf(label, sizeof(label), "%u jobs", static_cast<unsigned>(chunks));
+		printf("  %-16s %8.1f us per frame (%.2fx)%s%s\n", chunks ? label : "game chunks", time * 1e6, single / time,
+			chunks > threads ? " more jobs than threads" : "", visible == expected ? "" : " MISMATCH");
+	}
+	return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_occlusion(const int argc, char** argv)
+{
+	const int scenes = argc > 2 ? atoi(argv[2]) : 200;
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	size_t tested = 0, occluded = 0, leaks = 0;
+	double render_time = 0.0, test_time = 0.0;
+	for (int s = 0; s < scenes; s++)
+	{
+		// walls of random length, height and direction around the camera
+		occlusion_culler culler;
+		std::vector<glm::vec3> triangles;
+		for (int w = 0; w < 20; w++)
+		{
+			const glm::vec3 center(unit(rng) * 80.0f - 40.0f, unit(rng) * 20.0f - 10.0f, unit(rng) * 80.0f - 40.0f);
+			const float angle = glm::two_pi<float>() * unit(rng);
+			const glm::vec3 along = glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * (5.0f + unit(rng) * 20.0f);
+			const glm::vec3 up(0.0f, 5.0f + unit(rng) * 10.0f, 0.0f);
+			const std::vector<glm::vec3> corners = { center - along - up, center + along - up, center + along + up, center - along + up };
+			const std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+			culler.add_occluder(corners, indices);
+			for (const uint32_t i : indices)
+				triangles.push_back(corners[i]);
+		}
+
+		const glm::vec3 eye(unit(rng) * 20.0f - 10.0f, unit(rng) * 4.0f - 2.0f, unit(rng) * 20.0f - 10.0f);
+		const float angle = glm::two_pi<float>() * unit(rng);
+		const glm::mat4 view_proj = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 200.0f) * glm_look_at(eye, eye + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0, 1, 0));
+		glm::vec4 planes[6], corners[8];
+		frustum_culler::get_frustum_planes(view_proj, planes);
+		frustum_culler::get_frustum_corners(view_proj, corners);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		culler.render(view_proj);
+		render_time += seconds_since(start);
+
+		for (int i = 0; i < 2000; i++)
+		{
+			const glm::vec3 center(unit(rng) * 160.0f - 80.0f, unit(rng) * 20.0f - 10.0f, unit(rng) * 160.0f - 80.0f);
+			const glm::vec3 half = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f + 0.05f;
+			const bounding_box b(center - half, center + half);
+			if (!frustum_culler::is_box_in_frustum(planes, corners, b))
+				continue;
+			tested++;
+			start = std::chrono::high_resolution_clock::now();
+			const bool visible = culler.is_box_visible(b);
+			test_time += seconds_since(start);
+			if (visible)
+				continue;
+			occluded++;
+
+			// every point on the surface of a culled box that is inside the frustum has to be behind a wall
+			for (int p = 0; p < 200; p++)
+			{
+				glm::vec3 point = b.min_ + (b.max_ - b.min_) * glm::vec3(unit(rng), unit(rng), unit(rng));
+				point[p % 3] = p % 6 < 3 ? b.min_[p % 3] : b.max_[p % 3];
+				const glm::vec4 clip = view_proj * glm::vec4(point, 1.0f);
+				if (clip.w <= 0.0f || std::abs(clip.x) > clip.w || std::abs(clip.y) > clip.w || std::abs(clip.z) > clip.w)
+					continue;
+				bool hidden = false;
+				for (size_t t = 0; t < triangles.size() && !hidden; t += 3)
+				{
+					const float distance = intersect_triangle(eye, point - eye, triangles[t], triangles[t + 1], triangles[t + 2]);
+					hidden = distance > 0.0f && distance < 1.0f;
+				}
+				if (!hidden)
+				{
+					if (leaks++ < 10)
+						printf("leak: scene %d, box at %.2f %.2f %.2f is visible at %.2f %.2f %.2f\n", s, center.x, center.y, center.z, point.x, point.y, point.z);
+					break;
+				}
+			}
+		}
+	}
+
+	printf("%llu boxes in the frustum, %.1f%% occluded, %llu leaks, render %.1f us, %.3f us per box\n", static_cast<unsigned long long>(tested),
+		100.0 * occluded / std::max<size_t>(1, tested), static_cast<unsigned long long>(leaks), render_time / scenes * 1e6, test_time / std::max<size_t>(1, tested) * 1e6);
+	return leaks == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_occlusion(const int argc, char** argv)
+{
+	level lvl(scene_argument(argc, argv), true);
+	const entity_table& scene = lvl.get_scene();
+	occlusion_culler& culler = lvl.get_occlusion_culler();
+	if (scene.empty())
+		return EXIT_FAILURE;
+	printf("%u occluders, %u triangles\n", static_cast<unsigned>(culler.get_occluder_count()), static_cast<unsigned>(culler.get_triangle_count()));
+
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const bounding_box& b : scene.world_bounds)
+	{
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+	}
+
+	// a camera in the middle of the tower every few meters of height, looking into 4 directions
+	constexpr int floors = 8;
+	const glm::vec3 center = (vmin + vmax) * 0.5f;
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, glm::length(vmax - vmin));
+	size_t in_frustum = 0, occluded = 0, views = 0;
+	double render_time = 0.0, test_time = 0.0;
+	for (int f = 0; f < floors; f++)
+	{
+		for (int d = 0; d < 4; d++)
+		{
+			const glm::vec3 eye(center.x, vmin.y + (vmax.y - vmin.y) * (f + 0.5f) / floors, center.z);
+			const float angle = glm::half_pi<float>() * d;
+			const glm::mat4 view_proj = projection * glm_look_at(eye, eye + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0, 1, 0));
+			glm::vec4 planes[6], corners[8];
+			frustum_culler::get_frustum_planes(view_proj, planes);
+			frustum_culler::get_frustum_corners(view_proj, corners);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			culler.render(view_proj);
+			render_time += seconds_since(start);
+			start = std::chrono::high_resolution_clock::now();
+			for (const bounding_box& b : scene.world_bounds)
+			{
+				if (!frustum_culler::is_box_in_frustum(planes, corners, b))
+					continue;
+				in_frustum++;
+				occluded += culler.is_box_visible(b) ? 0 : 1;
+			}
+			test_time += seconds_since(start);
+			views++;
+		}
+	}
+
+	printf("%u views, %.1f models in the frustum per view, %.1f%% of them occluded\n", static_cast<unsigned>(views),
+		static_cast<double>(in_frustum) / views, 100.0 * occluded / std::max<size_t>(1, in_frustum));
+	printf("render %.1f us, frustum and occlusion tests %.1f us per view\n", render_time / views * 1e6, test_time / views * 1e6);
+	return EXIT_SUCCESS;
+}
+
+int tools::bench_entities(const int argc, char** argv)
+{
+	const size_t count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 200000;
+	if (count == 0)
+		return EXIT_FAILURE;
+
+	// the same random entities in both layouts, every mesh has 8 LODs whose error doubles from one to the next
+	constexpr int32_t meshes = 64;
+	sub_mesh lods;
+	lods.lod_error.push_back(0.0f);
+	for (int l = 1; l < 8; l++)
+		lods.lod_error.push_back(0.005f * static_cast<float>(1 << l));
+	const float size = std::sqrt(static_cast<float>(count)) * 10.0f;
+	std::mt19937 rng(18);
+	std::uniform_int_distribution<int32_t> mesh(0, meshes - 1);
+	const std::vector<bounding_box> boxes = world_boxes(rng, size, count);
+	std::vector<legacy_entity> legacy(count);
+	entity_table table;
+	table.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		legacy_entity& e = legacy[i];
+		e.name = "Entity." + std::to_string(i % 1000);
+		e.type = i % 10 == 0 ? dynamic : rigid;
+		e.mesh_index = mesh(rng);
+		e.TRS.local = glm::mat4(1.0f);
+		e.model_bounds = e.world_bounds = boxes[i];
+		e.is_active = i % 50 != 0;
+		const uint32_t t = table.add(e.name, e.type, e.mesh_index, e.TRS, e.model_bounds);
+		table.world_bounds[t] = e.world_bounds;
+		table.render[t].is_active = e.is_active;
+	}
+
+	// the frustum culling result is shared, only the loops that read the entities are timed
+	const box_soa soa = to_soa(boxes);
+	std::vector<uint32_t> visible(soa.mask_words());
+
+	// cameras standing in the world, looking along it
+	constexpr int views = 16;
+	constexpr int frames = 10;
+	std::uniform_real_distribution<float> position(-size * 0.4f, size * 0.4f);
+	std::uniform_real_distribution<float> angle(0.0f, glm::two_pi<float>());
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, size * 0.5f);
+	uint64_t legacy_visible = 0, table_visible = 0, legacy_lods = 0, table_lods = 0;
+	double legacy_time = 0.0, table_time = 0.0;
+	size_t legacy_lines = 0, table_lines = 0;
+	for (int v = 0; v < views; v++)
+	{
+		const glm::vec3 eye(position(rng), 10.0f, position(rng));
+		const float a = angle(rng);
+		const glm::vec3 direction(std::cos(a), 0.0f, std::sin(a));
+		const glm::mat4 view_proj = projection * glm_look_at(eye, eye + direction, glm::vec3(0, 1, 0));
+		glm::vec4 planes[6], corners[8];
+		frustum_culler::get_frustum_planes(view_proj, planes);
+		frustum_culler::get_frustum_corners(view_proj, corners);
+		lod_system::near_plane = 0.1f;
+		lod_system::view_pos = glm::vec4(eye, 1.0f);
+		frustum_culler::cull_boxes(planes, corners, soa, visible.data());
+
+		// the command update of a frame like level::update_commands, once over the structs and once over the hot component arrays
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int f = 0; f < frames; f++)
+			for (size_t i = 0; i < count; i++)
+			{
+				const legacy_entity& e = legacy[i];
+				if (!e.is_active || (visible[i / 32] >> (i % 32) & 1) == 0)
+					continue;
+				legacy_visible++;
+				legacy_lods += lod_system::decide_lod(lods, e.world_bounds, 0) + static_cast<uint32_t>(e.mesh_index);
+			}
+		legacy_time += seconds_since(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int f = 0; f < frames; f++)
+			for (size_t i = 0; i < count; i++)
+			{
+				const entity_render& render = table.render[i];
+				if (!render.is_active || (visible[i / 32] >> (i % 32) & 1) == 0)
+					continue;
+				table_visible++;
+				table_lods += lod_system::decide_lod(lods, table.world_bounds[i], 0) + static_cast<uint32_t>(render.mesh_index);
+			}
+		table_time += seconds_since(start);
+
+		// 64 byte lines that the loops read, every entity needs its state and the visible ones their bounds and mesh too
+		std::unordered_set<uintptr_t> lines;
+		const auto touch = [&lines](const void* p, const size_t bytes)
+		{
+			const auto address = reinterpret_cast<uintptr_t>(p);
+			for (uintptr_t line = address / 64; line <= (address + bytes - 1) / 64; line++)
+				lines.insert(line);
+		};
+		for (size_t i = 0; i < count; i++)
+		{
+			const bool drawn = legacy[i].is_active && (visible[i / 32] >> (i % 32) & 1) != 0;
+			touch(&legacy[i].is_active, sizeof(bool));
+			if (drawn)
+			{
+				touch(&legacy[i].world_bounds, sizeof(bounding_box));
+				touch(&legacy[i].mesh_index, sizeof(int32_t));
+			}
+		}
+		legacy_lines += lines.size();
+		lines.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			touch(&table.render[i], sizeof(entity_render));
+			if (table.render[i].is_active && (visible[i / 32] >> (i % 32) & 1) != 0)
+				touch(&table.world_bounds[i], sizeof(bounding_box));
+		}
+		table_lines += lines.size();
+	}
+
+	const double runs = static_cast<double>(views) * frames;
+	printf("%u entities, %.1f visible per frame, %u different names\n", static_cast<unsigned>(count), table_visible / runs, static_cast<unsigned>(table.get_name_count()));
+	printf("  entity structs    %8.3f ms per frame, %3u bytes per entity, %8.0f cache lines per frame\n", legacy_time / runs * 1e3,
+		static_cast<unsigned>(sizeof(legacy_entity)), static_cast<double>(legacy_lines) / views);
+	printf("  component arrays  %8.3f ms per frame, %3u bytes per entity, %8.0f cache lines per frame (%.1fx faster, %.1fx fewer lines)\n", table_time / runs * 1e3,
+		static_cast<unsigned>(sizeof(bounding_box) + sizeof(entity_render)), static_cast<double>(table_lines) / views, legacy_time / table_time,
+		static_cast<double>(legacy_lines) / std::max<size_t>(1, table_lines));
+
+	const bool same = legacy_visible == table_visible && legacy_lods == table_lods;
+	if (!same)
+		printf("MISMATCH: the layouts selected different entities or LODs\n");
+	return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_lod(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+	const entity_table& scene = lvl.get_scene();
+	const std::vector<sub_mesh>& meshes = lvl.get_meshes();
+	if (scene.empty())
+		return EXIT_FAILURE;
+
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const bounding_box& b : scene.world_bounds)
+	{
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+	}
+	const glm::vec3 center = (vmin + vmax) * 0.5f;
+	const float radius = glm::length(vmax - vmin) * 0.5f;
+
+	// a slow circle through the level, with a small shake on top like a walking player
+	constexpr int frames = 600;
+	constexpr float screen_height = 1080.0f;
+	std::mt19937 rng(21);
+	std::normal_distribution<float> shake(0.0f, radius * 0.001f);
+	bool same_lods = true;
+	for (const float fov : { 40.0f, 100.0f })
+	{
+		const glm::mat4 projection = glm::perspective(glm::radians(fov), 16.0f / 9.0f, 0.1f, radius * 4.0f);
+		lod_system::near_plane = 0.1f;
+		lod_system::pixels_per_unit = 0.5f * screen_height / std::tan(glm::radians(fov) * 0.5f);
+
+		std::vector<uint8_t> lods(scene.size(), 0), previous(scene.size(), 0);
+		uint64_t full_triangles = 0, lod_triangles = 0, changes = 0, flips = 0;
+		for (int f = 0; f < frames; f++)
+		{
+			const float angle = glm::two_pi<float>() * static_cast<float>(f) / frames;
+			const glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * radius * 0.5f + glm::vec3(shake(rng), shake(rng), shake(rng));
+			const glm::vec3 forward(-std::sin(angle), 0.0f, std::cos(angle));
+			const glm::mat4 view_proj = projection * glm_look_at(eye, eye + forward, glm::vec3(0, 1, 0));
+			glm::vec4 planes[6], corners[8];
+			frustum_culler::get_frustum_planes(view_proj, planes);
+			frustum_culler::get_frustum_corners(view_proj, corners);
+			lod_system::view_pos = glm::vec4(eye, 1.0f);
+
+			for (uint32_t i = 0; i < scene.size(); i++)
+			{
+				const sub_mesh& mesh = meshes[scene.render[i].mesh_index];
+				const auto lod = static_cast<uint8_t>(lod_system::decide_lod(mesh, scene.world_bounds[i], lods[i]));
+				if (lod != lods[i])
+				{
+					changes++;
+					flips += lod == previous[i];	// back to the LOD it just left, a visible pop
+					previous[i] = lods[i];
+					lods[i] = lod;
+				}
+				if (!scene.render[i].is_active || !frustum_culler::is_box_in_frustum(planes, corners, scene.world_bounds[i]))
+					continue;
+				full_triangles += mesh.index_count[0] / 3;
+				lod_triangles += mesh.index_count[lod] / 3;
+			}
+		}
+
+		// without hysteresis a model gets the same LOD from any start, with it the LOD may only lag by one step
+		for (uint32_t i = 0; i < scene.size(); i++)
+		{
+			const sub_mesh& mesh = meshes[scene.render[i].mesh_index];
+			const uint32_t from_finest = lod_system::decide_lod(mesh, scene.world_bounds[i], 0);
+			const uint32_t from_coarsest = lod_system::decide_lod(mesh, scene.world_bounds[i], 7);
+			same_lods = same_lods && from_coarsest >= from_finest && lods[i] >= from_finest && lods[i] <= from_coarsest;
+		}
+
+		printf("fov %3.0f: %llu triangles per frame with LOD 0, %llu with screen space error LODs (%.1f%%), %.2f LOD changes and %.3f flips back per frame\n",
+			fov, static_cast<unsigned long long>(full_triangles / frames), static_cast<unsigned long long>(lod_triangles / frames),
+			full_triangles ? 100.0 * static_cast<double>(lod_triangles) / static_cast<double>(full_triangles) : 100.0,
+			static_cast<double>(changes) / frames, static_cast<double>(flips) / frames);
+	}
+	if (!same_lods)
+		printf("MISMATCH: a LOD is outside of the hysteresis band\n");
+	return same_lods ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::bench_coherence(const int argc, char** argv)
+{
+	const level lvl(scene_argument(argc, argv), true);
+	const entity_table& scene = lvl.get_scene();
+	if (scene.empty())
+		return EXIT_FAILURE;
+
+	glm::vec3 vmin(std::numeric_limits<float>::max()), vmax(std::numeric_limits<float>::lowest());
+	for (const bounding_box& b : scene.world_bounds)
+	{
+		vmin = glm::min(vmin, b.min_);
+		vmax = glm::max(vmax, b.max_);
+	}
+	const float radius = glm::length(vmax - vmin) * 0.5f;
+	std::vector<camera_path> paths = builtin_camera_paths((vmin + vmax) * 0.5f, radius, radius * 4.0f);
+	if (argc > 3)
+	{
+		camera_path recorded = read_camera_path(argv[3]);
+		if (recorded.frames.empty())
+		{
+			printf("no camera path in %s\n", argv[3]);
+			return EXIT_FAILURE;
+		}
+		paths.insert(paths.begin(), std::move(recorded));
+	}
+	size_t mismatches = bench_coherence_paths("level", scene.world_bounds, paths);
+
+	// a large world walked through at the height of the player, the recorded path belongs to the level only
+	std::mt19937 rng(22);
+	mismatches += bench_coherence_paths("world 100k", world_boxes(rng, 2000.0f, 100000), builtin_camera_paths(glm::vec3(0.0f, 2.0f, 0.0f), 1000.0f, 300.0f));
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_ring(const int argc, char** argv)
+{
+	const int frames = argc > 2 ? std::max(atoi(argv[2]), 1) : 300;
+	GLFWwindow* window = create_hidden_context("verify ring");
+	if (!window)
+		return EXIT_FAILURE;
+
+	size_t mismatches = 0;
+	{
+		GLint alignment = 1;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+		// a shadow and a main pass push in turn like the level does, the shadow one with a size that isn't aligned
+		constexpr GLsizeiptr main_size = 2048, shadow_max = 1024 + 63 * 4;
+		buffer ring(GL_SHADER_STORAGE_BUFFER);
+		ring.reserve_ring(shadow_max + main_size, 2);
+
+		// every push is copied by the GPU into its own slot, a region written again too early shows up as a wrong slot
+		const GLsizeiptr slot = shadow_max + main_size;
+		buffer result(GL_COPY_WRITE_BUFFER);
+		glNamedBufferStorage(result.get_id(), slot * 2 * frames, nullptr, 0);
+
+		std::vector<uint32_t> pattern(slot / 4);
+		std::vector<std::pair<GLintptr, GLsizeiptr>> ranges;
+		uint64_t bytes = 0;
+		for (int f = 0; f < frames; f++)
+		{
+			buffer::begin_frame();
+			bytes += buffer::bytes_uploaded_last_frame;
+			for (int pass = 0; pass < 2; pass++)
+			{
+				const GLsizeiptr size = pass == 0 ? 1024 + (f % 64) * 4 : main_size;
+				for (size_t i = 0; i < pattern.size(); i++)
+					pattern[i] = static_cast<uint32_t>(f * 2 + pass) << 16 | static_cast<uint32_t>(i);
+				const GLintptr offset = ring.push(size, pattern.data());
+				ring.bind_range(0, offset, size);
+				glCopyNamedBufferSubData(ring.get_id(), result.get_id(), offset, (f * 2 + pass) * slot, size);
+
+				// no range may overlap one of the frames the GPU may still read
+				if (offset % alignment != 0 || offset + size > ring.get_region_size() * buffer::ring_frames)
+					mismatches++;
+				for (const auto& r : ranges)
+					if (offset < r.first + r.second && r.first < offset + size)
+						mismatches++;
+				ranges.emplace_back(offset, size);
+			}
+			if (ranges.size() > 2 * (buffer::ring_frames - 1))
+				ranges.erase(ranges.begin(), ranges.begin() + 2);
+			buffer::end_frame();
+		}
+		if (glGetError() != GL_NO_ERROR)
+			mismatches++;
+
+		std::vector<uint32_t> copied(slot / 4 * 2 * frames);
+		glGetNamedBufferSubData(result.get_id(), 0, slot * 2 * frames, copied.data());
+		for (int f = 0; f < frames; f++)
+			for (int pass = 0; pass < 2; pass++)
+			{
+				const size_t words = (pass == 0 ? 1024 + (f % 64) * 4 : main_size) / 4;
+				const uint32_t* data = copied.data() + (f * 2 + pass) * (slot / 4);
+				for (size_t i = 0; i < words; i++)
+					if (data[i] != (static_cast<uint32_t>(f * 2 + pass) << 16 | static_cast<uint32_t>(i)))
+					{
+						if (mismatches++ < 10)
+							printf("mismatch: frame %d %s pass word %u\n", f, pass == 0 ? "shadow" : "main", static_cast<unsigned>(i));
+						break;
+					}
+			}
+
+		printf("%d frames, %u bytes per frame in %d regions of %u bytes, GPU waits: %u, %llu mismatches\n", frames,
+			static_cast<unsigned>(bytes / std::max(frames - 1, 1)), buffer::ring_frames, static_cast<unsigned>(ring.get_region_size()),
+			buffer::fence_waits, static_cast<unsigned long long>(mismatches));
+	}
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_gpu_cull(const int argc, char** argv)
+{
+	const size_t count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20000;
+	GLFWwindow* window = create_hidden_context("verify gpu cull");
+	if (!window)
+		return EXIT_FAILURE;
+	level::indirect_count_supported = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+
+	// without a level given and without the default one, synthetic models are culled with both ways to count the draws
+	const char* scene_path = scene_argument(argc, argv, 3);
+	size_t mismatches = 1;
+	if (argc <= 3 && !std::ifstream(scene_path) && count > 0)
+	{
+		printf("no level at %s, culling synthetic models\n", scene_path);
+		mismatches = verify_gpu_synthetic(count, false) + verify_gpu_synthetic(count, true);
+	}
+	else
+	{
+		// the buffers of the level need the context, it is released before the context
+		level lvl(scene_path, true);
+		if (!lvl.get_scene().empty() && count > 0)
+			mismatches = verify_gpu_passes(lvl, count);
+	}
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int tools::verify_portals(const int argc, char** argv)
+{
+	const int towers = argc > 2 ? atoi(argv[2]) : 100;
+	std::mt19937 rng(25);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+
+	size_t tested = 0, hidden = 0, leaks = 0, cells = 0, visible_cells = 0, visits = 0, views = 0;
+	double update_time = 0.0;
+	for (int s = 0; s < towers; s++)
+	{
+		const portal_tower tower = build_portal_tower(rng);
+		portal_culler culler;
+		if (culler.build(tower.cells, tower.portals) != 0)
+		{
+			printf("tower %d: a portal opens into fewer than 2 cells\n", s);
+			leaks++;
+			continue;
+		}
+
+		// boxes inside of a single room each, away from its walls
+		std::vector<bounding_box> boxes;
+		for (int i = 0; i < 300; i++)
+		{
+			const bounding_box& cell = tower.cells[rng() % tower.cells.size()];
+			const glm::vec3 half = glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.8f + 0.05f;
+			const glm::vec3 low = cell.min_ + half + 0.05f, high = cell.max_ - half - 0.05f;
+			const glm::vec3 center = low + (high - low) * glm::vec3(unit(rng), unit(rng), unit(rng));
+			boxes.emplace_back(center - half, center + half);
+		}
+		const box_soa soa = to_soa(boxes);
+		culler.assign(soa, {});
+		std::vector<uint32_t> in_frustum(soa.mask_words()), visible;
+
+		for (int v = 0; v < 20; v++)
+		{
+			// a camera anywhere in a room, or every 4th right next to a portal, looking in any direction
+			glm::vec3 eye;
+			if (v % 4 == 0)
+			{
+				const bounding_box& p = tower.portals[rng() % tower.portals.size()];
+				eye = (p.min_ + p.max_) * 0.5f + (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * 0.8f;
+			}
+			else
+			{
+				const bounding_box& cell = tower.cells[rng() % tower.cells.size()];
+				eye = cell.min_ + 0.3f + (cell.max_ - cell.min_ - 0.6f) * glm::vec3(unit(rng), unit(rng), unit(rng));
+			}
+			const float yaw = glm::two_pi<float>() * unit(rng);
+			const float pitch = (unit(rng) - 0.5f) * 2.4f;
+			const glm::vec3 direction(std::cos(yaw) * std::cos(pitch), std::sin(pitch), std::sin(yaw) * std::cos(pitch));
+			const glm::mat4 view_proj = projection * glm_look_at(eye, eye + direction, glm::vec3(0, 1, 0));
+			glm::vec4 planes[6], corners[8];
+			frustum_culler::get_frustum_planes(view_proj, planes);
+			frustum_culler::get_frustum_corners(view_proj, corners);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			const bool in_cell = culler.update(eye, planes);
+			update_time += seconds_since(start);
+			views++;
+			visits += culler.get_visits();
+			cells += culler.get_cell_count();
+			visible_cells += in_cell ? culler.get_visible_cell_count() : culler.get_cell_count();
+
+			frustum_culler::cull_boxes(planes, corners, soa, in_frustum.data());
+			visible = in_frustum;
+			culler.cull(visible.data());
+			for (size_t i = 0; i < boxes.size(); i++)
+			{
+				if ((in_frustum[i / 32] >> (i % 32) & 1) == 0)
+					continue;
+				tested++;
+				if ((visible[i / 32] >> (i % 32) & 1) != 0)
+					continue;
+				hidden++;
+
+				// every point on the surface of a culled box that is inside the frustum has to be behind a wall
+				const bounding_box& b = boxes[i];
+				for (int p = 0; p < 200; p++)
+				{
+					glm::vec3 point = b.min_ + (b.max_ - b.min_) * glm::vec3(unit(rng), unit(rng), unit(rng));
+					point[p % 3] = p % 6 < 3 ? b.min_[p % 3] : b.max_[p % 3];
+					const glm::vec4 clip = view_proj * glm::vec4(point, 1.0f);
+					if (clip.w <= 0.0f || std::abs(clip.x) > clip.w || std::abs(clip.y) > clip.w || std::abs(clip.z) > clip.w)
+						continue;
+					bool behind_wall = false;
+					for (size_t t = 0; t < tower.walls.size() && !behind_wall; t += 3)
+					{
+						const float distance = intersect_triangle(eye, point - eye, tower.walls[t], tower.walls[t + 1], tower.walls[t + 2]);
+						behind_wall = distance > 0.0f && distance < 1.0f;
+					}
+					if (!behind_wall)
+					{
+						if (leaks++ < 10)
+							printf("leak: tower %d, camera at %.2f %.2f %.2f sees %.2f %.2f %.2f\n", s, eye.x, eye.y, eye.z, point.x, point.y, point.z);
+						break;
+					}
+				}
+			}
+		}
+	}
+	printf("%llu boxes in the frustum, %.1f%% hidden by the portals, %.1f of %.1f cells visible, %.1f visits, %.2f us per update, %llu leaks\n",
+		static_cast<unsigned long long>(tested), 100.0 * hidden / std::max<size_t>(1, tested), static_cast<double>(visible_cells) / std::max<size_t>(1, views),
+		static_cast<double>(cells) / std::max<size_t>(1, views), static_cast<double>(visits) / std::max<size_t>(1, views), update_time / std::max<size_t>(1, views) * 1e6,
+		static_cast<unsigned long long>(leaks));
+
+	// the cells of the level seen from the middle of each, looking around
+	const level lvl(scene_argument(argc, argv, 3), true);
+	if (lvl.get_cells().empty())
+	{
+		printf("the level has no cells\n");
+		return leaks == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	portal_culler culler;
+	const uint32_t unlinked = culler.build(lvl.get_cells(), lvl.get_portals());
+	const box_soa soa = to_soa(lvl.get_scene().world_bounds);
+	culler.assign(soa, {});
+	std::vector<uint32_t> visible(soa.mask_words());
+	size_t level_tested = 0, level_hidden = 0, level_visible_cells = 0;
+	for (const bounding_box& cell : lvl.get_cells())
+	{
+		const glm::vec3 eye = (cell.min_ + cell.max_) * 0.5f;
+		for (int d = 0; d < 4; d++)
+		{
+			const float angle = glm::half_pi<float>() * d;
+			const glm::mat4 view_proj = projection * glm_look_at(eye, eye + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0, 1, 0));
+			glm::vec4 planes[6], corners[8];
+			frustum_culler::get_frustum_planes(view_proj, planes);
+			frustum_culler::get_frustum_corners(view_proj, corners);
+			culler.update(eye, planes);
+			level_visible_cells += culler.get_visible_cell_count();
+			frustum_culler::cull_boxes(planes, corners, soa, visible.data());
+			for (const uint32_t word : visible)
+				level_tested += std::bitset<32>(word).count();
+			level_hidden += culler.cull(visible.data());
+		}
+	}
+	const size_t level_views = lvl.get_cells().size() * 4;
+	printf("level: %llu cells, %llu portals, %u unlinked, %.1f cells visible, %.1f%% of the models in the frustum hidden\n",
+		static_cast<unsigned long long>(lvl.get_cells().size()), static_cast<unsigned long long>(lvl.get_portals().size()), unlinked,
+		static_cast<double>(level_visible_cells) / level_views, 100.0 * level_hidden / std::max<size_t>(1, level_tested));
+	return leaks == 0 && unlinked == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
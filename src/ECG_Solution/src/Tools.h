@@ -0,0 +1,167 @@
+#pragma once
+
+/* headless command line tools, they run instead of the game if the executable gets arguments
+ * none of them create a window or a GL context
+*/
+namespace tools
+{
+	/**
+	 * \brief runs the tool selected by the first argument, prints the usage for unknown tools
+	 * \param argc argument count from main
+	 * \param argv arguments from main
+	 * \return exit code of the tool
+	 */
+	int run(int argc, char** argv);
+
+	/**
+	 * \brief imports an fbx file and writes its bake next to it
+	 * usage: --bake [scene.fbx]
+	 */
+	int bake(int argc, char** argv);
+
+	/**
+	 * \brief loads a level once from the fbx file and once from its bake and compares all loaded arrays
+	 * usage: --verify-bake [scene.fbx]
+	 */
+	int verify_bake(int argc, char** argv);
+
+	/**
+	 * \brief packs every mesh of a level into the compact vertex format, unpacks it and prints the largest errors
+	 * usage: --verify-packing [scene.fbx]
+	 */
+	int verify_packing(int argc, char** argv);
+
+	/**
+	 * \brief measures how many triangles meshlet culling saves and how long it takes, from views around the level
+	 * usage: --bench-meshlets [scene.fbx]
+	 */
+	int bench_meshlets(int argc, char** argv);
+
+	/**
+	 * \brief reads and decodes all material textures of a level on the job system without uploading them
+	 * usage: --bench-textures [scene.fbx]
+	 */
+	int bench_textures(int argc, char** argv);
+
+	/**
+	 * \brief writes a ktx2 file with a full mip chain next to every material texture of a level
+	 * color, single channel and normal images get block compressed, every level is supercompressed with Zstd,
+	 * every file is read back and compared with its ktx source
+	 * usage: --convert-ktx2 [scene.fbx]
+	 */
+	int convert_ktx2(int argc, char** argv);
+
+	/**
+	 * \brief measures vertex cache, overdraw, vertex fetch and simplification error of every mesh LOD and writes them as json
+	 * the report is written next to the scene as scene.fbx.analysis.json if no output file is given
+	 * usage: --analyze [scene.fbx] [report.json]
+	 */
+	int analyze(int argc, char** argv);
+
+	/**
+	 * \brief compares two reports of --analyze and fails if a metric of a mesh got worse
+	 * usage: --analyze-diff before.json after.json
+	 */
+	int analyze_diff(int argc, char** argv);
+
+	/**
+	 * \brief times parsing a .cube lut against a scanf reference and checks that both give the same floats,
+	 * then does the same for a generated 65^3 lut and checks that the binary cache gives back the converted texels
+	 * usage: --bench-lut [look.cube]
+	 */
+	int bench_lut(int argc, char** argv);
+
+	/**
+	 * \brief builds a few programs into a cache file of its own over several simulated starts and checks that they link once,
+	 * come from the cache afterwards and relink only after an edit or a truncated or corrupted file, and that the file drops
+	 * duplicated binaries and the ones of old sources. needs an OpenGL 4.5 context
+	 * usage: --verify-program-cache
+	 */
+	int verify_program_cache(int argc, char** argv);
+
+	/**
+	 * \brief compares the batched frustum culling of every supported instruction set with is_box_in_frustum,
+	 * box by box on random frusta and boxes, including boxes that touch the frustum corners exactly
+	 * usage: --verify-cull [frusta]
+	 */
+	int verify_cull(int argc, char** argv);
+
+	/**
+	 * \brief times is_box_in_frustum against the batched culling of every supported instruction set,
+	 * with the entity bounds of a level and with 64k random boxes
+	 * usage: --bench-cull [scene.fbx]
+	 */
+	int bench_cull(int argc, char** argv);
+
+	/**
+	 * \brief times the entity bvh against testing every box, on the entity bounds of a level and on large random worlds,
+	 * and checks that it culls exactly the same boxes, also after refitting moving ones
+	 * usage: --bench-bvh [scene.fbx]
+	 */
+	int bench_bvh(int argc, char** argv);
+
+	/**
+	 * \brief times culling and updating a render queue of copies of the level entities split into 1, 2, 4, 8 and up to
+	 * one job per thread and checks that every job count gives the same visible commands,
+	 * without a scene argument and without the default level the entities are random boxes of synthetic meshes
+	 * usage: --bench-queue [entities] [scene.fbx]
+	 */
+	int bench_queue(int argc, char** argv);
+
+	/**
+	 * \brief culls random boxes behind random walls with the occlusion culler and casts rays to points on every culled box,
+	 * it fails if one of the points can be seen
+	 * usage: --verify-occlusion [scenes]
+	 */
+	int verify_occlusion(int argc, char** argv);
+
+	/**
+	 * \brief times rasterizing the occluders of a level and testing its models, from cameras inside the level
+	 * usage: --bench-occlusion [scene.fbx]
+	 */
+	int bench_occlusion(int argc, char** argv);
+
+	/**
+	 * \brief times the culling and LOD loop of a frame over random entities stored as one struct each and as the
+	 * component arrays of entity_table, and prints the memory both layouts stream per frame
+	 * usage: --bench-entities [entities]
+	 */
+	int bench_entities(int argc, char** argv);
+
+	/**
+	 * \brief flies a shaking camera through a level with a narrow and a wide field of view and prints the triangles
+	 * of the LODs picked by screen space error against LOD 0, and how often models change or flip back their LOD
+	 * usage: --bench-lod [scene.fbx]
+	 */
+	int bench_lod(int argc, char** argv);
+
+	/**
+	 * \brief culls a level and a large world along camera paths with the visibility cache and with full culling,
+	 * prints the tests per frame of both and fails if the cache culls a single box differently
+	 * usage: --bench-coherence [scene.fbx] [path.txt], the path is recorded by the game with recordPath in settings.ini
+	 */
+	int bench_coherence(int argc, char** argv);
+
+	/**
+	 * \brief pushes a shadow and a main pass into a ring buffer for many frames and lets the GPU copy every push away,
+	 * fails if two ranges the GPU may read at once overlap or a copy shows data of a later frame
+	 * usage: --verify-ring [frames], needs an OpenGL 4.5 context, which a software renderer like Mesa llvmpipe provides
+	 */
+	int verify_ring(int argc, char** argv);
+
+	/**
+	 * \brief culls and picks the LODs of copies of the level entities with the compute shaders of the GPU culling and with
+	 * frustum_culler and lod_system along a camera path and a shadow view, fails if a single model or LOD differs.
+	 * without a scene argument and without the default level it culls that many random models of synthetic meshes
+	 * usage: --verify-gpu-cull [entities] [scene.fbx], needs an OpenGL 4.5 context like --verify-ring
+	 */
+	int verify_gpu_cull(int argc, char** argv);
+
+	/**
+	 * \brief culls random boxes in generated towers of stacked chambers with portal_culler from random cameras and casts rays
+	 * from the camera to points on every hidden box in the frustum, fails if one reaches it without hitting a wall.
+	 * prints the cells of the level seen from the middle of each if it has any
+	 * usage: --verify-portals [towers] [scene.fbx]
+	 */
+	int verify_portals(int argc, char** argv);
+};
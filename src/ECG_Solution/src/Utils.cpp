@@ -69,6 +69,7 @@ global_state load_settings()
 	state.fullscreen = reader.GetBoolean("window", "fullscreen", false);
 	state.window_title = "Greed";
 	state.fov = reader.GetReal("camera", "fov", 60.0f);
+	state.camera_path = reader.Get("camera", "recordPath", "");
 	state.znear = 0.1f;
 	state.zfar = 1000.0f;
 
@@ -85,7 +86,13 @@ global_state load_settings()
 	state.dist_scale = reader.GetReal("image", "distScale", 0.5f);
 	state.shadow_res = reader.GetInteger("image", "shadowRes", 4);
 	state.fog_quality = reader.GetInteger("image", "fogQuality", 2);
-	state.use_lod = reader.GetBoolean("image", "useLOD", false);
+	state.use_lod = reader.GetBoolean("image", "useLOD", true);
+	state.lod_bias = reader.GetReal("image", "lodBias", 0.0f);
+	state.packed_vertices = reader.GetBoolean("image", "packedVertices", true);
+	state.meshlet_cull = reader.GetBoolean("image", "meshletCulling", false);
+	state.coherent_cull = reader.GetBoolean("image", "coherentCulling", false);
+	state.gpu_cull = reader.GetBoolean("image", "gpuCulling", false);
+	state.portal_cull = reader.GetBoolean("image", "portalCulling", true);
 
 	return state;
 }
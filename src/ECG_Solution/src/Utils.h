@@ -23,6 +23,7 @@ struct global_state
 	bool fullscreen = false;
 	std::string window_title = "Greed";
 	float fov = 60;
+	std::string camera_path;	// the view projection of every frame is appended to this file if set
 	float znear = 0.1f;
 	float zfar = 1000.0;
 
@@ -49,7 +50,14 @@ struct global_state
 	//lightFX
 	int shadow_res = 4;
 	int fog_quality = 2;
-	bool use_lod = false;
+	bool use_lod = true;
+	float lod_bias = 0.0f;
+	bool packed_vertices = true;
+	bool meshlet_cull = false;
+	bool occlusion_cull = true;
+	bool coherent_cull = false;
+	bool gpu_cull = false;
+	bool portal_cull = true;
 	//game logic
 	bool won = false;
 	bool lost = false;
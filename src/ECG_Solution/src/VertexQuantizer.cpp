@@ -0,0 +1,144 @@
+#include "VertexQuantizer.h"
+#include <meshoptimizer/meshoptimizer.h>
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	constexpr float unorm16_max = 65535.0f;
+	constexpr float snorm16_max = 32767.0f;
+
+	/// @brief largest absolute difference per axis, relative to the extent of that axis
+	/// float rounding of the dequantization itself is not counted, it depends on the distance to the origin
+	template <typename V>
+	float relative_error(const V& a, const V& b, const V& extent)
+	{
+		float result = 0.0f;
+		for (int i = 0; i < V::length(); i++)
+		{
+			const float rounding = 2.0f * std::numeric_limits<float>::epsilon() * std::max(std::abs(a[i]), std::abs(b[i]));
+			const float diff = std::max(std::abs(a[i] - b[i]) - rounding, 0.0f);
+			result = std::max(result, extent[i] > 0.0f ? diff / extent[i] : diff);
+		}
+		return result;
+	}
+}
+
+glm::vec2 vertex_quantizer::encode_octahedral(glm::vec3 n)
+{
+	const float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (length == 0.0f)
+		return glm::vec2(0.0f);
+	n /= length;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return e;
+}
+
+glm::vec3 vertex_quantizer::decode_octahedral(const glm::vec2 e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+	const float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+vertex_dequant vertex_quantizer::pack(const float* vertices, const uint32_t count, packed_vertex* packed)
+{
+	glm::vec3 pmin(std::numeric_limits<float>::max()), pmax(std::numeric_limits<float>::lowest());
+	glm::vec2 tmin(std::numeric_limits<float>::max()), tmax(std::numeric_limits<float>::lowest());
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float* vf = &vertices[i * 8];
+		pmin = glm::min(pmin, glm::vec3(vf[0], vf[1], vf[2]));
+		pmax = glm::max(pmax, glm::vec3(vf[0], vf[1], vf[2]));
+		tmin = glm::min(tmin, glm::vec2(vf[6], vf[7]));
+		tmax = glm::max(tmax, glm::vec2(vf[6], vf[7]));
+	}
+
+	vertex_dequant dequant;
+	if (count == 0)
+		return dequant;
+
+	const glm::vec3 pext = pmax - pmin;
+	const glm::vec2 text = tmax - tmin;
+	dequant.position_min = glm::vec4(pmin, 1.0f);
+	dequant.position_extent = glm::vec4(pext, 0.0f);
+	dequant.uv = glm::vec4(tmin, text);
+
+	// flat meshes have no extent on some axis, they get quantized to 0 and restored exactly
+	const glm::vec3 pscale(pext.x > 0.0f ? 1.0f / pext.x : 0.0f, pext.y > 0.0f ? 1.0f / pext.y : 0.0f, pext.z > 0.0f ? 1.0f / pext.z : 0.0f);
+	const glm::vec2 tscale(text.x > 0.0f ? 1.0f / text.x : 0.0f, text.y > 0.0f ? 1.0f / text.y : 0.0f);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float* vf = &vertices[i * 8];
+		packed_vertex& v = packed[i];
+
+		const glm::vec3 p = (glm::vec3(vf[0], vf[1], vf[2]) - pmin) * pscale;
+		v.px = static_cast<uint16_t>(meshopt_quantizeUnorm(p.x, 16));
+		v.py = static_cast<uint16_t>(meshopt_quantizeUnorm(p.y, 16));
+		v.pz = static_cast<uint16_t>(meshopt_quantizeUnorm(p.z, 16));
+		v.pw = 0;
+
+		const glm::vec2 n = encode_octahedral(glm::vec3(vf[3], vf[4], vf[5]));
+		v.nx = static_cast<int16_t>(meshopt_quantizeSnorm(n.x, 16));
+		v.ny = static_cast<int16_t>(meshopt_quantizeSnorm(n.y, 16));
+
+		const glm::vec2 t = (glm::vec2(vf[6], vf[7]) - tmin) * tscale;
+		v.tx = static_cast<uint16_t>(meshopt_quantizeUnorm(t.x, 16));
+		v.ty = static_cast<uint16_t>(meshopt_quantizeUnorm(t.y, 16));
+	}
+	return dequant;
+}
+
+void vertex_quantizer::unpack(const packed_vertex& v, const vertex_dequant& dequant, float* result)
+{
+	// same conversion as GL does for normalized integer attributes
+	const glm::vec3 p = glm::vec3(dequant.position_min) + glm::vec3(v.px, v.py, v.pz) / unorm16_max * glm::vec3(dequant.position_extent);
+	const glm::vec3 n = decode_octahedral(glm::max(glm::vec2(v.nx, v.ny) / snorm16_max, glm::vec2(-1.0f)));
+	const glm::vec2 t = glm::vec2(dequant.uv.x, dequant.uv.y) + glm::vec2(v.tx, v.ty) / unorm16_max * glm::vec2(dequant.uv.z, dequant.uv.w);
+
+	result[0] = p.x; result[1] = p.y; result[2] = p.z;
+	result[3] = n.x; result[4] = n.y; result[5] = n.z;
+	result[6] = t.x; result[7] = t.y;
+}
+
+vertex_quantizer::error vertex_quantizer::round_trip_error(const float* vertices, const uint32_t count)
+{
+	std::vector<packed_vertex> packed(count);
+	const vertex_dequant dequant = pack(vertices, count, packed.data());
+
+	error e;
+	float restored[8];
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float* vf = &vertices[i * 8];
+		unpack(packed[i], dequant, restored);
+
+		e.position = std::max(e.position, relative_error(glm::vec3(vf[0], vf[1], vf[2]),
+			glm::vec3(restored[0], restored[1], restored[2]), glm::vec3(dequant.position_extent)));
+
+		// atan2 stays precise for tiny angles, acos of the dot product doesn't
+		const glm::vec3 n = glm::normalize(glm::vec3(vf[3], vf[4], vf[5]));
+		const glm::vec3 r(restored[3], restored[4], restored[5]);
+		e.normal = std::max(e.normal, std::atan2(glm::length(glm::cross(n, r)), glm::dot(n, r)));
+
+		e.uv = std::max(e.uv, relative_error(glm::vec2(vf[6], vf[7]),
+			glm::vec2(restored[6], restored[7]), glm::vec2(dequant.uv.z, dequant.uv.w)));
+	}
+	return e;
+}
+
+bool vertex_quantizer::is_within_tolerance(const error& e)
+{
+	// half a quantization step plus float rounding, octahedral snorm16 stays well below 0.01 degree
+	constexpr float step = 0.5f / unorm16_max + 1e-6f;
+	constexpr float max_angle = 0.0002f;
+	return e.position <= step && e.uv <= step && e.normal <= max_angle;
+}
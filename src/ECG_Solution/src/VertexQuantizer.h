@@ -0,0 +1,54 @@
+#pragma once
+#include "LevelStructs.h"
+
+/// @brief converts the 8 float vertices of a mesh to the compact packed_vertex format and back
+class vertex_quantizer
+{
+public:
+	/// @brief largest round trip error of a packed mesh
+	struct error
+	{
+		float position = 0.0f;	// fraction of the AABB extent of the mesh
+		float normal = 0.0f;	// radians
+		float uv = 0.0f;		// fraction of the uv range of the mesh
+	};
+
+	/**
+	 * \brief quantizes a mesh, positions relative to the mesh AABB, normals octahedral, uvs relative to their range
+	 * \param vertices first vertex of the mesh (1 vertex consists of 8 floats)
+	 * \param count number of vertices
+	 * \param packed target array with space for count vertices
+	 * \return parameters to restore the mesh in the shader
+	 */
+	static vertex_dequant pack(const float* vertices, uint32_t count, packed_vertex* packed);
+
+	/**
+	 * \brief restores one vertex exactly like the vertex shaders do
+	 * \param v packed vertex
+	 * \param dequant parameters of its mesh
+	 * \param result 8 floats, position, normal and uv
+	 */
+	static void unpack(const packed_vertex& v, const vertex_dequant& dequant, float* result);
+
+	/**
+	 * \brief packs and unpacks a mesh and measures the largest error of all vertices
+	 * \param vertices first vertex of the mesh (1 vertex consists of 8 floats)
+	 * \param count number of vertices
+	 * \return largest error of position, normal and uv
+	 */
+	static error round_trip_error(const float* vertices, uint32_t count);
+
+	/**
+	 * \brief checks if a round trip error is within the precision of 16 bit quantization
+	 * \param e measured round trip error
+	 * \return true if the error is acceptable
+	 */
+	static bool is_within_tolerance(const error& e);
+
+	/**
+	 * \brief maps a unit vector onto the octahedron and unfolds it into the [-1,1] square
+	 * https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+	 */
+	static glm::vec2 encode_octahedral(glm::vec3 n);
+	static glm::vec3 decode_octahedral(glm::vec2 e);
+};
@@ -0,0 +1,273 @@
+#include "VisibilityCache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// relative rounding error of one dot product (px * x + py * y) + (pz * z + pw), a few float ulps
+	constexpr double dot_rounding = 1e-6;
+
+	// tests of a visible box whose slack is at most this many times the smallest one go into its plane mask
+	constexpr double mask_width = 2.0;
+	// and at least those that the frustum could reach in this many frames of the last movement
+	constexpr double mask_frames = 8.0;
+
+	bounding_box box_at(const box_soa& boxes, const size_t i)
+	{
+		bounding_box b;
+		b.min_ = glm::vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]);
+		b.max_ = glm::vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]);
+		return b;
+	}
+}
+
+void visibility_cache::reset(const size_t count)
+{
+	block_expiry_.assign((count + 31) / 32, -1.0);
+	expiry_.assign(count, -1.0);
+	visible_.assign((count + 31) / 32, 0u);
+	entries_.assign(count, entry());
+	drift_ = 0.0;
+	last_drift_ = 0.0;
+	has_view_ = false;
+}
+
+void visibility_cache::invalidate(const uint32_t index)
+{
+	block_expiry_[index / 32] = -1.0;
+	expiry_[index] = -1.0;
+	entries_[index].mask_expiry = -1.0;
+}
+
+void visibility_cache::update_drift(const glm::vec4* planes, const glm::vec4* corners, const bounding_box& bounds)
+{
+	// the bounds of the corners like frustum_culler::cull_boxes, a NaN corner never rejects
+	glm::vec3 corner_min, corner_max;
+	for (int a = 0; a < 3; a++)
+	{
+		float lo = corners[0][a], hi = corners[0][a];
+		for (int i = 1; i < 8; i++)
+		{
+			const float v = corners[i][a];
+			lo = v < lo || v != v ? v : lo;
+			hi = v > hi || v != v ? v : hi;
+		}
+		corner_min[a] = lo;
+		corner_max[a] = hi;
+	}
+
+	const glm::dvec3 center = (glm::dvec3(bounds.min_) + glm::dvec3(bounds.max_)) * 0.5;
+	const double radius = glm::length(glm::dvec3(bounds.max_) - glm::dvec3(bounds.min_)) * 0.5;
+	const double extent = std::max(glm::length(glm::dvec3(bounds.min_)), glm::length(glm::dvec3(bounds.max_)));
+
+	// a plane moves every point inside of the bounds by at most |n' - n| * radius plus its move at the center,
+	// the rounding of the new dot products is added as well, results of the same frustum are reused without any drift
+	double drift = 0.0;
+	bool moved = false;
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::dvec4 p(planes[i]);
+		plane_epsilon_[i] = static_cast<float>(dot_rounding * ((std::abs(p.x) + std::abs(p.y) + std::abs(p.z)) * extent + std::abs(p.w)));
+		if (!has_view_ || planes[i] == planes_[i])
+			continue;
+		moved = true;
+		const glm::dvec4 q(planes_[i]);
+		const double normal = glm::length(glm::dvec3(p) - glm::dvec3(q));
+		const double at_center = std::abs(glm::dot(glm::dvec3(p) - glm::dvec3(q), center) + (p.w - q.w));
+		drift = std::max(drift, normal * radius + at_center + plane_epsilon_[i]);
+	}
+	if (has_view_ && (corner_min != corner_min_ || corner_max != corner_max_))
+	{
+		moved = true;
+		const glm::dvec3 lo = glm::abs(glm::dvec3(corner_min) - glm::dvec3(corner_min_));
+		const glm::dvec3 hi = glm::abs(glm::dvec3(corner_max) - glm::dvec3(corner_max_));
+		drift = std::max(drift, std::max(std::max(lo.x, lo.y), std::max(std::max(lo.z, hi.x), std::max(hi.y, hi.z))));
+	}
+
+	if (!has_view_ || !std::isfinite(drift))
+	{
+		// nothing can be reused, every box gets tested
+		std::fill(block_expiry_.begin(), block_expiry_.end(), -1.0);
+		std::fill(expiry_.begin(), expiry_.end(), -1.0);
+		for (entry& e : entries_)
+			e.mask_expiry = -1.0;
+		drift_ = 0.0;
+		drift = 0.0;
+	}
+	last_drift_ = moved ? drift : 0.0;
+	drift_ += drift;
+
+	std::copy(planes, planes + 6, planes_);
+	corner_min_ = corner_min;
+	corner_max_ = corner_max;
+	has_view_ = true;
+}
+
+visibility_cache::test_result visibility_cache::run_test(const uint32_t test, const bounding_box& b) const
+{
+	if (test < 6)
+	{
+		// the largest of the 8 corner dots, rounded like frustum_culler::cull_boxes
+		const glm::vec4& p = planes_[test];
+		const float x = std::max(p.x * b.min_.x, p.x * b.max_.x);
+		const float y = std::max(p.y * b.min_.y, p.y * b.max_.y);
+		const float z = std::max(p.z * b.min_.z, p.z * b.max_.z);
+		const float d = (x + y) + (z + p.w);
+		return { d < 0.0f, std::max(0.0, std::abs(static_cast<double>(d)) - plane_epsilon_[test]) };
+	}
+
+	// all corners above the max or below the min of the box along one axis, comparisons of floats don't round
+	const int axis = (test - 6) / 2;
+	if ((test & 1) == 0)
+	{
+		const double slack = static_cast<double>(corner_min_[axis]) - static_cast<double>(b.max_[axis]);
+		return { corner_min_[axis] > b.max_[axis], std::abs(slack) };
+	}
+	const double slack = static_cast<double>(b.min_[axis]) - static_cast<double>(corner_max_[axis]);
+	return { corner_max_[axis] < b.min_[axis], std::abs(slack) };
+}
+
+uint32_t visibility_cache::run_all(const bounding_box& b, double* slack) const
+{
+	// run_test for every test without branches, the same float operations in the same order
+	uint32_t rejected = 0;
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		const glm::vec4& q = planes_[p];
+		const float x = std::max(q.x * b.min_.x, q.x * b.max_.x);
+		const float y = std::max(q.y * b.min_.y, q.y * b.max_.y);
+		const float z = std::max(q.z * b.min_.z, q.z * b.max_.z);
+		const float d = (x + y) + (z + q.w);
+		rejected |= static_cast<uint32_t>(d < 0.0f) << p;
+		slack[p] = std::max(0.0, std::abs(static_cast<double>(d)) - plane_epsilon_[p]);
+	}
+	for (uint32_t a = 0; a < 3; a++)
+	{
+		rejected |= static_cast<uint32_t>(corner_min_[a] > b.max_[a]) << (6 + a * 2);
+		rejected |= static_cast<uint32_t>(corner_max_[a] < b.min_[a]) << (7 + a * 2);
+		slack[6 + a * 2] = std::abs(static_cast<double>(corner_min_[a]) - static_cast<double>(b.max_[a]));
+		slack[7 + a * 2] = std::abs(static_cast<double>(b.min_[a]) - static_cast<double>(corner_max_[a]));
+	}
+	return rejected;
+}
+
+void visibility_cache::reject(const size_t index, const uint32_t test, const double slack)
+{
+	entry& e = entries_[index];
+	e.last_test = static_cast<uint8_t>(test);
+	e.mask_expiry = -1.0;
+	expiry_[index] = drift_ + slack;
+	visible_[index / 32] &= ~(1u << (index % 32));
+}
+
+uint32_t visibility_cache::test_all(const size_t index, const bounding_box& b)
+{
+	double slack[test_count];
+	const uint32_t rejected = run_all(b, slack);
+
+	// a rejected box keeps the test that rejects it by the widest margin, it holds the longest
+	double smallest = std::numeric_limits<double>::max();
+	uint32_t rejecting = no_test;
+	for (uint32_t t = 0; t < test_count; t++)
+	{
+		smallest = std::min(smallest, slack[t]);
+		if ((rejected >> t & 1) != 0 && (rejecting == no_test || slack[t] > slack[rejecting]))
+			rejecting = t;
+	}
+	if (rejecting != no_test)
+	{
+		reject(index, rejecting, slack[rejecting]);
+		return test_count;
+	}
+
+	// the tests close to the border go into the mask, the others only have to be repeated once the mask expires
+	entry& e = entries_[index];
+	const double width = std::max(smallest * mask_width, last_drift_ * mask_frames);
+	double outside = std::numeric_limits<double>::max();
+	e.mask = 0;
+	for (uint32_t t = 0; t < test_count; t++)
+	{
+		if (slack[t] <= width)
+			e.mask |= 1 << t;
+		else
+			outside = std::min(outside, slack[t]);
+	}
+	e.last_test = no_test;
+	e.mask_expiry = drift_ + outside;
+	expiry_[index] = drift_ + smallest;
+	visible_[index / 32] |= 1u << (index % 32);
+	return test_count;
+}
+
+uint32_t visibility_cache::retest(const size_t index, const bounding_box& b)
+{
+	entry& e = entries_[index];
+	const bool was_visible = (visible_[index / 32] >> (index % 32) & 1) != 0;
+
+	// a box that was rejected is most likely rejected by the same test again
+	if (!was_visible && e.last_test != no_test)
+	{
+		const test_result r = run_test(e.last_test, b);
+		if (r.reject)
+		{
+			expiry_[index] = drift_ + r.slack;
+			return 1;
+		}
+		return 1 + test_all(index, b);
+	}
+
+	// the tests outside of the mask can't have changed yet, only the masked ones are repeated
+	if (was_visible && drift_ <= e.mask_expiry)
+	{
+		uint32_t tests = 0;
+		double smallest = std::numeric_limits<double>::max();
+		for (uint32_t t = 0; t < test_count; t++)
+		{
+			if ((e.mask >> t & 1) == 0)
+				continue;
+			const test_result r = run_test(t, b);
+			tests++;
+			if (r.reject)
+			{
+				reject(index, t, r.slack);
+				return tests;
+			}
+			smallest = std::min(smallest, r.slack);
+		}
+		expiry_[index] = std::min(e.mask_expiry, drift_ + smallest);
+		return tests;
+	}
+	return test_all(index, b);
+}
+
+uint32_t visibility_cache::cull(const glm::vec4* planes, const glm::vec4* corners, const box_soa& boxes, const bounding_box& bounds, uint32_t* visible)
+{
+	if (entries_.size() != boxes.count)
+		reset(boxes.count);
+	update_drift(planes, corners, bounds);
+
+	// most blocks stop at their smallest expiry, the drift is kept in a local so it isn't reloaded after every store
+	const double drift = drift_;
+	uint32_t tests = 0;
+	retested_ = 0;
+	for (size_t block = 0; block < block_expiry_.size(); block++)
+	{
+		if (drift <= block_expiry_[block])
+			continue;
+		const size_t end = std::min(boxes.count, block * 32 + 32);
+		double lowest = std::numeric_limits<double>::max();
+		for (size_t i = block * 32; i < end; i++)
+		{
+			if (drift > expiry_[i])
+			{
+				retested_++;
+				tests += retest(i, box_at(boxes, i));
+			}
+			lowest = std::min(lowest, expiry_[i]);
+		}
+		block_expiry_[block] = lowest;
+	}
+	std::copy(visible_.begin(), visible_.end(), visible);
+	return tests;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "LevelStructs.h"
+#include <vector>
+
+/// @brief frustum culling that reuses the results of the last frames, with exactly the result of frustum_culler::is_box_in_frustum
+/// a box is tested by 6 planes and 6 axis tests against the corners of the frustum. every box remembers how far it is from
+/// changing the result of its tests, and between two frames the frustum moves every test by at most a drift that is summed up.
+/// boxes are only tested again when the summed drift reaches their distance or they moved, and then only their tests near
+/// the border (the plane mask) or first the test that rejected them last time. blocks of 32 boxes that all hold are skipped
+class visibility_cache
+{
+public:
+	static constexpr uint32_t test_count = 12;
+
+	/**
+	 * \brief forgets every result, all boxes are tested on the next cull
+	 * \param count number of boxes
+	 */
+	void reset(size_t count);
+
+	/// @brief the bounds of a box changed, it gets tested on the next cull
+	void invalidate(uint32_t index);
+
+	/**
+	 * \brief culls all boxes, only boxes whose result may have changed are tested
+	 * \param planes are the 6 planes of the view frustum
+	 * \param corners are the 8 corners of the view frustum
+	 * \param boxes tested boxes, the same ones as in the last call except for the invalidated ones
+	 * \param bounds contains every box, the drift of a plane is measured inside of it
+	 * \param visible receives boxes.mask_words() words, like the result of frustum_culler::cull_boxes
+	 * \return number of plane and axis tests, a full culling runs test_count per box
+	 */
+	uint32_t cull(const glm::vec4* planes, const glm::vec4* corners, const box_soa& boxes, const bounding_box& bounds, uint32_t* visible);
+
+	/// @brief number of boxes that were tested again by the last cull
+	uint32_t get_retested() const { return retested_; }
+
+private:
+	static constexpr uint8_t no_test = 0xff;
+
+	/// @brief what a box remembers besides its expiry and visibility, expiries are values of drift_
+	struct entry
+	{
+		double mask_expiry = -1.0;		// the tests outside of mask can't change before this
+		uint16_t mask = 0;				// tests close to changing, a visible box repeats only these while mask_expiry holds
+		uint8_t last_test = no_test;	// test that rejected the box, tried first next time
+	};
+
+	/// @brief result of one test, slack is how much the frustum can move without changing it
+	struct test_result
+	{
+		bool reject;
+		double slack;
+	};
+
+	std::vector<double> block_expiry_;	// smallest expiry of every 32 boxes, the only array scanned every cull
+	std::vector<double> expiry_;		// none of the tests of a box can change before the drift reaches this
+	std::vector<uint32_t> visible_;		// last result of every box, one bit each
+	std::vector<entry> entries_;		// read only for the boxes that get tested again
+	double drift_ = 0.0;			// summed largest movement of a plane or corner of the frustum over all culls
+	double last_drift_ = 0.0;		// movement in the last cull, sets the width of the plane mask
+	bool has_view_ = false;
+	glm::vec4 planes_[6];
+	glm::vec3 corner_min_{ 0.0f }, corner_max_{ 0.0f };
+	float plane_epsilon_[6] = {};	// rounding error of a dot product with every plane inside of the bounds
+	uint32_t retested_ = 0;
+
+	/// @brief updates drift_ from the movement of the frustum since the last cull
+	void update_drift(const glm::vec4* planes, const glm::vec4* corners, const bounding_box& bounds);
+
+	/// @brief test 0-5 is a plane, 6-11 an axis of the bounds of the frustum corners
+	test_result run_test(uint32_t test, const bounding_box& b) const;
+
+	/// @brief runs all tests, the result of test t is bit t and its slack slack[t]
+	uint32_t run_all(const bounding_box& b, double* slack) const;
+
+	/// @brief runs all tests of a box and remembers its result
+	uint32_t test_all(size_t index, const bounding_box& b);
+
+	/// @brief remembers that a test rejected a box
+	void reject(size_t index, uint32_t test, double slack);
+
+	/// @brief tests a box whose expiry was reached, with as few tests as its last result allows
+	uint32_t retest(size_t index, const bounding_box& b);
+};
@@ -1,8 +1,13 @@
 #include "buffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
 
 buffer::buffer(const GLenum type) : type_(type)
 {
-	glCreateBuffers(1, &buffer_id_);
+	if (glCreateBuffers) // headless tools create levels without a GL context
+		glCreateBuffers(1, &buffer_id_);
 }
 
 void buffer::reserve_memory(const GLuint binding, const GLsizeiptr size, const void* data) const
@@ -26,5 +31,126 @@ void buffer::reserve_memory(const GLsizeiptr size, const void* data) const
 
 void buffer::update(const GLsizeiptr size, const void* data) const
 {
-	glNamedBufferSubData(buffer_id_, 0, size, data);
+	update(0, size, data);
+}
+
+void buffer::update(const GLintptr offset, const GLsizeiptr size, const void* data) const
+{
+	glNamedBufferSubData(buffer_id_, offset, size, data);
+	bytes_uploaded += static_cast<uint64_t>(size);
+}
+
+namespace
+{
+	/// @brief offset alignment of ranges of ring buffers, the largest one of uniform and storage buffers
+	GLsizeiptr ring_alignment()
+	{
+		static const GLsizeiptr alignment = []()
+		{
+			GLint uniform = 256, storage = 256;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform);
+			glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage);
+			return static_cast<GLsizeiptr>(std::max(std::max(uniform, storage), 4));
+		}();
+		return alignment;
+	}
+
+	GLsizeiptr align_up(const GLsizeiptr value, const GLsizeiptr alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+uint64_t buffer::bytes_uploaded = 0;
+uint64_t buffer::bytes_uploaded_last_frame = 0;
+uint32_t buffer::fence_waits = 0;
+uint32_t buffer::dropped_pushes = 0;
+GLsync buffer::fences_[ring_frames] = {};
+uint64_t buffer::frame_ = 0;
+
+void buffer::reserve_ring(const GLsizeiptr region_size, const int pushes)
+{
+	if (mapped_)
+	{
+		// immutable storage can't grow, the old one is dropped once the GPU stopped reading it
+		glFinish();
+		release();
+		glCreateBuffers(1, &buffer_id_);
+	}
+
+	region_size_ = align_up(std::max<GLsizeiptr>(region_size, 1), ring_alignment()) + (pushes - 1) * ring_alignment();
+	const GLsizeiptr size = region_size_ * ring_frames;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glNamedBufferStorage(buffer_id_, size, nullptr, flags);
+	mapped_ = static_cast<uint8_t*>(glMapNamedBufferRange(buffer_id_, 0, size, flags));
+	cursor_ = 0;
+	cursor_frame_ = frame_;
+}
+
+GLintptr buffer::push(const GLsizeiptr size, const void* data)
+{
+	assert(mapped_ != nullptr);
+	if (cursor_frame_ != frame_)
+	{
+		cursor_ = 0;
+		cursor_frame_ = frame_;
+	}
+
+	// every push starts aligned, so it can be bound as a range of its own
+	GLsizeiptr start = align_up(cursor_, ring_alignment());
+	if (start + size > region_size_)
+	{
+		if (start != 0)
+		{
+			if (dropped_pushes++ == 0)
+				std::cout << "WARNING: push of " << size << " bytes doesn't fit the " << region_size_ - start << " bytes left in the ring buffer region, dropped" << std::endl;
+			return no_offset;
+		}
+		// room for a second push of the same size, like the shadow and the main pass push
+		std::cout << "ring buffer region of " << region_size_ << " bytes grows for a push of " << size << " bytes" << std::endl;
+		reserve_ring(size * 2, 2);
+		start = 0;
+	}
+	const GLintptr offset = static_cast<GLintptr>(frame_ % ring_frames) * region_size_ + start;
+	if (size > 0)
+		memcpy(mapped_ + offset, data, static_cast<size_t>(size));
+	cursor_ = start + size;
+	bytes_uploaded += static_cast<uint64_t>(size);
+	return offset;
+}
+
+void buffer::bind_range(const GLuint binding, const GLintptr offset, const GLsizeiptr size) const
+{
+	if (size > 0 && offset != no_offset)
+		glBindBufferRange(type_, binding, buffer_id_, offset, size);
+}
+
+void buffer::begin_frame()
+{
+	frame_++;
+	bytes_uploaded_last_frame = bytes_uploaded;
+	bytes_uploaded = 0;
+
+	// the region was written ring_frames frames ago, usually the GPU is long done with it
+	GLsync& fence = fences_[frame_ % ring_frames];
+	if (!fence)
+		return;
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		fence_waits++;
+		do
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		while (result == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void buffer::end_frame()
+{
+	GLsync& fence = fences_[frame_ % ring_frames];
+	if (fence)
+		glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
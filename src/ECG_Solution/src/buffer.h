@@ -6,15 +6,40 @@
 
 class buffer
 {
+    public:
+        /// @brief frames the CPU may run ahead of the GPU, a ring buffer has one region for each of them
+        static constexpr int ring_frames = 3;
+
+        static uint64_t bytes_uploaded;             // by update and push in the current frame
+        static uint64_t bytes_uploaded_last_frame;
+        static uint32_t fence_waits;                // times begin_frame had to wait for the GPU
+        static uint32_t dropped_pushes;             // pushes that didn't fit the region of their frame
+
+        /// @brief returned by push if the data got dropped, bind_range ignores it
+        static constexpr GLintptr no_offset = -1;
+
     private:
 
         // reference ID
         GLuint buffer_id_ = 0;
 		GLenum type_;
 
+        // persistently mapped ring, see reserve_ring
+        uint8_t* mapped_ = nullptr;
+        GLsizeiptr region_size_ = 0;
+        GLsizeiptr cursor_ = 0;         // bytes written into the region of cursor_frame_
+        uint64_t cursor_frame_ = 0;
+
+        static GLsync fences_[ring_frames];
+        static uint64_t frame_;
+
         void release()
         {
-            glDeleteBuffers(1, &buffer_id_);
+            if (mapped_)
+                glUnmapNamedBuffer(buffer_id_);
+            mapped_ = nullptr;
+            if (buffer_id_)
+                glDeleteBuffers(1, &buffer_id_);
 			buffer_id_ = 0;
         }
 
@@ -41,6 +66,60 @@ class buffer
          */
         void update(const GLsizeiptr size, const void* data) const;
 
+        /**
+         * \brief uploads new data to a part of the buffer
+         * \param offset of the data in the buffer in bytes
+         * \param size of the data in bytes
+         * \param data to be uploaded
+         */
+        void update(GLintptr offset, GLsizeiptr size, const void* data) const;
+
+        /**
+         * \brief makes this a persistently mapped and coherent ring buffer of ring_frames regions, written with push instead of update
+         * the CPU writes the region of the current frame while the GPU still reads the ones of the last frames,
+         * begin_frame waits on the fence of a region before it gets written again. calling it again recreates the ring
+         * with the new size after waiting for the GPU, which also drops the ranges pushed before in this frame
+         * \param region_size in bytes of all pushes of one frame
+         * \param pushes per frame, each one may need padding to start aligned
+         */
+        void reserve_ring(GLsizeiptr region_size, int pushes = 1);
+
+        /**
+         * \brief copies data into the region of the current frame, behind everything pushed before in this frame,
+         * so passes that push in turn (shadow and main view) get disjoint ranges of the same ring.
+         * data that doesn't fit grows the ring to twice its size if it is the first push of the frame, later pushes of the frame
+         * are already bound to the old storage, then the data is dropped instead and counted in dropped_pushes
+         * \param size of the data in bytes
+         * \param data to be copied
+         * \return offset of the data in the buffer, for bind_range or as the indirect offset of a draw, no_offset if it got dropped
+         */
+        GLintptr push(GLsizeiptr size, const void* data);
+
+        /// @brief bytes one frame can push into the ring
+        GLsizeiptr get_region_size() const { return region_size_; }
+
+        /**
+         * \brief binds a range of the buffer to an indexed binding of its type, nothing for an empty or dropped range
+         * \param binding of the buffer in the shaders
+         * \param offset returned by push
+         * \param size of the range in bytes
+         */
+        void bind_range(GLuint binding, GLintptr offset, GLsizeiptr size) const;
+
+        /**
+         * \brief starts the next frame of all ring buffers, waits until the GPU is done with the regions it reuses
+         * call once per frame before the first push
+         */
+        static void begin_frame();
+
+        /**
+         * \brief fences the commands that read the regions of the current frame, call after its last draw
+         */
+        static void end_frame();
+
+        /// @brief number of the current frame of the ring buffers
+        static uint64_t get_frame() { return frame_; }
+
         /**
          * \brief creates a buffer id
          * \param type of the buffer (eg. uniform)
@@ -54,9 +133,11 @@ class buffer
 		buffer(const buffer&) = delete;
 		buffer& operator=(const buffer&) = delete;
 
-		buffer(buffer&& other) noexcept : buffer_id_(other.buffer_id_)
+		buffer(buffer&& other) noexcept : buffer_id_(other.buffer_id_), type_(other.type_), mapped_(other.mapped_),
+			region_size_(other.region_size_), cursor_(other.cursor_), cursor_frame_(other.cursor_frame_)
 		{
 			other.buffer_id_ = 0; //Use the "null" ID for the old object.
+			other.mapped_ = nullptr;
 		}
 
 		buffer& operator=(buffer&& other)
@@ -67,7 +148,13 @@ class buffer
 				release();
 				//obj_ is now 0.
 				std::swap(buffer_id_, other.buffer_id_);
+				std::swap(type_, other.type_);
+				std::swap(mapped_, other.mapped_);
+				std::swap(region_size_, other.region_size_);
+				std::swap(cursor_, other.cursor_);
+				std::swap(cursor_frame_, other.cursor_frame_);
 			}
+			return *this;
 		}
 		
 		GLuint get_id() const {return buffer_id_;}
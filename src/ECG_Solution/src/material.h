@@ -52,6 +52,14 @@ struct PACKED_STRUCT material final
 
 /// @brief explicitly deletes every texture in this material
 	static void clear(material& mat);
+
+/// @brief converts a material texture path to the folder containing all textures of the material
+/// @param tex_path should be of the form "textures/(Material_1)/albedo.jpg"
+/// @return folder of the form "../assets/textures/(Material_1)"
+	static std::string get_folder(const char* tex_path);
+
+/// @brief sets one of the 7 textures, in the order albedo, normal, metal, rough, ao, emissive, height
+	static void set_texture(material& mat, size_t slot, GLuint handle, uint64_t bindless);
 };
 
 static_assert(sizeof(material) % 16 == 0, "material should be padded to 16 bytes");
@@ -22,8 +22,36 @@ layout(std430, binding = 4) restrict readonly buffer Matrices
 	mat4 modelMatrix[];
 };
 
+// restores packed vertices, float vertices have identity parameters
+struct VertexDequant
+{
+	vec4 positionMin; // w = 1 if the normal is octahedral encoded
+	vec4 positionExtent;
+	vec4 uv; // xy = min, zw = extent
+};
+
+layout(std430, binding = 6) restrict readonly buffer Dequant
+{
+	VertexDequant dequant[];
+};
+
+// the models of every instanced command, gl_BaseInstance is the first of them
+struct DrawInstance
+{
+	uint model;
+	uint material;
+};
+
+layout(std430, binding = 7) restrict readonly buffer Instances
+{
+	DrawInstance instances[];
+};
+
 void main()
 {
-	mat4 model = modelMatrix[gl_BaseInstance >> 16];
-	gl_Position = lightViewProj * model * vec4(vPosition, 1.0);
+	DrawInstance instance = instances[gl_BaseInstance + gl_InstanceID];
+	mat4 model = modelMatrix[instance.model];
+	VertexDequant dq = dequant[instance.model];
+	vec3 position = dq.positionMin.xyz + vPosition * dq.positionExtent.xyz;
+	gl_Position = lightViewProj * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -350,7 +350,9 @@ mat3 cotangentFrame( vec3 N, vec3 p, vec2 uv )
 
 vec3 perturbNormal(vec3 n, vec3 v, vec3 normalSample, vec2 uv)
 {
-	vec3 map = normalize( 2.0 * normalSample - vec3(1.0) );
+	// z is rebuilt from x and y, BC5 normal maps only store those two
+	vec2 xy = 2.0 * normalSample.xy - vec2(1.0);
+	vec3 map = normalize( vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0))) );
 	mat3 TBN = cotangentFrame(n, v, uv);
 	return normalize(TBN * map);
 }
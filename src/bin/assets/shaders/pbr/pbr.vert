@@ -26,6 +26,31 @@ layout(std430, binding = 4) restrict readonly buffer Matrices
 	mat4 modelMatrix[];
 };
 
+// restores packed vertices, float vertices have identity parameters
+struct VertexDequant
+{
+	vec4 positionMin; // w = 1 if the normal is octahedral encoded
+	vec4 positionExtent;
+	vec4 uv; // xy = min, zw = extent
+};
+
+layout(std430, binding = 6) restrict readonly buffer Dequant
+{
+	VertexDequant dequant[];
+};
+
+// the models of every instanced command, gl_BaseInstance is the first of them
+struct DrawInstance
+{
+	uint model;
+	uint material;
+};
+
+layout(std430, binding = 7) restrict readonly buffer Instances
+{
+	DrawInstance instances[];
+};
+
 out vec3 fNormal;
 out vec3 fPosition;
 out vec2 fUV;
@@ -38,6 +63,15 @@ const mat4 scaleBias = mat4(
 0.0, 0.0, 0.5, 0.0,
 0.5, 0.5, 0.5, 1.0);
 
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 // vertex wave animation
 float x_freq = 0.1;
 float x_velo = 2.0;
@@ -48,11 +82,13 @@ float z_amp = 0.07;
 
 void main()
 {
-	mat4 model = modelMatrix[gl_BaseInstance >> 16];
-	mat_id = gl_BaseInstance & 0xffff;
+	DrawInstance instance = instances[gl_BaseInstance + gl_InstanceID];
+	mat4 model = modelMatrix[instance.model];
+	VertexDequant dq = dequant[instance.model];
+	mat_id = instance.material;
 	
-	vec3 position = vPosition;
-	vec3 normal = vNormal;
+	vec3 position = dq.positionMin.xyz + vPosition * dq.positionExtent.xyz;
+	vec3 normal = dq.positionMin.w > 0.5 ? decodeOctahedral(vNormal.xy) : vNormal;
 	if(mat_id == normalMap.y)
 	{
 		float u = x_freq * position.x -x_velo * deltaTime.y;
@@ -66,7 +102,7 @@ void main()
 	}
 	
 	gl_Position = ViewProj * model * vec4(position, 1.0);
-	fUV = vUV;
+	fUV = dq.uv.xy + vUV * dq.uv.zw;
 	fPosition = vec3(model * vec4(position, 1.0));
 	fNormal = mat3(transpose(inverse(model))) * normal;
 	